@@ -18,31 +18,77 @@
 #define CALCQ_H_
 
 #include <Eigen/Eigen>
-#include <msf_core/msf_core.h>
+#include <msf_core/msf_tmp.h>
+
+/**
+ * \brief The terms of Qd which only depend on the noise parameters, computed
+ * once per parameter change instead of on every propagation step.
+ */
+struct CoreProcessNoise {
+  Eigen::Matrix<double, 3, 1> n_a;  ///< Acceleration noise density.
+  Eigen::Matrix<double, 3, 1> n_ba;  ///< Acceleration bias noise density.
+  Eigen::Matrix<double, 3, 1> n_w;  ///< Angular velocity noise density.
+  Eigen::Matrix<double, 3, 1> n_bw;  ///< Angular velocity bias noise density.
+  Eigen::Matrix<double, 3, 1> n_a2;  ///< Squares of n_a.
+  Eigen::Matrix<double, 3, 1> n_ba2;  ///< Squares of n_ba.
+  Eigen::Matrix<double, 3, 1> n_w2;  ///< Squares of n_w.
+  Eigen::Matrix<double, 3, 1> n_bw2;  ///< Squares of n_bw.
+
+  CoreProcessNoise() {
+    n_a.setZero();
+    n_ba.setZero();
+    n_w.setZero();
+    n_bw.setZero();
+    n_a2.setZero();
+    n_ba2.setZero();
+    n_w2.setZero();
+    n_bw2.setZero();
+  }
+
+  /**
+   * \brief Sets the noise densities and updates the derived terms, if they
+   * changed.
+   * \returns True if the noise densities changed.
+   */
+  template<class Derived>
+  bool Set(const Eigen::MatrixBase<Derived>& n_a_new,
+           const Eigen::MatrixBase<Derived>& n_ba_new,
+           const Eigen::MatrixBase<Derived>& n_w_new,
+           const Eigen::MatrixBase<Derived>& n_bw_new) {
+    if (n_a == n_a_new && n_ba == n_ba_new && n_w == n_w_new
+        && n_bw == n_bw_new) {
+      return false;
+    }
+    n_a = n_a_new;
+    n_ba = n_ba_new;
+    n_w = n_w_new;
+    n_bw = n_bw_new;
+    n_a2 = n_a.cwiseProduct(n_a);
+    n_ba2 = n_ba.cwiseProduct(n_ba);
+    n_w2 = n_w.cwiseProduct(n_w);
+    n_bw2 = n_bw.cwiseProduct(n_bw);
+    return true;
+  }
+};
 
 /**
  * \brief Calculate the observation covariance matrix for the core states.
  * The user has the possibility to set the blocks of Q for user defined states.
  * The EKF core calls the respective user defined function.
+ * The expression is a polynomial of third order in dt.
+ * \param noise The noise terms, see CoreProcessNoise.
  */
 template<typename StateSequence_T, typename StateDefinition_T, class Derived,
     class DerivedQ>
-void CalcQCore(const double dt, const Eigen::Quaternion<double> & q,
-                const Eigen::MatrixBase<Derived> & ew,
-                const Eigen::MatrixBase<Derived> & ea,
-                const Eigen::MatrixBase<Derived> & n_a,
-                const Eigen::MatrixBase<Derived> & n_ba,
-                const Eigen::MatrixBase<Derived> & n_w,
-                const Eigen::MatrixBase<Derived> & n_bw,
-                Eigen::MatrixBase<DerivedQ> & Qd) {
+void CalcQCoreThirdOrder(const double dt, const Eigen::Quaternion<double> & q,
+                         const Eigen::MatrixBase<Derived> & ew,
+                         const Eigen::MatrixBase<Derived> & ea,
+                         const CoreProcessNoise & noise,
+                         Eigen::MatrixBase<DerivedQ> & Qd) {
 
   const double q1 = q.w(), q2 = q.x(), q3 = q.y(), q4 = q.z();
   const double ew1 = ew(0), ew2 = ew(1), ew3 = ew(2);
   const double ea1 = ea(0), ea2 = ea(1), ea3 = ea(2);
-  const double n_a1 = n_a(0), n_a2 = n_a(1), n_a3 = n_a(2);
-  const double n_ba1 = n_ba(0), n_ba2 = n_ba(1), n_ba3 = n_ba(2);
-  const double n_w1 = n_w(0), n_w2 = n_w(1), n_w3 = n_w(2);
-  const double n_bw1 = n_bw(0), n_bw2 = n_bw(1), n_bw3 = n_bw(2);
 
   const double t343 = dt * dt;
   const double t348 = q1 * q4 * 2.0;
@@ -56,9 +102,9 @@ void CalcQCore(const double dt, const Eigen::Quaternion<double> & q,
   const double t352 = q3 * q3;
   const double t353 = q4 * q4;
   const double t346 = t350 + t351 - t352 - t353;
-  const double t347 = n_a1 * n_a1;
-  const double t354 = n_a2 * n_a2;
-  const double t355 = n_a3 * n_a3;
+  const double t347 = noise.n_a2(0);
+  const double t354 = noise.n_a2(1);
+  const double t355 = noise.n_a2(2);
   const double t358 = q1 * q2 * 2.0;
   const double t359 = t344 * t344;
   const double t360 = t345 * t345;
@@ -72,10 +118,10 @@ void CalcQCore(const double dt, const Eigen::Quaternion<double> & q,
   const double t368 = q3 * q4 * 2.0;
   const double t369 = t356 - t357;
   const double t370 = t350 - t351 - t352 + t353;
-  const double t371 = n_w3 * n_w3;
+  const double t371 = noise.n_w2(2);
   const double t372 = t358 + t368;
-  const double t373 = n_w2 * n_w2;
-  const double t374 = n_w1 * n_w1;
+  const double t373 = noise.n_w2(1);
+  const double t374 = noise.n_w2(0);
   const double t375 = dt * t343 * t346 * t347 * t366 * (1.0 / 3.0);
   const double t376 = t358 - t368;
   const double t377 = t343 * t346 * t347 * t366 * (1.0 / 2.0);
@@ -100,9 +146,9 @@ void CalcQCore(const double dt, const Eigen::Quaternion<double> & q,
   const double t395 = ea1 * t370;
   const double t396 = ea3 * t369;
   const double t397 = t395 + t396;
-  const double t398 = n_ba1 * n_ba1;
-  const double t399 = n_ba2 * n_ba2;
-  const double t400 = n_ba3 * n_ba3;
+  const double t398 = noise.n_ba2(0);
+  const double t399 = noise.n_ba2(1);
+  const double t400 = noise.n_ba2(2);
   const double t401 = dt * t343 * t345 * t355 * t370 * (1.0 / 3.0);
   const double t402 = t401 - dt * t343 * t346 * t347 * t369 * (1.0 / 3.0)
       - dt * t343 * t344 * t354 * t372 * (1.0 / 3.0);
@@ -212,8 +258,8 @@ void CalcQCore(const double dt, const Eigen::Quaternion<double> & q,
   const double t499 = ew1 * t343 * t381 * (1.0 / 2.0);
   const double t500 = t384 * t432 * (1.0 / 2.0);
   const double t501 = ew2 * ew3 * t388 * (1.0 / 2.0);
-  const double t502 = n_bw1 * n_bw1;
-  const double t503 = n_bw3 * n_bw3;
+  const double t502 = noise.n_bw2(0);
+  const double t503 = noise.n_bw2(2);
   const double t504 = t343 * t347 * t413 * (1.0 / 2.0);
   const double t505 = t343 * t354 * t414 * (1.0 / 2.0);
   const double t506 = t397 * t397;
@@ -275,7 +321,7 @@ void CalcQCore(const double dt, const Eigen::Quaternion<double> & q,
       - dt * t343 * t370 * t376 * t400 * (1.0 / 3.0);
   const double t561 = ew1 * t343 * t394 * t397;
   const double t562 = ew1 * t343 * t397 * (1.0 / 2.0);
-  const double t563 = n_bw2 * n_bw2;
+  const double t563 = noise.n_bw2(1);
   const double t564 = dt * t343 * t362 * t374 * (1.0 / 6.0);
   const double t565 = dt * t343 * t374 * t390 * (1.0 / 6.0);
   const double t566 = ew1 * ew2 * t362 * (1.0 / 2.0);
@@ -719,4 +765,484 @@ void CalcQCore(const double dt, const Eigen::Quaternion<double> & q,
   Qd(idxstartcorr_b_a + 2, idxstartcorr_b_a + 2) = dt * t400;
 
 }
+
+/**
+ * \brief Calculate the observation covariance matrix for the core states
+ * without the O(dt^3) terms of CalcQCoreThirdOrder, expanded from its
+ * expression. Takes about a third of the time. For a dt of a few milliseconds
+ * the dropped terms are below 1e-5 of Qd.
+ * \param noise The noise terms, see CoreProcessNoise.
+ */
+template<typename StateSequence_T, typename StateDefinition_T, class Derived,
+    class DerivedQ>
+void CalcQCoreSecondOrder(const double dt, const Eigen::Quaternion<double> & q,
+                          const Eigen::MatrixBase<Derived> & ew,
+                          const Eigen::MatrixBase<Derived> & ea,
+                          const CoreProcessNoise & noise,
+                          Eigen::MatrixBase<DerivedQ> & Qd) {
+
+  const double dt2 = dt * dt;
+  const double q1 = q.w(), q2 = q.x(), q3 = q.y(), q4 = q.z();
+  const double ew1 = ew(0), ew2 = ew(1), ew3 = ew(2);
+  const double ea1 = ea(0), ea2 = ea(1), ea3 = ea(2);
+  const double t348 = q1 * q4 * 2.0;
+  const double t349 = q2 * q3 * 2.0;
+  const double t344 = t348 - t349;
+  const double t356 = q1 * q3 * 2.0;
+  const double t357 = q2 * q4 * 2.0;
+  const double t345 = t356 + t357;
+  const double t350 = q1 * q1;
+  const double t351 = q2 * q2;
+  const double t352 = q3 * q3;
+  const double t353 = q4 * q4;
+  const double t346 = t350 + t351 - t352 - t353;
+  const double t358 = q1 * q2 * 2.0;
+  const double t359 = t344 * t344;
+  const double t360 = t345 * t345;
+  const double t361 = t346 * t346;
+  const double t363 = ea2 * t345;
+  const double t364 = ea3 * t344;
+  const double t362 = t363 + t364;
+  const double t365 = t362 * t362;
+  const double t366 = t348 + t349;
+  const double t367 = t350 - t351 + t352 - t353;
+  const double t368 = q3 * q4 * 2.0;
+  const double t369 = t356 - t357;
+  const double t370 = t350 - t351 - t352 + t353;
+  const double t372 = t358 + t368;
+  const double t376 = t358 - t368;
+  const double t377_2 = t346 * noise.n_a2(0) * t366 * (1.0 / 2.0);
+  const double t378 = t366 * t366;
+  const double t379 = t376 * t376;
+  const double t380 = ea1 * t367;
+  const double t391 = ea2 * t366;
+  const double t381 = t380 - t391;
+  const double t382 = ea3 * t367;
+  const double t383 = ea2 * t376;
+  const double t384 = t382 + t383;
+  const double t385 = t367 * t367;
+  const double t386 = ea1 * t376;
+  const double t387 = ea3 * t366;
+  const double t388 = t386 + t387;
+  const double t389 = ea2 * t370;
+  const double t407 = ea3 * t372;
+  const double t390 = t389 - t407;
+  const double t392 = ea1 * t372;
+  const double t393 = ea2 * t369;
+  const double t394 = t392 + t393;
+  const double t395 = ea1 * t370;
+  const double t396 = ea3 * t369;
+  const double t397 = t395 + t396;
+  const double t405_2 = t345 * noise.n_a2(2) * t370 * (1.0 / 2.0);
+  const double t421_2 = t346 * noise.n_a2(0) * t369 * (1.0 / 2.0);
+  const double t423_2 = t344 * noise.n_a2(1) * t372 * (1.0 / 2.0);
+  const double t408_2 = t405_2 - t421_2 - t423_2;
+  const double t409_2 = noise.n_a2(1) * t367 * t372 * (1.0 / 2.0);
+  const double t463_2 = noise.n_a2(2) * t370 * t376 * (1.0 / 2.0);
+  const double t464_2 = noise.n_a2(0) * t366 * t369 * (1.0 / 2.0);
+  const double t412_2 = t409_2 - t463_2 - t464_2;
+  const double t413 = t369 * t369;
+  const double t414 = t372 * t372;
+  const double t415 = t370 * t370;
+  const double t416_2 = noise.n_a2(1) * t359 * (1.0 / 2.0);
+  const double t417_2 = noise.n_a2(2) * t360 * (1.0 / 2.0);
+  const double t418_2 = noise.n_a2(0) * t361 * (1.0 / 2.0);
+  const double t419_2 = t416_2 + t417_2 + t418_2;
+  const double t453_2 = t344 * noise.n_a2(1) * t367 * (1.0 / 2.0);
+  const double t454_2 = t345 * noise.n_a2(2) * t376 * (1.0 / 2.0);
+  const double t420_2 = t377_2 - t453_2 - t454_2;
+  const double t426 = ew2 * t362;
+  const double t427 = ew3 * t362;
+  const double t425 = t426 - t427;
+  const double t434_2 = ew1 * t365;
+  const double t438 = ew1 * t362 * t394;
+  const double t511 = ew1 * t362 * t397;
+  const double t439 = t438 - t511;
+  const double t440_2 = t439 * (1.0 / 2.0);
+  const double t445 = ew2 * t394;
+  const double t446 = ew3 * t397;
+  const double t447 = t445 + t446;
+  const double t452_2 = ew1 * t362 * (1.0 / 2.0);
+  const double t456_2 = noise.n_a2(0) * t378 * (1.0 / 2.0);
+  const double t457_2 = noise.n_a2(2) * t379 * (1.0 / 2.0);
+  const double t458 = t381 * t381;
+  const double t459 = t384 * t384;
+  const double t460_2 = noise.n_a2(1) * t385 * (1.0 / 2.0);
+  const double t461 = t388 * t388;
+  const double t462_2 = t456_2 + t457_2 + t460_2;
+  const double t467 = ew1 * t362 * t388;
+  const double t468 = ew1 * t362 * t381;
+  const double t469 = t467 + t468;
+  const double t470_2 = t469 * (1.0 / 2.0);
+  const double t472 = ew2 * t381;
+  const double t479 = ew3 * t388;
+  const double t473 = t472 - t479;
+  const double t476_1 = t346 * noise.n_a2(0) * t366;
+  const double t493 = ew1 * t381 * t397;
+  const double t541 = ew1 * t388 * t394;
+  const double t494 = t493 - t541;
+  const double t495_2 = t494 * (1.0 / 2.0);
+  const double t499_2 = ew1 * t381 * (1.0 / 2.0);
+  const double t504_2 = noise.n_a2(0) * t413 * (1.0 / 2.0);
+  const double t505_2 = noise.n_a2(1) * t414 * (1.0 / 2.0);
+  const double t506 = t397 * t397;
+  const double t507 = t390 * t390;
+  const double t508_2 = noise.n_a2(2) * t415 * (1.0 / 2.0);
+  const double t509 = t394 * t394;
+  const double t510_2 = t504_2 + t505_2 + t508_2;
+  const double t515_1 = t362 * t397;
+  const double t520_1 = t362 * t394;
+  const double t522_1 = noise.n_w2(2) * t520_1;
+  const double t522_2 = noise.n_w2(2) * t440_2;
+  const double t523 = t362 * t447;
+  const double t524 = t390 * t425;
+  const double t525 = t523 + t524;
+  const double t526_2 = t525 * (1.0 / 2.0);
+  const double t532_1 = t362 * t390;
+  const double t534_1 = noise.n_w2(0) * t532_1;
+  const double t534_2 = noise.n_w2(0) * t526_2;
+  const double t536_1 = t345 * noise.n_a2(2) * t370;
+  const double t542_1 = -t381 * t394;
+  const double t547_1 = -t388 * t397;
+  const double t548_1 = noise.n_w2(1) * t547_1;
+  const double t548_2 = noise.n_w2(1) * t495_2;
+  const double t549 = t384 * t447;
+  const double t550 = t549 - t390 * t473;
+  const double t551_2 = t550 * (1.0 / 2.0);
+  const double t556_1 = t384 * t390;
+  const double t559_1 = noise.n_a2(1) * t367 * t372;
+  const double t560_1 = t548_1
+      + t559_1 - noise.n_w2(2) * t542_1 - noise.n_w2(0) * t556_1
+      - noise.n_a2(0) * t366 * t369 - noise.n_a2(2) * t370 * t376;
+  const double t560_2 = t548_2 - noise.n_w2(2) * t495_2
+      - noise.n_w2(0) * t551_2;
+  const double t561_2 = ew1 * t394 * t397;
+  const double t562_2 = ew1 * t397 * (1.0 / 2.0);
+  const double t569_2 = t425 * (1.0 / 2.0);
+  const double t573_1 = -noise.n_w2(0) * t362;
+  const double t573_2 = -noise.n_w2(0) * t569_2;
+  const double t576_2 = t447 * (1.0 / 2.0);
+  const double t580_1 = -noise.n_w2(0) * t390;
+  const double t580_2 = -noise.n_w2(0) * t576_2;
+  const double t590_2 = -noise.n_w2(0) * ew3 * t384 * (1.0 / 2.0);
+  const double t599_1 = -noise.n_w2(1) * t388;
+  const double t599_2 = t590_2 - noise.n_w2(2) * t499_2
+      + noise.n_w2(1) * t499_2;
+  const double t602_2 = ew1 * t394 * (1.0 / 2.0);
+  const double t606_2 = ew3 * t390 * (1.0 / 2.0);
+  const double t608_2 = noise.n_w2(0) * t606_2;
+  const double t614_2 = ew1 * (1.0 / 2.0);
+  const double t621_2 = ew2 * t362 * (1.0 / 2.0);
+  const double t627_2 = ew1 * t388 * (1.0 / 2.0);
+  const double t631_2 = -ew2 * t384 * (1.0 / 2.0);
+  const double t640_2 = ew2 * t390 * (1.0 / 2.0);
+  const double t647_1 = -noise.n_w2(2) * t394;
+  const double t647_2 = noise.n_w2(2) * t562_2;
+  const double t648_2 = ew2 * (1.0 / 2.0);
+  const double t651_2 = noise.n_w2(0) * t648_2;
+  const double t655_2 = noise.n_w2(2) * t614_2;
+  const double t659_2 = t369 * noise.n_ba2(0) * (1.0 / 2.0);
+  const double t661_2 = t344 * noise.n_ba2(1) * (1.0 / 2.0);
+  const double t663_2 = t376 * noise.n_ba2(2) * (1.0 / 2.0);
+
+  enum {
+    idxstartcorr_p = msf_tmp::GetStartIndexInCorrection<StateSequence_T,
+        StateDefinition_T::p>::value,
+    idxstartcorr_v = msf_tmp::GetStartIndexInCorrection<StateSequence_T,
+        StateDefinition_T::v>::value,
+    idxstartcorr_q = msf_tmp::GetStartIndexInCorrection<StateSequence_T,
+        StateDefinition_T::q>::value,
+    idxstartcorr_b_w = msf_tmp::GetStartIndexInCorrection<StateSequence_T,
+        StateDefinition_T::b_w>::value,
+    idxstartcorr_b_a = msf_tmp::GetStartIndexInCorrection<StateSequence_T,
+        StateDefinition_T::b_a>::value
+  };
+
+  Qd(idxstartcorr_p + 0, idxstartcorr_v + 0) = dt2 * t419_2;
+  Qd(idxstartcorr_p + 0, idxstartcorr_v + 1) = dt2 * t420_2;
+  Qd(idxstartcorr_p + 0, idxstartcorr_v + 2) = dt2 * t408_2;
+  Qd(idxstartcorr_p + 1, idxstartcorr_v + 0) = dt2 * (t377_2
+      - t344 * noise.n_a2(1) * t367 * (1.0 / 2.0)
+      - t345 * noise.n_a2(2) * t376 * (1.0 / 2.0));
+  Qd(idxstartcorr_p + 1, idxstartcorr_v + 1) = dt2 * t462_2;
+  Qd(idxstartcorr_p + 1, idxstartcorr_v + 2) = dt2 * t412_2;
+  Qd(idxstartcorr_p + 2, idxstartcorr_v + 0) = dt2 * t408_2;
+  Qd(idxstartcorr_p + 2, idxstartcorr_v + 1) = dt2 * t412_2;
+  Qd(idxstartcorr_p + 2, idxstartcorr_v + 2) = dt2 * t510_2;
+  Qd(idxstartcorr_v + 0, idxstartcorr_p + 0) = dt2 * t419_2;
+  Qd(idxstartcorr_v + 0, idxstartcorr_p + 1) = dt2 * t420_2;
+  Qd(idxstartcorr_v + 0, idxstartcorr_p + 2) = dt2 * t408_2;
+  Qd(idxstartcorr_v + 0, idxstartcorr_v + 0) = dt * (noise.n_w2(0) * t365
+      + noise.n_w2(1) * t365 + noise.n_w2(2) * t365 + noise.n_a2(0) * t361
+      + noise.n_a2(1) * t359 + noise.n_a2(2) * t360)
+      + dt2 * (noise.n_w2(0) * t362 * t425 - noise.n_w2(1) * t434_2
+      + noise.n_w2(2) * t434_2);
+  Qd(idxstartcorr_v + 0, idxstartcorr_v + 1) = dt * (t476_1
+      - t344 * noise.n_a2(1) * t367 - t345 * noise.n_a2(2) * t376);
+  Qd(idxstartcorr_v + 0, idxstartcorr_v + 2) = dt * (t522_1 + t534_1
+      + t536_1 - noise.n_w2(1) * t515_1 - t346 * noise.n_a2(0) * t369
+      - t344 * noise.n_a2(1) * t372) + dt2 * (t522_2
+      + t534_2 - noise.n_w2(1) * t440_2);
+  Qd(idxstartcorr_v + 0, idxstartcorr_q + 0) = dt * t573_1 + dt2 * t573_2;
+  Qd(idxstartcorr_v + 0, idxstartcorr_q + 2) = -dt * noise.n_w2(2) * t362
+      + dt2 * (-noise.n_w2(2) * t452_2 - noise.n_w2(0) * t621_2
+      + noise.n_w2(1) * t452_2);
+  Qd(idxstartcorr_v + 0, idxstartcorr_b_a + 0) = -dt2 * t346 * noise.n_ba2(0)
+      * (1.0 / 2.0);
+  Qd(idxstartcorr_v + 0, idxstartcorr_b_a + 1) = dt2 * t661_2;
+  Qd(idxstartcorr_v + 0, idxstartcorr_b_a + 2) = -dt2 * t345 * noise.n_ba2(2)
+      * (1.0 / 2.0);
+  Qd(idxstartcorr_v + 1, idxstartcorr_p + 0) = dt2 * (t377_2 - t453_2 - t454_2);
+  Qd(idxstartcorr_v + 1, idxstartcorr_p + 1) = dt2 * t462_2;
+  Qd(idxstartcorr_v + 1, idxstartcorr_p + 2) = dt2 * t412_2;
+  Qd(idxstartcorr_v + 1, idxstartcorr_v + 0) = dt * (t476_1
+      - noise.n_w2(0) * t362 * t384 + noise.n_w2(2) * t362 * t381
+      + noise.n_w2(1) * t362 * t388 - t344 * noise.n_a2(1) * t367
+      - t345 * noise.n_a2(2) * t376)
+      + dt2 * (-noise.n_w2(0) * (t384 * t425 - t362 * t473) * (1.0 / 2.0)
+      + noise.n_w2(2) * t470_2 - noise.n_w2(1) * t470_2);
+  Qd(idxstartcorr_v + 1, idxstartcorr_v + 1) = dt * (noise.n_w2(0) * t459
+      + noise.n_w2(1) * t461 + noise.n_w2(2) * t458 + noise.n_a2(0) * t378
+      + noise.n_a2(2) * t379 + noise.n_a2(1) * t385)
+      + dt2 * (-noise.n_w2(0) * t384 * t473
+      - noise.n_w2(1) * ew1 * t381 * t388 + noise.n_w2(2) * ew1 * t381 * t388);
+  Qd(idxstartcorr_v + 1, idxstartcorr_v + 2) = dt * t560_1 + dt2 * t560_2;
+  Qd(idxstartcorr_v + 1, idxstartcorr_q + 0) = dt * noise.n_w2(0) * t384
+      - dt2 * noise.n_w2(0) * t473 * (1.0 / 2.0);
+  Qd(idxstartcorr_v + 1, idxstartcorr_q + 1) = dt * t599_1 + dt2 * t599_2;
+  Qd(idxstartcorr_v + 1, idxstartcorr_q + 2) = -dt * noise.n_w2(2) * t381
+      + dt2 * (-noise.n_w2(0) * t631_2 - noise.n_w2(2) * t627_2
+      + noise.n_w2(1) * ew1 * t388 * (1.0 / 2.0));
+  Qd(idxstartcorr_v + 1, idxstartcorr_b_a + 0) = -dt2 * t366 * noise.n_ba2(0)
+      * (1.0 / 2.0);
+  Qd(idxstartcorr_v + 1, idxstartcorr_b_a + 1) = -dt2 * t367 * noise.n_ba2(1)
+      * (1.0 / 2.0);
+  Qd(idxstartcorr_v + 1, idxstartcorr_b_a + 2) = dt2 * t663_2;
+  Qd(idxstartcorr_v + 2, idxstartcorr_p + 0) = dt2 * t408_2;
+  Qd(idxstartcorr_v + 2, idxstartcorr_p + 1) = dt2 * t412_2;
+  Qd(idxstartcorr_v + 2, idxstartcorr_p + 2) = dt2 * t510_2;
+  Qd(idxstartcorr_v + 2, idxstartcorr_v + 0) = dt * (t522_1 + t534_1
+      + t536_1 - noise.n_w2(1) * t515_1 - t346 * noise.n_a2(0) * t369
+      - t344 * noise.n_a2(1) * t372) + dt2 * (t522_2
+      + t534_2 - noise.n_w2(1) * t440_2);
+  Qd(idxstartcorr_v + 2, idxstartcorr_v + 1) = dt * t560_1 + dt2 * t560_2;
+  Qd(idxstartcorr_v + 2, idxstartcorr_v + 2) = dt * (noise.n_w2(2) * t509
+      + noise.n_w2(1) * t506 + noise.n_w2(0) * t507 + noise.n_a2(0) * t413
+      + noise.n_a2(1) * t414 + noise.n_a2(2) * t415)
+      + dt2 * (-noise.n_w2(2) * t561_2 + noise.n_w2(1) * t561_2
+      + noise.n_w2(0) * t390 * t447);
+  Qd(idxstartcorr_v + 2, idxstartcorr_q + 0) = dt * t580_1 + dt2 * t580_2;
+  Qd(idxstartcorr_v + 2, idxstartcorr_q + 1) = dt * noise.n_w2(1) * t397
+      + dt2 * (t608_2 - noise.n_w2(2) * ew1 * t394 * (1.0 / 2.0)
+      + noise.n_w2(1) * t602_2);
+  Qd(idxstartcorr_v + 2, idxstartcorr_q + 2) = dt * t647_1
+      + dt2 * (t647_2 - noise.n_w2(0) * t640_2 - noise.n_w2(1) * t562_2);
+  Qd(idxstartcorr_v + 2, idxstartcorr_b_a + 0) = dt2 * t659_2;
+  Qd(idxstartcorr_v + 2, idxstartcorr_b_a + 1) = -dt2 * t372 * noise.n_ba2(1)
+      * (1.0 / 2.0);
+  Qd(idxstartcorr_v + 2, idxstartcorr_b_a + 2) = -dt2 * t370 * noise.n_ba2(2)
+      * (1.0 / 2.0);
+  Qd(idxstartcorr_q + 0, idxstartcorr_v + 0) = dt * t573_1 + dt2 * t573_2;
+  Qd(idxstartcorr_q + 0, idxstartcorr_v + 2) = dt * t580_1 + dt2 * t580_2;
+  Qd(idxstartcorr_q + 0, idxstartcorr_q + 0) = dt * noise.n_w2(0);
+  Qd(idxstartcorr_q + 0, idxstartcorr_q + 2) = dt2 * t651_2;
+  Qd(idxstartcorr_q + 0, idxstartcorr_b_w + 0) = -dt2 * noise.n_bw2(0)
+      * (1.0 / 2.0);
+  Qd(idxstartcorr_q + 1, idxstartcorr_v + 0) = -dt * noise.n_w2(1) * t362
+      + dt2 * (-noise.n_w2(2) * t452_2
+      + noise.n_w2(0) * ew3 * t362 * (1.0 / 2.0) + noise.n_w2(1) * t452_2);
+  Qd(idxstartcorr_q + 1, idxstartcorr_v + 1) = dt * t599_1 + dt2 * t599_2;
+  Qd(idxstartcorr_q + 1, idxstartcorr_v + 2) = dt * noise.n_w2(1) * t397
+      + dt2 * (t608_2 + noise.n_w2(1) * t602_2 - noise.n_w2(2) * t602_2);
+  Qd(idxstartcorr_q + 1, idxstartcorr_q + 0) = -dt2 * noise.n_w2(0) * ew3
+      * (1.0 / 2.0);
+  Qd(idxstartcorr_q + 1, idxstartcorr_q + 1) = dt * noise.n_w2(1);
+  Qd(idxstartcorr_q + 1, idxstartcorr_q + 2) = dt2 * (t655_2
+      - noise.n_w2(1) * t614_2);
+  Qd(idxstartcorr_q + 1, idxstartcorr_b_w + 1) = -dt2 * noise.n_bw2(1)
+      * (1.0 / 2.0);
+  Qd(idxstartcorr_q + 2, idxstartcorr_v + 0) = -dt * noise.n_w2(2) * t362
+      + dt2 * (-noise.n_w2(0) * t621_2 - noise.n_w2(2) * t452_2
+      + noise.n_w2(1) * t452_2);
+  Qd(idxstartcorr_q + 2, idxstartcorr_v + 1) = -dt * noise.n_w2(2) * t381
+      + dt2 * (-noise.n_w2(0) * t631_2 - noise.n_w2(2) * t627_2
+      + noise.n_w2(1) * t627_2);
+  Qd(idxstartcorr_q + 2, idxstartcorr_v + 2) = dt * t647_1
+      + dt2 * (t647_2 - noise.n_w2(0) * t640_2 - noise.n_w2(1) * t562_2);
+  Qd(idxstartcorr_q + 2, idxstartcorr_q + 0) = dt2 * t651_2;
+  Qd(idxstartcorr_q + 2, idxstartcorr_q + 1) = dt2 * (t655_2
+      - noise.n_w2(1) * t614_2);
+  Qd(idxstartcorr_q + 2, idxstartcorr_q + 2) = dt * noise.n_w2(2);
+  Qd(idxstartcorr_q + 2, idxstartcorr_b_w + 2) = -dt2 * noise.n_bw2(2)
+      * (1.0 / 2.0);
+  Qd(idxstartcorr_b_w + 0, idxstartcorr_q + 0) = -dt2 * noise.n_bw2(0)
+      * (1.0 / 2.0);
+  Qd(idxstartcorr_b_w + 0, idxstartcorr_b_w + 0) = dt * noise.n_bw2(0);
+  Qd(idxstartcorr_b_w + 1, idxstartcorr_q + 1) = -dt2 * noise.n_bw2(1)
+      * (1.0 / 2.0);
+  Qd(idxstartcorr_b_w + 1, idxstartcorr_b_w + 1) = dt * noise.n_bw2(1);
+  Qd(idxstartcorr_b_w + 2, idxstartcorr_q + 2) = -dt2 * noise.n_bw2(2)
+      * (1.0 / 2.0);
+  Qd(idxstartcorr_b_w + 2, idxstartcorr_b_w + 2) = dt * noise.n_bw2(2);
+  Qd(idxstartcorr_b_a + 0, idxstartcorr_v + 0) = -dt2 * t346 * noise.n_ba2(0)
+      * (1.0 / 2.0);
+  Qd(idxstartcorr_b_a + 0, idxstartcorr_v + 1) = -dt2 * t366 * noise.n_ba2(0)
+      * (1.0 / 2.0);
+  Qd(idxstartcorr_b_a + 0, idxstartcorr_v + 2) = dt2 * t659_2;
+  Qd(idxstartcorr_b_a + 0, idxstartcorr_b_a + 0) = dt * noise.n_ba2(0);
+  Qd(idxstartcorr_b_a + 1, idxstartcorr_v + 0) = dt2 * t661_2;
+  Qd(idxstartcorr_b_a + 1, idxstartcorr_v + 1) = -dt2 * t367 * noise.n_ba2(1)
+      * (1.0 / 2.0);
+  Qd(idxstartcorr_b_a + 1, idxstartcorr_v + 2) = -dt2 * t372 * noise.n_ba2(1)
+      * (1.0 / 2.0);
+  Qd(idxstartcorr_b_a + 1, idxstartcorr_b_a + 1) = dt * noise.n_ba2(1);
+  Qd(idxstartcorr_b_a + 2, idxstartcorr_v + 0) = -dt2 * t345 * noise.n_ba2(2)
+      * (1.0 / 2.0);
+  Qd(idxstartcorr_b_a + 2, idxstartcorr_v + 1) = dt2 * t663_2;
+  Qd(idxstartcorr_b_a + 2, idxstartcorr_v + 2) = -dt2 * t370 * noise.n_ba2(2)
+      * (1.0 / 2.0);
+  Qd(idxstartcorr_b_a + 2, idxstartcorr_b_a + 2) = dt * noise.n_ba2(2);
+
+  // The entries of Qd whose leading term is O(dt^3).
+  Qd(idxstartcorr_p + 0, idxstartcorr_p + 0) = 0;
+  Qd(idxstartcorr_p + 0, idxstartcorr_p + 1) = 0;
+  Qd(idxstartcorr_p + 0, idxstartcorr_p + 2) = 0;
+  Qd(idxstartcorr_p + 0, idxstartcorr_q + 0) = 0;
+  Qd(idxstartcorr_p + 0, idxstartcorr_q + 2) = 0;
+  Qd(idxstartcorr_p + 0, idxstartcorr_b_a + 0) = 0;
+  Qd(idxstartcorr_p + 0, idxstartcorr_b_a + 1) = 0;
+  Qd(idxstartcorr_p + 0, idxstartcorr_b_a + 2) = 0;
+  Qd(idxstartcorr_p + 1, idxstartcorr_p + 0) = 0;
+  Qd(idxstartcorr_p + 1, idxstartcorr_p + 1) = 0;
+  Qd(idxstartcorr_p + 1, idxstartcorr_p + 2) = 0;
+  Qd(idxstartcorr_p + 1, idxstartcorr_q + 0) = 0;
+  Qd(idxstartcorr_p + 1, idxstartcorr_q + 1) = 0;
+  Qd(idxstartcorr_p + 1, idxstartcorr_q + 2) = 0;
+  Qd(idxstartcorr_p + 1, idxstartcorr_b_a + 0) = 0;
+  Qd(idxstartcorr_p + 1, idxstartcorr_b_a + 1) = 0;
+  Qd(idxstartcorr_p + 1, idxstartcorr_b_a + 2) = 0;
+  Qd(idxstartcorr_p + 2, idxstartcorr_p + 0) = 0;
+  Qd(idxstartcorr_p + 2, idxstartcorr_p + 1) = 0;
+  Qd(idxstartcorr_p + 2, idxstartcorr_p + 2) = 0;
+  Qd(idxstartcorr_p + 2, idxstartcorr_q + 0) = 0;
+  Qd(idxstartcorr_p + 2, idxstartcorr_q + 1) = 0;
+  Qd(idxstartcorr_p + 2, idxstartcorr_q + 2) = 0;
+  Qd(idxstartcorr_p + 2, idxstartcorr_b_a + 0) = 0;
+  Qd(idxstartcorr_p + 2, idxstartcorr_b_a + 1) = 0;
+  Qd(idxstartcorr_p + 2, idxstartcorr_b_a + 2) = 0;
+  Qd(idxstartcorr_v + 0, idxstartcorr_b_w + 0) = 0;
+  Qd(idxstartcorr_v + 0, idxstartcorr_b_w + 2) = 0;
+  Qd(idxstartcorr_v + 1, idxstartcorr_b_w + 0) = 0;
+  Qd(idxstartcorr_v + 1, idxstartcorr_b_w + 1) = 0;
+  Qd(idxstartcorr_v + 1, idxstartcorr_b_w + 2) = 0;
+  Qd(idxstartcorr_v + 2, idxstartcorr_b_w + 0) = 0;
+  Qd(idxstartcorr_v + 2, idxstartcorr_b_w + 1) = 0;
+  Qd(idxstartcorr_v + 2, idxstartcorr_b_w + 2) = 0;
+  Qd(idxstartcorr_q + 0, idxstartcorr_p + 0) = 0;
+  Qd(idxstartcorr_q + 0, idxstartcorr_p + 2) = 0;
+  Qd(idxstartcorr_q + 1, idxstartcorr_p + 0) = 0;
+  Qd(idxstartcorr_q + 1, idxstartcorr_p + 1) = 0;
+  Qd(idxstartcorr_q + 1, idxstartcorr_p + 2) = 0;
+  Qd(idxstartcorr_q + 1, idxstartcorr_b_w + 0) = 0;
+  Qd(idxstartcorr_q + 1, idxstartcorr_b_w + 2) = 0;
+  Qd(idxstartcorr_q + 2, idxstartcorr_p + 0) = 0;
+  Qd(idxstartcorr_q + 2, idxstartcorr_p + 1) = 0;
+  Qd(idxstartcorr_q + 2, idxstartcorr_p + 2) = 0;
+  Qd(idxstartcorr_q + 2, idxstartcorr_b_w + 0) = 0;
+  Qd(idxstartcorr_q + 2, idxstartcorr_b_w + 1) = 0;
+  Qd(idxstartcorr_b_w + 0, idxstartcorr_v + 0) = 0;
+  Qd(idxstartcorr_b_w + 0, idxstartcorr_v + 2) = 0;
+  Qd(idxstartcorr_b_w + 0, idxstartcorr_q + 2) = 0;
+  Qd(idxstartcorr_b_w + 1, idxstartcorr_v + 0) = 0;
+  Qd(idxstartcorr_b_w + 1, idxstartcorr_v + 1) = 0;
+  Qd(idxstartcorr_b_w + 1, idxstartcorr_v + 2) = 0;
+  Qd(idxstartcorr_b_w + 1, idxstartcorr_q + 2) = 0;
+  Qd(idxstartcorr_b_w + 2, idxstartcorr_v + 0) = 0;
+  Qd(idxstartcorr_b_w + 2, idxstartcorr_v + 1) = 0;
+  Qd(idxstartcorr_b_w + 2, idxstartcorr_v + 2) = 0;
+  Qd(idxstartcorr_b_w + 2, idxstartcorr_q + 1) = 0;
+  Qd(idxstartcorr_b_a + 0, idxstartcorr_p + 0) = 0;
+  Qd(idxstartcorr_b_a + 0, idxstartcorr_p + 1) = 0;
+  Qd(idxstartcorr_b_a + 0, idxstartcorr_p + 2) = 0;
+  Qd(idxstartcorr_b_a + 1, idxstartcorr_p + 0) = 0;
+  Qd(idxstartcorr_b_a + 1, idxstartcorr_p + 1) = 0;
+  Qd(idxstartcorr_b_a + 1, idxstartcorr_p + 2) = 0;
+  Qd(idxstartcorr_b_a + 2, idxstartcorr_p + 0) = 0;
+  Qd(idxstartcorr_b_a + 2, idxstartcorr_p + 1) = 0;
+  Qd(idxstartcorr_b_a + 2, idxstartcorr_p + 2) = 0;
+}
+
+/// The largest dt [s] CalcQCore leaves out the O(dt^3) terms of Qd for.
+const double kCalcQCoreSecondOrderMaxDt = 0.0025;
+
+/**
+ * \brief Calculate the observation covariance matrix for the core states,
+ * taking the fast path of CalcQCoreSecondOrder for small dt.
+ * \param noise The noise terms, see CoreProcessNoise.
+ */
+template<typename StateSequence_T, typename StateDefinition_T, class Derived,
+    class DerivedQ>
+void CalcQCore(const double dt, const Eigen::Quaternion<double> & q,
+                const Eigen::MatrixBase<Derived> & ew,
+                const Eigen::MatrixBase<Derived> & ea,
+                const CoreProcessNoise & noise,
+                Eigen::MatrixBase<DerivedQ> & Qd) {
+  if (dt <= kCalcQCoreSecondOrderMaxDt) {
+    CalcQCoreSecondOrder<StateSequence_T, StateDefinition_T>(dt, q, ew, ea,
+                                                             noise, Qd);
+  } else {
+    CalcQCoreThirdOrder<StateSequence_T, StateDefinition_T>(dt, q, ew, ea,
+                                                            noise, Qd);
+  }
+}
+
+/**
+ * \brief Calculate the observation covariance matrix for the core states from
+ * the noise densities.
+ */
+template<typename StateSequence_T, typename StateDefinition_T, class Derived,
+    class DerivedQ>
+void CalcQCore(const double dt, const Eigen::Quaternion<double> & q,
+                const Eigen::MatrixBase<Derived> & ew,
+                const Eigen::MatrixBase<Derived> & ea,
+                const Eigen::MatrixBase<Derived> & n_a,
+                const Eigen::MatrixBase<Derived> & n_ba,
+                const Eigen::MatrixBase<Derived> & n_w,
+                const Eigen::MatrixBase<Derived> & n_bw,
+                Eigen::MatrixBase<DerivedQ> & Qd) {
+  CoreProcessNoise noise;
+  noise.Set(n_a, n_ba, n_w, n_bw);
+  CalcQCore<StateSequence_T, StateDefinition_T>(dt, q, ew, ea, noise, Qd);
+}
+
+/**
+ * \brief The inputs of CalcQCore for one propagation step.
+ */
+struct CoreProcessInterval {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  double dt;  ///< Duration of the step [s].
+  Eigen::Quaternion<double> q;  ///< Attitude at the end of the step.
+  Eigen::Matrix<double, 3, 1> ew;  ///< Bias corrected angular velocity.
+  Eigen::Matrix<double, 3, 1> ea;  ///< Bias corrected acceleration.
+};
+
+/**
+ * \brief Calculate the observation covariance matrices of the core states for
+ * n consecutive steps at once, e.g. for the steps of a batch of IMU readings.
+ * All steps share the noise terms, and the kernel stays in the cache instead
+ * of alternating with the covariance propagation.
+ * \param Qd The n matrices to fill.
+ */
+template<typename StateSequence_T, typename StateDefinition_T, class DerivedQ>
+void CalcQCoreBatch(const CoreProcessInterval* intervals, size_t n,
+                    const CoreProcessNoise & noise, DerivedQ* const * Qd) {
+  for (size_t i = 0; i < n; ++i) {
+    CalcQCore<StateSequence_T, StateDefinition_T>(intervals[i].dt,
+                                                  intervals[i].q,
+                                                  intervals[i].ew,
+                                                  intervals[i].ea, noise,
+                                                  *Qd[i]);
+  }
+}
+
 #endif  // CALCQ_H_
@@ -19,15 +19,16 @@
 #ifndef MSF_CORE_INL_H_
 #define MSF_CORE_INL_H_
 
+#include <algorithm>
 #include <chrono>
 #include <thread>
 #include <deque>
+#include <limits>
 #include <numeric>
 #include <string>
 #include <vector>
 
 #include <msf_timing/Timer.h>
-#include <msf_core/implementation/calcQCore.h>
 #include <msf_core/eigen_utils.h>
 #include <msf_core/msf_sensormanager.h>
 #include <msf_core/msf_tools.h>
@@ -48,17 +49,35 @@ MSF_Core<EKFState_T>::MSF_Core(const MSF_SensorManager<EKFState_T>& GetUserCalc)
   isfuzzyState_ = false;
   g_ << 0, 0, 9.80834;  // At 47.37 lat (Zurich).
   time_P_propagated = 0;
+  bufferHorizon_ = 60;  // Set from the sensor manager upon init.
+  statesSinceCovarianceKeyframe_ = 0;
+  time_P_composed_from = 0;
+  time_P_composed = 0;
+  snapshotPeriod_ = 0;
+  time_last_snapshot = 0;
+  coreParametersVersion_ = 0;
+  covarianceWorkPending_ = false;
+  covarianceStepInFlight_ = false;
+  covarianceThreadStop_ = false;
   it_last_IMU = stateBuffer_.GetIteratorEnd();
 }
 
 template<typename EKFState_T>
 MSF_Core<EKFState_T>::~MSF_Core() {
+  StopCovarianceThread();
+  if (initialized_) {
+    MSF_INFO_STREAM(
+        "State pool: high water mark " << statePool_.HighWaterMark() <<
+        " states, capacity " << statePool_.Capacity() << ", " <<
+        statePool_.Refused() << " states refused when the pool was full.");
+    if (!snapshotFile_.empty()) {
+      WriteSnapshot(snapshotFile_);
+    }
+  }
 }
 
 template<typename EKFState_T>
-void MSF_Core<EKFState_T>::SetPCore(
-    Eigen::Matrix<double, EKFState_T::nErrorStatesAtCompileTime,
-        EKFState_T::nErrorStatesAtCompileTime>& P) {
+void MSF_Core<EKFState_T>::SetPCore(ErrorStateCov& P) {
   enum {
     // We might want to calculate this, but on the other hand the values for the
     // matrix later on are anyway hardcoded.
@@ -68,7 +87,7 @@ void MSF_Core<EKFState_T>::SetPCore(
   P *= 0.0001;  // Set diagonal small covariance for all states.
 
   // Now set the core state covariance to the simulated values.
-  Eigen::Matrix<double, coreErrorStates, coreErrorStates> P_core;
+  Eigen::Matrix<Scalar_T, coreErrorStates, coreErrorStates> P_core;
   // This violates the 80 chars rule, to keep it somehow readable.
   P_core << 0.0166, 0.0122, -0.0015, 0.0211, 0.0074, 0.0000, 0.0012, -0.0012, 0.0001, -0.0000, 0.0000, -0.0000, -0.0003, -0.0002, -0.0000,
             0.0129, 0.0508, -0.0020, 0.0179, 0.0432, 0.0006, 0.0020, 0.0004, -0.0002, -0.0000, 0.0000, 0.0000, 0.0003, -0.0002, 0.0000,
@@ -86,7 +105,7 @@ void MSF_Core<EKFState_T>::SetPCore(
             -0.0002, -0.0002, -0.0004, -0.0001, 0.0003, 0.0001, -0.0001, -0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0000, 0.0010, 0.0000,
             -0.0000, 0.0000, -0.0001, 0.0000, 0.0000, -0.0001, -0.0000, -0.0000, -0.0000, 0.0000, 0.0000, -0.0000, 0.0000, 0.0000, 0.0001;
 
-  P_core = 0.5 * (P_core + P_core.transpose());
+  P_core = 0.5 * (P_core + P_core.transpose()).eval();
   P.template block<coreErrorStates, coreErrorStates>(0, 0) = P_core;
 }
 
@@ -98,13 +117,91 @@ const MSF_SensorManager<EKFState_T>& MSF_Core<EKFState_T>::GetUserCalc() const {
 template<typename EKFState_T>
 void MSF_Core<EKFState_T>::ProcessIMU(
     const msf_core::Vector3& linear_acceleration,
-    const msf_core::Vector3& angular_velocity, const double& msg_stamp,
+    const msf_core::Vector3& angular_velocity, const int64_t& msg_stamp,
     size_t /*msg_seq*/) {
 
   if (!initialized_)
     return;
 
-  msf_timing::DebugTimer timer_PropGetClosestState("PropGetClosestState");
+  std::vector<SnapshotRecord_T> snapshot;
+  {
+    std::lock_guard<std::recursive_mutex> lock(bufferMutex_);
+
+    if (IntegrateIMUReading(linear_acceleration, angular_velocity, msg_stamp,
+                            true) && predictionMade_) {
+      // Remove states and measurements which fell out of the buffer horizon.
+      CleanUpBuffers();
+      // Check if we can apply some pending measurement.
+      HandlePendingMeasurements();
+      CollectSnapshotIfDue(&snapshot);
+    }
+  }
+  WriteSnapshotRecords(snapshotFile_, snapshot);
+}
+
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::ProcessIMUBatch(const ImuReading* readings,
+                                           size_t count) {
+  if (!initialized_ || count == 0)
+    return;
+
+  std::vector<SnapshotRecord_T> snapshot;
+  std::unique_lock<std::recursive_mutex> lock(bufferMutex_);
+
+  msf_timing::DebugTimer timer_PropBatch("PropBatch");
+  const size_t decimation = usercalc_.GetImuBatchPublishDecimation();
+  // Propagate the covariance over the whole batch at once, where it is kept
+  // state by state.
+  const bool batchcovariance = !covarianceThread_.joinable()
+      && KeepsCovarianceOfAllStates()
+      && usercalc_.GetImuPreintegrationStride() <= 1;
+  bool integrated = false;
+  for (size_t i = 0; i < count && initialized_; ++i) {
+    const bool publish = i + 1 == count
+        || (decimation > 0 && (i + 1) % decimation == 0);
+    integrated |= IntegrateIMUReading(readings[i].linear_acceleration,
+                                      readings[i].angular_velocity,
+                                      readings[i].time, publish,
+                                      !batchcovariance);
+  }
+  timer_PropBatch.Stop();
+
+  if (batchcovariance && integrated && initialized_) {
+    msf_timing::DebugTimer timer_PropCovBatch("PropCovBatch");
+    PropagateCovarianceBatch();
+    timer_PropCovBatch.Stop();
+  }
+
+  if (integrated && initialized_ && predictionMade_) {
+    CleanUpBuffers();
+    // Give every queued measurement a chance, not only one as per reading.
+    HandlePendingMeasurements(queueFutureMeasurements_.size());
+    CollectSnapshotIfDue(&snapshot);
+  }
+  lock.unlock();
+  WriteSnapshotRecords(snapshotFile_, snapshot);
+}
+
+template<typename EKFState_T>
+bool MSF_Core<EKFState_T>::IntegrateIMUReading(
+    const msf_core::Vector3& linear_acceleration,
+    const msf_core::Vector3& angular_velocity, const int64_t& msg_stamp,
+    bool publish, bool propagatecovariance) {
+  // Looked up once, this runs for every IMU reading.
+  static const size_t handle_PropGetClosestState =
+      msf_timing::Timing::GetHandle("PropGetClosestState");
+  static const size_t handle_PropPrepare =
+      msf_timing::Timing::GetHandle("PropPrepare");
+  static const size_t handle_PropPreintegrate =
+      msf_timing::Timing::GetHandle("PropPreintegrate");
+  static const size_t handle_PropState =
+      msf_timing::Timing::GetHandle("PropState");
+  static const size_t handle_PropCov =
+      msf_timing::Timing::GetHandle("PropCov");
+  static const size_t handle_PropInsertState =
+      msf_timing::Timing::GetHandle("PropInsertState");
+
+  msf_timing::DebugTimer timer_PropGetClosestState(handle_PropGetClosestState);
   if (it_last_IMU == stateBuffer_.GetIteratorEnd()) {
     it_last_IMU = stateBuffer_.GetIteratorClosestBefore(msg_stamp);
   }
@@ -112,36 +209,39 @@ void MSF_Core<EKFState_T>::ProcessIMU(
   shared_ptr<EKFState_T> lastState = it_last_IMU->second;
   timer_PropGetClosestState.Stop();
 
-  msf_timing::DebugTimer timer_PropPrepare("PropPrepare");
+  msf_timing::DebugTimer timer_PropPrepare(handle_PropPrepare);
   if (lastState->time == -1) {
     MSF_WARN_STREAM_THROTTLE(
         2, __FUNCTION__<<"ImuCallback: closest state is invalid\n");
-    return;  // Early abort.
+    return false;  // Early abort.
   }
 
-  shared_ptr<EKFState_T> currentState(new EKFState_T);
+  shared_ptr<EKFState_T> currentState = statePool_.Acquire();
+  if (!currentState) {
+    return false;  // The pool is exhausted, the reading is dropped.
+  }
   currentState->time = msg_stamp;
 
   // Check if this IMU message is really after the last one (caused by restarting
   // a bag file).
-  if (currentState->time - lastState->time < -0.01 && predictionMade_) {
+  if (NanosecondsToSeconds(currentState->time - lastState->time) < -0.01
+      && predictionMade_) {
     initialized_ = false;
     predictionMade_ = false;
     MSF_ERROR_STREAM(
         __FUNCTION__<<"latest IMU message was out of order by a too large amount, "
         "resetting EKF: last-state-time: " << msf_core::timehuman(lastState->time)
         << " "<< "current-imu-time: "<< msf_core::timehuman(currentState->time));
-    return;
+    return false;
   }
 
   static int seq = 0;
   // Get inputs.
-  currentState->a_m = linear_acceleration;
-  currentState->w_m = angular_velocity;
+  currentState->a_m = linear_acceleration.template cast<Scalar_T>();
+  currentState->w_m = angular_velocity.template cast<Scalar_T>();
 
   // Remove acc spikes (TODO (slynen): find a cleaner way to do this).
-  static Eigen::Matrix<double, 3, 1> last_am =
-      Eigen::Matrix<double, 3, 1>(0, 0, 0);
+  static Vector3_T last_am = Vector3_T(0, 0, 0);
   if (currentState->a_m.norm() > 50)
     currentState->a_m = last_am;
   else {
@@ -150,7 +250,7 @@ void MSF_Core<EKFState_T>::ProcessIMU(
       MSF_WARN_STREAM(
           "Accelerometer readings had a spike, but no prior state was in the "
           "buffer to take cleaner measurements from");
-      return;
+      return false;
     }
     last_am = lastState->a_m;
   }
@@ -158,15 +258,19 @@ void MSF_Core<EKFState_T>::ProcessIMU(
     if (lastState->time == -1) {
       MSF_WARN_STREAM("Wanted to compare prediction time offset to last state, "
       "but no prior state was in the buffer to take cleaner measurements from");
-      return;
+      return false;
     }
-    if (fabs(currentState->time - lastState->time) > 0.1) {
+    if (fabs(NanosecondsToSeconds(currentState->time - lastState->time))
+        > 0.1) {
       MSF_WARN_STREAM_THROTTLE(
           2, "large time-gap re-initializing to last state\n");
       typename StateBuffer_T::Ptr_T tmp = stateBuffer_.UpdateTime(
           lastState->time, currentState->time);
+      // Updating the time may have moved the state inside the buffer.
+      it_last_IMU = stateBuffer_.GetIteratorEnd();
+      WaitForCovarianceThread();
       time_P_propagated = currentState->time;
-      return;  // // early abort // // (if timegap too big)
+      return false;  // // early abort // // (if timegap too big)
     }
   }
 
@@ -174,46 +278,69 @@ void MSF_Core<EKFState_T>::ProcessIMU(
     MSF_WARN_STREAM(
         "Wanted to propagate state, but no valid prior state could be found in "
         "the buffer");
-    return;
+    return false;
   }
   timer_PropPrepare.Stop();
 
-  msf_timing::DebugTimer timer_PropState("PropState");
+  // Add the reading to the latest state instead of inserting a new one, if
+  // the readings are preintegrated.
+  if (predictionMade_ && CanPreintegrateIntoLastState(currentState->time)) {
+    msf_timing::DebugTimer timer_PropPreintegrate(handle_PropPreintegrate);
+    PreintegrateIntoLastState(currentState->a_m, currentState->w_m,
+                              currentState->time);
+    timer_PropPreintegrate.Stop();
+
+    if (publish) {
+      usercalc_.PublishStateAfterPropagation(stateBuffer_.GetLast());
+    }
+    seq++;
+    return true;
+  }
+
+  MarkCovarianceKeyframeByStride(*currentState);
+
+  msf_timing::DebugTimer timer_PropState(handle_PropState);
   //propagate state and covariance
   PropagateState(lastState, currentState);
   timer_PropState.Stop();
-  msf_timing::DebugTimer timer_PropCov("PropCov");
-  PropagatePOneStep();
+  msf_timing::DebugTimer timer_PropCov(handle_PropCov);
+  // Otherwise the covariance thread catches up once the state is inserted.
+  if (!covarianceThread_.joinable() && propagatecovariance) {
+    PropagatePOneStep();
+  }
   timer_PropCov.Stop();
 
-  usercalc_.PublishStateAfterPropagation(currentState);
+  if (publish) {
+    usercalc_.PublishStateAfterPropagation(currentState);
+  }
 
   // Making sure we have sufficient states to apply measurements to.
   if (stateBuffer_.Size() > 3)
     predictionMade_ = true;
 
-  msf_timing::DebugTimer timer_PropInsertState("PropInsertState");
+  msf_timing::DebugTimer timer_PropInsertState(handle_PropInsertState);
   it_last_IMU = stateBuffer_.Insert(currentState);
   timer_PropInsertState.Stop();
-
-  if (predictionMade_) {
-    // Check if we can apply some pending measurement.
-    HandlePendingMeasurements();
-  }
+  NotifyCovarianceThread();
   seq++;
-
+  return true;
 }
 
+
 template<typename EKFState_T>
 void MSF_Core<EKFState_T>::ProcessExternallyPropagatedState(
     const msf_core::Vector3& linear_acceleration,
     const msf_core::Vector3& angular_velocity, const msf_core::Vector3& p,
     const msf_core::Vector3& v, const msf_core::Quaternion& q,
-    bool is_already_propagated, const double& msg_stamp, size_t /*msg_seq*/) {
+    bool is_already_propagated, const int64_t& msg_stamp, size_t /*msg_seq*/) {
 
   if (!initialized_)
     return;
 
+  // The covariance is propagated synchronously here.
+  std::unique_lock<std::recursive_mutex> lock(bufferMutex_);
+  WaitForCovarianceThread();
+
   // fast method to get last_IMU is broken
   // TODO(slynen): fix iterator setting for state callback
 
@@ -231,23 +358,26 @@ void MSF_Core<EKFState_T>::ProcessExternallyPropagatedState(
   }
 
   // Create a new state.
-  shared_ptr<EKFState_T> currentState(new EKFState_T);
+  shared_ptr<EKFState_T> currentState = statePool_.Acquire();
+  if (!currentState) {
+    return;  // The pool is exhausted, the state is dropped.
+  }
   currentState->time = msg_stamp;
+  MarkCovarianceKeyframeByStride(*currentState);
 
   // Get inputs.
-  currentState->a_m = linear_acceleration;
-  currentState->w_m = angular_velocity;
+  currentState->a_m = linear_acceleration.template cast<Scalar_T>();
+  currentState->w_m = angular_velocity.template cast<Scalar_T>();
 
   // Remove acc spikes (TODO (slynen): Find a cleaner way to do this).
-  static Eigen::Matrix<double, 3, 1> last_am =
-      Eigen::Matrix<double, 3, 1>(0, 0, 0);
+  static Vector3_T last_am = Vector3_T(0, 0, 0);
   if (currentState->a_m.norm() > 50)
     currentState->a_m = last_am;
   else
     last_am = currentState->a_m;
 
   if (!predictionMade_) {
-    if (fabs(currentState->time - lastState->time) > 5) {
+    if (fabs(NanosecondsToSeconds(currentState->time - lastState->time)) > 5) {
       typename StateBuffer_T::Ptr_T tmp = stateBuffer_.UpdateTime(
           lastState->time, currentState->time);
       MSF_WARN_STREAM_THROTTLE(
@@ -263,9 +393,12 @@ void MSF_Core<EKFState_T>::ProcessExternallyPropagatedState(
 
   // State propagation is made externally, so we read the actual state.
   if (is_already_propagated && isnumeric) {
-    currentState->template Get<StateDefinition_T::p>() = p;
-    currentState->template Get<StateDefinition_T::v>() = v;
-    currentState->template Get<StateDefinition_T::q>() = q;
+    currentState->template Get<StateDefinition_T::p>() =
+        p.template cast<Scalar_T>();
+    currentState->template Get<StateDefinition_T::v>() =
+        v.template cast<Scalar_T>();
+    currentState->template Get<StateDefinition_T::q>() =
+        q.template cast<Scalar_T>();
 
     // Zero props: copy non propagation states from last state.
     boost::fusion::for_each(
@@ -281,50 +414,149 @@ void MSF_Core<EKFState_T>::ProcessExternallyPropagatedState(
 
   isnumeric = CheckForNumeric(
       currentState->template Get<StateDefinition_T::p>(), "prediction p");
-  isnumeric = CheckForNumeric(currentState->P, "prediction done P");
+  isnumeric = CheckForNumeric(
+      const_cast<const EKFState_T&>(*currentState).GetP(), "prediction done P");
 
   // Clean reset of state and measurement buffer, before we start propagation.
   if (!predictionMade_) {
 
     // Make sure we keep the covariance for the first state.
-    currentState->P = stateBuffer_.GetLast()->P;
+    PropPToState(stateBuffer_.GetLast());
+    AttachCovariance(*currentState);
+    currentState->GetP() =
+        const_cast<const EKFState_T&>(*stateBuffer_.GetLast()).GetP();
+    CovarianceForm_T::FromP(*currentState);
     time_P_propagated = currentState->time;
 
     stateBuffer_.Clear();
     MeasurementBuffer_.Clear();
+    measurementIndex_.Clear();
     while (!queueFutureMeasurements_.empty()) {
       queueFutureMeasurements_.pop();
     }
+    measurementBurst_.clear();
+    while (!deferredMeasurements_.empty()) {
+      deferredMeasurements_.pop();
+    }
   }
   predictionMade_ = true;
 
   stateBuffer_.Insert(currentState);
+  // Remove states and measurements which fell out of the buffer horizon.
+  CleanUpBuffers();
   // Check if we can apply some pending measurement.
   HandlePendingMeasurements();
+  std::vector<SnapshotRecord_T> snapshot;
+  CollectSnapshotIfDue(&snapshot);
+  lock.unlock();
+  WriteSnapshotRecords(snapshotFile_, snapshot);
 }
 
 template<typename EKFState_T>
-void MSF_Core<EKFState_T>::HandlePendingMeasurements() {
-  if (queueFutureMeasurements_.empty())
-    return;
-  shared_ptr<MSF_MeasurementBase<EKFState_T> > meas = queueFutureMeasurements_
-      .front();
-  queueFutureMeasurements_.pop();
-  AddMeasurement(meas);
+void MSF_Core<EKFState_T>::HandlePendingMeasurements(size_t maxfuture) {
+  const bool idle = queueFutureMeasurements_.empty()
+      && measurementBurst_.empty();
+  // Measurements still in the future are queued again.
+  for (size_t i = 0; i < maxfuture && !queueFutureMeasurements_.empty(); ++i) {
+    shared_ptr<MSF_MeasurementBase<EKFState_T> > meas =
+        queueFutureMeasurements_.front();
+    queueFutureMeasurements_.pop();
+    AddMeasurement(meas);
+  }
+  ApplyMeasurementBurst();
+
+  // Apply a deferred measurement, regardless of the replay budget.
+  if (idle && !deferredMeasurements_.empty()) {
+    std::lock_guard<std::recursive_mutex> lock(bufferMutex_);
+    shared_ptr<MSF_MeasurementBase<EKFState_T> > meas =
+        deferredMeasurements_.front();
+    deferredMeasurements_.pop();
+    typename measurementBufferT::iterator_T it_meas;
+    if (InsertMeasurement(meas, &it_meas)) {
+      ApplyMeasurementsFrom(it_meas);
+    }
+  }
 }
 
 template<typename EKFState_T>
 void MSF_Core<EKFState_T>::CleanUpBuffers() {
-  double timeold = 60;  // 1 min.
-  stateBuffer_.ClearOlderThan(timeold);
-  MeasurementBuffer_.ClearOlderThan(timeold);
+  if (stateBuffer_.Size() == 0)
+    return;
+  // Keep the states the covariance has not been propagated over yet.
+  int64_t timeold = std::min(
+      stateBuffer_.GetLast()->time - SecondsToNanoseconds(bufferHorizon_),
+      time_P_propagated.load());
+  // Keep the keyframe the covariance of the oldest state is reconstructed from.
+  if (!KeepsCovarianceOfAllStates()) {
+    typename StateBuffer_T::iterator_T it = stateBuffer_
+        .GetIteratorClosestBefore(timeold);
+    if (it != stateBuffer_.GetIteratorEnd() && it->second->time != -1) {
+      while (it != stateBuffer_.GetIteratorBegin()
+          && !it->second->HasCovariance()) {
+        --it;
+      }
+      timeold = std::min(timeold, it->second->time);
+    }
+  }
+  stateBuffer_.ClearOlderThan(stateBuffer_.GetLast()->time - timeold);
+  if (MeasurementBuffer_.Size() == 0)
+    return;
+  MeasurementBuffer_.ClearOlderThan(MeasurementBuffer_.GetLast()->time - timeold);
+  measurementIndex_.ClearOlderThan(MeasurementBuffer_.GetFirst()->time);
+}
+
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::UpdateDelayStatistics(
+    const shared_ptr<MSF_MeasurementBase<EKFState_T> >& measurement) {
+  // Number of measurements to see from a sensor before its statistics are
+  // used to shrink the buffers.
+  static const size_t nMeasurementsForStatistics = 10;
+  // Scaling of the max lookback to account for jitter.
+  static const double lookbackScale = 1.5;
+
+  const int64_t latest = stateBuffer_.GetLast()->time;
+  const double delay = std::max(
+      0.0, NanosecondsToSeconds(latest - measurement->time));
+
+  SensorDelayStatistics& stats = sensorDelayStatistics_[measurement->sensorID_];
+  ++stats.count;
+  stats.meandelay += (delay - stats.meandelay) / stats.count;
+  stats.maxdelay = std::max(stats.maxdelay, delay);
+  double lookback = delay;
+  // Relative measurements are applied together with the previous one.
+  if (!measurement->isabsolute_ && stats.lasttime > 0
+      && stats.lasttime < measurement->time) {
+    lookback = NanosecondsToSeconds(latest - stats.lasttime);
+  }
+  stats.maxlookback = std::max(stats.maxlookback, lookback);
+  stats.lasttime = std::max(stats.lasttime, measurement->time);
+
+  // Keep everything until we know all the sensors seen so far well enough.
+  double maxlookback = 0;
+  for (typename std::map<int, SensorDelayStatistics>::const_iterator it =
+      sensorDelayStatistics_.begin(); it != sensorDelayStatistics_.end();
+      ++it) {
+    if (it->second.count < nMeasurementsForStatistics) {
+      bufferHorizon_ = usercalc_.GetMaxBufferHorizon();
+      return;
+    }
+    maxlookback = std::max(maxlookback, it->second.maxlookback);
+  }
+  bufferHorizon_ = std::min(
+      usercalc_.GetMaxBufferHorizon(),
+      lookbackScale * maxlookback + usercalc_.GetBufferHorizonMargin());
 }
 
 template<typename EKFState_T>
 void MSF_Core<EKFState_T>::PropagateState(shared_ptr<EKFState_T>& state_old,
                                           shared_ptr<EKFState_T>& state_new) {
 
-  double dt = state_new->time - state_old->time;
+  if (!state_new->GetPreintegration().Empty()) {
+    PropagateStatePreintegrated(state_old, state_new);
+    return;
+  }
+
+  const Scalar_T dt = NanosecondsToSeconds(state_new->time - state_old->time);
 
   // Reset new state to zero.
   boost::fusion::for_each(state_new->statevars, msf_tmp::ResetState());
@@ -334,53 +566,112 @@ void MSF_Core<EKFState_T>::PropagateState(shared_ptr<EKFState_T>& state_old,
       state_new->statevars,
       msf_tmp::CopyNonPropagationStates<EKFState_T>(*state_old));
 
-  Eigen::Matrix<double, 3, 1> dv;
-  const Vector3 ew = state_new->w_m
+  const Vector3_T ew = state_new->w_m
       - state_new->template Get<StateDefinition_T::b_w>();
-  const Vector3 ewold = state_old->w_m
+  const Vector3_T ewold = state_old->w_m
       - state_old->template Get<StateDefinition_T::b_w>();
-  const Vector3 ea = state_new->a_m
+  const Vector3_T ea = state_new->a_m
       - state_new->template Get<StateDefinition_T::b_a>();
-  const Vector3 eaold = state_old->a_m
+  const Vector3_T eaold = state_old->a_m
       - state_old->template Get<StateDefinition_T::b_a>();
-  const Matrix4 Omega = OmegaMatJPL(ew);
-  const Matrix4 OmegaOld = OmegaMatJPL(ewold);
-  Matrix4 OmegaMean = OmegaMatJPL((ew + ewold) / 2);
-
-  // Zero order quaternion integration.
-  // cur_state.q_ = (Eigen::Matrix<double,4,4>::Identity() +
-  // 0.5*Omega*dt)*StateBuffer_[(unsigned char)(idx_state_-1)].q_.coeffs();
-
-  // First order quaternion integration, this is kind of costly and may not add
-  // a lot to the quality of propagation...
-  int div = 1;
-  Matrix4 MatExp;
-  MatExp.setIdentity();
-  OmegaMean *= 0.5 * dt;
-  for (int i = 1; i < 5; i++) {  // Can be made fourth order or less to save cycles.
-    div *= i;
-    MatExp = MatExp + OmegaMean / div;
-    OmegaMean *= OmegaMean;
-  }
-
-  // First oder quat integration matrix.
-  const Matrix4 quat_int =
-      MatExp + 1.0 / 48.0 * (Omega * OmegaOld - OmegaOld * Omega) * dt * dt;
-
-  // First oder quaternion integration.
-  state_new->template Get<StateDefinition_T::q>().coeffs() = quat_int *
-  state_old->template Get<StateDefinition_T::q>().coeffs();
-  state_new->template Get<StateDefinition_T::q>().normalize();
 
-  dv = (state_new->template Get<StateDefinition_T::q>().toRotationMatrix() *
-       ea + state_old->template Get<StateDefinition_T::q>().toRotationMatrix() *
-       eaold) / 2;
+  AttitudeIntegrator_T::Integrate(
+      ewold, ew, eaold, ea, g_, dt,
+      state_old->template Get<StateDefinition_T::q>(),
+      state_old->template Get<StateDefinition_T::v>(),
+      state_old->template Get<StateDefinition_T::p>(),
+      &state_new->template Get<StateDefinition_T::q>(),
+      &state_new->template Get<StateDefinition_T::v>(),
+      &state_new->template Get<StateDefinition_T::p>());
+}
+
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::PropagateStatePreintegrated(
+    shared_ptr<EKFState_T>& state_old, shared_ptr<EKFState_T>& state_new) {
+  const ImuPreintegration<Scalar_T>& preintegration =
+      state_new->GetPreintegration();
+  if (preintegration.Front().time != state_old->time) {
+    MSF_ERROR_STREAM(
+        __FUNCTION__ << " The preintegrated readings of the state at "
+        << timehuman(state_new->time) << " do not start at the state at "
+        << timehuman(state_old->time) << ".");
+  }
+
+  // Reset new state to zero.
+  boost::fusion::for_each(state_new->statevars, msf_tmp::ResetState());
+
+  // Zero props: copy constant for non propagated states.
+  boost::fusion::for_each(
+      state_new->statevars,
+      msf_tmp::CopyNonPropagationStates<EKFState_T>(*state_old));
+
+  // The increments for the current biases.
+  Eigen::Quaternion<Scalar_T> dq;
+  Vector3_T dv;
+  Vector3_T dp;
+  preintegration.Predict(state_old->template Get<StateDefinition_T::b_a>(),
+                         state_old->template Get<StateDefinition_T::b_w>(),
+                         &dq, &dv, &dp);
+
+  const Scalar_T dt = preintegration.Dt();
+  const Matrix3_T C_old =
+      state_old->template Get<StateDefinition_T::q>().toRotationMatrix();
+
+  state_new->template Get<StateDefinition_T::q>() =
+      state_old->template Get<StateDefinition_T::q>() * dq;
+  state_new->template Get<StateDefinition_T::q>().normalize();
   state_new->template Get<StateDefinition_T::v>() =
-      state_old->template Get<StateDefinition_T::v>() + (dv - g_) * dt;
+      state_old->template Get<StateDefinition_T::v>() + C_old * dv - g_ * dt;
   state_new->template Get<StateDefinition_T::p>() =
       state_old->template Get<StateDefinition_T::p>()
-      + ((state_new->template Get<StateDefinition_T::v>()
-          + state_old->template Get<StateDefinition_T::v>()) / 2 * dt);
+      + state_old->template Get<StateDefinition_T::v>() * dt + C_old * dp
+      - g_ * (dt * dt * Scalar_T(0.5));
+}
+
+template<typename EKFState_T>
+bool MSF_Core<EKFState_T>::CanPreintegrateIntoLastState(int64_t time) {
+  const size_t stride = usercalc_.GetImuPreintegrationStride();
+  if (stride <= 1 || stateBuffer_.Size() < 2)
+    return false;
+  shared_ptr<EKFState_T>& state = stateBuffer_.GetLast();
+  if (time <= state->time || std::max<size_t>(
+      state->GetPreintegration().Size(), 1) >= stride)
+    return false;
+  // The covariance, and maybe a measurement, was already applied at the state.
+  if (state->time <= time_P_propagated || state->time <= time_P_composed)
+    return false;
+  return true;
+}
+
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::PreintegrateIntoLastState(const Vector3_T& a_m,
+                                                     const Vector3_T& w_m,
+                                                     int64_t time) {
+  RefreshCoreParameters();
+  shared_ptr<EKFState_T> state = stateBuffer_.GetLast();
+  typename StateBuffer_T::iterator_T itprevious = stateBuffer_
+      .GetIteratorAtValue(state);
+  --itprevious;
+  shared_ptr<EKFState_T> previous = itprevious->second;
+
+  AttachPreintegration(*state);
+  ImuPreintegration<Scalar_T>& preintegration = state->MutablePreintegration();
+  if (preintegration.Empty()) {
+    // The state was propagated over a single reading so far.
+    preintegration.Start(previous->time, previous->a_m, previous->w_m,
+                         previous->template Get<StateDefinition_T::b_a>(),
+                         previous->template Get<StateDefinition_T::b_w>());
+    preintegration.Integrate(state->time, state->a_m, state->w_m,
+                             coreParameters_.noise);
+  }
+  preintegration.Integrate(time, a_m, w_m, coreParameters_.noise);
+  state->a_m = a_m;
+  state->w_m = w_m;
+
+  shared_ptr<EKFState_T> moved = stateBuffer_.UpdateTime(state->time, time);
+  it_last_IMU = stateBuffer_.GetIteratorAtValue(moved);
+
+  PropagateState(previous, state);
 }
 
 template<typename EKFState_T>
@@ -396,8 +687,14 @@ void MSF_Core<EKFState_T>::PropagatePOneStep() {
   // Might happen if there is a measurement in the future.
   if (stateIteratorPLastPropagatedNext != stateBuffer_.GetIteratorEnd()) {
 
-    PredictProcessCovariance(stateIteratorPLastPropagated->second,
-                             stateIteratorPLastPropagatedNext->second);
+    if (usercalc_.GetCovariancePropagationDecimation() > 1) {
+      ComposeCovariancePropagation(
+          stateBuffer_.GetLast(), false,
+          usercalc_.GetCovariancePropagationDecimation());
+    } else {
+      PredictProcessCovariance(stateIteratorPLastPropagated->second,
+                               stateIteratorPLastPropagatedNext->second);
+    }
 
     if (!CheckForNumeric(
         stateIteratorPLastPropagatedNext->second
@@ -415,21 +712,228 @@ void MSF_Core<EKFState_T>::PropagatePOneStep() {
   }
 }
 
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::PropagateCovarianceBatch() {
+  typename StateBuffer_T::iterator_T it = stateBuffer_.GetIteratorAtValue(
+      time_P_propagated, false);
+  typename StateBuffer_T::iterator_T itnext = it;
+  ++itnext;
+  if (itnext == stateBuffer_.GetIteratorEnd())
+    return;
+
+  RefreshCoreParameters();
+  covarianceBatchIntervals_.clear();
+  covarianceBatchStates_.clear();
+  covarianceBatchQd_.clear();
+
+  // Fd and the auxiliary blocks of Qd state by state, the core blocks of Qd
+  // are left for CalcQCoreBatch.
+  for (; itnext != stateBuffer_.GetIteratorEnd(); ++it, ++itnext) {
+    if (itnext->second->time - it->second->time <= 0) {
+      MSF_WARN_STREAM_THROTTLE(
+          1, "Requested cov prop between two states that are not in time "
+          "order. Rejecting");
+      break;
+    }
+    if (!it->second->HasCovariance()) {
+      ReconstructCovariance(it->second);
+    }
+    AttachCovariance(*it->second);
+    AttachCovariance(*itnext->second);
+    CalculateQAuxiliaryStates(it->second, itnext->second);
+    covarianceBatchIntervals_.resize(covarianceBatchIntervals_.size() + 1);
+    CalculateStateTransition(it->second, itnext->second, coreParameters_,
+                             it->second->GetFd(), it->second->GetQd(),
+                             &covarianceBatchIntervals_.back());
+    covarianceBatchStates_.push_back(it->second.get());
+    covarianceBatchQd_.push_back(&it->second->GetQd());
+  }
+  const size_t steps = covarianceBatchIntervals_.size();
+  if (steps == 0)
+    return;
+  covarianceBatchStates_.push_back(it->second.get());
+
+  CalcQCoreBatch<StateSequence_T, StateDefinition_T>(
+      covarianceBatchIntervals_.data(), steps, coreParameters_.noise,
+      covarianceBatchQd_.data());
+
+  for (size_t i = 0; i < steps; ++i) {
+    EKFState_T& state_old = *covarianceBatchStates_[i];
+    CovarianceForm_T::Propagate(state_old, state_old.GetFd(),
+                                state_old.GetQd(),
+                                *covarianceBatchStates_[i + 1]);
+  }
+  time_P_propagated = it->second->time;
+
+  if (!CheckForNumeric(it->second->template Get<StateDefinition_T::p>(),
+                       "prediction p")) {
+    MSF_WARN_STREAM("prop state to:\t"<< it->second->ToEigenVector());
+    MSF_ERROR_STREAM(__FUNCTION__<<" Resetting EKF");
+    predictionMade_ = initialized_ = false;
+  }
+}
+
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::StartCovarianceThread() {
+  if (!usercalc_.GetCovariancePropagationThread() || covarianceThread_.joinable())
+    return;
+  // The thread only touches the two states it propagates between, which rules
+  // out keyframes, decimation, lazy updates and states still collecting
+  // readings.
+  if (!KeepsCovarianceOfAllStates()
+      || usercalc_.GetCovariancePropagationDecimation() > 1
+      || usercalc_.GetImuPreintegrationStride() > 1) {
+    MSF_WARN_STREAM(
+        "The covariance thread needs the covariance of every state, without "
+        "decimation and preintegration. Propagating the covariance in the IMU "
+        "callback instead.");
+    return;
+  }
+  covarianceThreadStop_ = false;
+  covarianceThread_ = std::thread(&MSF_Core<EKFState_T>::CovarianceThreadLoop,
+                                  this);
+}
+
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::StopCovarianceThread() {
+  if (!covarianceThread_.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(covarianceMutex_);
+    covarianceThreadStop_ = true;
+  }
+  covarianceCondition_.notify_all();
+  covarianceThread_.join();
+}
+
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::NotifyCovarianceThread() {
+  if (!covarianceThread_.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(covarianceMutex_);
+    covarianceWorkPending_ = true;
+  }
+  covarianceCondition_.notify_all();
+}
+
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::WaitForCovarianceThread() {
+  if (!covarianceThread_.joinable())
+    return;
+  std::unique_lock<std::mutex> lock(covarianceMutex_);
+  while (covarianceStepInFlight_) {
+    covarianceCondition_.wait(lock);
+  }
+}
+
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::CovarianceThreadLoop() {
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(covarianceMutex_);
+      while (!covarianceWorkPending_ && !covarianceThreadStop_) {
+        covarianceCondition_.wait(lock);
+      }
+      if (covarianceThreadStop_)
+        return;
+      covarianceWorkPending_ = false;
+    }
+    while (PropagatePOneStepInBackground()) {
+    }
+  }
+}
+
+template<typename EKFState_T>
+bool MSF_Core<EKFState_T>::PropagatePOneStepInBackground() {
+  shared_ptr<EKFState_T> state_old;
+  shared_ptr<EKFState_T> state_new;
+  CoreParameters parameters;
+  {
+    // Pick the step while the buffer can not change.
+    std::lock_guard<std::recursive_mutex> lock(bufferMutex_);
+    if (!initialized_ || !predictionMade_)
+      return false;
+    typename StateBuffer_T::iterator_T it = stateBuffer_.GetIteratorAtValue(
+        time_P_propagated, false);
+    if (it == stateBuffer_.GetIteratorEnd())
+      return false;
+    typename StateBuffer_T::iterator_T itnext = it;
+    ++itnext;
+    // The latest state is left alone, the IMU callback propagates from it.
+    if (itnext == stateBuffer_.GetIteratorEnd()
+        || itnext->second == stateBuffer_.GetLast()
+        || itnext->second->time <= it->second->time
+        || !it->second->HasCovariance())
+      return false;
+    state_old = it->second;
+    state_new = itnext->second;
+
+    std::lock_guard<std::mutex> flagLock(covarianceMutex_);
+    if (covarianceThreadStop_)
+      return false;
+    covarianceStepInFlight_ = true;
+
+    RefreshCoreParameters();
+    parameters = coreParameters_;
+    CalculateQAuxiliaryStates(state_old, state_new);
+    AttachCovariance(*state_new);
+  }
+
+  // Writers of the buffers wait for the step before they touch the covariance
+  // or time_P_propagated, so the step runs without holding the buffer.
+  msf_timing::DebugTimer timer_PropCovBackground("PropCovBackground");
+  typename EKFState_T::F_type& Fd = state_old->GetFd();
+  typename EKFState_T::Q_type& Qd = state_old->GetQd();
+  CalculateStateTransition(state_old, state_new, parameters, Fd, Qd);
+  CovarianceForm_T::Propagate(*state_old, Fd, Qd, *state_new);
+  time_P_propagated = state_new->time;
+  timer_PropCovBackground.Stop();
+
+  {
+    std::lock_guard<std::mutex> lock(covarianceMutex_);
+    covarianceStepInFlight_ = false;
+  }
+  covarianceCondition_.notify_all();
+  return true;
+}
+
 template<typename EKFState_T>
 void MSF_Core<EKFState_T>::GetAccumulatedStateTransitionStochasticCloning(
     const shared_ptr<EKFState_T>& state_old,
     const shared_ptr<EKFState_T>& state_new,
-    Eigen::Matrix<double, MSF_Core<EKFState_T>::nErrorStatesAtCompileTime,
-        MSF_Core<EKFState_T>::nErrorStatesAtCompileTime>& F) {
+    ErrorStateCov& F) {
   typename StateBuffer_T::iterator_T it = stateBuffer_.GetIteratorAtValue(
       state_old);
   typename StateBuffer_T::iterator_T itend = stateBuffer_.GetIteratorAtValue(
       state_new);
-  typedef Eigen::Matrix<double, MSF_Core<EKFState_T>::nErrorStatesAtCompileTime,
-      MSF_Core<EKFState_T>::nErrorStatesAtCompileTime> F_type;
-  F = F_type::Identity();
+  F = ErrorStateCov::Identity();
   for (; it != itend; ++it) {
-    F = F * it->second->Fd;
+    if (it->second->HasCovariance()) {
+      const_cast<const EKFState_T&>(*it->second).GetFd().MultiplyFromRight(F);
+    } else {
+      // Fd is not kept for states between covariance keyframes.
+      typename StateBuffer_T::iterator_T itnext = it;
+      ++itnext;
+      typename EKFState_T::F_type Fd;
+      typename EKFState_T::Q_type Qd = EKFState_T::Q_type::Zero();
+      CalculateStateTransition(it->second, itnext->second, Fd, Qd);
+      Fd.MultiplyFromRight(F);
+    }
+  }
+}
+
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::AttachCovariance(EKFState_T& state) {
+  if (!state.HasCovariance()) {
+    state.SetCovarianceStorage(covariancePool_.Acquire());
+  }
+}
+
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::AttachPreintegration(EKFState_T& state) {
+  if (!state.HasPreintegration()) {
+    state.SetPreintegrationStorage(preintegrationPool_.Acquire());
   }
 }
 
@@ -437,7 +941,7 @@ template<typename EKFState_T>
 void MSF_Core<EKFState_T>::PredictProcessCovariance(
     shared_ptr<EKFState_T>& state_old, shared_ptr<EKFState_T>& state_new) {
 
-  double dt = state_new->time - state_old->time;
+  double dt = NanosecondsToSeconds(state_new->time - state_old->time);
 
   if (dt <= 0) {
     MSF_WARN_STREAM_THROTTLE(
@@ -446,124 +950,379 @@ void MSF_Core<EKFState_T>::PredictProcessCovariance(
     return;
   }
 
-  // Noises.
-  const Vector3 nav = Vector3::Constant(usercalc_.GetParamNoiseAcc());
-  const Vector3 nbav = Vector3::Constant(usercalc_.GetParamNoiseAccbias());
+  // The propagation may restart at a state between keyframes.
+  if (!state_old->HasCovariance()) {
+    ReconstructCovariance(state_old);
+  }
+  AttachCovariance(*state_old);
+  AttachCovariance(*state_new);
+  typename EKFState_T::F_type& Fd = state_old->GetFd();
+  typename EKFState_T::Q_type& Qd = state_old->GetQd();
+
+  CalculateStateTransition(state_old, state_new, Fd, Qd);
+
+  // P_new = Fd * P * Fd^T + Qd, in the representation of the covariance form.
+  CovarianceForm_T::Propagate(*state_old, Fd, Qd, *state_new);
+
+  // Set time for best cov prop to now.
+  time_P_propagated = state_new->time;
+
+  // Only keep the covariance at keyframes, if requested.
+  if (usercalc_.GetCovarianceKeyframeStride() > 0
+      && !state_old->IsCovarianceKeyframe()) {
+    state_old->ReleaseCovariance();
+  }
+}
+
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::ComposeCovariancePropagation(
+    shared_ptr<EKFState_T>& state, bool apply, size_t decimation) {
+  if (state->time <= time_P_propagated)
+    return;
+  // Start over if the covariance was changed or propagated elsewhere, or if
+  // the composition already went past the state.
+  if (composedTransition_.Steps() == 0
+      || time_P_composed_from != time_P_propagated
+      || time_P_composed > state->time) {
+    composedTransition_.Reset();
+    time_P_composed_from = time_P_composed = time_P_propagated;
+  }
+
+  typename StateBuffer_T::iterator_T it = stateBuffer_.GetIteratorAtValue(
+      time_P_composed, false);
+  typename StateBuffer_T::iterator_T itnext = it;
+  ++itnext;
+  for (; itnext != stateBuffer_.GetIteratorEnd()
+      && itnext->second->time <= state->time; ++it, ++itnext) {
+    if (itnext->second->time - it->second->time <= 0)
+      continue;
+    if (it->second->time == time_P_composed_from) {
+      // The first state keeps its covariance and the transition from it.
+      if (!it->second->HasCovariance()) {
+        ReconstructCovariance(it->second);
+      }
+      CalculateStateTransition(it->second, itnext->second,
+                               it->second->GetFd(), it->second->GetQd());
+      const EKFState_T& state_from = *it->second;
+      composedTransition_.Append(state_from.GetFd(), state_from.GetQd());
+    } else {
+      typename EKFState_T::F_type Fd;
+      typename EKFState_T::Q_type Qd = EKFState_T::Q_type::Zero();
+      CalculateStateTransition(it->second, itnext->second, Fd, Qd);
+      composedTransition_.Append(Fd, Qd);
+      // The covariance is not propagated to the states inside the composed
+      // transition, so a covariance left from before is outdated.
+      it->second->ReleaseCovariance();
+    }
+    time_P_composed = itnext->second->time;
 
-  const Vector3 nwv = Vector3::Constant(usercalc_.GetParamNoiseGyr());
-  const Vector3 nbwv = Vector3::Constant(usercalc_.GetParamNoiseGyrbias());
+    if (composedTransition_.Steps() >= decimation
+        || itnext->second->IsCovarianceKeyframe()) {
+      ApplyComposedTransition();
+    }
+  }
+  if (apply && composedTransition_.Steps() > 0) {
+    ApplyComposedTransition();
+  }
+}
+
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::ApplyComposedTransition() {
+  typename StateBuffer_T::iterator_T itold = stateBuffer_.GetIteratorAtValue(
+      time_P_composed_from, false);
+  typename StateBuffer_T::iterator_T itnew = stateBuffer_.GetIteratorAtValue(
+      time_P_composed, false);
+  shared_ptr<EKFState_T>& state_old = itold->second;
+
+  AttachCovariance(*itnew->second);
+  composedTransition_.PropagateCovariance(
+      const_cast<const EKFState_T&>(*state_old).GetP(),
+      itnew->second->GetP());
+  CovarianceForm_T::FromP(*itnew->second);
+
+  time_P_propagated = time_P_composed_from = time_P_composed;
+  composedTransition_.Reset();
+
+  // Only keep the covariance at keyframes, if requested.
+  if (usercalc_.GetCovarianceKeyframeStride() > 0
+      && !state_old->IsCovarianceKeyframe()) {
+    state_old->ReleaseCovariance();
+  }
+}
+
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::RefreshCoreParameters() {
+  usercalc_.GetCoreParameters().ReadIfNewer(&coreParametersVersion_,
+                                            &coreParameters_);
+}
+
+template<typename EKFState_T>
+bool MSF_Core<EKFState_T>::KeepsCovarianceOfAllStates() const {
+  return usercalc_.GetCovarianceKeyframeStride() == 0
+      && usercalc_.GetCovariancePropagationDecimation() <= 1
+      && !usercalc_.GetLazyRepropagation();
+}
+
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::CalculateStateTransition(
+    shared_ptr<EKFState_T>& state_old, shared_ptr<EKFState_T>& state_new,
+    typename EKFState_T::F_type& Fd, typename EKFState_T::Q_type& Qd) {
+  RefreshCoreParameters();
+  CalculateQAuxiliaryStates(state_old, state_new);
+  CalculateStateTransition(state_old, state_new, coreParameters_, Fd, Qd);
+}
+
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::CalculateQAuxiliaryStates(
+    shared_ptr<EKFState_T>& state_old, shared_ptr<EKFState_T>& state_new) {
+  const ImuPreintegration<Scalar_T>& preintegration =
+      state_new->GetPreintegration();
+  const Scalar_T dt = preintegration.Empty() ?
+      NanosecondsToSeconds(state_new->time - state_old->time) :
+      preintegration.Dt();
+  // TODO optim: make state Q-blocks map respective parts of Q using Eigen Map,
+  // avoids copy.
+  usercalc_.CalculateQAuxiliaryStates(*state_new, dt);
+}
+
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::CalculateStateTransition(
+    shared_ptr<EKFState_T>& state_old, shared_ptr<EKFState_T>& state_new,
+    const CoreParameters& parameters, typename EKFState_T::F_type& Fd,
+    typename EKFState_T::Q_type& Qd, CoreProcessInterval* interval) const {
+  if (!state_new->GetPreintegration().Empty()) {
+    CalculatePreintegratedStateTransition(state_old, state_new, parameters, Fd,
+                                          Qd);
+    return;
+  }
+
+  const Scalar_T dt = NanosecondsToSeconds(state_new->time - state_old->time);
 
   // Bias corrected IMU readings.
-  const Vector3 ew = state_new->w_m
+  const Vector3_T ew = state_new->w_m
       - state_new->template Get<StateDefinition_T::b_w>();
-  const Vector3 ea = state_new->a_m
+  const Vector3_T ea = state_new->a_m
       - state_new->template Get<StateDefinition_T::b_a>();
 
-  const Matrix3 a_sk = Skew(ea);
-  const Matrix3 w_sk = Skew(ew);
-  const Matrix3 eye3 = Eigen::Matrix<double, 3, 3>::Identity();
+  const Matrix3_T a_sk = Skew(ea);
+  const Matrix3_T w_sk = Skew(ew);
+  const Matrix3_T eye3 = Matrix3_T::Identity();
 
-  const Matrix3 C_eq = state_new->template Get<StateDefinition_T::q>().toRotationMatrix();
+  const Matrix3_T C_eq = state_new->template Get<StateDefinition_T::q>().toRotationMatrix();
 
-  const double dt_p2_2 = dt * dt * 0.5;
-  const double dt_p3_6 = dt_p2_2 * dt / 3.0;
-  const double dt_p4_24 = dt_p3_6 * dt * 0.25;
-  const double dt_p5_120 = dt_p4_24 * dt * 0.2;
+  const Scalar_T dt_p2_2 = dt * dt * Scalar_T(0.5);
+  const Scalar_T dt_p3_6 = dt_p2_2 * dt / Scalar_T(3.0);
+  const Scalar_T dt_p4_24 = dt_p3_6 * dt * Scalar_T(0.25);
+  const Scalar_T dt_p5_120 = dt_p4_24 * dt * Scalar_T(0.2);
 
-  const Matrix3 Ca3 = C_eq * a_sk;
-  const Matrix3 A = Ca3
+  const Matrix3_T Ca3 = C_eq * a_sk;
+  const Matrix3_T A = Ca3
       * (-dt_p2_2 * eye3 + dt_p3_6 * w_sk - dt_p4_24 * w_sk * w_sk);
-  const Matrix3 B = Ca3
+  const Matrix3_T B = Ca3
       * (dt_p3_6 * eye3 - dt_p4_24 * w_sk + dt_p5_120 * w_sk * w_sk);
-  const Matrix3 D = -A;
-  const Matrix3 E = eye3 - dt * w_sk + dt_p2_2 * w_sk * w_sk;
-  const Matrix3 F = -dt * eye3 + dt_p2_2 * w_sk - dt_p3_6 * (w_sk * w_sk);
-  const Matrix3 C = Ca3 * F;
+  const Matrix3_T D = -A;
+  const Matrix3_T E = eye3 - dt * w_sk + dt_p2_2 * w_sk * w_sk;
+  const Matrix3_T F = -dt * eye3 + dt_p2_2 * w_sk - dt_p3_6 * (w_sk * w_sk);
+  const Matrix3_T C = Ca3 * F;
 
   // Discrete error state propagation Matrix Fd according to:
   // Stephan Weiss and Roland Siegwart.
   // Real-Time Metric State Estimation for Modular Vision-Inertial Systems.
   // IEEE International Conference on Robotics and Automation. Shanghai, China, 2011
-  typename EKFState_T::F_type& Fd = state_old->Fd;
-
-  enum {
-    idxstartcorr_p = msf_tmp::GetStartIndexInCorrection<StateSequence_T,
-        StateDefinition_T::p>::value,
-    idxstartcorr_v = msf_tmp::GetStartIndexInCorrection<StateSequence_T,
-        StateDefinition_T::v>::value,
-    idxstartcorr_q = msf_tmp::GetStartIndexInCorrection<StateSequence_T,
-        StateDefinition_T::q>::value,
-    idxstartcorr_b_w = msf_tmp::GetStartIndexInCorrection<StateSequence_T,
-        StateDefinition_T::b_w>::value,
-    idxstartcorr_b_a = msf_tmp::GetStartIndexInCorrection<StateSequence_T,
-        StateDefinition_T::b_a>::value
-  };
-
-  Fd.template block<3, 3>(idxstartcorr_p, idxstartcorr_v) = dt * eye3;
-  Fd.template block<3, 3>(idxstartcorr_p, idxstartcorr_q) = A;
-  Fd.template block<3, 3>(idxstartcorr_p, idxstartcorr_b_w) = B;
-  Fd.template block<3, 3>(idxstartcorr_p, idxstartcorr_b_a) = -C_eq * dt_p2_2;
-
-  Fd.template block<3, 3>(idxstartcorr_v, idxstartcorr_q) = C;
-  Fd.template block<3, 3>(idxstartcorr_v, idxstartcorr_b_w) = D;
-  Fd.template block<3, 3>(idxstartcorr_v, idxstartcorr_b_a) = -C_eq * dt;
-
-  Fd.template block<3, 3>(idxstartcorr_q, idxstartcorr_q) = E;
-  Fd.template block<3, 3>(idxstartcorr_q, idxstartcorr_b_w) = F;
-
-  typename EKFState_T::Q_type& Qd = state_old->Qd;
+  Fd.p_v = dt * eye3;
+  Fd.p_q = A;
+  Fd.p_b_w = B;
+  Fd.p_b_a = -C_eq * dt_p2_2;
+
+  Fd.v_q = C;
+  Fd.v_b_w = D;
+  Fd.v_b_a = -C_eq * dt;
+
+  Fd.q_q = E;
+  Fd.q_b_w = F;
+
+  // Qd is computed in double for any scalar of the state.
+  if (interval) {
+    interval->dt = dt;
+    interval->q =
+        state_new->template Get<StateDefinition_T::q>().template cast<double>();
+    interval->ew = ew.template cast<double>();
+    interval->ea = ea.template cast<double>();
+  } else {
+    CalcQCore<StateSequence_T, StateDefinition_T>(
+        dt,
+        state_new->template Get<StateDefinition_T::q>().template cast<double>(),
+        ew, ea, parameters.noise, Qd);
+  }
 
-  CalcQCore<StateSequence_T, StateDefinition_T>(
-      dt, state_new->template Get<StateDefinition_T::q>(), ew, ea, nav, nbav,
-      nwv, nbwv, Qd);
+  // Now copy the userdefined blocks of the auxiliary states to Qd.
+  boost::fusion::for_each(
+      state_new->statevars,
+      msf_tmp::CopyQBlocksFromAuxiliaryStatesToQ<StateSequence_T>(Qd));
+}
 
-  // Call user Q calc to fill in the blocks of auxiliary states.
-  // TODO optim: make state Q-blocks map respective parts of Q using Eigen Map,
-  // avoids copy.
-  usercalc_.CalculateQAuxiliaryStates(*state_new, dt);
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::CalculatePreintegratedStateTransition(
+    shared_ptr<EKFState_T>& state_old, shared_ptr<EKFState_T>& state_new,
+    const CoreParameters& parameters, typename EKFState_T::F_type& Fd,
+    typename EKFState_T::Q_type& Qd) const {
+  typedef typename EKFState_T::F_type::Core_T Core_T;
+  const ImuPreintegration<Scalar_T>& preintegration =
+      state_new->GetPreintegration();
+  const Scalar_T dt = preintegration.Dt();
+  const Matrix3_T C_old =
+      state_old->template Get<StateDefinition_T::q>().toRotationMatrix();
+  const Matrix3_T eye3 = Matrix3_T::Identity();
+
+  // The error state transition over the interval, from the Jacobians of the
+  // increments. Attitude errors are in the body frame, like in
+  // CalculateStateTransition.
+  Fd.p_v = dt * eye3;
+  Fd.p_q = -C_old * Skew(preintegration.DeltaP());
+  Fd.p_b_w = C_old * preintegration.J_p_bw();
+  Fd.p_b_a = C_old * preintegration.J_p_ba();
+
+  Fd.v_q = -C_old * Skew(preintegration.DeltaV());
+  Fd.v_b_w = C_old * preintegration.J_v_bw();
+  Fd.v_b_a = C_old * preintegration.J_v_ba();
+
+  Fd.q_q = preintegration.DeltaQ().toRotationMatrix().transpose();
+  Fd.q_b_w = preintegration.J_q_bw();
+
+  // The noise of the increments, rotated from the older body frame.
+  const typename ImuPreintegration<Scalar_T>::Matrix9_T& Sigma =
+      preintegration.Sigma();
+  Eigen::Matrix<Scalar_T, 9, 9> T = Eigen::Matrix<Scalar_T, 9, 9>::Zero();
+  T.template block<3, 3>(0, 6) = C_old;  // p.
+  T.template block<3, 3>(3, 3) = C_old;  // v.
+  T.template block<3, 3>(6, 0) = eye3;  // q.
+  Core_T Qd_core = Core_T::Zero();
+  Qd_core.template block<9, 9>(0, 0) = T * Sigma * T.transpose();
+  Qd_core.template block<3, 3>(9, 9) =
+      (parameters.noise.n_bw2.template cast<Scalar_T>() * dt).asDiagonal();
+  Qd_core.template block<3, 3>(12, 12) =
+      (parameters.noise.n_ba2.template cast<Scalar_T>() * dt).asDiagonal();
+  Qd.template topLeftCorner<Core_T::RowsAtCompileTime,
+      Core_T::ColsAtCompileTime>() = Qd_core;
 
-  // Now copy the userdefined blocks to Qd.
   boost::fusion::for_each(
       state_new->statevars,
       msf_tmp::CopyQBlocksFromAuxiliaryStatesToQ<StateSequence_T>(Qd));
+}
 
-  // TODO (slynen) Optim: Multiplication of F blockwise, using the fact that aux
-  // states have no entries outside their block.
-  state_new->P = Fd * state_old->P * Fd.transpose() + Qd;
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::ReconstructCovariance(
+    shared_ptr<EKFState_T>& state) {
+  typename StateBuffer_T::iterator_T it = stateBuffer_.GetIteratorAtValue(
+      state);
+  // Go back to the closest state which has its covariance.
+  typename StateBuffer_T::iterator_T itkeyframe = it;
+  while (itkeyframe != stateBuffer_.GetIteratorBegin()
+      && !itkeyframe->second->HasCovariance()) {
+    --itkeyframe;
+  }
+  const bool foundkeyframe = itkeyframe->second->HasCovariance();
+  AttachCovariance(*state);
+  if (!foundkeyframe) {
+    MSF_ERROR_STREAM(
+        __FUNCTION__ << " No covariance keyframe before the state at "
+        << timehuman(state->time) << ". Setting its covariance to zero.");
+    return;
+  }
 
-  // Set time for best cov prop to now.
-  time_P_propagated = state_new->time;
+  // Replay the propagation from the keyframe to the state.
+  typename EKFState_T::P_type P =
+      const_cast<const EKFState_T&>(*itkeyframe->second).GetP();
+  typename StateBuffer_T::iterator_T itnext = itkeyframe;
+  ++itnext;
+  for (; itkeyframe != it; ++itkeyframe, ++itnext) {
+    if (itnext->second->time - itkeyframe->second->time <= 0)
+      continue;
+    typename EKFState_T::F_type Fd;
+    typename EKFState_T::Q_type Qd = EKFState_T::Q_type::Zero();
+    CalculateStateTransition(itkeyframe->second, itnext->second, Fd, Qd);
+    typename EKFState_T::P_type P_next;
+    Fd.PropagateCovariance(P, Qd, P_next);
+    P = P_next;
+  }
+  state->GetP() = P;
+  CovarianceForm_T::FromP(*state);
+
+  // Also restore Fd and Qd, if the propagation already went past the state.
+  if (itnext != stateBuffer_.GetIteratorEnd()
+      && itnext->second->time > state->time
+      && itnext->second->time <= time_P_propagated) {
+    CalculateStateTransition(state, itnext->second, state->GetFd(),
+                             state->GetQd());
+  }
+}
 
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::MarkCovarianceKeyframeByStride(EKFState_T& state) {
+  const size_t stride = usercalc_.GetCovarianceKeyframeStride();
+  if (stride == 0)
+    return;
+  if (++statesSinceCovarianceKeyframe_ >= stride) {
+    state.covarianceKeyframe_ = true;
+    statesSinceCovarianceKeyframe_ = 0;
+  }
 }
 
 template<typename EKFState_T>
 void MSF_Core<EKFState_T>::Init(
     shared_ptr<MSF_MeasurementBase<EKFState_T> > measurement) {
 
+  std::lock_guard<std::recursive_mutex> lock(bufferMutex_);
+  WaitForCovarianceThread();
+
   initialized_ = false;
   predictionMade_ = false;
 
   usleep(100000);  // Hack, Hack, Hack, Hack thread sync.
 
   MeasurementBuffer_.Clear();
+  measurementIndex_.Clear();
   stateBuffer_.Clear();
   fuzzyTracker_.Reset();
+  composedTransition_.Reset();
 
   while (!queueFutureMeasurements_.empty())
     queueFutureMeasurements_.pop();
+  measurementBurst_.clear();
+  while (!deferredMeasurements_.empty())
+    deferredMeasurements_.pop();
+
+  // Preallocate the states, the pool keeps its slots over re-initialization.
+  statePool_.SetCapacity(usercalc_.GetStatePoolCapacity());
+  covariancePool_.SetCapacity(usercalc_.GetStatePoolCapacity());
+  if (usercalc_.GetImuPreintegrationStride() > 1) {
+    preintegrationPool_.SetCapacity(usercalc_.GetStatePoolCapacity());
+  }
+
+  usercalc_.PublishCoreParameters();
+  RefreshCoreParameters();
 
   // Push one state to the buffer to apply the init on.
-  shared_ptr<EKFState_T> state(new EKFState_T);
+  shared_ptr<EKFState_T> state = statePool_.Acquire();
+  if (!state) {
+    MSF_ERROR_STREAM("Could not allocate the initial state, the filter is not "
+                     "initialized.");
+    return;
+  }
   state->time = 0;  // Will be set by the measurement.
 
   // Reset new state to zero.
   boost::fusion::for_each(state->statevars, msf_tmp::ResetState());
 
   // Set intialial covariance for core states.
-  SetPCore(state->P);
+  AttachCovariance(*state);
+  state->covarianceKeyframe_ = true;
+  statesSinceCovarianceKeyframe_ = 0;
+  SetPCore(state->GetP());
 
   // Apply init measurement, where the user can provide additional values for P.
   measurement->Apply(state, *this);
+  CovarianceForm_T::FromP(*state);
 
   // Hack: Wait for the external propagation to get the init message.
   usleep(10000);
@@ -575,25 +1334,176 @@ void MSF_Core<EKFState_T>::Init(
   // Will be set upon first IMU message.
   time_P_propagated = state->time;
 
+  bufferHorizon_ = usercalc_.GetMaxBufferHorizon();
+  sensorDelayStatistics_.clear();
+
+  ConfigureSnapshots();
+  time_last_snapshot = state->time;
+
   MSF_INFO_STREAM("Initializing msf_core (built: " <<__DATE__<<")");
 
   // Echo params.
   MSF_INFO_STREAM(
       "Core parameters: "<<std::endl << "\tfixed_bias:\t" <<
-      usercalc_.GetParamFixedBias() << std::endl << "\tfuzzythres:\t" <<
-      usercalc_.GetParamFuzzyTrackingThreshold() << std::endl <<
-      "\tnoise_acc:\t" << usercalc_.GetParamNoiseAcc() << std::endl <<
-      "\tnoise_accbias:\t" << usercalc_.GetParamNoiseAccbias() << std::endl <<
-      "\tnoise_gyr:\t" << usercalc_.GetParamNoiseGyr() << std::endl <<
-      "\tnoise_gyrbias:\t" << usercalc_.GetParamNoiseGyrbias() << std::endl);
+      coreParameters_.fixed_bias << std::endl << "\tfuzzythres:\t" <<
+      coreParameters_.fuzzy_tracking_threshold << std::endl <<
+      "\tnoise_acc:\t" << coreParameters_.noise.n_a(0) << std::endl <<
+      "\tnoise_accbias:\t" << coreParameters_.noise.n_ba(0) << std::endl <<
+      "\tnoise_gyr:\t" << coreParameters_.noise.n_w(0) << std::endl <<
+      "\tnoise_gyrbias:\t" << coreParameters_.noise.n_bw(0) << std::endl <<
+      "\tstate_pool_capacity:\t" << statePool_.Capacity() << std::endl);
 
 
   MSF_INFO_STREAM("Core init with state: " << std::endl << state->Print());
   initialized_ = true;
+  StartCovarianceThread();
 
   msf_timing::Timing::Print(std::cout);
 }
 
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::ConfigureSnapshots() {
+  snapshotFile_ = usercalc_.GetSnapshotFile();
+  snapshotPeriod_ = usercalc_.GetSnapshotPeriod();
+}
+
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::CollectSnapshotIfDue(
+    std::vector<SnapshotRecord_T>* records) {
+  if (snapshotFile_.empty() || snapshotPeriod_ <= 0)
+    return;
+  if (NanosecondsToSeconds(time_P_propagated - time_last_snapshot)
+      < snapshotPeriod_)
+    return;
+  msf_timing::DebugTimer timer_snapshot("CollectSnapshot");
+  CollectSnapshot(records);
+}
+
+template<typename EKFState_T>
+bool MSF_Core<EKFState_T>::CollectSnapshot(
+    std::vector<SnapshotRecord_T>* records) {
+  typedef FilterSnapshot<EKFState_T> Snapshot_T;
+  std::lock_guard<std::recursive_mutex> lock(bufferMutex_);
+  WaitForCovarianceThread();
+  if (!initialized_ || stateBuffer_.Size() == 0)
+    return false;
+
+  // The covariance lags behind the latest states, so start at the state it was
+  // propagated to. This only reads the buffers, so it is safe on shutdown.
+  typename StateBuffer_T::iterator_T it = stateBuffer_.GetIteratorAtValue(
+      time_P_propagated, false);
+  if (it == stateBuffer_.GetIteratorEnd() || !it->second->HasCovariance())
+    return false;
+
+  records->clear();
+  for (; it != stateBuffer_.GetIteratorEnd(); ++it) {
+    records->resize(records->size() + 1);
+    Snapshot_T::ToRecord(*it->second, records->back());
+  }
+  time_last_snapshot = stateBuffer_.GetLast()->time;
+  return true;
+}
+
+template<typename EKFState_T>
+bool MSF_Core<EKFState_T>::WriteSnapshotRecords(
+    const std::string& filename, const std::vector<SnapshotRecord_T>& records) {
+  if (records.empty())
+    return true;
+  std::lock_guard<std::mutex> lock(snapshotMutex_);
+  msf_timing::DebugTimer timer_snapshot("WriteSnapshot");
+  return FilterSnapshot<EKFState_T>::Write(filename, records);
+}
+
+template<typename EKFState_T>
+bool MSF_Core<EKFState_T>::WriteSnapshot(const std::string& filename) {
+  std::vector<SnapshotRecord_T> records;
+  if (!CollectSnapshot(&records))
+    return false;
+  return WriteSnapshotRecords(filename, records);
+}
+
+template<typename EKFState_T>
+bool MSF_Core<EKFState_T>::RestoreFromSnapshot(const std::string& filename) {
+  typedef FilterSnapshot<EKFState_T> Snapshot_T;
+  std::vector<typename Snapshot_T::Record> records;
+  if (!Snapshot_T::Read(filename, records))
+    return false;
+  if (records.empty() || !(records[0].flags & Snapshot_T::kHasCovariance)) {
+    MSF_WARN_STREAM("The filter snapshot " << filename << " has no covariance");
+    return false;
+  }
+
+  std::lock_guard<std::recursive_mutex> lock(bufferMutex_);
+  WaitForCovarianceThread();
+
+  initialized_ = false;
+  predictionMade_ = false;
+
+  MeasurementBuffer_.Clear();
+  measurementIndex_.Clear();
+  stateBuffer_.Clear();
+  fuzzyTracker_.Reset();
+  composedTransition_.Reset();
+
+  while (!queueFutureMeasurements_.empty())
+    queueFutureMeasurements_.pop();
+  measurementBurst_.clear();
+  while (!deferredMeasurements_.empty())
+    deferredMeasurements_.pop();
+
+  statePool_.SetCapacity(usercalc_.GetStatePoolCapacity());
+  covariancePool_.SetCapacity(usercalc_.GetStatePoolCapacity());
+  if (usercalc_.GetImuPreintegrationStride() > 1) {
+    preintegrationPool_.SetCapacity(usercalc_.GetStatePoolCapacity());
+  }
+
+  usercalc_.PublishCoreParameters();
+  RefreshCoreParameters();
+
+  shared_ptr<EKFState_T> state;
+  for (size_t i = 0; i < records.size(); ++i) {
+    state = statePool_.Acquire();
+    if (!state) {
+      MSF_ERROR_STREAM("The filter snapshot " << filename << " has more states "
+                       "than the state pool can hold");
+      stateBuffer_.Clear();
+      return false;
+    }
+    if (records[i].flags & Snapshot_T::kHasCovariance) {
+      AttachCovariance(*state);
+    }
+    Snapshot_T::FromRecord(records[i], *state);
+    if (state->HasCovariance()) {
+      CovarianceForm_T::FromP(*state);
+    }
+    stateBuffer_.Insert(state);
+  }
+  time_P_propagated = records[0].time;
+
+  // Catch up with the covariance from the first state and keep the others, so
+  // the covariance of the states in between can be reconstructed from it.
+  stateBuffer_.GetFirst()->covarianceKeyframe_ = true;
+  state->covarianceKeyframe_ = true;
+  statesSinceCovarianceKeyframe_ = 0;
+  PropPToState(state);
+  it_last_IMU = stateBuffer_.GetIteratorAtValue(state);
+
+  bufferHorizon_ = usercalc_.GetMaxBufferHorizon();
+  sensorDelayStatistics_.clear();
+
+  ConfigureSnapshots();
+  time_last_snapshot = state->time;
+
+  usercalc_.PublishStateInitial(state);
+
+  MSF_INFO_STREAM(
+      "Restored msf_core from the snapshot " << filename << " with state: "
+      << std::endl << state->Print());
+  initialized_ = true;
+  StartCovarianceThread();
+  return true;
+}
+
 template<typename EKFState_T>
 void MSF_Core<EKFState_T>::AddMeasurement(
     shared_ptr<MSF_MeasurementBase<EKFState_T> > measurement) {
@@ -602,6 +1512,8 @@ void MSF_Core<EKFState_T>::AddMeasurement(
   if (!initialized_ || !predictionMade_)
     return;
 
+  std::lock_guard<std::recursive_mutex> lock(bufferMutex_);
+
   // Check if the measurement is in the future where we don't have imu
   // measurements yet.
   if (measurement->time > stateBuffer_.GetLast()->time) {
@@ -609,6 +1521,78 @@ void MSF_Core<EKFState_T>::AddMeasurement(
     return;
 
   }
+  // Also track measurements which are too old, so the buffers grow for them.
+  UpdateDelayStatistics(measurement);
+
+  // Applied together with the others arriving until the next IMU reading.
+  if (usercalc_.GetCoalesceMeasurements()) {
+    measurementBurst_.push_back(measurement);
+    return;
+  }
+
+  if (!CheckReplayBudget(measurement))
+    return;
+
+  typename measurementBufferT::iterator_T it_meas;
+  if (!InsertMeasurement(measurement, &it_meas))
+    return;
+  ApplyMeasurementsFrom(it_meas);
+}
+
+template<typename EKFState_T>
+bool MSF_Core<EKFState_T>::CheckReplayBudget(
+    shared_ptr<MSF_MeasurementBase<EKFState_T> >& measurement) {
+  const size_t maxmeasurements = usercalc_.GetMaxReplayMeasurements();
+  const size_t maxstates = usercalc_.GetMaxReplayStates();
+  if ((maxmeasurements == 0 && maxstates == 0)
+      || measurement->time < stateBuffer_.GetFirst()->time) {
+    return true;  // Too old measurements are rejected on insertion.
+  }
+
+  // Count the measurements to replay and the states to repropagate, only up
+  // to the budget.
+  size_t measurements = 1;
+  for (typename measurementBufferT::iterator_T it = MeasurementBuffer_
+      .GetIteratorAtValue(measurement->time, false);
+      it != MeasurementBuffer_.GetIteratorEnd()
+      && (maxmeasurements == 0 || measurements <= maxmeasurements); ++it) {
+    ++measurements;
+  }
+  size_t states = 0;
+  for (typename StateBuffer_T::iterator_T it = stateBuffer_.GetIteratorAtValue(
+      measurement->time, false); it != stateBuffer_.GetIteratorEnd()
+      && (maxstates == 0 || states <= maxstates); ++it) {
+    ++states;
+  }
+  if ((maxmeasurements == 0 || measurements <= maxmeasurements)
+      && (maxstates == 0 || states <= maxstates)) {
+    return true;
+  }
+
+  const double delay = NanosecondsToSeconds(
+      stateBuffer_.GetLast()->time - measurement->time);
+  switch (usercalc_.GetLateMeasurementStrategy()) {
+    case kDeferLateMeasurement:
+      MSF_WARN_STREAM_THROTTLE(
+          1, "Replaying the measurement of sensor " << measurement->sensorID_
+          << " delayed by " << delay << " s exceeds the replay budget, "
+          "deferring it.");
+      deferredMeasurements_.push(measurement);
+      return false;
+    case kDropLateMeasurement:
+      break;
+  }
+  MSF_WARN_STREAM_THROTTLE(
+      1, "Replaying the measurement of sensor " << measurement->sensorID_
+      << " delayed by " << delay << " s exceeds the replay budget, dropping "
+      "it.");
+  return false;
+}
+
+template<typename EKFState_T>
+bool MSF_Core<EKFState_T>::InsertMeasurement(
+    shared_ptr<MSF_MeasurementBase<EKFState_T> >& measurement,
+    typename measurementBufferT::iterator_T* it_meas) {
   // Check if there is still a state in the buffer for this message (too old).
   if (measurement->time < stateBuffer_.GetFirst()->time) {
     MSF_WARN_STREAM(
@@ -616,12 +1600,84 @@ void MSF_Core<EKFState_T>::AddMeasurement(
         "you sure your clocks are synced and delays compensated correctly? "
         "[measurement: "<<timehuman(measurement->time)<<" (s) first state in "
             "buffer: "<<timehuman(stateBuffer_.GetFirst()->time)<<" (s)]");
-    return;  // Reject measurements too far in the past.
+    return false;  // Reject measurements too far in the past.
   }
 
+  // From here on the covariance is needed, so let the covariance thread finish
+  // its step.
+  WaitForCovarianceThread();
+
   // Add this measurement to the buffer and get an iterator to it.
-  typename measurementBufferT::iterator_T it_meas =
-      MeasurementBuffer_.Insert(measurement);
+  *it_meas = MeasurementBuffer_.Insert(measurement);
+  if ((*it_meas)->second == measurement) {  // Not discarded as duplicate.
+    measurementIndex_.Insert(measurement);
+  }
+  return true;
+}
+
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::ApplyMeasurementBurst() {
+  std::lock_guard<std::recursive_mutex> lock(bufferMutex_);
+  if (measurementBurst_.empty())
+    return;
+  std::vector<shared_ptr<MSF_MeasurementBase<EKFState_T> > > burst;
+  burst.swap(measurementBurst_);
+  if (!initialized_ || !predictionMade_) {
+    MSF_WARN_STREAM(
+        "Dropping " << burst.size() << " coalesced measurements, the filter "
+        "is not initialized.");
+    return;
+  }
+
+  // Insert in the order of arrival and count the measurements each of them
+  // would have replayed on its own.
+  size_t separatereplays = 0;
+  size_t inserted = 0;
+  int64_t timeoldest = -1;
+  for (size_t i = 0; i < burst.size(); ++i) {
+    typename measurementBufferT::iterator_T it_meas;
+    if (!CheckReplayBudget(burst[i]) || !InsertMeasurement(burst[i], &it_meas))
+      continue;
+    ++inserted;
+    if (timeoldest == -1 || burst[i]->time < timeoldest) {
+      timeoldest = burst[i]->time;
+    }
+    for (; it_meas != MeasurementBuffer_.GetIteratorEnd(); ++it_meas) {
+      ++separatereplays;
+    }
+  }
+  if (inserted == 0)
+    return;
+
+  // One replay from the oldest measurement of the burst on.
+  typename measurementBufferT::iterator_T it_oldest = MeasurementBuffer_
+      .GetIteratorAtValue(timeoldest, false);
+  size_t replays = 0;
+  for (typename measurementBufferT::iterator_T it = it_oldest;
+      it != MeasurementBuffer_.GetIteratorEnd(); ++it) {
+    ++replays;
+  }
+  ApplyMeasurementsFrom(it_oldest);
+
+  if (inserted > 1) {
+    ++burstStatistics_.bursts;
+    burstStatistics_.measurements += inserted;
+    burstStatistics_.savedreplays += separatereplays - replays;
+    burstStatistics_.coalescedmeasurements += inserted - 1;
+    if (burstStatistics_.bursts % 100 == 1) {
+      MSF_INFO_STREAM(
+          "Applied " << burstStatistics_.measurements << " measurements in "
+          << burstStatistics_.bursts << " bursts so far, saving "
+          << burstStatistics_.savedreplays << " measurement replays. "
+          << burstStatistics_.coalescedmeasurements << " of them were applied "
+          "by the replay of another measurement of their burst.");
+    }
+  }
+}
+
+template<typename EKFState_T>
+void MSF_Core<EKFState_T>::ApplyMeasurementsFrom(
+    typename measurementBufferT::iterator_T it_meas) {
   // Get an iterator the the end of the measurement buffer.
   typename measurementBufferT::iterator_T it_meas_end = MeasurementBuffer_
       .GetIteratorEnd();
@@ -701,7 +1757,16 @@ void MSF_Core<EKFState_T>::AddMeasurement(
   // Now publish the best current estimate.
   shared_ptr<EKFState_T>& latestState = stateBuffer_.GetLast();
 
-  PropPToState(latestState);  // Get the latest covariance.
+  if (usercalc_.GetLazyRepropagation()) {
+    // Only the latest state gets its covariance, over the transitions from the
+    // last measurement composed into one. The states in between are left
+    // without covariance and reconstructed when they are read.
+    WaitForCovarianceThread();
+    ComposeCovariancePropagation(latestState, true,
+                                 std::numeric_limits<size_t>::max());
+  } else {
+    PropPToState(latestState);  // Get the latest covariance.
+  }
 
   usercalc_.PublishStateAfterUpdate(latestState);
 }
@@ -709,36 +1774,54 @@ void MSF_Core<EKFState_T>::AddMeasurement(
 template<typename EKFState_T>
 shared_ptr<msf_core::MSF_MeasurementBase<EKFState_T> >
 MSF_Core<EKFState_T>::GetPreviousMeasurement(
-    double time, int sensorID) {
-  typename measurementBufferT::iterator_T it = MeasurementBuffer_
-      .GetIteratorAtValue(time);
-  if (it->second->time != time) {
-    MSF_WARN_STREAM("GetPreviousMeasurement: Error invalid iterator at value");
+    int64_t time, int sensorID) {
+  shared_ptr<MSF_MeasurementBase<EKFState_T> > measurement =
+      measurementIndex_.GetPrevious(sensorID, time);
+  if (!measurement) {
+    MSF_WARN_STREAM("GetPreviousMeasurement: Error hit before begin");
     return MeasurementBuffer_.GetInvalid();
   }
-  --it;
-  typename measurementBufferT::iterator_T itbeforebegin = MeasurementBuffer_
-      .GetIteratorBeforeBegin();
-  while (it != itbeforebegin
-      && (it->second->time != time && it->second->sensorID_ != sensorID)) {
-    --it;
-  }
-  if (it == itbeforebegin) {
-    MSF_WARN_STREAM("GetPreviousMeasurement: Error hit before begin");
+  return measurement;
+}
+
+template<typename EKFState_T>
+shared_ptr<msf_core::MSF_MeasurementBase<EKFState_T> >
+MSF_Core<EKFState_T>::GetNextMeasurement(
+    int64_t time, int sensorID) {
+  shared_ptr<MSF_MeasurementBase<EKFState_T> > measurement =
+      measurementIndex_.GetNext(sensorID, time);
+  if (!measurement) {
     return MeasurementBuffer_.GetInvalid();
   }
-  return it->second;
+  return measurement;
 }
 
 template<typename EKFState_T>
-shared_ptr<EKFState_T> MSF_Core<EKFState_T>::GetStateAtTime(double tstamp) {
-  return stateBuffer_.GetValueAt(tstamp);
+size_t MSF_Core<EKFState_T>::GetMeasurementsInRange(
+    int64_t timefrom, int64_t timeto, int sensorID,
+    std::vector<shared_ptr<msf_core::MSF_MeasurementBase<EKFState_T> > >&
+        measurements) {
+  return measurementIndex_.GetRange(sensorID, timefrom, timeto, measurements);
 }
 
 template<typename EKFState_T>
-shared_ptr<EKFState_T> MSF_Core<EKFState_T>::GetClosestState(double tstamp) {
+shared_ptr<EKFState_T> MSF_Core<EKFState_T>::GetStateAtTime(int64_t tstamp) {
+  std::lock_guard<std::recursive_mutex> lock(bufferMutex_);
+  shared_ptr<EKFState_T> state = stateBuffer_.GetValueAt(tstamp);
+  // A lazy update leaves the states before the latest one without covariance.
+  if (state->time != -1 && usercalc_.GetLazyRepropagation()) {
+    PropPToState(state);
+    if (!state->HasCovariance()) {
+      ReconstructCovariance(state);
+    }
+  }
+  return state;
+}
 
-  double timenow = tstamp;  // Delay compensated by sensor handler.
+template<typename EKFState_T>
+shared_ptr<EKFState_T> MSF_Core<EKFState_T>::GetClosestState(int64_t tstamp) {
+
+  int64_t timenow = tstamp;  // Delay compensated by sensor handler.
 
   typename StateBuffer_T::iterator_T it = stateBuffer_.GetIteratorClosest(
       timenow);
@@ -746,7 +1829,8 @@ shared_ptr<EKFState_T> MSF_Core<EKFState_T>::GetClosestState(double tstamp) {
   shared_ptr<EKFState_T> closestState = it->second;
   // Check if the state really is close to the requested time.
   // With the new buffer this might not be given.
-  if (closestState->time == -1 || fabs(closestState->time - timenow) > 0.1) {
+  if (closestState->time == -1
+      || fabs(NanosecondsToSeconds(closestState->time - timenow)) > 0.1) {
     MSF_ERROR_STREAM(
         __FUNCTION__<< " Requested closest state to "<<timehuman(timenow)<<" but "
         "there was no suitable state in the map");
@@ -755,7 +1839,8 @@ shared_ptr<EKFState_T> MSF_Core<EKFState_T>::GetClosestState(double tstamp) {
   }
 
   // Do state interpolation if state is too far away from the measurement.
-  double tdiff = fabs(closestState->time - timenow);  // Timediff to closest state.
+  // Timediff to closest state.
+  double tdiff = fabs(NanosecondsToSeconds(closestState->time - timenow));
   // If time diff too large, insert new state and do state interpolation.
   if (tdiff > 0.001) {
     shared_ptr<EKFState_T> lastState = stateBuffer_.GetClosestBefore(timenow);
@@ -766,38 +1851,71 @@ shared_ptr<EKFState_T> MSF_Core<EKFState_T>::GetClosestState(double tstamp) {
         && nextState->CheckStateForNumeric();
     bool statesnotsame = lastState->time != nextState->time;
 
-    // If one of the states is invalid, we don't do interpolation, but just
-    // take closest.
+    // Prepare a new state.
+    shared_ptr<EKFState_T> currentState;
     if (statevalid && statenotnan && statesnotsame) {
+      currentState = statePool_.Acquire();
+    }
 
-      // Prepare a new state.
-      shared_ptr<EKFState_T> currentState(new EKFState_T);
+    // If one of the states is invalid or the pool is exhausted, we don't do
+    // interpolation, but just take closest.
+    if (currentState) {
       currentState->time = timenow;  // Set state time to measurement time.
-      // Linearly interpolate imu readings.
-      currentState->a_m = lastState->a_m
-          + (nextState->a_m - lastState->a_m)
-              / (nextState->time - lastState->time)
-              * (timenow - lastState->time);
-      currentState->w_m = lastState->w_m
-          + (nextState->w_m - lastState->w_m)
-              / (nextState->time - lastState->time)
-              * (timenow - lastState->time);
+      bool split = false;
+      if (!nextState->GetPreintegration().Empty()) {
+        // Take the readings up to now from the preintegrated readings of the
+        // next state.
+        RefreshCoreParameters();
+        AttachPreintegration(*currentState);
+        split = nextState->MutablePreintegration().Split(
+            timenow, coreParameters_.noise,
+            &currentState->MutablePreintegration());
+        if (split) {
+          currentState->a_m = currentState->GetPreintegration().Back().a_m;
+          currentState->w_m = currentState->GetPreintegration().Back().w_m;
+        } else {
+          // The time is not within the readings of the next state, so it is
+          // propagated from the new state over its latest reading instead.
+          currentState->ReleasePreintegration();
+          nextState->ReleasePreintegration();
+        }
+      }
+      if (!split) {
+        // Linearly interpolate imu readings.
+        const Scalar_T dtstates = NanosecondsToSeconds(
+            nextState->time - lastState->time);
+        const Scalar_T dtnow = NanosecondsToSeconds(timenow - lastState->time);
+        currentState->a_m = lastState->a_m
+            + (nextState->a_m - lastState->a_m) / dtstates * dtnow;
+        currentState->w_m = lastState->w_m
+            + (nextState->w_m - lastState->w_m) / dtstates * dtnow;
+      }
 
       // Propagate with respective dt.
       PropagateState(lastState, currentState);
 
       stateBuffer_.Insert(currentState);
+      // Out of order inserts may move newer states inside the buffer, so the
+      // cached iterator to the last IMU state is looked up again.
+      it_last_IMU = stateBuffer_.GetIteratorEnd();
 
       // Make sure we propagate P correctly to the new state.
       if (time_P_propagated > lastState->time) {
         time_P_propagated = lastState->time;
       }
+      // The composed transition must not skip the new state.
+      if (time_P_composed > lastState->time) {
+        composedTransition_.Reset();
+      }
 
       closestState = currentState;
     }
   }
   // Catch up with covariance propagation if necessary.
   PropPToState(closestState);
+  if (!closestState->HasCovariance()) {
+    ReconstructCovariance(closestState);
+  }
 
   if (!closestState->CheckStateForNumeric()) {
     MSF_ERROR_STREAM(
@@ -805,17 +1923,17 @@ shared_ptr<EKFState_T> MSF_Core<EKFState_T>::GetClosestState(double tstamp) {
     return stateBuffer_.GetInvalid();  // Early abort.
   }
 
-  static int janitorRun = 0;
-  if (janitorRun++ > 100) {
-    // Remove very old states and measurements from the buffers.
-    CleanUpBuffers();
-    janitorRun = 0;
-  }
   return closestState;
 }
 
 template<typename EKFState_T>
 void MSF_Core<EKFState_T>::PropPToState(shared_ptr<EKFState_T>& state) {
+  WaitForCovarianceThread();
+  if (usercalc_.GetCovariancePropagationDecimation() > 1) {
+    ComposeCovariancePropagation(
+        state, true, usercalc_.GetCovariancePropagationDecimation());
+    return;
+  }
   // Propagate cov matrix until the current states time.
   typename StateBuffer_T::iterator_T it = stateBuffer_.GetIteratorAtValue(
       time_P_propagated, false);
@@ -840,7 +1958,8 @@ bool MSF_Core<EKFState_T>::ApplyCorrection(shared_ptr<EKFState_T>& delaystate,
   usercalc_.AugmentCorrectionVector(correction);
 
   // Now augment core states.
-  if (usercalc_.GetParamFixedBias()) {
+  RefreshCoreParameters();
+  if (coreParameters_.fixed_bias) {
     typedef typename msf_tmp::GetEnumStateType<StateSequence_T,
         StateDefinition_T::b_a>::value b_a_type;
     typedef typename msf_tmp::GetEnumStateType<StateSequence_T,
@@ -876,8 +1995,24 @@ bool MSF_Core<EKFState_T>::ApplyCorrection(shared_ptr<EKFState_T>& delaystate,
 
   // State update:
   // TODO(slynen) What to do with attitude? Augment measurement noise?
-  // Store old values in case of fuzzy tracking.
-  EKFState_T buffstate = *delaystate;
+  // Store old values in case of fuzzy tracking. Rolling back only needs the
+  // state variables, so leave out the covariance related matrices.
+  EKFState_T buffstate;
+  buffstate.CopyStateVariables(*delaystate);
+
+  // The transition from the previous state was computed with the uncorrected
+  // state, keep it instead of recomputing it from the corrected one.
+  if (!KeepsCovarianceOfAllStates()) {
+    typename StateBuffer_T::iterator_T itprev = stateBuffer_.GetIteratorAtValue(
+        delaystate);
+    if (itprev != stateBuffer_.GetIteratorBegin()) {
+      --itprev;
+      if (!itprev->second->HasCovariance()) {
+        ReconstructCovariance(itprev->second);
+      }
+      itprev->second->covarianceKeyframe_ = true;
+    }
+  }
 
   // Call correction function for every state.
   delaystate->Correct(correction);
@@ -894,6 +2029,9 @@ bool MSF_Core<EKFState_T>::ApplyCorrection(shared_ptr<EKFState_T>& delaystate,
 
   // Set time latest propagated, we need to repropagate at least from here.
   time_P_propagated = delaystate->time;
+  composedTransition_.Reset();
+  // Keep the covariance at states measurements were applied to.
+  delaystate->covarianceKeyframe_ = true;
 
   return 1;
 }
@@ -33,30 +33,35 @@ void MSF_MeasurementBase<EKFState_T>::CalculateAndApplyCorrection(
     shared_ptr<EKFState_T> state, MSF_Core<EKFState_T>& core,
     const Eigen::MatrixBase<H_type>& H_delayed,
     const Eigen::MatrixBase<Res_type> & res_delayed,
-    const Eigen::MatrixBase<R_type>& R_delayed) {
+    const Eigen::MatrixBase<R_type>& R_delayed, CovarianceUpdateForm form) {
 
   EIGEN_STATIC_ASSERT_FIXED_SIZE (H_type);
   EIGEN_STATIC_ASSERT_FIXED_SIZE (R_type);
+  typedef typename EKFState_T::Scalar_T Scalar_T;
 
   // Get measurements.
   /// Correction from EKF update.
-  Eigen::Matrix<double, MSF_Core<EKFState_T>::nErrorStatesAtCompileTime, 1> correction_;
-
-  R_type S;
-  Eigen::Matrix<double, MSF_Core<EKFState_T>::nErrorStatesAtCompileTime,
-      R_type::RowsAtCompileTime> K;
-  typename MSF_Core<EKFState_T>::ErrorStateCov & P = state->P;
-
-  S = H_delayed * P * H_delayed.transpose() + R_delayed;
-  K = P * H_delayed.transpose() * S.inverse();
+  Eigen::Matrix<Scalar_T, MSF_Core<EKFState_T>::nErrorStatesAtCompileTime, 1> correction_;
+
+  if (IsDiagonalCovariance(R_delayed)) {
+    // Uncorrelated rows are applied as scalar updates.
+    MSF_Core<EKFState_T>::CovarianceForm_T::template UpdateSequential<
+        DenseJacobian<MSF_Core<EKFState_T>::nErrorStatesAtCompileTime> >(
+        *state, H_delayed.template cast<Scalar_T>(),
+        R_delayed.template cast<Scalar_T>(),
+        res_delayed.template cast<Scalar_T>(), correction_, form);
+  } else {
+    Eigen::Matrix<Scalar_T, MSF_Core<EKFState_T>::nErrorStatesAtCompileTime,
+        R_type::RowsAtCompileTime> K;
 
-  correction_ = K * res_delayed;
-  const typename MSF_Core<EKFState_T>::ErrorStateCov KH =
-      (MSF_Core<EKFState_T>::ErrorStateCov::Identity() - K * H_delayed);
-  P = KH * P * KH.transpose() + K * R_delayed * K.transpose();
+    // Computes K and updates the covariance in the form of the state type. The
+    // measurement may be given in another scalar than the state.
+    MSF_Core<EKFState_T>::CovarianceForm_T::Update(
+        *state, H_delayed.template cast<Scalar_T>(),
+        R_delayed.template cast<Scalar_T>(), K);
 
-  // Make sure P stays symmetric.
-  P = 0.5 * (P + P.transpose());
+    correction_ = K * res_delayed.template cast<Scalar_T>();
+  }
 
   core.ApplyCorrection(state, correction_);
 }
@@ -65,28 +70,69 @@ template<typename EKFState_T>
 void MSF_MeasurementBase<EKFState_T>::CalculateAndApplyCorrection(
     shared_ptr<EKFState_T> state, MSF_Core<EKFState_T>& core,
     const Eigen::MatrixXd& H_delayed, const Eigen::MatrixXd & res_delayed,
-    const Eigen::MatrixXd& R_delayed) {
+    const Eigen::MatrixXd& R_delayed, CovarianceUpdateForm form) {
+  typedef typename EKFState_T::Scalar_T Scalar_T;
 
   // Get measurements.
   /// Correction from EKF update.
-  Eigen::Matrix<double, MSF_Core<EKFState_T>::nErrorStatesAtCompileTime, 1> correction_;
+  Eigen::Matrix<Scalar_T, MSF_Core<EKFState_T>::nErrorStatesAtCompileTime, 1> correction_;
+
+  if (IsDiagonalCovariance(R_delayed)) {
+    // Uncorrelated rows are applied as scalar updates, which needs no
+    // temporaries of the size of the measurement.
+    MSF_Core<EKFState_T>::CovarianceForm_T::template UpdateSequential<
+        DenseJacobian<MSF_Core<EKFState_T>::nErrorStatesAtCompileTime> >(
+        *state, H_delayed.template cast<Scalar_T>(),
+        R_delayed.template cast<Scalar_T>(),
+        res_delayed.template cast<Scalar_T>(), correction_, form);
+  } else {
+    Eigen::Matrix<Scalar_T, Eigen::Dynamic, Eigen::Dynamic> K(
+        static_cast<int>(MSF_Core<EKFState_T>::nErrorStatesAtCompileTime),
+        R_delayed.rows());
 
-  Eigen::MatrixXd S;
-  Eigen::MatrixXd K(
-      static_cast<int>(MSF_Core<EKFState_T>::nErrorStatesAtCompileTime),
-      R_delayed.rows());
-  typename MSF_Core<EKFState_T>::ErrorStateCov & P = state->P;
+    // Computes K and updates the covariance in the form of the state type.
+    MSF_Core<EKFState_T>::CovarianceForm_T::Update(
+        *state, H_delayed.template cast<Scalar_T>(),
+        R_delayed.template cast<Scalar_T>(), K);
 
-  S = H_delayed * P * H_delayed.transpose() + R_delayed;
-  K = P * H_delayed.transpose() * S.inverse();
+    correction_ = K * res_delayed.template cast<Scalar_T>();
+  }
 
-  correction_ = K * res_delayed;
-  const typename MSF_Core<EKFState_T>::ErrorStateCov KH =
-      (MSF_Core<EKFState_T>::ErrorStateCov::Identity() - K * H_delayed);
-  P = KH * P * KH.transpose() + K * R_delayed * K.transpose();
+  core.ApplyCorrection(state, correction_);
+}
 
-  // Make sure P stays symmetric.
-  P = 0.5 * (P + P.transpose());
+template<typename EKFState_T>
+template<class HBlocks_T, class H_type, class Res_type, class R_type>
+void MSF_MeasurementBase<EKFState_T>::CalculateAndApplyCorrection(
+    shared_ptr<EKFState_T> state, MSF_Core<EKFState_T>& core,
+    const Eigen::MatrixBase<H_type>& H_delayed,
+    const Eigen::MatrixBase<Res_type> & res_delayed,
+    const Eigen::MatrixBase<R_type>& R_delayed,
+    const HBlocks_T& UNUSEDPARAM(hblocks), CovarianceUpdateForm form) {
+
+  EIGEN_STATIC_ASSERT_FIXED_SIZE (H_type);
+  EIGEN_STATIC_ASSERT_FIXED_SIZE (R_type);
+  typedef typename EKFState_T::Scalar_T Scalar_T;
+
+  /// Correction from EKF update.
+  Eigen::Matrix<Scalar_T, MSF_Core<EKFState_T>::nErrorStatesAtCompileTime, 1> correction_;
+
+  if (IsDiagonalCovariance(R_delayed)) {
+    // Uncorrelated rows are applied as scalar updates.
+    MSF_Core<EKFState_T>::CovarianceForm_T::template UpdateSequential<
+        HBlocks_T>(*state, H_delayed.template cast<Scalar_T>(),
+                   R_delayed.template cast<Scalar_T>(),
+                   res_delayed.template cast<Scalar_T>(), correction_, form);
+  } else {
+    Eigen::Matrix<Scalar_T, MSF_Core<EKFState_T>::nErrorStatesAtCompileTime,
+        R_type::RowsAtCompileTime> K;
+
+    MSF_Core<EKFState_T>::CovarianceForm_T::template UpdateSparse<HBlocks_T>(
+        *state, H_delayed.template cast<Scalar_T>(),
+        R_delayed.template cast<Scalar_T>(), K, form);
+
+    correction_ = K * res_delayed.template cast<Scalar_T>();
+  }
 
   core.ApplyCorrection(state, correction_);
 }
@@ -102,17 +148,18 @@ void MSF_MeasurementBase<EKFState_T>::CalculateAndApplyCorrectionRelative(
 
   EIGEN_STATIC_ASSERT_FIXED_SIZE (H_type);
   EIGEN_STATIC_ASSERT_FIXED_SIZE (R_type);
+  typedef typename EKFState_T::Scalar_T Scalar_T;
 
   // Get measurements.
   /// Correction from EKF update.
-  Eigen::Matrix<double, MSF_Core<EKFState_T>::nErrorStatesAtCompileTime, 1> correction_;
+  Eigen::Matrix<Scalar_T, MSF_Core<EKFState_T>::nErrorStatesAtCompileTime, 1> correction_;
 
   enum {
     Pdim = MSF_Core<EKFState_T>::nErrorStatesAtCompileTime
   };
 
   // Get the accumulated system dynamics.
-  Eigen::Matrix<double, Pdim, Pdim> F_accum;
+  Eigen::Matrix<Scalar_T, Pdim, Pdim> F_accum;
   core.GetAccumulatedStateTransitionStochasticCloning(state_old, state_new, F_accum);
 
   /*[
@@ -120,47 +167,48 @@ void MSF_MeasurementBase<EKFState_T>::CalculateAndApplyCorrectionRelative(
    * P_SC = |                      |
    *        | F * P_kk   P_mk      |
    */
-  Eigen::Matrix<double, 2 * Pdim, 2 * Pdim> P_SC;
-  P_SC.template block<Pdim, Pdim>(0, 0) = state_old->P;
+  Eigen::Matrix<Scalar_T, 2 * Pdim, 2 * Pdim> P_SC;
+  const typename EKFState_T::P_type& P_old =
+      const_cast<const EKFState_T&>(*state_old).GetP();
+  P_SC.template block<Pdim, Pdim>(0, 0) = P_old;
   // According to TRO paper, ICRA paper has a mistake here.
-  P_SC.template block<Pdim, Pdim>(0, Pdim) = state_old->P * F_accum.transpose();
-  P_SC.template block<Pdim, Pdim>(Pdim, 0) = F_accum * state_old->P;
-  P_SC.template block<Pdim, Pdim>(Pdim, Pdim) = state_new->P;
+  P_SC.template block<Pdim, Pdim>(0, Pdim) = P_old * F_accum.transpose();
+  P_SC.template block<Pdim, Pdim>(Pdim, 0) = F_accum * P_old;
+  P_SC.template block<Pdim, Pdim>(Pdim, Pdim) = state_new->GetP();
 
   /*
    * H_SC = [H_kk  H_mk]
    */
-  Eigen::Matrix<double, H_type::RowsAtCompileTime, H_type::ColsAtCompileTime * 2> H_SC;
+  Eigen::Matrix<Scalar_T, H_type::RowsAtCompileTime, H_type::ColsAtCompileTime * 2> H_SC;
 
   H_SC.template block<H_type::RowsAtCompileTime, H_type::ColsAtCompileTime>(0,
                                                                             0) =
-      H_old;
+      H_old.template cast<Scalar_T>();
   H_SC.template block<H_type::RowsAtCompileTime, H_type::ColsAtCompileTime>(
-      0, H_type::ColsAtCompileTime) = H_new;
-
-  R_type S_SC;
-  S_SC = H_SC * P_SC * H_SC.transpose() + R;
+      0, H_type::ColsAtCompileTime) = H_new.template cast<Scalar_T>();
 
-  //TODO (slynen): Only compute the part of K_SC that we need.
-  Eigen::Matrix<double, MSF_Core<EKFState_T>::nErrorStatesAtCompileTime * 2,
-      R_type::RowsAtCompileTime> K_SC;
-  K_SC = P_SC * H_SC.transpose() * S_SC.inverse();
+  Eigen::Matrix<Scalar_T, R_type::RowsAtCompileTime, R_type::ColsAtCompileTime>
+      S_SC;
+  S_SC = H_SC * P_SC * H_SC.transpose() + R.template cast<Scalar_T>();
 
-  Eigen::Matrix<double, MSF_Core<EKFState_T>::nErrorStatesAtCompileTime,
+  // Only the gain of the current state is needed, the rows of the clone are
+  // dropped.
+  Eigen::Matrix<Scalar_T, MSF_Core<EKFState_T>::nErrorStatesAtCompileTime,
       R_type::RowsAtCompileTime> K;
-  K = K_SC
-      .template block<MSF_Core<EKFState_T>::nErrorStatesAtCompileTime,
-          R_type::RowsAtCompileTime>(
-      MSF_Core<EKFState_T>::nErrorStatesAtCompileTime, 0);
+  SolveKalmanGain(
+      S_SC, P_SC.template bottomRows<Pdim>() * H_SC.transpose(), K);
 
-  correction_ = K * res;
+  correction_ = K * res.template cast<Scalar_T>();
 
-  typename MSF_Core<EKFState_T>::ErrorStateCov & P = state_new->P;
+  typename MSF_Core<EKFState_T>::ErrorStateCov & P = state_new->GetP();
   P = P - K * S_SC * K.transpose();
 
   // Make sure P stays symmetric.
   // TODO (slynen): EV, set Evalues<eps to zero, then reconstruct.
-  state_new->P = 0.5 * (state_new->P + state_new->P.transpose());
+  P = 0.5 * (P + P.transpose()).eval();
+  // The square root form can not downdate its square root by the cross
+  // covariance of the clone, so it factorizes the updated P.
+  MSF_Core<EKFState_T>::CovarianceForm_T::FromP(*state_new);
 
   core.ApplyCorrection(state_new, correction_);
 }
@@ -175,8 +223,10 @@ void MSF_InitMeasurement<EKFState_T>::Apply(
   boost::fusion::for_each(stateWithCovariance->statevars,
                           msf_tmp::CopyInitStates<EKFState_T>(InitState));
 
-  if (!(InitState.P.minCoeff() == 0 && InitState.P.maxCoeff() == 0)) {
-    stateWithCovariance->P = InitState.P;
+  const typename EKFState_T::P_type& P_init =
+      const_cast<const EKFState_T&>(InitState).GetP();
+  if (!(P_init.minCoeff() == 0 && P_init.maxCoeff() == 0)) {
+    stateWithCovariance->GetP() = P_init;
     MSF_WARN_STREAM("Using user defined initial error state covariance.");
   } else {
     MSF_WARN_STREAM(
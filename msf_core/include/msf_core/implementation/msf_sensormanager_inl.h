@@ -25,8 +25,39 @@ template<typename EKFState_T>
 MSF_SensorManager<EKFState_T>::MSF_SensorManager() {
   sensorID_ = 0;
   data_playback_ = false;
+  state_pool_capacity_ = 0;
+  max_buffer_horizon_ = 60;  // 1 min.
+  buffer_horizon_margin_ = 0.1;
+  covariance_keyframe_stride_ = 0;
+  covariance_propagation_decimation_ = 1;
+  imu_preintegration_stride_ = 1;
+  covariance_propagation_thread_ = false;
+  lazy_repropagation_ = false;
+  coalesce_measurements_ = false;
+  max_replay_measurements_ = 0;
+  max_replay_states_ = 0;
+  late_measurement_strategy_ = "drop";
+  imu_batch_publish_decimation_ = 0;
+  snapshot_period_ = 0;
   //TODO (slynen): Make this a (better) design. This is so aweful.
   msf_core_.reset(new msf_core::MSF_Core<EKFState_T>(*this));
 }
+
+template<typename EKFState_T>
+bool MSF_SensorManager<EKFState_T>::RestoreFromSnapshot() {
+  if (snapshot_file_.empty())
+    return false;
+  return msf_core_->RestoreFromSnapshot(snapshot_file_);
+}
+
+template<typename EKFState_T>
+void MSF_SensorManager<EKFState_T>::PublishCoreParameters() const {
+  CoreParameters parameters;
+  parameters.fixed_bias = GetParamFixedBias();
+  parameters.fuzzy_tracking_threshold = GetParamFuzzyTrackingThreshold();
+  parameters.SetNoise(GetParamNoiseAcc(), GetParamNoiseAccbias(),
+                      GetParamNoiseGyr(), GetParamNoiseGyrbias());
+  core_parameters_.Publish(parameters);
+}
 }  // namespace msf_core
 #endif  // MSF_SENSORHANDLER_INL_H_
@@ -22,6 +22,7 @@
 #include <msf_core/msf_tmp.h>
 #include <Eigen/Dense>
 #include <Eigen/Geometry>
+#include <cassert>
 #include <vector>
 #include <msf_core/eigen_conversions.h>
 #include <sensor_fusion_comm/ExtState.h>
@@ -66,11 +67,11 @@ GenericState_T<stateVector_T, StateDefinition_T>::Get() {
 // Apply the correction vector to all state vars.
 template<typename stateVector_T, typename StateDefinition_T>
 inline void GenericState_T<stateVector_T, StateDefinition_T>::Correct(
-    const Eigen::Matrix<double, nErrorStatesAtCompileTime, 1>& correction) {
+    const Eigen::Matrix<Scalar_T, nErrorStatesAtCompileTime, 1>& correction) {
   boost::fusion::for_each(
       statevars,
       msf_tmp::CorrectState<
-          const Eigen::Matrix<double, nErrorStatesAtCompileTime, 1>,
+          const Eigen::Matrix<Scalar_T, nErrorStatesAtCompileTime, 1>,
           stateVector_T>(correction));
 }
 
@@ -156,17 +157,17 @@ void GenericState_T<stateVector_T, StateDefinition_T>::ToCoreStateMsg(
 }
 
 template<typename stateVector_T, typename StateDefinition_T>
-Eigen::Matrix<double,
+Eigen::Matrix<typename GenericState_T<stateVector_T, StateDefinition_T>::Scalar_T,
     GenericState_T<stateVector_T,
                    StateDefinition_T>::nCoreStatesAtCompileTime,1>
 GenericState_T<stateVector_T, StateDefinition_T>::ToEigenVector() {
-  Eigen::Matrix<double,
+  Eigen::Matrix<Scalar_T,
       GenericState_T<stateVector_T, StateDefinition_T>::nCoreStatesAtCompileTime,
       1> data;
   boost::fusion::for_each(
       statevars,
       msf_tmp::CoreStatetoDoubleArray<
-          typename Eigen::Matrix<double,
+          typename Eigen::Matrix<Scalar_T,
               GenericState_T<stateVector_T,
                              StateDefinition_T>::nCoreStatesAtCompileTime, 1>,
                              stateVector_T>(data));
@@ -197,13 +198,13 @@ std::string GenericState_T<stateVector_T, StateDefinition_T>::Print() {
 
 template<typename stateVector_T, typename StateDefinition_T>
 bool GenericState_T<stateVector_T, StateDefinition_T>::CheckStateForNumeric() {
-  Eigen::Matrix<double,
+  Eigen::Matrix<Scalar_T,
       GenericState_T<stateVector_T,
                      StateDefinition_T>::nCoreStatesAtCompileTime, 1> data;
   boost::fusion::for_each(
       statevars,
       msf_tmp::CoreStatetoDoubleArray<
-          typename Eigen::Matrix<double,
+          typename Eigen::Matrix<Scalar_T,
               GenericState_T<stateVector_T, StateDefinition_T>::nCoreStatesAtCompileTime,
               1>, stateVector_T>(data));
 
@@ -256,6 +257,132 @@ inline void GenericState_T<stateVector_T, StateDefinition_T>::Set(
   boost::fusion::at < boost::mpl::int_<INDEX> > (statevars).state_ = newvalue;
 }
 
+template<typename stateVector_T, typename StateDefinition_T>
+GenericState_T<stateVector_T, StateDefinition_T>::GenericState_T(
+    const GenericState_T& other)
+    : statevars(other.statevars),
+      w_m(other.w_m),
+      a_m(other.a_m),
+      time(other.time),
+      covarianceKeyframe_(other.covarianceKeyframe_) {
+  if (other.covariance_) {
+    AllocateCovariance();
+    *covariance_ = *other.covariance_;
+  }
+  if (other.preintegration_) {
+    preintegration_.reset(new Preintegration_T(*other.preintegration_));
+  }
+}
+
+template<typename stateVector_T, typename StateDefinition_T>
+GenericState_T<stateVector_T, StateDefinition_T>&
+GenericState_T<stateVector_T, StateDefinition_T>::operator=(
+    const GenericState_T& other) {
+  if (this == &other) {
+    return *this;
+  }
+  statevars = other.statevars;
+  w_m = other.w_m;
+  a_m = other.a_m;
+  time = other.time;
+  covarianceKeyframe_ = other.covarianceKeyframe_;
+  if (other.covariance_) {
+    // Reuse the storage we have.
+    if (!covariance_) {
+      AllocateCovariance();
+    }
+    *covariance_ = *other.covariance_;
+  } else {
+    covariance_.reset();
+  }
+  if (other.preintegration_) {
+    if (!preintegration_) {
+      preintegration_.reset(new Preintegration_T);
+    }
+    *preintegration_ = *other.preintegration_;
+  } else {
+    preintegration_.reset();
+  }
+  return *this;
+}
+
+template<typename stateVector_T, typename StateDefinition_T>
+void GenericState_T<stateVector_T, StateDefinition_T>::CopyStateVariables(
+    const GenericState_T& other) {
+  statevars = other.statevars;
+  w_m = other.w_m;
+  a_m = other.a_m;
+  time = other.time;
+}
+
+template<typename stateVector_T, typename StateDefinition_T>
+inline typename GenericState_T<stateVector_T, StateDefinition_T>::Covariance_T&
+GenericState_T<stateVector_T, StateDefinition_T>::MutableCovariance() {
+  assert(covariance_ && "Attach the covariance storage before writing to it.");
+  if (!covariance_) {
+    MSF_ERROR_STREAM(
+        "Write access to the covariance of the state at " << timehuman(time)
+        << ", which has no covariance storage. The core attaches it by "
+        "MSF_Core::AttachCovariance before.");
+    AllocateCovariance();
+  }
+  return *covariance_;
+}
+
+template<typename stateVector_T, typename StateDefinition_T>
+const typename GenericState_T<stateVector_T, StateDefinition_T>::Covariance_T&
+GenericState_T<stateVector_T, StateDefinition_T>::DefaultCovariance() {
+  static const Covariance_T defaultcovariance;
+  return defaultcovariance;
+}
+
+template<typename stateVector_T, typename StateDefinition_T>
+void GenericState_T<stateVector_T, StateDefinition_T>::SetCovarianceStorage(
+    const shared_ptr<Covariance_T>& covariance) {
+  if (covariance_ && covariance) {
+    *covariance = *covariance_;
+  }
+  covariance_ = covariance;
+}
+
+template<typename stateVector_T, typename StateDefinition_T>
+void GenericState_T<stateVector_T, StateDefinition_T>::AllocateCovariance() {
+  covariance_.reset(new Covariance_T);
+}
+
+template<typename stateVector_T, typename StateDefinition_T>
+inline typename GenericState_T<stateVector_T, StateDefinition_T>::
+    Preintegration_T&
+GenericState_T<stateVector_T, StateDefinition_T>::MutablePreintegration() {
+  assert(preintegration_ &&
+         "Attach the preintegration storage before writing to it.");
+  if (!preintegration_) {
+    MSF_ERROR_STREAM(
+        "Write access to the preintegrated readings of the state at "
+        << timehuman(time) << ", which has no storage for them. The core "
+        "attaches it by MSF_Core::AttachPreintegration before.");
+    preintegration_.reset(new Preintegration_T);
+  }
+  return *preintegration_;
+}
+
+template<typename stateVector_T, typename StateDefinition_T>
+const typename GenericState_T<stateVector_T, StateDefinition_T>::
+    Preintegration_T&
+GenericState_T<stateVector_T, StateDefinition_T>::DefaultPreintegration() {
+  static const Preintegration_T defaultpreintegration;
+  return defaultpreintegration;
+}
+
+template<typename stateVector_T, typename StateDefinition_T>
+void GenericState_T<stateVector_T, StateDefinition_T>::SetPreintegrationStorage(
+    const shared_ptr<Preintegration_T>& preintegration) {
+  if (preintegration_ && preintegration) {
+    *preintegration = *preintegration_;
+  }
+  preintegration_ = preintegration;
+}
+
 template<typename stateVector_T, typename StateDefinition_T>
 template<int INDEX>
 inline void GenericState_T<stateVector_T, StateDefinition_T>::ClearCrossCov() {
@@ -268,8 +395,9 @@ inline void GenericState_T<stateVector_T, StateDefinition_T>::ClearCrossCov() {
         msf_tmp::CorrectionStateLengthForType>::value,
     lengthInState = StateVar_T::sizeInCorrection_
   };
+  P_type& P = GetP();
   // Save covariance block.
-  Eigen::Matrix<double, lengthInState, lengthInState> cov = P
+  Eigen::Matrix<Scalar_T, lengthInState, lengthInState> cov = P
       .template block<lengthInState, lengthInState>(startIdxInState,
                                                     startIdxInState);
   P.template block<lengthInState, nErrorStatesAtCompileTime>(startIdxInState, 0)
@@ -298,7 +426,9 @@ void GenericState_T<stateVector_T, StateDefinition_T>::Reset(
   w_m.setZero();
   a_m.setZero();
 
-  P.setZero();
+  if (covariance_) {
+    covariance_->P.setZero();
+  }
   time = 0;
 
   // Now call the user provided function.
@@ -310,6 +440,7 @@ void GenericState_T<stateVector_T, StateDefinition_T>::Reset(
 template<typename stateVector_T, typename StateDefinition_T>
 void GenericState_T<stateVector_T, StateDefinition_T>::GetPoseCovariance(
     geometry_msgs::PoseWithCovariance::_covariance_type& cov) {
+  const P_type& P = const_cast<const GenericState_T&>(*this).GetP();
 
   typedef typename msf_tmp::GetEnumStateType<stateVector_T, StateDefinition_T::p>::value p_type;
   typedef typename msf_tmp::GetEnumStateType<stateVector_T, StateDefinition_T::q>::value q_type;
@@ -348,6 +479,7 @@ void GenericState_T<stateVector_T, StateDefinition_T>::GetPoseCovariance(
 template<typename stateVector_T, typename StateDefinition_T>
 void GenericState_T<stateVector_T, StateDefinition_T>::GetCoreCovariance(
     sensor_fusion_comm::DoubleMatrixStamped& cov) {
+  const P_type& P = const_cast<const GenericState_T&>(*this).GetP();
 
   const int n_core = nCoreErrorStatesAtCompileTime;
   cov.data.resize(n_core * n_core);
@@ -364,6 +496,7 @@ void GenericState_T<stateVector_T, StateDefinition_T>::GetCoreCovariance(
 template<typename stateVector_T, typename StateDefinition_T>
 void GenericState_T<stateVector_T, StateDefinition_T>::GetAuxCovariance(
     sensor_fusion_comm::DoubleMatrixStamped& cov) {
+  const P_type& P = const_cast<const GenericState_T&>(*this).GetP();
 
   const int n_core = nCoreErrorStatesAtCompileTime;
   const int n_aux = nErrorStatesAtCompileTime-n_core;
@@ -383,6 +516,7 @@ void GenericState_T<stateVector_T, StateDefinition_T>::GetAuxCovariance(
 template<typename stateVector_T, typename StateDefinition_T>
 void GenericState_T<stateVector_T, StateDefinition_T>::GetCoreAuxCovariance(
     sensor_fusion_comm::DoubleMatrixStamped& cov) {
+  const P_type& P = const_cast<const GenericState_T&>(*this).GetP();
 
   const int n_core = nCoreErrorStatesAtCompileTime;
   const int n_aux = nErrorStatesAtCompileTime - n_core;
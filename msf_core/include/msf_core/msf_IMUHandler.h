@@ -38,15 +38,18 @@ class IMUHandler : public SensorHandler<EKFState_T> {
   virtual bool Initialize() = 0;
   void ProcessIMU(const msf_core::Vector3& linear_acceleration,
                    const msf_core::Vector3& angular_velocity,
-                   const double& msg_stamp, size_t msg_seq) {
+                   const int64_t& msg_stamp, size_t msg_seq) {
     core_->ProcessIMU(linear_acceleration, angular_velocity, msg_stamp,
                        msg_seq);
   }
+  void ProcessIMUBatch(const ImuReading* readings, size_t count) {
+    core_->ProcessIMUBatch(readings, count);
+  }
   void ProcessState(const msf_core::Vector3& linear_acceleration,
                      const msf_core::Vector3& angular_velocity,
                      const msf_core::Vector3& p, const msf_core::Vector3& v,
                      const msf_core::Quaternion& q, bool is_already_propagated,
-                     const double& msg_stamp, size_t msg_seq) {
+                     const int64_t& msg_stamp, size_t msg_seq) {
     core_->ProcessExternallyPropagatedState(linear_acceleration,
                                             angular_velocity, p, v, q,
                                             is_already_propagated,
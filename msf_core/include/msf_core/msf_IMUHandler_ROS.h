@@ -88,7 +88,7 @@ class IMUHandler_ROS : public IMUHandler<EKFState_T> {
     }
 
     this->ProcessState(linacc, angvel, p, v, q, is_already_propagated,
-                        msg->header.stamp.toSec(), msg->header.seq);
+                        msg->header.stamp.toNSec(), msg->header.seq);
   }
 
   void IMUCallbackAsctec(const asctec_hl_comm::mav_imuConstPtr & msg) {
@@ -99,7 +99,7 @@ class IMUHandler_ROS : public IMUHandler<EKFState_T> {
     angvel << msg->angular_velocity.x, msg->angular_velocity.y, msg
         ->angular_velocity.z;
 
-    this->ProcessIMU(linacc, angvel, msg->header.stamp.toSec(),
+    this->ProcessIMU(linacc, angvel, msg->header.stamp.toNSec(),
                       msg->header.seq);
   }
 
@@ -120,7 +120,7 @@ class IMUHandler_ROS : public IMUHandler<EKFState_T> {
     angvel << msg->angular_velocity.x, msg->angular_velocity.y, msg
         ->angular_velocity.z;
 
-    this->ProcessIMU(linacc, angvel, msg->header.stamp.toSec(),
+    this->ProcessIMU(linacc, angvel, msg->header.stamp.toNSec(),
                       msg->header.seq);
   }
 
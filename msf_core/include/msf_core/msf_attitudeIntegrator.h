@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MSF_ATTITUDEINTEGRATOR_H_
+#define MSF_ATTITUDEINTEGRATOR_H_
+
+#include <cmath>
+
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+
+#include <msf_core/eigen_utils.h>
+
+namespace msf_core {
+
+/**
+ * \brief Returns the rotation by the rotation vector theta, i.e. the
+ * quaternion exponential of theta / 2.
+ */
+template<typename Scalar_T>
+inline Eigen::Quaternion<Scalar_T> QuaternionExp(
+    const Eigen::Matrix<Scalar_T, 3, 1>& theta) {
+  const Scalar_T angle = theta.norm();
+  // sin(angle / 2) / angle, by its series for small angles.
+  const Scalar_T k = angle < Scalar_T(1e-4) ?
+      Scalar_T(0.5) - angle * angle / 48 : std::sin(angle / 2) / angle;
+  return Eigen::Quaternion<Scalar_T>(std::cos(angle / 2), k * theta.x(),
+                                     k * theta.y(), k * theta.z());
+}
+
+/**
+ * \brief Integrates attitude, velocity and position over one IMU step by a
+ * truncated power series of the mean rate, plus a first order commutator
+ * correction, and trapezoidal means of acceleration and velocity. This is the
+ * default. The series squares its matrix in every term, so it has the powers
+ * 1, 2, 4 and 8 and is of second order.
+ *
+ * The integrators take the bias corrected rates and accelerations at the
+ * start (ewold, eaold) and the end (ew, ea) of the step of dt seconds, the
+ * gravity g in the world frame and the state at the start of the step.
+ */
+struct PowerSeriesAttitudeIntegrator {
+  template<typename Scalar_T>
+  static void Integrate(const Eigen::Matrix<Scalar_T, 3, 1>& ewold,
+                        const Eigen::Matrix<Scalar_T, 3, 1>& ew,
+                        const Eigen::Matrix<Scalar_T, 3, 1>& eaold,
+                        const Eigen::Matrix<Scalar_T, 3, 1>& ea,
+                        const Eigen::Matrix<Scalar_T, 3, 1>& g, Scalar_T dt,
+                        const Eigen::Quaternion<Scalar_T>& qold,
+                        const Eigen::Matrix<Scalar_T, 3, 1>& vold,
+                        const Eigen::Matrix<Scalar_T, 3, 1>& pold,
+                        Eigen::Quaternion<Scalar_T>* q,
+                        Eigen::Matrix<Scalar_T, 3, 1>* v,
+                        Eigen::Matrix<Scalar_T, 3, 1>* p) {
+    typedef Eigen::Matrix<Scalar_T, 4, 4> Matrix4_T;
+    const Matrix4_T Omega = OmegaMatJPL(ew);
+    const Matrix4_T OmegaOld = OmegaMatJPL(ewold);
+    Matrix4_T OmegaMean = OmegaMatJPL((ew + ewold) / 2);
+
+    // Zero order quaternion integration.
+    // cur_state.q_ = (Eigen::Matrix<double,4,4>::Identity() +
+    // 0.5*Omega*dt)*StateBuffer_[(unsigned char)(idx_state_-1)].q_.coeffs();
+
+    // First order quaternion integration, this is kind of costly and may not
+    // add a lot to the quality of propagation...
+    int div = 1;
+    Matrix4_T MatExp;
+    MatExp.setIdentity();
+    OmegaMean *= 0.5 * dt;
+    for (int i = 1; i < 5; i++) {  // Can be made fourth order or less to save cycles.
+      div *= i;
+      MatExp = MatExp + OmegaMean / div;
+      OmegaMean *= OmegaMean;
+    }
+
+    // First oder quat integration matrix.
+    const Matrix4_T quat_int = MatExp
+        + Scalar_T(1.0 / 48.0) * (Omega * OmegaOld - OmegaOld * Omega) * dt
+            * dt;
+
+    // First oder quaternion integration.
+    q->coeffs() = quat_int * qold.coeffs();
+    q->normalize();
+
+    const Eigen::Matrix<Scalar_T, 3, 1> dv = (q->toRotationMatrix() * ea
+        + qold.toRotationMatrix() * eaold) / 2;
+    *v = vold + (dv - g) * dt;
+    *p = pold + ((*v + vold) / 2 * dt);
+  }
+};
+
+/**
+ * \brief Integrates the attitude by the closed form quaternion exponential of
+ * the mean rate, which is exact for a constant rate and cheaper than the
+ * power series. Velocity and position are integrated by trapezoidal means.
+ */
+struct ClosedFormAttitudeIntegrator {
+  template<typename Scalar_T>
+  static void Integrate(const Eigen::Matrix<Scalar_T, 3, 1>& ewold,
+                        const Eigen::Matrix<Scalar_T, 3, 1>& ew,
+                        const Eigen::Matrix<Scalar_T, 3, 1>& eaold,
+                        const Eigen::Matrix<Scalar_T, 3, 1>& ea,
+                        const Eigen::Matrix<Scalar_T, 3, 1>& g, Scalar_T dt,
+                        const Eigen::Quaternion<Scalar_T>& qold,
+                        const Eigen::Matrix<Scalar_T, 3, 1>& vold,
+                        const Eigen::Matrix<Scalar_T, 3, 1>& pold,
+                        Eigen::Quaternion<Scalar_T>* q,
+                        Eigen::Matrix<Scalar_T, 3, 1>* v,
+                        Eigen::Matrix<Scalar_T, 3, 1>* p) {
+    const Eigen::Matrix<Scalar_T, 3, 1> theta = (ew + ewold) / 2 * dt;
+    *q = qold * QuaternionExp(theta);
+    q->normalize();
+
+    const Eigen::Matrix<Scalar_T, 3, 1> dv = (*q * ea + qold * eaold) / 2;
+    *v = vold + (dv - g) * dt;
+    *p = pold + ((*v + vold) / 2 * dt);
+  }
+};
+
+/**
+ * \brief Integrates attitude, velocity and position jointly by the classic
+ * fourth order Runge-Kutta scheme, with rate and acceleration linear over the
+ * step. Integrates the readings the most accurately for fast rotations, at
+ * the highest cost.
+ */
+struct RungeKuttaAttitudeIntegrator {
+  template<typename Scalar_T>
+  static void Integrate(const Eigen::Matrix<Scalar_T, 3, 1>& ewold,
+                        const Eigen::Matrix<Scalar_T, 3, 1>& ew,
+                        const Eigen::Matrix<Scalar_T, 3, 1>& eaold,
+                        const Eigen::Matrix<Scalar_T, 3, 1>& ea,
+                        const Eigen::Matrix<Scalar_T, 3, 1>& g, Scalar_T dt,
+                        const Eigen::Quaternion<Scalar_T>& qold,
+                        const Eigen::Matrix<Scalar_T, 3, 1>& vold,
+                        const Eigen::Matrix<Scalar_T, 3, 1>& pold,
+                        Eigen::Quaternion<Scalar_T>* q,
+                        Eigen::Matrix<Scalar_T, 3, 1>* v,
+                        Eigen::Matrix<Scalar_T, 3, 1>* p) {
+    typedef Eigen::Matrix<Scalar_T, 3, 1> Vector3_T;
+    typedef Eigen::Matrix<Scalar_T, 4, 1> Vector4_T;
+    // Fraction of the step the stages are evaluated at.
+    const Scalar_T c[4] = { 0, Scalar_T(0.5), Scalar_T(0.5), 1 };
+    Vector4_T kq[4];
+    Vector3_T kv[4];
+    Vector3_T kp[4];
+    Vector4_T qs = qold.coeffs();
+    Vector3_T vs = vold;
+    for (int i = 0; i < 4; ++i) {
+      if (i > 0) {
+        qs = qold.coeffs() + c[i] * dt * kq[i - 1];
+        vs = vold + c[i] * dt * kv[i - 1];
+      }
+      const Vector3_T w = ewold + c[i] * (ew - ewold);
+      const Vector3_T a = eaold + c[i] * (ea - eaold);
+      kq[i] = Scalar_T(0.5) * OmegaMatJPL(w) * qs;
+      kv[i] = Eigen::Quaternion<Scalar_T>(qs).normalized() * a - g;
+      kp[i] = vs;
+    }
+    q->coeffs() = qold.coeffs()
+        + dt / 6 * (kq[0] + 2 * kq[1] + 2 * kq[2] + kq[3]);
+    q->normalize();
+    *v = vold + dt / 6 * (kv[0] + 2 * kv[1] + 2 * kv[2] + kv[3]);
+    *p = pold + dt / 6 * (kp[0] + 2 * kp[1] + 2 * kp[2] + kp[3]);
+  }
+};
+
+}  // namespace msf_core
+#endif  // MSF_ATTITUDEINTEGRATOR_H_
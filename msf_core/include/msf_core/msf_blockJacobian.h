@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MSF_BLOCKJACOBIAN_H_
+#define MSF_BLOCKJACOBIAN_H_
+
+#include <Eigen/Dense>
+#include <msf_core/msf_tmp.h>
+
+namespace msf_core {
+
+/**
+ * \brief Selects whether a measurement update keeps the covariance in Joseph
+ * form, P = (I - K * H) * P * (I - K * H)^T + K * R * K^T, which stays
+ * positive semi-definite for a suboptimal gain, or uses the cheaper
+ * P = P - K * H * P.
+ */
+enum CovarianceUpdateForm {
+  kStandardUpdate,
+  kJosephUpdate
+};
+
+namespace {  // For internal use only:
+/**
+ * \brief Start and size of the columns of a state in the error state, size
+ * zero for the unused index -1.
+ */
+template<typename StateSequence_T, int StateIdx>
+struct JacobianColumnBlock {
+  enum {
+    start = msf_tmp::GetStartIndexInCorrection<StateSequence_T, StateIdx>
+        ::value,
+    size = msf_tmp::StripConstReference<
+        typename msf_tmp::GetEnumStateType<StateSequence_T, StateIdx>::value>
+        ::result_t::sizeInCorrection_
+  };
+};
+template<typename StateSequence_T>
+struct JacobianColumnBlock<StateSequence_T, -1> {
+  enum {
+    start = 0,
+    size = 0
+  };
+};
+
+/**
+ * \brief Copies a block of columns or rows to its place in the compact matrix.
+ */
+template<int Start, int Size, int Offset>
+struct CopyJacobianBlock {
+  template<class Dense_T, class Compact_T>
+  static void Columns(const Eigen::MatrixBase<Dense_T>& dense,
+                      Eigen::MatrixBase<Compact_T>& compact) {
+    compact.template middleCols<Size>(Offset) = dense.template middleCols<Size>(
+        Start);
+  }
+  template<class Dense_T, class Compact_T>
+  static void Rows(const Eigen::MatrixBase<Dense_T>& dense,
+                   Eigen::MatrixBase<Compact_T>& compact) {
+    compact.template middleRows<Size>(Offset) = dense.template middleRows<Size>(
+        Start);
+  }
+};
+template<int Start, int Offset>
+struct CopyJacobianBlock<Start, 0, Offset> {
+  template<class Dense_T, class Compact_T>
+  static void Columns(const Eigen::MatrixBase<Dense_T>&,
+                      Eigen::MatrixBase<Compact_T>&) {
+  }
+  template<class Dense_T, class Compact_T>
+  static void Rows(const Eigen::MatrixBase<Dense_T>&,
+                   Eigen::MatrixBase<Compact_T>&) {
+  }
+};
+}  // namespace
+
+/**
+ * \brief Declares the column blocks of a measurement Jacobian H which can be
+ * nonzero, by the indices of their states in the state definition. Unused
+ * slots are -1, each state may only be given once.
+ *
+ * The measurement update then only needs the columns of P of these states:
+ * P * H^T is a thin product over the compact columns and the covariance update
+ * is of the rank of the measurement, instead of the dense N x N products.
+ *
+ *   typedef msf_core::BlockSparseJacobian<StateSequence_T,
+ *       StateDefinition_T::p, StateDefinition_T::q> HBlocks_T;
+ *   this->CalculateAndApplyCorrection(state, core, H, r, R, HBlocks_T());
+ */
+template<typename StateSequence_T, int S0, int S1 = -1, int S2 = -1,
+    int S3 = -1, int S4 = -1, int S5 = -1, int S6 = -1, int S7 = -1>
+struct BlockSparseJacobian {
+ private:
+  typedef JacobianColumnBlock<StateSequence_T, S0> B0;
+  typedef JacobianColumnBlock<StateSequence_T, S1> B1;
+  typedef JacobianColumnBlock<StateSequence_T, S2> B2;
+  typedef JacobianColumnBlock<StateSequence_T, S3> B3;
+  typedef JacobianColumnBlock<StateSequence_T, S4> B4;
+  typedef JacobianColumnBlock<StateSequence_T, S5> B5;
+  typedef JacobianColumnBlock<StateSequence_T, S6> B6;
+  typedef JacobianColumnBlock<StateSequence_T, S7> B7;
+  /// Offsets of the blocks in the compact columns.
+  enum {
+    O1 = B0::size,
+    O2 = O1 + B1::size,
+    O3 = O2 + B2::size,
+    O4 = O3 + B3::size,
+    O5 = O4 + B4::size,
+    O6 = O5 + B5::size,
+    O7 = O6 + B6::size
+  };
+
+ public:
+  enum {
+    nColumns = O7 + B7::size  ///< Number of columns H can be nonzero in.
+  };
+
+  /**
+   * \brief Copies the columns of the blocks of dense to the compact matrix
+   * with nColumns columns.
+   */
+  template<class Dense_T, class Compact_T>
+  static void GatherColumns(const Eigen::MatrixBase<Dense_T>& dense,
+                            Eigen::MatrixBase<Compact_T>& compact) {
+    CopyJacobianBlock<B0::start, B0::size, 0>::Columns(dense, compact);
+    CopyJacobianBlock<B1::start, B1::size, O1>::Columns(dense, compact);
+    CopyJacobianBlock<B2::start, B2::size, O2>::Columns(dense, compact);
+    CopyJacobianBlock<B3::start, B3::size, O3>::Columns(dense, compact);
+    CopyJacobianBlock<B4::start, B4::size, O4>::Columns(dense, compact);
+    CopyJacobianBlock<B5::start, B5::size, O5>::Columns(dense, compact);
+    CopyJacobianBlock<B6::start, B6::size, O6>::Columns(dense, compact);
+    CopyJacobianBlock<B7::start, B7::size, O7>::Columns(dense, compact);
+  }
+
+  /**
+   * \brief Copies the rows of the blocks of dense to the compact matrix with
+   * nColumns rows.
+   */
+  template<class Dense_T, class Compact_T>
+  static void GatherRows(const Eigen::MatrixBase<Dense_T>& dense,
+                         Eigen::MatrixBase<Compact_T>& compact) {
+    CopyJacobianBlock<B0::start, B0::size, 0>::Rows(dense, compact);
+    CopyJacobianBlock<B1::start, B1::size, O1>::Rows(dense, compact);
+    CopyJacobianBlock<B2::start, B2::size, O2>::Rows(dense, compact);
+    CopyJacobianBlock<B3::start, B3::size, O3>::Rows(dense, compact);
+    CopyJacobianBlock<B4::start, B4::size, O4>::Rows(dense, compact);
+    CopyJacobianBlock<B5::start, B5::size, O5>::Rows(dense, compact);
+    CopyJacobianBlock<B6::start, B6::size, O6>::Rows(dense, compact);
+    CopyJacobianBlock<B7::start, B7::size, O7>::Rows(dense, compact);
+  }
+};
+
+/**
+ * \brief Declares all N columns of a measurement Jacobian H as possibly
+ * nonzero, for the update routines taking the column blocks of H.
+ */
+template<int N>
+struct DenseJacobian {
+  enum {
+    nColumns = N
+  };
+
+  template<class Dense_T, class Compact_T>
+  static void GatherColumns(const Eigen::MatrixBase<Dense_T>& dense,
+                            Eigen::MatrixBase<Compact_T>& compact) {
+    compact = dense;
+  }
+
+  template<class Dense_T, class Compact_T>
+  static void GatherRows(const Eigen::MatrixBase<Dense_T>& dense,
+                         Eigen::MatrixBase<Compact_T>& compact) {
+    compact = dense;
+  }
+};
+
+}  // namespace msf_core
+#endif  // MSF_BLOCKJACOBIAN_H_
@@ -0,0 +1,370 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MSF_BLOCKTRANSITION_H_
+#define MSF_BLOCKTRANSITION_H_
+
+#include <Eigen/Dense>
+#include <msf_core/msf_tmp.h>
+
+namespace msf_core {
+/**
+ * \brief The discrete error state transition matrix Fd of the core states,
+ * stored as the nine 3x3 blocks which differ from identity.
+ *
+ * Only the rows of p, v and q depend on the IMU readings:
+ *
+ *         p   v     q     b_w     b_a
+ *   p  [  I  p_v   p_q   p_b_w   p_b_a ]
+ *   v  [  0   I    v_q   v_b_w   v_b_a ]
+ *   q  [  0   0    q_q   q_b_w    0    ]
+ *
+ * all other rows, including the ones of the auxiliary states, are identity.
+ * The products with Fd therefore only touch the p, v and q rows or columns of
+ * the other operand, which makes them linear instead of cubic in the number of
+ * error states. The covariance of the auxiliary states is not changed by the
+ * propagation at all, apart from their process noise.
+ */
+template<typename StateSequence_T, typename StateDefinition_T>
+class BlockSparseTransition {
+ public:
+  enum {
+    nErrorStatesAtCompileTime = msf_tmp::CountStates<StateSequence_T,
+        msf_tmp::CorrectionStateLengthForType>::value,  ///< N error states.
+    /// N core error states, which come first in the error state.
+    nCoreErrorStatesAtCompileTime = msf_tmp::CountStates<StateSequence_T,
+        msf_tmp::CoreErrorStateLengthForType>::value,
+    /// N auxiliary error states.
+    nAuxErrorStatesAtCompileTime = nErrorStatesAtCompileTime
+        - nCoreErrorStatesAtCompileTime
+  };
+  typedef typename msf_tmp::ScalarOfSequence<StateSequence_T>::type Scalar_T;
+  typedef Eigen::Matrix<Scalar_T, 3, 3> Block_T;
+  typedef Eigen::Matrix<Scalar_T, nErrorStatesAtCompileTime,
+      nErrorStatesAtCompileTime> Dense_T;
+  typedef Eigen::Matrix<Scalar_T, nCoreErrorStatesAtCompileTime,
+      nCoreErrorStatesAtCompileTime> Core_T;
+
+  Block_T p_v;  ///< d p / d v.
+  Block_T p_q;  ///< d p / d q.
+  Block_T p_b_w;  ///< d p / d b_w.
+  Block_T p_b_a;  ///< d p / d b_a.
+  Block_T v_q;  ///< d v / d q.
+  Block_T v_b_w;  ///< d v / d b_w.
+  Block_T v_b_a;  ///< d v / d b_a.
+  Block_T q_q;  ///< d q / d q.
+  Block_T q_b_w;  ///< d q / d b_w.
+
+ private:
+  /**
+   * \brief Start indices of the core states in the error state. Only resolved
+   * when the products are used, so states without core states can still hold
+   * this type.
+   */
+  struct Index {
+    enum {
+      p = msf_tmp::GetStartIndexInCorrection<StateSequence_T,
+          StateDefinition_T::p>::value,
+      v = msf_tmp::GetStartIndexInCorrection<StateSequence_T,
+          StateDefinition_T::v>::value,
+      q = msf_tmp::GetStartIndexInCorrection<StateSequence_T,
+          StateDefinition_T::q>::value,
+      b_w = msf_tmp::GetStartIndexInCorrection<StateSequence_T,
+          StateDefinition_T::b_w>::value,
+      b_a = msf_tmp::GetStartIndexInCorrection<StateSequence_T,
+          StateDefinition_T::b_a>::value
+    };
+  };
+
+ public:
+  BlockSparseTransition() {
+    SetIdentity();
+  }
+
+  /**
+   * \brief Sets Fd to identity.
+   */
+  void SetIdentity() {
+    p_v.setZero();
+    p_q.setZero();
+    p_b_w.setZero();
+    p_b_a.setZero();
+    v_q.setZero();
+    v_b_w.setZero();
+    v_b_a.setZero();
+    q_q.setIdentity();
+    q_b_w.setZero();
+  }
+
+  /**
+   * \brief Returns Fd as dense matrix.
+   */
+  Dense_T ToDense() const {
+    Dense_T Fd = Dense_T::Identity();
+    Fd.template block<3, 3>(Index::p, Index::v) = p_v;
+    Fd.template block<3, 3>(Index::p, Index::q) = p_q;
+    Fd.template block<3, 3>(Index::p, Index::b_w) = p_b_w;
+    Fd.template block<3, 3>(Index::p, Index::b_a) = p_b_a;
+    Fd.template block<3, 3>(Index::v, Index::q) = v_q;
+    Fd.template block<3, 3>(Index::v, Index::b_w) = v_b_w;
+    Fd.template block<3, 3>(Index::v, Index::b_a) = v_b_a;
+    Fd.template block<3, 3>(Index::q, Index::q) = q_q;
+    Fd.template block<3, 3>(Index::q, Index::b_w) = q_b_w;
+    return Fd;
+  }
+
+  /**
+   * \brief Computes P_new = Fd * P * Fd^T + Qd.
+   * \param P Must be symmetric.
+   * \param Qd Must be zero between the core and the auxiliary states, as
+   * computed by the core.
+   */
+  void PropagateCovariance(const Dense_T& P, const Dense_T& Qd,
+                           Dense_T& P_new) const {
+    enum {
+      N = nErrorStatesAtCompileTime,
+      nCore = nCoreErrorStatesAtCompileTime,
+      nAux = nAuxErrorStatesAtCompileTime
+    };
+    static_assert(
+        static_cast<int>(Index::p) < static_cast<int>(nCore) &&
+        static_cast<int>(Index::v) < static_cast<int>(nCore) &&
+        static_cast<int>(Index::q) < static_cast<int>(nCore) &&
+        static_cast<int>(Index::b_w) < static_cast<int>(nCore) &&
+        static_cast<int>(Index::b_a) < static_cast<int>(nCore),
+        "The core states must come first in the error state");
+    P_new = P;
+    // Fd * P: Only the rows of p, v and q change, q is updated last as the
+    // other rows depend on it.
+    P_new.template block<3, N>(Index::p, 0) +=
+        p_v * P.template block<3, N>(Index::v, 0)
+        + p_q * P.template block<3, N>(Index::q, 0)
+        + p_b_w * P.template block<3, N>(Index::b_w, 0)
+        + p_b_a * P.template block<3, N>(Index::b_a, 0);
+    P_new.template block<3, N>(Index::v, 0) +=
+        v_q * P.template block<3, N>(Index::q, 0)
+        + v_b_w * P.template block<3, N>(Index::b_w, 0)
+        + v_b_a * P.template block<3, N>(Index::b_a, 0);
+    P_new.template block<3, N>(Index::q, 0) =
+        q_q * P.template block<3, N>(Index::q, 0)
+        + q_b_w * P.template block<3, N>(Index::b_w, 0);
+
+    // (Fd * P) * Fd^T: Only the columns of p, v and q change. The rows of the
+    // auxiliary states are the transpose of the core-aux block from above.
+    P_new.template block<nCore, 3>(0, Index::p) +=
+        P_new.template block<nCore, 3>(0, Index::v) * p_v.transpose()
+        + P_new.template block<nCore, 3>(0, Index::q) * p_q.transpose()
+        + P_new.template block<nCore, 3>(0, Index::b_w) * p_b_w.transpose()
+        + P_new.template block<nCore, 3>(0, Index::b_a) * p_b_a.transpose();
+    P_new.template block<nCore, 3>(0, Index::v) +=
+        P_new.template block<nCore, 3>(0, Index::q) * v_q.transpose()
+        + P_new.template block<nCore, 3>(0, Index::b_w) * v_b_w.transpose()
+        + P_new.template block<nCore, 3>(0, Index::b_a) * v_b_a.transpose();
+    P_new.template block<nCore, 3>(0, Index::q) =
+        P_new.template block<nCore, 3>(0, Index::q) * q_q.transpose()
+        + P_new.template block<nCore, 3>(0, Index::b_w) * q_b_w.transpose();
+    P_new.template block<nAux, nCore>(nCore, 0) =
+        P_new.template block<nCore, nAux>(0, nCore).transpose();
+
+    P_new.template block<nCore, nCore>(0, 0) +=
+        Qd.template block<nCore, nCore>(0, 0);
+    P_new.template block<nAux, nAux>(nCore, nCore) +=
+        Qd.template block<nAux, nAux>(nCore, nCore);
+  }
+
+  /**
+   * \brief Computes M = Fd * M.
+   */
+  void MultiplyFromLeft(Dense_T& M) const {
+    MultiplyRowsFromLeft(M);
+  }
+
+  /**
+   * \brief Computes M = Fd_c * M, where Fd_c is the block of Fd between the
+   * core states.
+   */
+  void MultiplyCoreFromLeft(Core_T& M) const {
+    MultiplyRowsFromLeft(M);
+  }
+
+  /**
+   * \brief Computes M = Fd_c * M * Fd_c^T, where Fd_c is the block of Fd
+   * between the core states.
+   */
+  void PropagateCoreCovariance(Core_T& M) const {
+    enum {
+      nCore = nCoreErrorStatesAtCompileTime
+    };
+    MultiplyCoreFromLeft(M);
+    M.template block<nCore, 3>(0, Index::p) +=
+        M.template block<nCore, 3>(0, Index::v) * p_v.transpose()
+        + M.template block<nCore, 3>(0, Index::q) * p_q.transpose()
+        + M.template block<nCore, 3>(0, Index::b_w) * p_b_w.transpose()
+        + M.template block<nCore, 3>(0, Index::b_a) * p_b_a.transpose();
+    M.template block<nCore, 3>(0, Index::v) +=
+        M.template block<nCore, 3>(0, Index::q) * v_q.transpose()
+        + M.template block<nCore, 3>(0, Index::b_w) * v_b_w.transpose()
+        + M.template block<nCore, 3>(0, Index::b_a) * v_b_a.transpose();
+    M.template block<nCore, 3>(0, Index::q) =
+        M.template block<nCore, 3>(0, Index::q) * q_q.transpose()
+        + M.template block<nCore, 3>(0, Index::b_w) * q_b_w.transpose();
+  }
+
+  /**
+   * \brief Computes F = F * Fd, e.g. to chain the transitions of several
+   * states.
+   */
+  void MultiplyFromRight(Dense_T& F) const {
+    enum {
+      N = nErrorStatesAtCompileTime
+    };
+    // Only the columns of v, q, b_w and b_a change. Update them in reverse
+    // order, so the columns read are still the ones of the old F.
+    F.template block<N, 3>(0, Index::b_a) +=
+        F.template block<N, 3>(0, Index::p) * p_b_a
+        + F.template block<N, 3>(0, Index::v) * v_b_a;
+    F.template block<N, 3>(0, Index::b_w) +=
+        F.template block<N, 3>(0, Index::p) * p_b_w
+        + F.template block<N, 3>(0, Index::v) * v_b_w
+        + F.template block<N, 3>(0, Index::q) * q_b_w;
+    F.template block<N, 3>(0, Index::q) =
+        F.template block<N, 3>(0, Index::p) * p_q
+        + F.template block<N, 3>(0, Index::v) * v_q
+        + F.template block<N, 3>(0, Index::q) * q_q;
+    F.template block<N, 3>(0, Index::v) +=
+        F.template block<N, 3>(0, Index::p) * p_v;
+  }
+
+ private:
+  /**
+   * \brief Computes M = Fd * M for a matrix with the rows of all or only of
+   * the core error states: Only the rows of p, v and q change, q is updated
+   * last as the other rows depend on it.
+   */
+  template<typename Matrix_T>
+  void MultiplyRowsFromLeft(Matrix_T& M) const {
+    enum {
+      C = Matrix_T::ColsAtCompileTime
+    };
+    M.template block<3, C>(Index::p, 0) +=
+        p_v * M.template block<3, C>(Index::v, 0)
+        + p_q * M.template block<3, C>(Index::q, 0)
+        + p_b_w * M.template block<3, C>(Index::b_w, 0)
+        + p_b_a * M.template block<3, C>(Index::b_a, 0);
+    M.template block<3, C>(Index::v, 0) +=
+        v_q * M.template block<3, C>(Index::q, 0)
+        + v_b_w * M.template block<3, C>(Index::b_w, 0)
+        + v_b_a * M.template block<3, C>(Index::b_a, 0);
+    M.template block<3, C>(Index::q, 0) =
+        q_q * M.template block<3, C>(Index::q, 0)
+        + q_b_w * M.template block<3, C>(Index::b_w, 0);
+  }
+};
+
+/**
+ * \brief The transitions of several consecutive states composed into one, to
+ * propagate the covariance over all of them at once:
+ *
+ *   P_k = Phi * P_0 * Phi^T + Q,  Phi = Fd_k * ... * Fd_1,
+ *   Q = sum_i (Fd_k * ... * Fd_i+1) * Qd_i * (Fd_k * ... * Fd_i+1)^T
+ *
+ * As every Fd is identity outside the core states, Phi is too and only its
+ * core block is kept. Q has no core-aux block, the noise of the auxiliary
+ * states just adds up. Appending a step is therefore independent of the number
+ * of auxiliary states, only the final propagation touches all of P.
+ */
+template<typename StateSequence_T, typename StateDefinition_T>
+class ComposedTransition {
+ public:
+  typedef BlockSparseTransition<StateSequence_T, StateDefinition_T> Step_T;
+  enum {
+    nErrorStatesAtCompileTime = Step_T::nErrorStatesAtCompileTime,
+    nCoreErrorStatesAtCompileTime = Step_T::nCoreErrorStatesAtCompileTime,
+    nAuxErrorStatesAtCompileTime = Step_T::nAuxErrorStatesAtCompileTime
+  };
+  typedef typename Step_T::Scalar_T Scalar_T;
+  typedef typename Step_T::Dense_T Dense_T;
+  typedef typename Step_T::Core_T Core_T;
+  typedef Eigen::Matrix<Scalar_T, nAuxErrorStatesAtCompileTime,
+      nAuxErrorStatesAtCompileTime> Aux_T;
+
+  Core_T Phi;  ///< Core block of the product of the transitions.
+  Core_T Q_core;  ///< Core block of the accumulated process noise.
+  Aux_T Q_aux;  ///< Aux block of the accumulated process noise.
+
+  ComposedTransition() {
+    Reset();
+  }
+
+  /**
+   * \brief Drops all steps, the composed transition is identity.
+   */
+  void Reset() {
+    Phi.setIdentity();
+    Q_core.setZero();
+    Q_aux.setZero();
+    steps_ = 0;
+  }
+
+  /**
+   * \brief Returns the number of steps composed so far.
+   */
+  size_t Steps() const {
+    return steps_;
+  }
+
+  /**
+   * \brief Appends the step with transition Fd and process noise Qd.
+   * \param Qd Must be zero between the core and the auxiliary states, as
+   * computed by the core.
+   */
+  void Append(const Step_T& Fd, const Dense_T& Qd) {
+    enum {
+      nCore = nCoreErrorStatesAtCompileTime,
+      nAux = nAuxErrorStatesAtCompileTime
+    };
+    Fd.MultiplyCoreFromLeft(Phi);
+    Fd.PropagateCoreCovariance(Q_core);
+    Q_core += Qd.template block<nCore, nCore>(0, 0);
+    Q_aux += Qd.template block<nAux, nAux>(nCore, nCore);
+    ++steps_;
+  }
+
+  /**
+   * \brief Computes P_new = Phi * P * Phi^T + Q.
+   * \param P Must be symmetric.
+   */
+  void PropagateCovariance(const Dense_T& P, Dense_T& P_new) const {
+    enum {
+      nCore = nCoreErrorStatesAtCompileTime,
+      nAux = nAuxErrorStatesAtCompileTime
+    };
+    P_new.template block<nCore, nCore>(0, 0) = Phi
+        * P.template block<nCore, nCore>(0, 0) * Phi.transpose() + Q_core;
+    P_new.template block<nCore, nAux>(0, nCore) = Phi
+        * P.template block<nCore, nAux>(0, nCore);
+    P_new.template block<nAux, nCore>(nCore, 0) =
+        P_new.template block<nCore, nAux>(0, nCore).transpose();
+    P_new.template block<nAux, nAux>(nCore, nCore) =
+        P.template block<nAux, nAux>(nCore, nCore) + Q_aux;
+  }
+
+ private:
+  size_t steps_;
+};
+}  // namespace msf_core
+
+#endif  // MSF_BLOCKTRANSITION_H_
@@ -33,7 +33,7 @@ class CheckFuzzyTracking {
 
   int nontemporaldrifting_inittimer_;  ///< A counter for fuzzy tracking detection
   // If there is no non temporal drifting state this matrix will have zero rows,
-  // to make use of it illegal.
+  // to make use of it illegal. Kept in double for any scalar of the state.
   Eigen::Matrix<double, nBuff_, qbuffRowsAtCompiletime> qbuff_;
 
  public:
@@ -79,7 +79,8 @@ class CheckFuzzyTracking {
       // should be unit quaternion if no error
       Eigen::Quaternion<double> errq =
           const_cast<const EKFState_T&>(*delaystate)
-              .template Get<indexOfStateWithoutTemporalDrift>().conjugate() *
+              .template Get<indexOfStateWithoutTemporalDrift>().conjugate()
+              .template cast<double>() *
       Eigen::Quaternion<double>(
           GetMedian(qbuff_.template block<nBuff_, 1> (0, 3)),
           GetMedian(qbuff_.template block<nBuff_, 1> (0, 0)),
@@ -107,14 +108,16 @@ class CheckFuzzyTracking {
         qbuff_.template block<1, 4>(nontemporaldrifting_inittimer_ - nBuff_ - 1, 0) =
             Eigen::Matrix<double, 1, 4>(
                 const_cast<const EKFState_T&>(*delaystate).
-                template Get<indexOfStateWithoutTemporalDrift>().coeffs());
+                template Get<indexOfStateWithoutTemporalDrift>().coeffs()
+                .template cast<double>());
          nontemporaldrifting_inittimer_ = (nontemporaldrifting_inittimer_) % nBuff_ + nBuff_ + 1;
        }
      } else {  // At beginning get mean and 3sigma of past N non drifting state values.
        qbuff_. template block<1, 4> (nontemporaldrifting_inittimer_ - 1, 0) =
            Eigen::Matrix<double, 1, 4>(
                const_cast<const EKFState_T&>(*delaystate).
-               template Get<indexOfStateWithoutTemporalDrift>().coeffs());
+               template Get<indexOfStateWithoutTemporalDrift>().coeffs()
+               .template cast<double>());
        nontemporaldrifting_inittimer_++;
      }
      return isfuzzy;
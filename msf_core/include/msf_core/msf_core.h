@@ -33,14 +33,26 @@ http://google-styleguide.googlecode.com/svn/trunk/cppguide.xml
 #ifndef MSF_CORE_H_
 #define MSF_CORE_H_
 
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
 #include <vector>
 #include <queue>
+#include <thread>
 
 #include <Eigen/Eigen>
 
+#include <msf_core/msf_attitudeIntegrator.h>
+#include <msf_core/msf_measurementIndex.h>
+#include <msf_core/msf_snapshot.h>
 #include <msf_core/msf_sortedContainer.h>
+#include <msf_core/msf_sortedRingContainer.h>
+#include <msf_core/msf_statePool.h>
 #include <msf_core/msf_state.h>
 #include <msf_core/msf_checkFuzzyTracking.h>
+#include <msf_core/msf_coreParameters.h>
+#include <msf_core/implementation/calcQCore.h>
 
 namespace msf_core {
 template<typename EKFState_T>
@@ -48,6 +60,30 @@ class MSF_SensorManager;
 template<typename EKFState_T>
 class IMUHandler;
 
+/**
+ * \brief Statistics on how far the measurements of one sensor reach back into
+ * the buffers of the core, i.e. their delay with respect to the latest state
+ * at the time they are added.
+ */
+struct SensorDelayStatistics {
+  size_t count;  ///< Number of measurements seen.
+  double meandelay;  ///< Mean delay [s].
+  double maxdelay;  ///< Maximum delay [s].
+  /// Maximum time back from the latest state the sensor needed states and
+  /// measurements for [s]. For relative sensors this includes the time to the
+  /// previous measurement.
+  double maxlookback;
+  int64_t lasttime;  ///< Time of the last measurement [ns].
+
+  SensorDelayStatistics()
+      : count(0),
+        meandelay(0),
+        maxdelay(0),
+        maxlookback(0),
+        lasttime(-1) {
+  }
+};
+
 /** \class MSF_Core
  *
  * \brief The core class of the EKF
@@ -71,22 +107,59 @@ class MSF_Core {
 
   typedef typename EKFState_T::StateDefinition_T StateDefinition_T;
   typedef typename EKFState_T::StateSequence_T StateSequence_T;
+  /// The representation of the error state covariance.
+  typedef typename EKFState_T::CovarianceForm_T CovarianceForm_T;
+  /// The scalar the filter computes in.
+  typedef typename EKFState_T::Scalar_T Scalar_T;
+  typedef Eigen::Matrix<Scalar_T, 3, 1> Vector3_T;
+  typedef Eigen::Matrix<Scalar_T, 3, 3> Matrix3_T;
+  typedef Eigen::Matrix<Scalar_T, 4, 4> Matrix4_T;
   /// The error state type.
-  typedef Eigen::Matrix<double, nErrorStatesAtCompileTime, 1> ErrorState;
+  typedef Eigen::Matrix<Scalar_T, nErrorStatesAtCompileTime, 1> ErrorState;
   /// The error state covariance type.
-  typedef Eigen::Matrix<double, nErrorStatesAtCompileTime,
+  typedef Eigen::Matrix<Scalar_T, nErrorStatesAtCompileTime,
       nErrorStatesAtCompileTime> ErrorStateCov;
 
+  /// The integrator of the IMU readings selected for this state type.
+  typedef typename AttitudeIntegratorForState<EKFState_T>::type
+      AttitudeIntegrator_T;
+  /// The container backend selected for this state type.
+  typedef typename ContainerBackendForState<EKFState_T>::type ContainerBackend_T;
   /// The type of the state buffer containing all the states.
-  typedef msf_core::SortedContainer<EKFState_T> StateBuffer_T;
+  typedef typename ContainerBackend_T::template Container<EKFState_T>::type
+      StateBuffer_T;
   /// The type of the measurement buffer containing all the measurements
-  typedef msf_core::SortedContainer<
+  typedef typename ContainerBackend_T::template Container<
       typename msf_core::MSF_MeasurementBase<EKFState_T>,
-      typename msf_core::MSF_InvalidMeasurement<EKFState_T> > measurementBufferT;
+      typename msf_core::MSF_InvalidMeasurement<EKFState_T> >::type
+      measurementBufferT;
+  /// A state as written to the snapshot files.
+  typedef typename FilterSnapshot<EKFState_T>::Record SnapshotRecord_T;
+
+  /**
+   * \brief Counts how much work applying the measurements in bursts saved.
+   */
+  struct MeasurementBurstStatistics {
+    size_t bursts;  ///< Bursts of more than one measurement.
+    size_t measurements;  ///< Measurements applied in these bursts.
+    /// Measurements not replayed, compared to replaying for each measurement.
+    size_t savedreplays;
+    /// Measurements applied by the replay of another one of their burst.
+    size_t coalescedmeasurements;
+
+    MeasurementBurstStatistics()
+        : bursts(0),
+          measurements(0),
+          savedreplays(0),
+          coalescedmeasurements(0) {
+    }
+  };
 
   /**
    * \brief Add a sensor measurement or an init measurement to the internal
-   * queue and apply it to the state.
+   * queue and apply it to the state. If measurements are coalesced, it is
+   * applied with the next IMU reading, together with the other measurements
+   * arriving until then.
    * \param Measurement the measurement to add to the internal measurement queue.
    */
   void AddMeasurement(shared_ptr<MSF_MeasurementBase<EKFState_T> > measurement);
@@ -99,11 +172,28 @@ class MSF_Core {
    */
   void Init(shared_ptr<MSF_MeasurementBase<EKFState_T> > measurement);
 
+  /**
+   * \brief Writes the latest states to a snapshot file, starting at the state
+   * the covariance was propagated to.
+   * \param filename The file to write the snapshot to.
+   */
+  bool WriteSnapshot(const std::string& filename);
+
+  /**
+   * \brief Initializes the filter from a snapshot file, instead of an init
+   * measurement. The buffers hold the states of the snapshot, so delayed
+   * measurements within them can still be applied.
+   * \param filename The file to read the snapshot from.
+   * \returns False if the snapshot can not be read, the filter is unchanged
+   * then.
+   */
+  bool RestoreFromSnapshot(const std::string& filename);
+
   /**
    * \brief Finds the closest state to the requested time in the internal state.
    * \param tstamp The time stamp to find the closest state to.
    */
-  shared_ptr<EKFState_T> GetClosestState(double tstamp);
+  shared_ptr<EKFState_T> GetClosestState(int64_t tstamp);
 
   /**
    * \brief Returns the accumulated dynamic matrix between two states.
@@ -111,18 +201,100 @@ class MSF_Core {
   void GetAccumulatedStateTransitionStochasticCloning(
       const shared_ptr<EKFState_T>& state_old,
       const shared_ptr<EKFState_T>& state_new,
-      Eigen::Matrix<double, nErrorStatesAtCompileTime, nErrorStatesAtCompileTime>& F);
+      ErrorStateCov& F);
   /**
    * \brief Returns previous measurement of the same type.
    */
   shared_ptr<msf_core::MSF_MeasurementBase<EKFState_T> > GetPreviousMeasurement(
-      double time, int sensorID);
+      int64_t time, int sensorID);
 
   /**
-   * \brief Finds the state at the requested time in the internal state.
+   * \brief Returns next measurement of the same type.
+   */
+  shared_ptr<msf_core::MSF_MeasurementBase<EKFState_T> > GetNextMeasurement(
+      int64_t time, int sensorID);
+
+  /**
+   * \brief Appends the buffered measurements of a sensor taken in
+   * [timefrom, timeto] to the vector, ordered by time.
+   * \returns The number of measurements appended.
+   */
+  size_t GetMeasurementsInRange(
+      int64_t timefrom, int64_t timeto, int sensorID,
+      std::vector<shared_ptr<msf_core::MSF_MeasurementBase<EKFState_T> > >&
+          measurements);
+
+  /**
+   * \brief The work saved by applying measurements in bursts so far.
+   */
+  const MeasurementBurstStatistics& GetMeasurementBurstStatistics() const {
+    return burstStatistics_;
+  }
+
+  /**
+   * \brief Finds the state at the requested time in the internal state. With
+   * lazy repropagation, its covariance is caught up or reconstructed first.
    * \param tstamp The time stamp to find the state to.
    */
-  shared_ptr<EKFState_T> GetStateAtTime(double tstamp);
+  shared_ptr<EKFState_T> GetStateAtTime(int64_t tstamp);
+
+  /**
+   * \brief Gives the state storage for its covariance related matrices from
+   * the pool, if it has none yet.
+   */
+  void AttachCovariance(EKFState_T& state);
+
+  /**
+   * \brief Gives the state storage for its preintegrated IMU readings from the
+   * pool, if it has none yet.
+   */
+  void AttachPreintegration(EKFState_T& state);
+
+  /**
+   * \brief Calculates the discrete error state propagation matrix and the
+   * discrete propagation noise matrix for the step between two states.
+   * \param Fd Must be identity outside the core state blocks.
+   */
+  void CalculateStateTransition(shared_ptr<EKFState_T>& state_old,
+                                shared_ptr<EKFState_T>& state_new,
+                                typename EKFState_T::F_type& Fd,
+                                typename EKFState_T::Q_type& Qd);
+
+  /**
+   * \brief Calculates Fd and Qd for the given core parameters, with the Q
+   * blocks of the auxiliary states already filled in by
+   * CalculateQAuxiliaryStates. Neither reads the sensor manager nor the
+   * members of the core, so the covariance thread can call it without
+   * holding the buffers.
+   * \param interval If given, the core blocks of Qd are left to the caller and
+   * the inputs of CalcQCore are returned here instead, e.g. for
+   * CalcQCoreBatch. Only for states without preintegration.
+   */
+  void CalculateStateTransition(shared_ptr<EKFState_T>& state_old,
+                                shared_ptr<EKFState_T>& state_new,
+                                const CoreParameters& parameters,
+                                typename EKFState_T::F_type& Fd,
+                                typename EKFState_T::Q_type& Qd,
+                                CoreProcessInterval* interval = nullptr) const;
+
+  /**
+   * \brief Lets the sensor manager fill in the Q blocks of the auxiliary
+   * states of state_new for the step from state_old.
+   */
+  void CalculateQAuxiliaryStates(shared_ptr<EKFState_T>& state_old,
+                                 shared_ptr<EKFState_T>& state_new);
+
+  /**
+   * \brief Recomputes the error state covariance of a state, whose covariance
+   * was not kept, from the closest keyframe before it.
+   */
+  void ReconstructCovariance(shared_ptr<EKFState_T>& state);
+
+  /**
+   * \brief Marks every n-th state as covariance keyframe, where n is the
+   * keyframe stride of the sensor manager.
+   */
+  void MarkCovarianceKeyframeByStride(EKFState_T& state);
 
   /**
    * \brief Propagates the error state covariance.
@@ -133,7 +305,36 @@ class MSF_Core {
                                 shared_ptr<EKFState_T>& state_new);
 
   /**
-   * \brief Propagates the state with given dt.
+   * \brief Appends the transitions up to the given state to the composed
+   * transition and propagates the covariance over it every decimation states
+   * and at covariance keyframes.
+   * \param state The state to compose the transitions up to.
+   * \param apply Also propagate the covariance to the state itself.
+   * \param decimation The number of transitions to compose at most.
+   */
+  void ComposeCovariancePropagation(shared_ptr<EKFState_T>& state, bool apply,
+                                    size_t decimation);
+
+  /**
+   * \brief Propagates the covariance over the composed transition.
+   */
+  void ApplyComposedTransition();
+
+  /**
+   * \brief Returns whether every state the covariance was propagated over
+   * keeps its covariance, i.e. neither keyframes, decimation nor lazy
+   * repropagation are used.
+   */
+  bool KeepsCovarianceOfAllStates() const;
+
+  /**
+   * \brief Takes the core parameters, if the sensor manager published new
+   * ones since the last call.
+   */
+  void RefreshCoreParameters();
+
+  /**
+   * \brief Propagates the state with given dt, by the AttitudeIntegrator_T.
    * \param state_old The state to propagate from.
    * \param state_new The state to propagate to.
    */
@@ -141,18 +342,62 @@ class MSF_Core {
                       shared_ptr<EKFState_T>& state_new);
 
   /**
-   * \brief Delete very old states and measurements from the buffers to free
-   * memory.
+   * \brief Propagates the state over the IMU readings preintegrated into
+   * state_new, see PropagateState.
+   */
+  void PropagateStatePreintegrated(shared_ptr<EKFState_T>& state_old,
+                                   shared_ptr<EKFState_T>& state_new);
+
+  /**
+   * \brief Calculates Fd and Qd for the IMU readings preintegrated into
+   * state_new, see CalculateStateTransition.
+   */
+  void CalculatePreintegratedStateTransition(
+      shared_ptr<EKFState_T>& state_old, shared_ptr<EKFState_T>& state_new,
+      const CoreParameters& parameters, typename EKFState_T::F_type& Fd,
+      typename EKFState_T::Q_type& Qd) const;
+
+  /**
+   * \brief Returns whether the IMU reading at the given time can be
+   * preintegrated into the latest state instead of inserting a new state.
+   * This is the case until the state holds the readings of the preintegration
+   * stride, or the covariance was propagated to it, e.g. to apply a
+   * measurement.
+   */
+  bool CanPreintegrateIntoLastState(int64_t time);
+
+  /**
+   * \brief Preintegrates an IMU reading into the latest state, which moves to
+   * the time of the reading.
+   */
+  void PreintegrateIntoLastState(const Vector3_T& a_m, const Vector3_T& w_m,
+                                 int64_t time);
+
+  /**
+   * \brief Delete states and measurements which are older than the buffer
+   * horizon from the buffers to free memory.
    */
   void CleanUpBuffers();
 
+  /**
+   * \brief Returns how long states and measurements are kept in the buffers.
+   */
+  double GetBufferHorizon() const {
+    return bufferHorizon_;
+  }
+
+  /**
+   * \brief Returns the delay statistics of the sensors by sensor id.
+   */
+  const std::map<int, SensorDelayStatistics>& GetSensorDelayStatistics() const {
+    return sensorDelayStatistics_;
+  }
+
   /**
    * \brief sets the covariance matrix of the core states to simulated values.
    * \param P the error state covariance Matrix to fill.
    */
-  void SetPCore(
-      Eigen::Matrix<double, EKFState_T::nErrorStatesAtCompileTime,
-          EKFState_T::nErrorStatesAtCompileTime>& P);
+  void SetPCore(ErrorStateCov& P);
 
   /**
    * \brief Ctor takes a pointer to an object which does the user defined
@@ -165,6 +410,14 @@ class MSF_Core {
 
   const MSF_SensorManager<EKFState_T>& GetUserCalc() const;
 
+  /**
+   * \brief Returns the pool the states of the filter are allocated from, e.g.
+   * to report its high water mark.
+   */
+  const StatePool<EKFState_T>& GetStatePool() const {
+    return statePool_;
+  }
+
  private:
   /**
    * \brief Get the index of the best state having no temporal drift at compile
@@ -182,16 +435,78 @@ class MSF_Core {
   /// EKF buffer containing pretty much all info needed at time t. Sorted by t
   // asc.
   StateBuffer_T stateBuffer_;
+  /// Recycling storage for the states in the state buffer.
+  StatePool<EKFState_T> statePool_;
+  /// Recycling storage for the covariance related matrices of the states. A
+  /// state holds at most one of them, so with the capacity of the state pool
+  /// this pool is not exhausted before the state pool.
+  StatePool<typename EKFState_T::Covariance_T> covariancePool_;
+  /// Recycling storage for the preintegrated IMU readings of the states.
+  StatePool<typename EKFState_T::Preintegration_T> preintegrationPool_;
   /// EKF Measurements and init values sorted by t asc.
   measurementBufferT MeasurementBuffer_;
+  /// The measurements of the measurement buffer by sensor.
+  MeasurementIndex<MSF_MeasurementBase<EKFState_T> > measurementIndex_;
   /// Buffer for measurements to apply in future.
   std::queue<shared_ptr<MSF_MeasurementBase<EKFState_T> > > queueFutureMeasurements_;
-  /// Last time stamp where we have a valid propagation.
-  double time_P_propagated;
+  /// Measurements collected since the last IMU reading, if coalesced.
+  std::vector<shared_ptr<MSF_MeasurementBase<EKFState_T> > > measurementBurst_;
+  /// Measurements beyond the replay budget, applied with IMU readings bringing
+  // no other measurement.
+  std::queue<shared_ptr<MSF_MeasurementBase<EKFState_T> > > deferredMeasurements_;
+  MeasurementBurstStatistics burstStatistics_;
+  /// Last time stamp where we have a valid propagation [ns]. Advanced by the
+  // covariance thread, if enabled.
+  std::atomic<int64_t> time_P_propagated;
+  /// Propagates the covariance in the background, if enabled.
+  std::thread covarianceThread_;
+  /// Held while the buffers are changed, the covariance thread takes it to
+  // pick its next step. Recursive since measurements are applied from within
+  // the IMU callback.
+  std::recursive_mutex bufferMutex_;
+  /// Serializes the writes of the snapshot file, which happen outside of
+  // bufferMutex_.
+  std::mutex snapshotMutex_;
+  /// Guards the flags below, which hand work to the covariance thread.
+  std::mutex covarianceMutex_;
+  std::condition_variable covarianceCondition_;
+  /// New states were inserted since the covariance thread last looked.
+  bool covarianceWorkPending_;
+  /// The covariance thread is propagating between two states.
+  bool covarianceStepInFlight_;
+  /// The covariance thread is asked to exit.
+  bool covarianceThreadStop_;
+  /// The delays of the sensors seen so far, by sensor id.
+  std::map<int, SensorDelayStatistics> sensorDelayStatistics_;
+  /// Time span of states and measurements kept in the buffers.
+  double bufferHorizon_;
+  /// The core parameters as last published by the sensor manager.
+  CoreParameters coreParameters_;
+  /// Version of coreParameters_ in the parameter buffer of the manager.
+  uint64_t coreParametersVersion_;
+  /// Number of states since the last keyframe marked by stride.
+  size_t statesSinceCovarianceKeyframe_;
+  /// The transitions the covariance was not propagated over yet.
+  ComposedTransition<StateSequence_T, StateDefinition_T> composedTransition_;
+  /// Time of the first state of the composed transition [ns].
+  int64_t time_P_composed_from;
+  /// Time of the last state of the composed transition [ns].
+  int64_t time_P_composed;
+  /// The steps of the covariance propagated by PropagateCovarianceBatch.
+  std::vector<CoreProcessInterval, Eigen::aligned_allocator<CoreProcessInterval>
+      > covarianceBatchIntervals_;
+  std::vector<EKFState_T*> covarianceBatchStates_;
+  std::vector<typename EKFState_T::Q_type*> covarianceBatchQd_;
+  /// The file snapshots are written to, empty if disabled.
+  std::string snapshotFile_;
+  /// Time between two snapshots [s], zero writes it on shutdown only.
+  double snapshotPeriod_;
+  /// Time of the latest state in the last snapshot written [ns].
+  int64_t time_last_snapshot;
   /// Last time stamp where we have a valid state.
   typename StateBuffer_T::iterator_T it_last_IMU;
   /// Gravity vector.
-  Eigen::Matrix<double, 3, 1> g_;
+  Vector3_T g_;
 
   /// Is the filter initialized, so that we can propagate the state?
   bool initialized_;
@@ -231,7 +546,16 @@ class MSF_Core {
    */
   void ProcessIMU(const msf_core::Vector3&linear_acceleration,
                    const msf_core::Vector3&angular_velocity,
-                   const double& msg_stamp, size_t msg_seq);
+                   const int64_t& msg_stamp, size_t msg_seq);
+
+  /**
+   * \brief Processes a batch of IMU readings in time order, e.g. the FIFO of
+   * a high rate IMU. Publishes only every n-th propagated state of the batch
+   * as set in the sensor manager and the last one, and checks the pending
+   * measurements once after the batch.
+   * \param readings The readings, count of them.
+   */
+  void ProcessIMUBatch(const ImuReading* readings, size_t count);
 
   /// External state propagation:
   /**
@@ -246,14 +570,126 @@ class MSF_Core {
                         const msf_core::Vector3& angular_velocity,
                         const msf_core::Vector3& p, const msf_core::Vector3& v,
                         const msf_core::Quaternion& q,
-                        bool is_already_propagated, const double& msg_stamp,
+                        bool is_already_propagated, const int64_t& msg_stamp,
                         size_t msg_seq);
 
   /// Propagates P by one step to distribute processing load.
   void PropagatePOneStep();
 
-  /// Checks the queue of measurements to be applied in the future.
-  void HandlePendingMeasurements();
+  /**
+   * \brief Propagates P from the last propagated state to the latest state,
+   * computing Qd of all steps at once with CalcQCoreBatch. Used after a batch
+   * of IMU readings if the covariance of every state is kept.
+   */
+  void PropagateCovarianceBatch();
+
+  /**
+   * \brief Starts the covariance thread, if the sensor manager asks for it and
+   * the covariance is propagated state by state.
+   */
+  void StartCovarianceThread();
+
+  /// Asks the covariance thread to exit and joins it.
+  void StopCovarianceThread();
+
+  /// Wakes the covariance thread after new states were inserted.
+  void NotifyCovarianceThread();
+
+  /**
+   * \brief Blocks until the covariance thread finished the step it is on.
+   * Called with bufferMutex_ held, so no new step is started until the caller
+   * returns and the caller may then touch the covariance and time_P_propagated.
+   */
+  void WaitForCovarianceThread();
+
+  /// The loop of the covariance thread.
+  void CovarianceThreadLoop();
+
+  /**
+   * \brief Propagates the covariance by one step from the covariance thread.
+   * The sensor manager and the core parameters are only accessed while
+   * holding the buffers, the step itself runs on a copy of the parameters.
+   * \returns False if there was no step to propagate over.
+   */
+  bool PropagatePOneStepInBackground();
+
+  /**
+   * \brief Updates the delay statistics of the sensor of the measurement and
+   * derives the buffer horizon from the statistics of all sensors.
+   */
+  void UpdateDelayStatistics(
+      const shared_ptr<MSF_MeasurementBase<EKFState_T> >& measurement);
+
+  /// Checks up to maxfuture measurements of the queue of measurements to be
+  /// applied in the future and applies the measurements collected since the
+  /// last IMU reading. If there were none, applies a measurement deferred for
+  /// exceeding the replay budget.
+  void HandlePendingMeasurements(size_t maxfuture = 1);
+
+  /**
+   * \brief Propagates the latest state over the IMU reading and inserts the
+   * new state, or preintegrates the reading into the latest state.
+   * \param publish Whether to publish the propagated state.
+   * \param propagatecovariance Whether to propagate P by one step, otherwise
+   * the caller propagates it.
+   * \returns False if the reading was not integrated, e.g. on a reset.
+   */
+  bool IntegrateIMUReading(const msf_core::Vector3& linear_acceleration,
+                           const msf_core::Vector3& angular_velocity,
+                           const int64_t& msg_stamp, bool publish,
+                           bool propagatecovariance = true);
+
+  /**
+   * \brief Checks whether applying the measurement stays within the replay
+   * budget. Otherwise drops or defers it, as set in the sensor manager.
+   * \returns True if the measurement is to be applied now.
+   */
+  bool CheckReplayBudget(
+      shared_ptr<MSF_MeasurementBase<EKFState_T> >& measurement);
+
+  /**
+   * \brief Inserts the measurement into the measurement buffers, unless it is
+   * older than the oldest state.
+   * \param it_meas Set to the measurement in the buffer.
+   * \returns False if the measurement was rejected.
+   */
+  bool InsertMeasurement(shared_ptr<MSF_MeasurementBase<EKFState_T> >& measurement,
+                         typename measurementBufferT::iterator_T* it_meas);
+
+  /**
+   * \brief Applies the buffered measurements from it_meas on, repropagates
+   * the states after each of them and publishes the latest state.
+   */
+  void ApplyMeasurementsFrom(typename measurementBufferT::iterator_T it_meas);
+
+  /**
+   * \brief Inserts the measurements collected since the last IMU reading and
+   * applies them in a single replay, starting at the oldest of them.
+   */
+  void ApplyMeasurementBurst();
+
+  /**
+   * \brief Reads the snapshot settings from the sensor manager.
+   */
+  void ConfigureSnapshots();
+
+  /**
+   * \brief Copies the states of a snapshot to records, the caller holds
+   * bufferMutex_ or this takes it.
+   * \returns False if there is no state with covariance to start at.
+   */
+  bool CollectSnapshot(std::vector<SnapshotRecord_T>* records);
+
+  /**
+   * \brief Collects a snapshot if the snapshot period elapsed. The caller
+   * holds bufferMutex_ and writes the records by WriteSnapshotRecords once it
+   * released it.
+   */
+  void CollectSnapshotIfDue(std::vector<SnapshotRecord_T>* records);
+
+  /// Writes the records to the file, does nothing if there are none.
+  bool WriteSnapshotRecords(const std::string& filename,
+                            const std::vector<SnapshotRecord_T>& records);
 };
 }
 // msf_core
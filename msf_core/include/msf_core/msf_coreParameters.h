@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MSF_COREPARAMETERS_H_
+#define MSF_COREPARAMETERS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include <msf_core/implementation/calcQCore.h>
+
+namespace msf_core {
+
+/**
+ * \brief The parameters of the core, together with the terms derived from
+ * them. A block is immutable once published.
+ */
+struct CoreParameters {
+  bool fixed_bias;  ///< Whether the IMU biases are kept fixed.
+  double fuzzy_tracking_threshold;  ///< Threshold of the fuzzy tracking.
+  CoreProcessNoise noise;  ///< The noise densities and their squares.
+
+  CoreParameters()
+      : fixed_bias(false),
+        fuzzy_tracking_threshold(0.1) {
+  }
+
+  /**
+   * \brief Sets the noise densities of the IMU and updates the derived terms.
+   */
+  void SetNoise(double n_a, double n_ba, double n_w, double n_bw) {
+    typedef Eigen::Matrix<double, 3, 1> Vector3_T;
+    noise.Set(Vector3_T::Constant(n_a), Vector3_T::Constant(n_ba),
+              Vector3_T::Constant(n_w), Vector3_T::Constant(n_bw));
+  }
+};
+
+/**
+ * \brief Hands the core parameters from the thread changing them (e.g.
+ * dynamic reconfigure) to the filter. The block and its version are written
+ * and copied under a mutex. The version is atomic as well, so the reader only
+ * takes the lock when it changed since it last read.
+ */
+class CoreParameterBuffer {
+ public:
+  CoreParameterBuffer()
+      : version_(0) {
+  }
+
+  /**
+   * \brief Publishes a new parameter block.
+   */
+  void Publish(const CoreParameters& parameters) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    parameters_ = parameters;
+    version_.store(version_.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_release);
+  }
+
+  /**
+   * \brief The version of the latest published block, zero if none was
+   * published yet.
+   */
+  uint64_t Version() const {
+    return version_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * \brief Copies the latest block to parameters, if it is newer than
+   * version.
+   * \returns True if parameters and version were updated.
+   */
+  bool ReadIfNewer(uint64_t* version, CoreParameters* parameters) const {
+    if (Version() == *version) {
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    *version = version_.load(std::memory_order_relaxed);
+    *parameters = parameters_;
+    return true;
+  }
+
+ private:
+  CoreParameters parameters_;
+  std::atomic<uint64_t> version_;
+  mutable std::mutex mutex_;
+};
+
+}  // namespace msf_core
+#endif  // MSF_COREPARAMETERS_H_
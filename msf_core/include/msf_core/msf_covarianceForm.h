@@ -0,0 +1,433 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MSF_COVARIANCEFORM_H_
+#define MSF_COVARIANCEFORM_H_
+
+#include <Eigen/Dense>
+#include <msf_core/msf_blockJacobian.h>
+#include <msf_core/msf_macros.h>
+
+namespace msf_core {
+
+/**
+ * \brief Computes a square root L of the symmetric positive semi-definite
+ * matrix A, A = L * L^T. L is lower triangular if A is positive definite,
+ * otherwise negative pivots, which can only stem from round off, are clamped
+ * to zero.
+ */
+template<typename DerivedA, typename DerivedL>
+void CovarianceSquareRoot(const Eigen::MatrixBase<DerivedA>& A,
+                          Eigen::MatrixBase<DerivedL>& L) {
+  typedef typename DerivedA::PlainObject Matrix_T;
+  const Matrix_T A_sym = 0.5 * (A + A.transpose());
+  Eigen::LLT<Matrix_T> llt(A_sym);
+  if (llt.info() == Eigen::Success) {
+    L = llt.matrixL();
+    return;
+  }
+  Eigen::LDLT<Matrix_T> ldlt(A_sym);
+  Matrix_T L_ldlt = ldlt.matrixL();
+  L_ldlt = ldlt.transpositionsP().transpose() * L_ldlt;
+  L = L_ldlt * ldlt.vectorD().cwiseMax(0).cwiseSqrt().asDiagonal();
+}
+
+/**
+ * \brief Computes the lower triangular S with S * S^T = A * A^T for a pre-array
+ * A with at least as many columns as rows, by a QR decomposition of A^T.
+ */
+template<typename DerivedA, typename DerivedS>
+void TriangularizePreArray(const Eigen::MatrixBase<DerivedA>& A,
+                           Eigen::MatrixBase<DerivedS>& S) {
+  typedef Eigen::Matrix<typename DerivedA::Scalar, DerivedA::ColsAtCompileTime,
+      DerivedA::RowsAtCompileTime> Transposed_T;
+  Eigen::HouseholderQR<Transposed_T> qr(A.transpose());
+  S = qr.matrixQR().topRows(A.rows()).template triangularView<Eigen::Upper>()
+      .transpose();
+}
+
+/**
+ * \brief Sets the symmetric P = S * S^T, only computing one half of the
+ * product.
+ */
+template<typename DerivedS, typename DerivedP>
+void CovarianceFromSquareRoot(const Eigen::MatrixBase<DerivedS>& S,
+                              Eigen::MatrixBase<DerivedP>& P) {
+  P.template triangularView<Eigen::Lower>() = S * S.transpose();
+  P.template triangularView<Eigen::StrictlyUpper>() = P.transpose();
+}
+
+/**
+ * \brief Computes the Kalman gain K = P * H^T * S^-1 from PHt = P * H^T and the
+ * innovation covariance S by a Cholesky factorization of S instead of its
+ * inverse. Falls back to LDLT if S is not numerically positive definite.
+ */
+template<class S_type, class PHt_type, class K_type>
+void SolveKalmanGain(const Eigen::MatrixBase<S_type>& S,
+                     const Eigen::MatrixBase<PHt_type>& PHt,
+                     Eigen::MatrixBase<K_type>& K) {
+  typedef typename S_type::PlainObject S_T;
+  Eigen::LLT<S_T> llt(S);
+  if (llt.info() == Eigen::Success) {
+    K = llt.solve(PHt.transpose()).transpose();
+    return;
+  }
+  K = Eigen::LDLT<S_T>(S).solve(PHt.transpose()).transpose();
+}
+
+/**
+ * \brief Whether all off-diagonal entries of the measurement covariance R are
+ * zero, so the rows of the measurement can be applied one by one.
+ */
+template<class R_type>
+bool IsDiagonalCovariance(const Eigen::MatrixBase<R_type>& R) {
+  for (int j = 0; j < R.cols(); ++j) {
+    for (int i = 0; i < R.rows(); ++i) {
+      if (i != j && R(i, j) != 0) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * \brief Keeps the error state covariance P of the states and propagates and
+ * updates P itself. This is the default.
+ */
+struct FullCovarianceForm {
+  /// Nothing is stored next to P.
+  template<typename P_type>
+  struct Storage {
+  };
+
+  /**
+   * \brief Updates the representation after P of the state was set directly.
+   */
+  template<typename EKFState_T>
+  static void FromP(EKFState_T& UNUSEDPARAM(state)) {
+  }
+
+  /**
+   * \brief Computes P of state_new = Fd * P * Fd^T + Qd from P of state_old.
+   */
+  template<typename EKFState_T>
+  static void Propagate(const EKFState_T& state_old,
+                        const typename EKFState_T::F_type& Fd,
+                        const typename EKFState_T::Q_type& Qd,
+                        EKFState_T& state_new) {
+    Fd.PropagateCovariance(state_old.GetP(), Qd, state_new.GetP());
+  }
+
+  /**
+   * \brief Computes the Kalman gain of the measurement and updates P of the
+   * state in Joseph form.
+   */
+  template<typename EKFState_T, class H_type, class R_type, class K_type>
+  static void Update(EKFState_T& state, const Eigen::MatrixBase<H_type>& H,
+                     const Eigen::MatrixBase<R_type>& R,
+                     Eigen::MatrixBase<K_type>& K) {
+    typedef typename EKFState_T::P_type P_type;
+    P_type& P = state.GetP();
+
+    const typename R_type::PlainObject S = H * P * H.transpose() + R;
+    SolveKalmanGain(S, P * H.transpose(), K);
+
+    const P_type KH = (P_type::Identity() - K * H);
+    P = KH * P * KH.transpose() + K * R * K.transpose();
+
+    // Make sure P stays symmetric.
+    P = 0.5 * (P + P.transpose()).eval();
+  }
+
+  /**
+   * \brief Computes the Kalman gain of a measurement whose H is only nonzero
+   * in the column blocks of HBlocks_T, see BlockSparseJacobian, and updates P
+   * of the state. Only the columns of P of these blocks enter P * H^T, the
+   * update of P is of the rank of the measurement. The Joseph form is expanded
+   * the same way, P - K * (P * H^T)^T - (P * H^T) * K^T + K * S * K^T.
+   */
+  template<class HBlocks_T, typename EKFState_T, class H_type, class R_type,
+      class K_type>
+  static void UpdateSparse(EKFState_T& state,
+                           const Eigen::MatrixBase<H_type>& H,
+                           const Eigen::MatrixBase<R_type>& R,
+                           Eigen::MatrixBase<K_type>& K,
+                           CovarianceUpdateForm form) {
+    enum {
+      N = EKFState_T::nErrorStatesAtCompileTime,
+      M = R_type::RowsAtCompileTime,
+      C = HBlocks_T::nColumns
+    };
+    typedef typename EKFState_T::Scalar_T Scalar_T;
+    typedef typename EKFState_T::P_type P_type;
+    typedef typename R_type::PlainObject R_T;
+    P_type& P = state.GetP();
+
+    Eigen::Matrix<Scalar_T, M, C> H_c;
+    HBlocks_T::GatherColumns(H, H_c);
+    Eigen::Matrix<Scalar_T, N, C> P_c;
+    HBlocks_T::GatherColumns(P, P_c);
+    const Eigen::Matrix<Scalar_T, N, M> PHt = P_c * H_c.transpose();
+    Eigen::Matrix<Scalar_T, C, M> PHt_c;
+    HBlocks_T::GatherRows(PHt, PHt_c);
+
+    const R_T S = H_c * PHt_c + R;
+    SolveKalmanGain(S, PHt, K);
+
+    if (form == kJosephUpdate) {
+      const P_type KHP = K * PHt.transpose();
+      P += K * S * K.transpose() - KHP - KHP.transpose();
+    } else {
+      P -= K * PHt.transpose();
+    }
+
+    // Make sure P stays symmetric.
+    P = 0.5 * (P + P.transpose()).eval();
+  }
+
+  /**
+   * \brief Applies a measurement with diagonal R as a sequence of scalar
+   * updates, one per row of H, and accumulates the correction of the state
+   * from the residual. No matrix is factorized or inverted, S of each row is a
+   * scalar. H is only nonzero in the column blocks of HBlocks_T, see
+   * BlockSparseJacobian and DenseJacobian. In Joseph form every row updates P
+   * by P - k * (P * h)^T - (P * h) * k^T + k * s * k^T.
+   */
+  template<class HBlocks_T, typename EKFState_T, class H_type, class R_type,
+      class Res_type, class Correction_type>
+  static void UpdateSequential(EKFState_T& state,
+                               const Eigen::MatrixBase<H_type>& H,
+                               const Eigen::MatrixBase<R_type>& R,
+                               const Eigen::MatrixBase<Res_type>& residual,
+                               Eigen::MatrixBase<Correction_type>& correction,
+                               CovarianceUpdateForm form = kStandardUpdate) {
+    enum {
+      N = EKFState_T::nErrorStatesAtCompileTime,
+      C = HBlocks_T::nColumns
+    };
+    typedef typename EKFState_T::Scalar_T Scalar_T;
+    typedef typename EKFState_T::P_type P_type;
+    typedef Eigen::Matrix<Scalar_T, N, 1> Column_T;
+    typedef Eigen::Matrix<Scalar_T, C, 1> CompactColumn_T;
+    P_type& P = state.GetP();
+
+    correction.setZero();
+    Eigen::Matrix<Scalar_T, N, C> P_c;
+    CompactColumn_T h_c;
+    CompactColumn_T Ph_c;
+    CompactColumn_T correction_c;
+    for (int i = 0; i < H.rows(); ++i) {
+      HBlocks_T::GatherRows(H.row(i).transpose(), h_c);
+      HBlocks_T::GatherColumns(P, P_c);
+      const Column_T Ph = P_c * h_c;
+      HBlocks_T::GatherRows(Ph, Ph_c);
+      HBlocks_T::GatherRows(correction, correction_c);
+
+      // The residual of this row is relinearized around the correction of
+      // the rows before.
+      const Scalar_T s = h_c.dot(Ph_c) + R(i, i);
+      const Column_T k = Ph / s;
+      correction += k * (residual(i, 0) - h_c.dot(correction_c));
+      if (form == kJosephUpdate) {
+        const P_type kPh = k * Ph.transpose();
+        P += s * k * k.transpose() - kPh - kPh.transpose();
+      } else {
+        P.noalias() -= k * Ph.transpose();
+      }
+    }
+
+    // Make sure P stays symmetric.
+    P = 0.5 * (P + P.transpose()).eval();
+  }
+};
+
+/**
+ * \brief Keeps a square root S of the error state covariance, P = S * S^T,
+ * next to P and propagates and updates S by triangularizing pre-arrays. P is
+ * derived from S, so it stays symmetric and positive semi-definite by
+ * construction, without symmetrization or Joseph form. The propagation costs a
+ * QR decomposition of size 2N x N per state instead of the block sparse
+ * product.
+ *
+ * Select it for a state type by specializing CovarianceFormForState.
+ */
+struct SquareRootCovarianceForm {
+  /// The square root S stored next to P.
+  template<typename P_type>
+  struct Storage {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    P_type S;  ///< Lower triangular square root of P.
+
+    Storage() {
+      S.setZero();
+    }
+  };
+
+  /**
+   * \brief Updates S after P of the state was set directly.
+   */
+  template<typename EKFState_T>
+  static void FromP(EKFState_T& state) {
+    CovarianceSquareRoot(const_cast<const EKFState_T&>(state).GetP(),
+                         state.GetSqrtP());
+  }
+
+  /**
+   * \brief Computes S of state_new from the pre-array [Fd * S, sqrt(Qd)] and
+   * derives P from it.
+   */
+  template<typename EKFState_T>
+  static void Propagate(const EKFState_T& state_old,
+                        const typename EKFState_T::F_type& Fd,
+                        const typename EKFState_T::Q_type& Qd,
+                        EKFState_T& state_new) {
+    enum {
+      N = EKFState_T::nErrorStatesAtCompileTime
+    };
+    Eigen::Matrix<typename EKFState_T::Scalar_T, N, 2 * N> A;
+    typename EKFState_T::P_type FS = state_old.GetSqrtP();
+    Fd.MultiplyFromLeft(FS);
+    A.template block<N, N>(0, 0) = FS;
+    typename EKFState_T::Q_type sqrtQd;
+    CovarianceSquareRoot(Qd, sqrtQd);
+    A.template block<N, N>(0, N) = sqrtQd;
+
+    TriangularizePreArray(A, state_new.GetSqrtP());
+    CovarianceFromSquareRoot(
+        const_cast<const EKFState_T&>(state_new).GetSqrtP(),
+        state_new.GetP());
+  }
+
+  /**
+   * \brief Computes the Kalman gain of the measurement and updates S of the
+   * state by triangularizing the pre-array
+   *
+   *   [ sqrt(R)  H * S ]        [ sqrt(H * P * H^T + R)  0   ]
+   *   [    0       S   ]  -->   [ K * sqrt(H*P*H^T + R)  S+  ]
+   */
+  template<typename EKFState_T, class H_type, class R_type, class K_type>
+  static void Update(EKFState_T& state, const Eigen::MatrixBase<H_type>& H,
+                     const Eigen::MatrixBase<R_type>& R,
+                     Eigen::MatrixBase<K_type>& K) {
+    enum {
+      N = EKFState_T::nErrorStatesAtCompileTime,
+      M = R_type::RowsAtCompileTime,
+      MN = (M == Eigen::Dynamic ? Eigen::Dynamic : M + N)
+    };
+    typedef Eigen::Matrix<typename EKFState_T::Scalar_T, MN, MN> PreArray_T;
+    typedef typename R_type::PlainObject R_T;
+    const int m = R.rows();
+    const typename EKFState_T::P_type& S =
+        const_cast<const EKFState_T&>(state).GetSqrtP();
+
+    PreArray_T A = PreArray_T::Zero(m + N, m + N);
+    R_T sqrtR;
+    CovarianceSquareRoot(R, sqrtR);
+    A.topLeftCorner(m, m) = sqrtR;
+    A.topRightCorner(m, N) = H * S;
+    A.bottomRightCorner(N, N) = S;
+    UpdateFromPreArray(state, A, m, K);
+  }
+
+  /**
+   * \brief Like Update, for a measurement whose H is only nonzero in the
+   * column blocks of HBlocks_T. H * S is computed from the rows of S of these
+   * blocks. The update is stable by construction, so the form is ignored.
+   */
+  template<class HBlocks_T, typename EKFState_T, class H_type, class R_type,
+      class K_type>
+  static void UpdateSparse(EKFState_T& state,
+                           const Eigen::MatrixBase<H_type>& H,
+                           const Eigen::MatrixBase<R_type>& R,
+                           Eigen::MatrixBase<K_type>& K,
+                           CovarianceUpdateForm UNUSEDPARAM(form)) {
+    enum {
+      N = EKFState_T::nErrorStatesAtCompileTime,
+      M = R_type::RowsAtCompileTime,
+      MN = (M == Eigen::Dynamic ? Eigen::Dynamic : M + N),
+      C = HBlocks_T::nColumns
+    };
+    typedef typename EKFState_T::Scalar_T Scalar_T;
+    typedef Eigen::Matrix<Scalar_T, MN, MN> PreArray_T;
+    typedef typename R_type::PlainObject R_T;
+    const int m = R.rows();
+
+    Eigen::Matrix<Scalar_T, M, C> H_c;
+    H_c.resize(m, static_cast<int>(C));
+    HBlocks_T::GatherColumns(H, H_c);
+    Eigen::Matrix<Scalar_T, C, N> S_c;
+    HBlocks_T::GatherRows(const_cast<const EKFState_T&>(state).GetSqrtP(), S_c);
+
+    PreArray_T A = PreArray_T::Zero(m + N, m + N);
+    R_T sqrtR;
+    CovarianceSquareRoot(R, sqrtR);
+    A.topLeftCorner(m, m) = sqrtR;
+    A.topRightCorner(m, N) = H_c * S_c;
+    A.bottomRightCorner(N, N) =
+        const_cast<const EKFState_T&>(state).GetSqrtP();
+    UpdateFromPreArray(state, A, m, K);
+  }
+
+  /**
+   * \brief Like UpdateSparse for a measurement with diagonal R, computing the
+   * correction of the state from the residual. The pre-array already takes
+   * the whole measurement without inverting S, so the rows are not split. The
+   * update is stable by construction, so the form is ignored.
+   */
+  template<class HBlocks_T, typename EKFState_T, class H_type, class R_type,
+      class Res_type, class Correction_type>
+  static void UpdateSequential(
+      EKFState_T& state, const Eigen::MatrixBase<H_type>& H,
+      const Eigen::MatrixBase<R_type>& R,
+      const Eigen::MatrixBase<Res_type>& residual,
+      Eigen::MatrixBase<Correction_type>& correction,
+      CovarianceUpdateForm UNUSEDPARAM(form) = kStandardUpdate) {
+    Eigen::Matrix<typename EKFState_T::Scalar_T,
+        EKFState_T::nErrorStatesAtCompileTime, R_type::RowsAtCompileTime> K;
+    K.resize(static_cast<int>(EKFState_T::nErrorStatesAtCompileTime), R.rows());
+    UpdateSparse<HBlocks_T>(state, H, R, K, kStandardUpdate);
+    correction = K * residual;
+  }
+
+ private:
+  /**
+   * \brief Triangularizes the pre-array of the update with m measurement rows
+   * and sets K and S of the state from it.
+   */
+  template<typename EKFState_T, class PreArray_T, class K_type>
+  static void UpdateFromPreArray(EKFState_T& state, const PreArray_T& A, int m,
+                                 Eigen::MatrixBase<K_type>& K) {
+    enum {
+      N = EKFState_T::nErrorStatesAtCompileTime,
+      M = PreArray_T::RowsAtCompileTime == Eigen::Dynamic ?
+          Eigen::Dynamic : PreArray_T::RowsAtCompileTime - N
+    };
+    typedef Eigen::Matrix<typename EKFState_T::Scalar_T, M, M> R_T;
+
+    PreArray_T L(m + N, m + N);
+    TriangularizePreArray(A, L);
+    K = L.bottomLeftCorner(N, m)
+        * L.topLeftCorner(m, m).template triangularView<Eigen::Lower>()
+            .solve(R_T::Identity(m, m));
+    state.GetSqrtP() = L.bottomRightCorner(N, N);
+    CovarianceFromSquareRoot(
+        const_cast<const EKFState_T&>(state).GetSqrtP(), state.GetP());
+  }
+};
+}  // namespace msf_core
+
+#endif  // MSF_COVARIANCEFORM_H_
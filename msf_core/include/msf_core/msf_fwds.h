@@ -85,5 +85,48 @@ template<typename EKFState_T> class MSF_InvalidMeasurement;
 template<typename EKFState_T> class MSF_SensorHandler;
 template<typename EKFState_T> class MSF_SensorManager;
 
+// Container backends for the state and measurement buffers of the core.
+struct SortedContainerBackend;
+struct SortedRingContainerBackend;
+
+/**
+ * \brief Selects the container backend used by the MSF_Core instantiated for
+ * a given state type. Specialize this next to the state definition to switch
+ * e.g. to the SortedRingContainerBackend.
+ */
+template<typename EKFState_T>
+struct ContainerBackendForState {
+  typedef SortedContainerBackend type;
+};
+
+// Representations of the error state covariance of the states.
+struct FullCovarianceForm;
+struct SquareRootCovarianceForm;
+
+/**
+ * \brief Selects how the core represents, propagates and updates the error
+ * state covariance of a given state type. Specialize this next to the state
+ * definition to switch e.g. to the SquareRootCovarianceForm.
+ */
+template<typename EKFState_T>
+struct CovarianceFormForState {
+  typedef FullCovarianceForm type;
+};
+
+// Integrators of the IMU readings between two states.
+struct PowerSeriesAttitudeIntegrator;
+struct ClosedFormAttitudeIntegrator;
+struct RungeKuttaAttitudeIntegrator;
+
+/**
+ * \brief Selects how the core integrates the IMU readings between two states
+ * of a given state type. Specialize this next to the state definition to
+ * switch e.g. to the RungeKuttaAttitudeIntegrator.
+ */
+template<typename EKFState_T>
+struct AttitudeIntegratorForState {
+  typedef PowerSeriesAttitudeIntegrator type;
+};
+
 }
 #endif  // MSF_FWD_HPP_
@@ -0,0 +1,330 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MSF_IMUPREINTEGRATION_H_
+#define MSF_IMUPREINTEGRATION_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+
+#include <msf_core/eigen_utils.h>
+#include <msf_core/msf_macros.h>
+#include <msf_core/msf_tools.h>
+#include <msf_core/implementation/calcQCore.h>
+
+namespace msf_core {
+
+/**
+ * \brief The IMU readings between two states, preintegrated in the body frame
+ * of the older state. Position, velocity and attitude of the newer state
+ * follow from the older state and the increments, see Predict. The
+ * increments are integrated like MSF_Core::PropagateState integrates single
+ * readings, for the biases of the older state at the time of integration.
+ * Different biases are accounted for to first order by the bias Jacobians.
+ *
+ * The readings are kept to split the interval, e.g. when a measurement falls
+ * in between the two states.
+ */
+template<typename Scalar_T>
+class ImuPreintegration {
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  typedef Eigen::Matrix<Scalar_T, 3, 1> Vector3_T;
+  typedef Eigen::Matrix<Scalar_T, 3, 3> Matrix3_T;
+  typedef Eigen::Matrix<Scalar_T, 9, 9> Matrix9_T;
+  typedef Eigen::Quaternion<Scalar_T> Quaternion_T;
+
+  /// \brief An IMU reading.
+  struct Reading {
+    int64_t time;  ///< Time of the reading [ns].
+    Vector3_T a_m;  ///< Linear acceleration.
+    Vector3_T w_m;  ///< Angular velocity.
+  };
+
+  ImuPreintegration() {
+    Reset();
+  }
+
+  /**
+   * \brief Removes all readings.
+   */
+  void Reset() {
+    readings_.clear();
+    b_a_.setZero();
+    b_w_.setZero();
+    ResetIncrements();
+  }
+
+  /**
+   * \brief Returns whether there are no readings, i.e. the newer state was
+   * propagated over a single reading.
+   */
+  bool Empty() const {
+    return readings_.empty();
+  }
+
+  /**
+   * \brief The number of readings integrated, not counting the one of the
+   * older state.
+   */
+  size_t Size() const {
+    return readings_.empty() ? 0 : readings_.size() - 1;
+  }
+
+  /**
+   * \brief Starts the integration at the older state.
+   * \param time, a_m, w_m Time and IMU reading of the older state.
+   * \param b_a, b_w The biases to integrate the readings for.
+   */
+  void Start(int64_t time, const Vector3_T& a_m, const Vector3_T& w_m,
+             const Vector3_T& b_a, const Vector3_T& b_w) {
+    Reset();
+    b_a_ = b_a;
+    b_w_ = b_w;
+    Reading reading;
+    reading.time = time;
+    reading.a_m = a_m;
+    reading.w_m = w_m;
+    readings_.push_back(reading);
+  }
+
+  /**
+   * \brief Integrates the next IMU reading.
+   */
+  void Integrate(int64_t time, const Vector3_T& a_m, const Vector3_T& w_m,
+                 const CoreProcessNoise& noise) {
+    Reading reading;
+    reading.time = time;
+    reading.a_m = a_m;
+    reading.w_m = w_m;
+    readings_.push_back(reading);
+    IntegrateStep(readings_[readings_.size() - 2], reading, noise);
+  }
+
+  /**
+   * \brief Splits the interval at the given time, which has to be between
+   * the first and the last reading. The readings up to time go to head,
+   * which afterwards ends at time with the reading interpolated there. This
+   * interval starts at time with the interpolated reading.
+   * \returns False if time is not within the readings, both are unchanged
+   * then.
+   */
+  bool Split(int64_t time, const CoreProcessNoise& noise,
+             ImuPreintegration* head) {
+    typename std::vector<Reading>::iterator it = readings_.begin();
+    while (it != readings_.end() && it->time <= time) {
+      ++it;
+    }
+    if (it == readings_.begin() || it == readings_.end()) {
+      MSF_ERROR_STREAM(__FUNCTION__ << " The time " << time << " is not within "
+                       "the preintegrated readings.");
+      return false;
+    }
+    const Reading& before = *(it - 1);
+    const Reading& after = *it;
+    Reading interpolated;
+    interpolated.time = time;
+    const Scalar_T alpha = static_cast<Scalar_T>(time - before.time)
+        / static_cast<Scalar_T>(after.time - before.time);
+    interpolated.a_m = before.a_m + (after.a_m - before.a_m) * alpha;
+    interpolated.w_m = before.w_m + (after.w_m - before.w_m) * alpha;
+
+    head->Start(readings_.front().time, readings_.front().a_m,
+                readings_.front().w_m, b_a_, b_w_);
+    for (typename std::vector<Reading>::const_iterator ithead =
+        readings_.begin() + 1; ithead != it; ++ithead) {
+      if (ithead->time < time) {
+        head->Integrate(ithead->time, ithead->a_m, ithead->w_m, noise);
+      }
+    }
+    head->Integrate(time, interpolated.a_m, interpolated.w_m, noise);
+
+    std::vector<Reading> tail;
+    tail.push_back(interpolated);
+    tail.insert(tail.end(), it, readings_.end());
+    const Vector3_T b_a = b_a_;
+    const Vector3_T b_w = b_w_;
+    Start(interpolated.time, interpolated.a_m, interpolated.w_m, b_a, b_w);
+    for (size_t i = 1; i < tail.size(); ++i) {
+      Integrate(tail[i].time, tail[i].a_m, tail[i].w_m, noise);
+    }
+    return true;
+  }
+
+  /**
+   * \brief Returns the increments for the given biases, corrected to first
+   * order from the biases the readings were integrated for.
+   */
+  void Predict(const Vector3_T& b_a, const Vector3_T& b_w,
+               Quaternion_T* delta_q, Vector3_T* delta_v,
+               Vector3_T* delta_p) const {
+    const Vector3_T db_a = b_a - b_a_;
+    const Vector3_T db_w = b_w - b_w_;
+    *delta_q = delta_q_ * QuaternionFromSmallAngle(J_q_bw_ * db_w);
+    delta_q->normalize();
+    *delta_v = delta_v_ + J_v_bw_ * db_w + J_v_ba_ * db_a;
+    *delta_p = delta_p_ + J_p_bw_ * db_w + J_p_ba_ * db_a;
+  }
+
+  /// The time the readings span [s].
+  Scalar_T Dt() const {
+    return dt_;
+  }
+  /// The first reading, i.e. the one of the older state.
+  const Reading& Front() const {
+    return readings_.front();
+  }
+  /// The latest reading.
+  const Reading& Back() const {
+    return readings_.back();
+  }
+  /// Rotation of the newer body frame with respect to the older one.
+  const Quaternion_T& DeltaQ() const {
+    return delta_q_;
+  }
+  /// Velocity increment in the older body frame, without gravity.
+  const Vector3_T& DeltaV() const {
+    return delta_v_;
+  }
+  /// Position increment in the older body frame, without gravity.
+  const Vector3_T& DeltaP() const {
+    return delta_p_;
+  }
+  /// Jacobians of the increments with respect to the biases.
+  const Matrix3_T& J_q_bw() const {
+    return J_q_bw_;
+  }
+  const Matrix3_T& J_v_bw() const {
+    return J_v_bw_;
+  }
+  const Matrix3_T& J_v_ba() const {
+    return J_v_ba_;
+  }
+  const Matrix3_T& J_p_bw() const {
+    return J_p_bw_;
+  }
+  const Matrix3_T& J_p_ba() const {
+    return J_p_ba_;
+  }
+  /**
+   * \brief Covariance of the increments due to the IMU noise, ordered
+   * attitude (in the newer body frame), velocity, position (both in the older
+   * body frame).
+   */
+  const Matrix9_T& Sigma() const {
+    return sigma_;
+  }
+
+ private:
+  void ResetIncrements() {
+    dt_ = 0;
+    delta_q_.setIdentity();
+    delta_v_.setZero();
+    delta_p_.setZero();
+    J_q_bw_.setZero();
+    J_v_bw_.setZero();
+    J_v_ba_.setZero();
+    J_p_bw_.setZero();
+    J_p_ba_.setZero();
+    sigma_.setZero();
+  }
+
+  void IntegrateStep(const Reading& previous, const Reading& reading,
+                     const CoreProcessNoise& noise) {
+    const Scalar_T dt = NanosecondsToSeconds(reading.time - previous.time);
+    if (dt <= 0) {
+      return;
+    }
+    const Scalar_T dt2_2 = dt * dt * Scalar_T(0.5);
+    const Vector3_T ea_old = previous.a_m - b_a_;
+    const Vector3_T ea = reading.a_m - b_a_;
+    const Vector3_T ew = (previous.w_m + reading.w_m) * Scalar_T(0.5) - b_w_;
+
+    // Rotation over the step, the mean rate like MSF_Core::PropagateState.
+    const Vector3_T theta = ew * dt;
+    const Scalar_T angle = theta.norm();
+    Quaternion_T dq = Quaternion_T::Identity();
+    if (angle > Scalar_T(0)) {
+      dq = Quaternion_T(Eigen::AngleAxis<Scalar_T>(angle, theta / angle));
+    }
+    const Matrix3_T dR = dq.toRotationMatrix();
+    const Matrix3_T Jr = Matrix3_T::Identity() - Scalar_T(0.5) * Skew(theta);
+
+    const Matrix3_T R_old = delta_q_.toRotationMatrix();
+    const Quaternion_T delta_q_new = (delta_q_ * dq).normalized();
+    const Matrix3_T R_new = delta_q_new.toRotationMatrix();
+
+    // Trapezoidal integration like MSF_Core::PropagateState.
+    const Vector3_T delta_v_new = delta_v_
+        + (R_old * ea_old + R_new * ea) * Scalar_T(0.5) * dt;
+    delta_p_ += (delta_v_ + delta_v_new) * Scalar_T(0.5) * dt;
+    delta_v_ = delta_v_new;
+
+    // Jacobians and noise propagation to first order, with the attitude
+    // Jacobian averaged over the step.
+    const Matrix3_T Ra_sk = R_old * Skew(ea_old);
+    const Matrix3_T J_q_bw_new = dR.transpose() * J_q_bw_ - Jr * dt;
+    const Matrix3_T J_q_bw_mean = (J_q_bw_ + J_q_bw_new) * Scalar_T(0.5);
+    J_p_ba_ += J_v_ba_ * dt - R_old * dt2_2;
+    J_p_bw_ += J_v_bw_ * dt - Ra_sk * J_q_bw_mean * dt2_2;
+    J_v_ba_ -= R_old * dt;
+    J_v_bw_ -= Ra_sk * J_q_bw_mean * dt;
+    J_q_bw_ = J_q_bw_new;
+
+    Matrix9_T A = Matrix9_T::Identity();
+    A.template block<3, 3>(0, 0) = dR.transpose();
+    A.template block<3, 3>(3, 0) = -Ra_sk * dt;
+    A.template block<3, 3>(6, 0) = -Ra_sk * dt2_2;
+    A.template block<3, 3>(6, 3) = Matrix3_T::Identity() * dt;
+    sigma_ = A * sigma_ * A.transpose();
+    // Angular velocity noise, and the acceleration noise integrated over the
+    // step.
+    sigma_.template block<3, 3>(0, 0) += Jr
+        * (noise.n_w2.template cast<Scalar_T>() * dt).asDiagonal()
+        * Jr.transpose();
+    const Matrix3_T N_a = R_old
+        * noise.n_a2.template cast<Scalar_T>().asDiagonal() * R_old.transpose();
+    sigma_.template block<3, 3>(3, 3) += N_a * dt;
+    sigma_.template block<3, 3>(3, 6) += N_a * dt2_2;
+    sigma_.template block<3, 3>(6, 3) += N_a * dt2_2;
+    sigma_.template block<3, 3>(6, 6) +=
+        N_a * (dt * dt * dt / Scalar_T(3.0));
+
+    delta_q_ = delta_q_new;
+    dt_ += dt;
+  }
+
+  std::vector<Reading> readings_;  ///< The readings, the older state first.
+  Vector3_T b_a_;  ///< The acceleration bias integrated for.
+  Vector3_T b_w_;  ///< The angular velocity bias integrated for.
+  Scalar_T dt_;
+  Quaternion_T delta_q_;
+  Vector3_T delta_v_;
+  Vector3_T delta_p_;
+  Matrix3_T J_q_bw_;
+  Matrix3_T J_v_bw_;
+  Matrix3_T J_v_ba_;
+  Matrix3_T J_p_bw_;
+  Matrix3_T J_p_ba_;
+  Matrix9_T sigma_;
+};
+
+}  // namespace msf_core
+#endif  // MSF_IMUPREINTEGRATION_H_
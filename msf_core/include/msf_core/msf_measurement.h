@@ -20,6 +20,7 @@
 #include <Eigen/Dense>
 #include <boost/shared_ptr.hpp>
 
+#include <msf_core/msf_blockJacobian.h>
 #include <msf_core/msf_fwds.h>
 #include <msf_core/msf_types.h>
 
@@ -45,24 +46,43 @@ class MSF_MeasurementBase {
   virtual std::string Type() = 0;
   int sensorID_;
   bool isabsolute_;
-  double time;  ///< The time_ this measurement was taken.
+  int64_t time;  ///< The time_ this measurement was taken [ns].
  protected:
   /**
    * Main update routine called by a given sensor, will apply the measurement to
-   * the state inside the core.
+   * the state inside the core. The gain is solved for by a Cholesky
+   * factorization of S, a measurement with diagonal R is applied as a sequence
+   * of scalar updates. These update the covariance in the given form, a
+   * correlated R always updates it in Joseph form.
    */
   template<class H_type, class Res_type, class R_type>
   void CalculateAndApplyCorrection(
       shared_ptr<EKFState_T> state, MSF_Core<EKFState_T>& core,
       const Eigen::MatrixBase<H_type>& H,
       const Eigen::MatrixBase<Res_type>& residual,
-      const Eigen::MatrixBase<R_type>& R);
+      const Eigen::MatrixBase<R_type>& R,
+      CovarianceUpdateForm form = kJosephUpdate);
 
   void CalculateAndApplyCorrection(shared_ptr<EKFState_T> state,
                                    MSF_Core<EKFState_T>& core,
                                    const Eigen::MatrixXd& H,
                                    const Eigen::MatrixXd& residual,
-                                   const Eigen::MatrixXd& R);
+                                   const Eigen::MatrixXd& R,
+                                   CovarianceUpdateForm form = kJosephUpdate);
+
+  /**
+   * Update routine for measurements whose H is only nonzero in the column
+   * blocks declared by HBlocks_T, see BlockSparseJacobian. Only works on these
+   * columns of P and keeps the covariance in Joseph form only if asked to.
+   * A diagonal R is applied as a sequence of scalar updates.
+   */
+  template<class HBlocks_T, class H_type, class Res_type, class R_type>
+  void CalculateAndApplyCorrection(
+      shared_ptr<EKFState_T> state, MSF_Core<EKFState_T>& core,
+      const Eigen::MatrixBase<H_type>& H,
+      const Eigen::MatrixBase<Res_type>& residual,
+      const Eigen::MatrixBase<R_type>& R, const HBlocks_T& hblocks,
+      CovarianceUpdateForm form = kStandardUpdate);
 
   template<class H_type, class Res_type, class R_type>
   void CalculateAndApplyCorrectionRelative(
@@ -122,7 +142,7 @@ class MSF_Measurement : public MSF_MeasurementBase<EKFState_T> {
   }
   virtual ~MSF_Measurement() { }
   void MakeFromSensorReading(const boost::shared_ptr<T const> reading,
-                             double timestamp) {
+                             int64_t timestamp) {
     this->time = timestamp;
     MakeFromSensorReadingImpl(reading);
 
@@ -163,7 +183,7 @@ class MSF_InitMeasurement : public MSF_MeasurementBase<EKFState_T> {
       bool ContainsInitialSensorReadings)
       : MSF_MeasurementBase<EKFState_T>(true, -1) {
     ContainsInitialSensorReadings_ = ContainsInitialSensorReadings;
-    this->time = ros::Time::now().toSec();
+    this->time = ros::Time::now().toNSec();
   }
   virtual ~MSF_InitMeasurement() {
   }
@@ -172,18 +192,21 @@ class MSF_InitMeasurement : public MSF_MeasurementBase<EKFState_T> {
     return "init";
   }
   typename EKFState_T::P_type& GetStateCovariance() {
-    return InitState.P;
+    if (!InitState.HasCovariance()) {
+      InitState.AllocateCovariance();
+    }
+    return InitState.GetP();
   }
   /**
    * \brief Get the gyro measurement.
    */
-  Eigen::Matrix<double, 3, 1>& Getw_m() {
+  Eigen::Matrix<typename EKFState_T::Scalar_T, 3, 1>& Getw_m() {
     return InitState.w_m;
   }
   /**
    * \brief Get the acceleration measurment.
    */
-  Eigen::Matrix<double, 3, 1>& Geta_m() {
+  Eigen::Matrix<typename EKFState_T::Scalar_T, 3, 1>& Geta_m() {
     return InitState.a_m;
   }
 
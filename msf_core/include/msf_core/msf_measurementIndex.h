@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MSF_MEASUREMENTINDEX_H_
+#define MSF_MEASUREMENTINDEX_H_
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include <msf_core/msf_types.h>
+
+namespace msf_core {
+/**
+ * \brief Keeps the measurements of every sensor in their own time ordered
+ * list, next to the buffer holding the measurements of all sensors. Queries
+ * for measurements of one sensor are logarithmic in the number of measurements
+ * of this sensor, independent of the other sensors fused.
+ */
+template<typename T>
+class MeasurementIndex {
+ public:
+  typedef shared_ptr<T> Ptr_T;
+
+ private:
+  typedef std::map<int64_t, Ptr_T> SensorListT;  ///< Measurements by time.
+  typedef std::map<int, SensorListT> IndexT;  ///< Lists by sensor id.
+  IndexT index_;
+
+ public:
+  /**
+   * \brief Drops the measurements of all sensors.
+   */
+  inline void Clear() {
+    index_.clear();
+  }
+
+  /**
+   * \brief Adds a measurement to the list of its sensor.
+   */
+  inline void Insert(const Ptr_T& value) {
+    index_[value->sensorID_][value->time] = value;
+  }
+
+  /**
+   * \brief Drops the measurements of all sensors older than the given time.
+   */
+  inline void ClearOlderThan(int64_t time) {
+    for (typename IndexT::iterator it = index_.begin(); it != index_.end();) {
+      SensorListT& list = it->second;
+      list.erase(list.begin(), list.lower_bound(time));
+      if (list.empty()) {
+        index_.erase(it++);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  /**
+   * \brief Returns the number of measurements of a sensor.
+   */
+  inline size_t Size(int sensorID) const {
+    typename IndexT::const_iterator it = index_.find(sensorID);
+    return it == index_.end() ? 0 : it->second.size();
+  }
+
+  /**
+   * \brief Returns the last measurement of the sensor before the given time,
+   * or an empty pointer if there is none.
+   */
+  inline Ptr_T GetPrevious(int sensorID, int64_t time) const {
+    typename IndexT::const_iterator it = index_.find(sensorID);
+    if (it == index_.end()) {
+      return Ptr_T();
+    }
+    typename SensorListT::const_iterator itmeas = it->second.lower_bound(time);
+    if (itmeas == it->second.begin()) {
+      return Ptr_T();
+    }
+    return (--itmeas)->second;
+  }
+
+  /**
+   * \brief Returns the first measurement of the sensor after the given time,
+   * or an empty pointer if there is none.
+   */
+  inline Ptr_T GetNext(int sensorID, int64_t time) const {
+    typename IndexT::const_iterator it = index_.find(sensorID);
+    if (it == index_.end()) {
+      return Ptr_T();
+    }
+    typename SensorListT::const_iterator itmeas = it->second.upper_bound(time);
+    if (itmeas == it->second.end()) {
+      return Ptr_T();
+    }
+    return itmeas->second;
+  }
+
+  /**
+   * \brief Appends the measurements of the sensor in [timefrom, timeto] to
+   * the vector, ordered by time.
+   * \returns The number of measurements appended.
+   */
+  inline size_t GetRange(int sensorID, int64_t timefrom, int64_t timeto,
+                         std::vector<Ptr_T>& measurements) const {
+    typename IndexT::const_iterator it = index_.find(sensorID);
+    if (it == index_.end() || timeto < timefrom) {
+      return 0;
+    }
+    size_t count = 0;
+    typename SensorListT::const_iterator itend = it->second.upper_bound(
+        timeto);
+    for (typename SensorListT::const_iterator itmeas = it->second.lower_bound(
+        timefrom); itmeas != itend; ++itmeas, ++count) {
+      measurements.push_back(itmeas->second);
+    }
+    return count;
+  }
+};
+}  // namespace msf_core
+
+#endif  // MSF_MEASUREMENTINDEX_H_
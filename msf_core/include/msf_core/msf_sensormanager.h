@@ -19,7 +19,9 @@
 
 #include <Eigen/Dense>
 #include <string.h>
+#include <string>
 #include <msf_core/msf_types.h>
+#include <msf_core/msf_coreParameters.h>
 #include <msf_core/msf_statevisitor.h>
 #include <msf_core/msf_macros.h>
 
@@ -31,6 +33,15 @@ class SensorHandler;
 template<typename EKFState_T>
 class MSF_Core;
 
+/**
+ * \brief What the core does with a delayed measurement whose replay would
+ * exceed the replay budget.
+ */
+enum LateMeasurementStrategy {
+  kDropLateMeasurement,  ///< Reject the measurement.
+  kDeferLateMeasurement  ///< Apply it with an IMU reading bringing no other.
+};
+
 /** \class MSF_SensorManager
  * \brief A manager for a given sensor set. Handlers for individual sensors
  * (camera/vicon etc.) are registered with this class as handlers of particular
@@ -53,6 +64,97 @@ class MSF_SensorManager : public StateVisitor<EKFState_T> {
    */
   bool data_playback_;
 
+  /**
+   * Number of states preallocated by the core. The core drops states beyond
+   * this bound. Zero allocates every state on the heap.
+   */
+  int state_pool_capacity_;
+
+  /**
+   * Upper limit and safety margin of the time span the core keeps states and
+   * measurements for. Within the limit the span is derived from the delays of
+   * the sensors.
+   */
+  double max_buffer_horizon_;
+  double buffer_horizon_margin_;
+
+  /**
+   * Every how many states the core keeps the error state covariance. States
+   * between keyframes get their covariance reconstructed when needed. Zero
+   * keeps the covariance of all states.
+   */
+  int covariance_keyframe_stride_;
+
+  /**
+   * Over how many states the core propagates the covariance at once, by
+   * composing their transitions. The covariance of the states in between is
+   * reconstructed when needed. One propagates the covariance state by state.
+   */
+  int covariance_propagation_decimation_;
+
+  /**
+   * Over how many IMU readings the core preintegrates before it inserts a new
+   * state into the buffer. States at measurement times are inserted from the
+   * preintegrated readings. One inserts a state for every reading.
+   */
+  int imu_preintegration_stride_;
+
+  /**
+   * Whether the core propagates the covariance in a background thread. The
+   * IMU callback then only propagates the state, measurements wait for the
+   * covariance they need. Only used when the covariance of every state is kept
+   * and neither decimated nor preintegrated.
+   */
+  bool covariance_propagation_thread_;
+
+  /**
+   * Whether a delayed update propagates the covariance from the last
+   * measurement to the latest state in one composed transition, instead of
+   * through every state in between. These states are left without covariance
+   * and it is reconstructed when a state is read.
+   */
+  bool lazy_repropagation_;
+
+  /**
+   * Whether the core collects the measurements arriving between two IMU
+   * readings and applies them with the next reading, in a single replay from
+   * the oldest of them. Otherwise every measurement replays the measurements
+   * after it on its own.
+   */
+  bool coalesce_measurements_;
+
+  /**
+   * Replay budget of a delayed measurement: how many measurements it may
+   * (re)apply including itself and how many states it may repropagate, zero
+   * is unlimited. Measurements beyond the budget are handled as set by
+   * late_measurement_strategy_. Only "drop" and "defer" are supported, any
+   * other value logs an error and drops them.
+   */
+  int max_replay_measurements_;
+  int max_replay_states_;
+  std::string late_measurement_strategy_;
+
+  /**
+   * Every how many readings of a batch given to MSF_Core::ProcessIMUBatch the
+   * core publishes the propagated state. The last reading of a batch is always
+   * published, zero publishes only the last.
+   */
+  int imu_batch_publish_decimation_;
+
+  /**
+   * File the core writes its snapshot to and restores from, empty disables
+   * snapshots. The snapshot is written every snapshot_period_ seconds and on
+   * shutdown, or only on shutdown if the period is zero.
+   */
+  std::string snapshot_file_;
+  double snapshot_period_;
+
+  /**
+   * The parameters of the core as last published, read by the core without
+   * calling the parameter getters.
+   */
+  mutable CoreParameterBuffer core_parameters_;
+
  public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
@@ -64,6 +166,85 @@ class MSF_SensorManager : public StateVisitor<EKFState_T> {
     return data_playback_;
   }
 
+  size_t GetStatePoolCapacity() const {
+    return state_pool_capacity_ > 0 ? state_pool_capacity_ : 0;
+  }
+
+  double GetMaxBufferHorizon() const {
+    return max_buffer_horizon_;
+  }
+
+  double GetBufferHorizonMargin() const {
+    return buffer_horizon_margin_;
+  }
+
+  size_t GetCovarianceKeyframeStride() const {
+    return covariance_keyframe_stride_ > 0 ? covariance_keyframe_stride_ : 0;
+  }
+
+  size_t GetCovariancePropagationDecimation() const {
+    return covariance_propagation_decimation_ > 1 ?
+        covariance_propagation_decimation_ : 1;
+  }
+
+  size_t GetImuPreintegrationStride() const {
+    return imu_preintegration_stride_ > 1 ? imu_preintegration_stride_ : 1;
+  }
+
+  bool GetCovariancePropagationThread() const {
+    return covariance_propagation_thread_;
+  }
+
+  bool GetLazyRepropagation() const {
+    return lazy_repropagation_;
+  }
+
+  bool GetCoalesceMeasurements() const {
+    return coalesce_measurements_;
+  }
+
+  size_t GetMaxReplayMeasurements() const {
+    return max_replay_measurements_ > 0 ? max_replay_measurements_ : 0;
+  }
+
+  size_t GetMaxReplayStates() const {
+    return max_replay_states_ > 0 ? max_replay_states_ : 0;
+  }
+
+  size_t GetImuBatchPublishDecimation() const {
+    return imu_batch_publish_decimation_ > 0 ? imu_batch_publish_decimation_
+        : 0;
+  }
+
+  LateMeasurementStrategy GetLateMeasurementStrategy() const {
+    if (late_measurement_strategy_ == "defer")
+      return kDeferLateMeasurement;
+    if (late_measurement_strategy_ != "drop")
+      MSF_ERROR_STREAM_THROTTLE(
+          1, "Unknown late_measurement_strategy \""
+          << late_measurement_strategy_ << "\", only \"drop\" and "
+          "\"defer\" are supported, falling back to \"drop\".");
+    return kDropLateMeasurement;
+  }
+
+  const std::string& GetSnapshotFile() const {
+    return snapshot_file_;
+  }
+
+  double GetSnapshotPeriod() const {
+    return snapshot_period_;
+  }
+
+  const CoreParameterBuffer& GetCoreParameters() const {
+    return core_parameters_;
+  }
+
+  /***
+   * Reads the parameter getters and publishes their values to the core. Has
+   * to be called whenever the parameters change.
+   */
+  void PublishCoreParameters() const;
+
   virtual ~MSF_SensorManager() {
 
   }
@@ -82,6 +263,13 @@ class MSF_SensorManager : public StateVisitor<EKFState_T> {
    */
   virtual void Init(double scale) const = 0;
 
+  /***
+   * Restores the EKF from the snapshot file instead of calling Init, e.g. on
+   * startup. Returns false if there is no snapshot or it does not match the
+   * state definition.
+   */
+  bool RestoreFromSnapshot();
+
   /***
    * This method will be called for the user to set the initial state.
    */
@@ -99,7 +287,8 @@ class MSF_SensorManager : public StateVisitor<EKFState_T> {
    * This method will be called for the user to set the initial P matrix.
    */
   virtual void SetStateCovariance(
-      Eigen::Matrix<double, EKFState_T::nErrorStatesAtCompileTime,
+      Eigen::Matrix<typename EKFState_T::Scalar_T,
+          EKFState_T::nErrorStatesAtCompileTime,
           EKFState_T::nErrorStatesAtCompileTime>& P) const = 0;
 
   /***
@@ -107,7 +296,8 @@ class MSF_SensorManager : public StateVisitor<EKFState_T> {
    * the correction vector.
    */
   virtual void AugmentCorrectionVector(
-      Eigen::Matrix<double, EKFState_T::nErrorStatesAtCompileTime, 1>&
+      Eigen::Matrix<typename EKFState_T::Scalar_T,
+          EKFState_T::nErrorStatesAtCompileTime, 1>&
       UNUSEDPARAM(correction)) const = 0;
 
   /***
@@ -118,12 +308,14 @@ class MSF_SensorManager : public StateVisitor<EKFState_T> {
   virtual void SanityCheckCorrection(
       EKFState_T& UNUSEDPARAM(delaystate),
       const EKFState_T& UNUSEDPARAM(buffstate),
-      Eigen::Matrix<double, EKFState_T::nErrorStatesAtCompileTime, 1>&
+      Eigen::Matrix<typename EKFState_T::Scalar_T,
+          EKFState_T::nErrorStatesAtCompileTime, 1>&
       UNUSEDPARAM(correction)) const  = 0;
 
   /***
    * Provide a getter for these parameters, this is implemented for a given
-   * middleware or param file parser.
+   * middleware or param file parser. The core does not call them, but reads
+   * the values published by PublishCoreParameters.
    */
   virtual bool GetParamFixedBias() const = 0;
   virtual double GetParamNoiseAcc() const = 0;
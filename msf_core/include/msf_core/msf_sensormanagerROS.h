@@ -82,6 +82,33 @@ struct MSF_SensorManagerROS : public msf_core::MSF_SensorManager<EKFState_T> {
     reconfServer_->setCallback(f);
 
     pnh.param("data_playback", this->data_playback_, false);
+    pnh.param("state_pool_capacity", this->state_pool_capacity_, 0);
+    pnh.param("max_buffer_horizon", this->max_buffer_horizon_, 60.0);
+    pnh.param("buffer_horizon_margin", this->buffer_horizon_margin_, 0.1);
+    pnh.param("covariance_keyframe_stride",
+              this->covariance_keyframe_stride_, 0);
+    pnh.param("covariance_propagation_decimation",
+              this->covariance_propagation_decimation_, 1);
+    pnh.param("imu_preintegration_stride", this->imu_preintegration_stride_, 1);
+    pnh.param("covariance_propagation_thread",
+              this->covariance_propagation_thread_, false);
+    pnh.param("lazy_repropagation", this->lazy_repropagation_, false);
+    pnh.param("coalesce_measurements", this->coalesce_measurements_, false);
+    pnh.param("max_replay_measurements", this->max_replay_measurements_, 0);
+    pnh.param("max_replay_states", this->max_replay_states_, 0);
+    pnh.param("late_measurement_strategy", this->late_measurement_strategy_,
+              std::string("drop"));
+    if (this->late_measurement_strategy_ != "drop"
+        && this->late_measurement_strategy_ != "defer") {
+      MSF_ERROR_STREAM("Unknown late_measurement_strategy \""
+          << this->late_measurement_strategy_ << "\", only \"drop\" and "
+          "\"defer\" are supported, falling back to \"drop\".");
+      this->late_measurement_strategy_ = "drop";
+    }
+    pnh.param("imu_batch_publish_decimation",
+              this->imu_batch_publish_decimation_, 0);
+    pnh.param("snapshot_file", this->snapshot_file_, std::string(""));
+    pnh.param("snapshot_period", this->snapshot_period_, 0.0);
 
     ros::NodeHandle nh("msf_core");
 
@@ -137,6 +164,7 @@ struct MSF_SensorManagerROS : public msf_core::MSF_SensorManager<EKFState_T> {
    */
   void Config(msf_core::MSF_CoreConfig &config, uint32_t level) {
     config_ = config;
+    this->PublishCoreParameters();
     CoreConfigCallback(config, level);
   }
 
@@ -172,7 +200,7 @@ struct MSF_SensorManagerROS : public msf_core::MSF_SensorManager<EKFState_T> {
      */
     sensor_fusion_comm::ExtEkf msgCorrect_;
     msgCorrect_.state.resize(HLI_EKF_STATE_SIZE, 0);
-    msgCorrect_.header.stamp = ros::Time(state->time);
+    msgCorrect_.header.stamp = ros::Time().fromNSec(state->time);
     msgCorrect_.header.seq = 0;
     msgCorrect_.angular_velocity.x = 0;
     msgCorrect_.angular_velocity.y = 0;
@@ -198,7 +226,7 @@ struct MSF_SensorManagerROS : public msf_core::MSF_SensorManager<EKFState_T> {
       static int msg_seq = 0;
 
       geometry_msgs::PoseWithCovarianceStamped msgPose;
-      msgPose.header.stamp = ros::Time(state->time);
+      msgPose.header.stamp = ros::Time().fromNSec(state->time);
       msgPose.header.seq = msg_seq++;
       msgPose.header.frame_id = "/world";
       state->ToPoseMsg(msgPose);
@@ -218,7 +246,7 @@ struct MSF_SensorManagerROS : public msf_core::MSF_SensorManager<EKFState_T> {
 
     sensor_fusion_comm::ExtEkf msgCorrect_;
     msgCorrect_.state.resize(HLI_EKF_STATE_SIZE);
-    msgCorrect_.header.stamp = ros::Time(state->time);
+    msgCorrect_.header.stamp = ros::Time().fromNSec(state->time);
     msgCorrect_.header.seq = msg_seq;
     msgCorrect_.angular_velocity.x = 0;
     msgCorrect_.angular_velocity.y = 0;
@@ -264,7 +292,8 @@ struct MSF_SensorManagerROS : public msf_core::MSF_SensorManager<EKFState_T> {
         Eigen::Quaterniond hl_q(hl_state_buf_.state[6], hl_state_buf_.state[7],
                                 hl_state_buf_.state[8], hl_state_buf_.state[9]);
         Eigen::Quaterniond qbuff_q = hl_q.inverse()
-            * state_const.template Get<StateDefinition_T::q>();
+            * state_const.template Get<StateDefinition_T::q>().template cast<
+                double>();
         msgCorrect_.state[6] = qbuff_q.w();
         msgCorrect_.state[7] = qbuff_q.x();
         msgCorrect_.state[8] = qbuff_q.y();
@@ -309,7 +338,7 @@ struct MSF_SensorManagerROS : public msf_core::MSF_SensorManager<EKFState_T> {
     if (pubPoseAfterUpdate_.getNumSubscribers()) {
       // Publish pose after correction with covariance.
       geometry_msgs::PoseWithCovarianceStamped msgPose;
-      msgPose.header.stamp = ros::Time(state->time);
+      msgPose.header.stamp = ros::Time().fromNSec(state->time);
       msgPose.header.seq = msg_seq;
       msgPose.header.frame_id = "/world";
 
@@ -320,10 +349,10 @@ struct MSF_SensorManagerROS : public msf_core::MSF_SensorManager<EKFState_T> {
     {
       tf::Transform transform;
       const EKFState_T& state_const = *state;
-      const Eigen::Matrix<double, 3, 1>& pos = state_const
-          .template Get<StateDefinition_T::p>();
-      const Eigen::Quaterniond& ori = state_const
-          .template Get<StateDefinition_T::q>();
+      const Eigen::Matrix<double, 3, 1> pos = state_const
+          .template Get<StateDefinition_T::p>().template cast<double>();
+      const Eigen::Quaterniond ori = state_const
+          .template Get<StateDefinition_T::q>().template cast<double>();
       transform.setOrigin(tf::Vector3(pos[0], pos[1], pos[2]));
       transform.setRotation(tf::Quaternion(ori.x(), ori.y(), ori.z(), ori.w()));
       tf_broadcaster_.sendTransform(
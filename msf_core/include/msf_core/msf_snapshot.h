@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MSF_SNAPSHOT_H_
+#define MSF_SNAPSHOT_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <msf_core/msf_macros.h>
+#include <msf_core/msf_tmp.h>
+
+namespace msf_core {
+
+/**
+ * \brief Header of a filter snapshot file. The header is followed by
+ * numRecords records of type FilterSnapshot<EKFState_T>::Record, which all have
+ * the same size and are 8 byte aligned, so the file can be read in one go or
+ * memory mapped.
+ */
+struct SnapshotHeader {
+  enum {
+    kVersion = 1  ///< Increment when the layout of header or records changes.
+  };
+  char magic[8];  ///< "MSFSNAP" zero terminated.
+  uint32_t version;  ///< The version of the file format.
+  uint32_t recordSize;  ///< Size of a record in bytes.
+  uint32_t nStates;  ///< Length of the state vector.
+  uint32_t nErrorStates;  ///< Length of the error state vector.
+  uint64_t layoutHash;  ///< Hash over the state variable layout.
+  uint64_t numRecords;  ///< Number of records following the header.
+
+  static const char* Magic() {
+    return "MSFSNAP";
+  }
+};
+
+/**
+ * \brief Converts states to and from the records of a snapshot file and reads
+ * and writes snapshot files. The layout is derived from the state sequence by
+ * the msf_tmp visitors, so every state definition can be stored.
+ */
+template<typename EKFState_T>
+class FilterSnapshot {
+ public:
+  enum {
+    nStatesAtCompileTime = EKFState_T::nStatesAtCompileTime,
+    nErrorStatesAtCompileTime = EKFState_T::nErrorStatesAtCompileTime
+  };
+
+  typedef typename EKFState_T::Scalar_T Scalar_T;
+  /// The covariance as stored in the records, in double for any scalar.
+  typedef Eigen::Matrix<double, nErrorStatesAtCompileTime,
+      nErrorStatesAtCompileTime> P_double_T;
+
+  enum RecordFlags {
+    kHasCovariance = 1 << 0  ///< P of the record is valid.
+  };
+
+  /**
+   * \brief A state as stored in the snapshot file, matrices are column major.
+   * Values are stored in double for any scalar of the state.
+   */
+  struct Record {
+    int64_t time;  ///< Time of the state [ns].
+    int32_t flags;  ///< RecordFlags.
+    int32_t reserved;
+    double statevars[nStatesAtCompileTime];  ///< The full state vector.
+    double w_m[3];  ///< Angular velocity from IMU.
+    double a_m[3];  ///< Linear acceleration from IMU.
+    double P[nErrorStatesAtCompileTime * nErrorStatesAtCompileTime];
+  };
+  static_assert(std::is_standard_layout<Record>::value &&
+                sizeof(Record) % 8 == 0,
+                "The snapshot records must be memory mappable");
+
+  /**
+   * \brief Returns a hash over the names, indices and sizes of the state
+   * variables, to reject snapshots written for other state definitions.
+   */
+  static uint64_t LayoutHash() {
+    std::vector<std::tuple<int, int, int> > indices;
+    EKFState_T state;
+    state.CalculateIndicesInErrorState(indices);
+    std::vector<int> layout;
+    layout.push_back(nStatesAtCompileTime);
+    layout.push_back(nErrorStatesAtCompileTime);
+    for (size_t i = 0; i < indices.size(); ++i) {
+      layout.push_back(std::get<0>(indices[i]));
+      layout.push_back(std::get<1>(indices[i]));
+      layout.push_back(std::get<2>(indices[i]));
+    }
+    uint64_t hash = 14695981039346656037ULL;  // FNV-1a.
+    for (size_t i = 0; i < layout.size(); ++i) {
+      hash = (hash ^ static_cast<uint32_t>(layout[i])) * 1099511628211ULL;
+    }
+    return hash;
+  }
+
+  /**
+   * \brief Stores the state in the record. P is only stored if the state has
+   * it.
+   */
+  static void ToRecord(const EKFState_T& state, Record& record) {
+    std::memset(&record, 0, sizeof(Record));
+    record.time = state.time;
+    boost::fusion::for_each(
+        const_cast<EKFState_T&>(state).statevars,
+        msf_tmp::FullStatetoDoubleArray<double[nStatesAtCompileTime],
+            typename EKFState_T::StateSequence_T>(record.statevars));
+    Eigen::Map<Eigen::Matrix<double, 3, 1> >(record.w_m) =
+        state.w_m.template cast<double>();
+    Eigen::Map<Eigen::Matrix<double, 3, 1> >(record.a_m) =
+        state.a_m.template cast<double>();
+    if (!state.HasCovariance()) {
+      return;
+    }
+    record.flags |= kHasCovariance;
+    Eigen::Map<P_double_T>(record.P) = state.GetP().template cast<double>();
+  }
+
+  /**
+   * \brief Sets the state from the record. P is only set if the record has it,
+   * the caller has to give the state storage for it beforehand if wanted.
+   */
+  static void FromRecord(const Record& record, EKFState_T& state) {
+    state.time = record.time;
+    boost::fusion::for_each(
+        state.statevars,
+        msf_tmp::FullStateFromDoubleArray<double[nStatesAtCompileTime],
+            typename EKFState_T::StateSequence_T>(record.statevars));
+    state.w_m = Eigen::Map<const Eigen::Matrix<double, 3, 1> >(record.w_m)
+        .template cast<Scalar_T>();
+    state.a_m = Eigen::Map<const Eigen::Matrix<double, 3, 1> >(record.a_m)
+        .template cast<Scalar_T>();
+    if (!(record.flags & kHasCovariance)) {
+      return;
+    }
+    state.GetP() = Eigen::Map<const P_double_T>(record.P)
+        .template cast<Scalar_T>();
+  }
+
+  /**
+   * \brief Writes the records to the file. The file is written next to the
+   * target and then renamed, so an existing snapshot is never left half
+   * written.
+   */
+  static bool Write(const std::string& filename,
+                    const std::vector<Record>& records) {
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::strncpy(header.magic, SnapshotHeader::Magic(), sizeof(header.magic));
+    header.version = SnapshotHeader::kVersion;
+    header.recordSize = sizeof(Record);
+    header.nStates = nStatesAtCompileTime;
+    header.nErrorStates = nErrorStatesAtCompileTime;
+    header.layoutHash = LayoutHash();
+    header.numRecords = records.size();
+
+    const std::string tmpfilename = filename + ".tmp";
+    std::ofstream file(tmpfilename.c_str(),
+                       std::ios::out | std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!records.empty()) {
+      file.write(reinterpret_cast<const char*>(&records[0]),
+                 records.size() * sizeof(Record));
+    }
+    file.close();
+    if (!file || std::rename(tmpfilename.c_str(), filename.c_str()) != 0) {
+      MSF_WARN_STREAM("Could not write filter snapshot to " << filename);
+      std::remove(tmpfilename.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * \brief Reads the records from the file.
+   * \returns False if the file can not be read or was written for another
+   * version or state definition.
+   */
+  static bool Read(const std::string& filename, std::vector<Record>& records) {
+    std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+    if (!file) {
+      MSF_WARN_STREAM("Could not open filter snapshot " << filename);
+      return false;
+    }
+    SnapshotHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || std::strncmp(header.magic, SnapshotHeader::Magic(),
+                              sizeof(header.magic)) != 0) {
+      MSF_WARN_STREAM(filename << " is not a filter snapshot");
+      return false;
+    }
+    if (header.version != SnapshotHeader::kVersion
+        || header.recordSize != sizeof(Record)
+        || header.nStates != nStatesAtCompileTime
+        || header.nErrorStates != nErrorStatesAtCompileTime
+        || header.layoutHash != LayoutHash()) {
+      MSF_WARN_STREAM(
+          "The filter snapshot " << filename << " (version " <<
+          header.version << ") was written for another version or state "
+          "definition, ignoring it.");
+      return false;
+    }
+    records.resize(header.numRecords);
+    if (!records.empty()) {
+      file.read(reinterpret_cast<char*>(&records[0]),
+                records.size() * sizeof(Record));
+    }
+    if (!file) {
+      MSF_WARN_STREAM("The filter snapshot " << filename << " is truncated");
+      records.clear();
+      return false;
+    }
+    return true;
+  }
+};
+}  // namespace msf_core
+
+#endif  // MSF_SNAPSHOT_H_
@@ -17,10 +17,14 @@
 #ifndef MSF_SORTEDCONTAINER_H_
 #define MSF_SORTEDCONTAINER_H_
 
+#include <msf_core/msf_fwds.h>
 #include <msf_core/msf_types.h>
 #include <msf_core/msf_tools.h>
 #include <msf_core/msf_macros.h>
+#include <cstdint>
+#include <cstdlib>
 #include <iomanip>
+#include <map>
 
 #define CHECK_IN_BOUNDS(iterator, container) \
   do { \
@@ -49,7 +53,7 @@ class SortedContainer {
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
  private:
-  typedef std::map<double, Ptr_T> ListT;  ///< The container type in which to store the data.
+  typedef std::map<int64_t, Ptr_T> ListT;  ///< The container type in which to store the data.
   ListT stateList;  ///< The container in which all the data is stored.
   Ptr_T invalid;  ///< A object to signal requests which cannot be satisfied.
  public:
@@ -88,11 +92,11 @@ class SortedContainer {
    */
   inline typename ListT::iterator Insert(const shared_ptr<T>& value) {
     std::pair<typename ListT::iterator, bool> itpr = stateList.insert(
-        std::pair<double, shared_ptr<T> >(value->time, value));
+        std::pair<int64_t, shared_ptr<T> >(value->time, value));
     if (!itpr.second) {
       MSF_WARN_STREAM(
           "Wanted to insert a value to the sorted container at time " <<
-          std::fixed << std::setprecision(9) << value->time <<
+          value->time <<
           " but the map already contained a value at this time. discarding.");
     }
     return itpr.first;
@@ -133,7 +137,7 @@ class SortedContainer {
       if (warnIfNotExistant)
         MSF_WARN_STREAM(
             "getIteratorAtValue(state): Could not find value for time " <<
-            std::fixed << std::setprecision(9) << value->time);
+            value->time);
       it = stateList.lower_bound(value->time);
     }
     return it;
@@ -146,13 +150,13 @@ class SortedContainer {
    * \returns iterator.
    */
   inline typename ListT::iterator GetIteratorAtValue(
-      const double& time, bool warnIfNotExistant = true) {
+      const int64_t& time, bool warnIfNotExistant = true) {
     typename ListT::iterator it = stateList.find(time);
     if (it == stateList.end()) {  //there is no value in the map with this time
       if (warnIfNotExistant)
         MSF_WARN_STREAM(
-            "getIteratorAtValue(double): Could not find value for time " <<
-            std::fixed << std::setprecision(9) << time);
+            "getIteratorAtValue(int64_t): Could not find value for time " <<
+            time);
       it = stateList.lower_bound(time);
     }
     return it;
@@ -164,7 +168,7 @@ class SortedContainer {
    * \returns iterator.
    */
   inline typename ListT::iterator GetIteratorClosestBefore(
-      const double& statetime) {
+      const int64_t& statetime) {
     typename ListT::iterator it = stateList.lower_bound(statetime);
     --it;
     return it;
@@ -176,7 +180,7 @@ class SortedContainer {
    * \returns iterator.
    */
   inline typename ListT::iterator GetIteratorClosestAfter(
-      const double& statetime) {
+      const int64_t& statetime) {
     typename ListT::iterator it = stateList.upper_bound(statetime);
     return it;
   }
@@ -186,7 +190,7 @@ class SortedContainer {
    * \param time The time where we want to get an iterator at.
    * \returns iterator.
    */
-  inline typename ListT::iterator GetIteratorClosest(const double& statetime) {
+  inline typename ListT::iterator GetIteratorClosest(const int64_t& statetime) {
 
     // First check if we have a value at this time in the buffer.
     typename ListT::iterator it_at = stateList.find(statetime);
@@ -205,8 +209,8 @@ class SortedContainer {
     if (tauPlus == it_end) {
       return tauMinus;
     }
-    if (fabs(tauPlus->second->time - statetime)
-        < fabs(tauMinus->second->time - statetime)) {
+    if (std::abs(tauPlus->second->time - statetime)
+        < std::abs(tauMinus->second->time - statetime)) {
       return tauPlus;
     } else {
       return tauMinus;
@@ -218,7 +222,7 @@ class SortedContainer {
    * \param Time the time where we want to get the value at.
    * \returns shared pointer of the object.
    */
-  inline shared_ptr<T>& GetClosestBefore(const double& statetime) {
+  inline shared_ptr<T>& GetClosestBefore(const int64_t& statetime) {
     typename ListT::iterator it = stateList.lower_bound(statetime);
     if (stateList.empty()) {
       MSF_WARN_STREAM("Requested the first object before time " << statetime <<
@@ -238,7 +242,7 @@ class SortedContainer {
    * \param time The time where we want to get the value at
    * \returns shared pointer of the object.
    */
-  inline shared_ptr<T>& GetClosestAfter(const double& statetime) {
+  inline shared_ptr<T>& GetClosestAfter(const int64_t& statetime) {
     typename ListT::iterator it = stateList.upper_bound(statetime);
     if (it == stateList.end()) {
       return GetInvalid();
@@ -252,7 +256,7 @@ class SortedContainer {
    * \param time The time where we want to get the value at.
    * \returns shared pointer of the object.
    */
-  inline shared_ptr<T>& GetValueAt(const double& statetime) {
+  inline shared_ptr<T>& GetValueAt(const int64_t& statetime) {
     typename ListT::iterator it = stateList.find(statetime);
     if (it == stateList.end()) {
       return GetInvalid();
@@ -265,7 +269,7 @@ class SortedContainer {
    * \param time The time where we want to get the value at.
    * \returns shared pointer of the object.
    */
-  inline shared_ptr<T>& GetClosest(const double& statetime) {
+  inline shared_ptr<T>& GetClosest(const int64_t& statetime) {
     shared_ptr<T>& at = GetValueAt(statetime);  // Is there one exactly at this point?
     if (at != GetInvalid()) {
       return at;
@@ -280,7 +284,8 @@ class SortedContainer {
       return tauMinus;
     }
 
-    if (fabs(tauPlus->time - statetime) < fabs(tauMinus->time - statetime)) {
+    if (std::abs(tauPlus->time - statetime)
+        < std::abs(tauMinus->time - statetime)) {
       return tauPlus;
     } else {
       return tauMinus;
@@ -289,12 +294,12 @@ class SortedContainer {
 
   /**
    * \brief Clears all objects having a time stamp older than the supplied time
-   * in seconds.
+   * in nanoseconds.
    * \param time The maximum age of states in the container.
    * \returns shared pointer of the object.
    */
-  inline void ClearOlderThan(double age) {
-    double newest = GetLast()->time;
+  inline void ClearOlderThan(int64_t age) {
+    int64_t newest = GetLast()->time;
     iterator_T it = GetIteratorClosest(newest - age);
     if (newest - it->second->time < age)
       return;  //there is no state older than time
@@ -342,14 +347,14 @@ class SortedContainer {
    * \param timeNew The time to update to.
    * \returns shared pointer of the object.
    */
-  inline shared_ptr<T> UpdateTime(double timeOld, double timeNew)
+  inline shared_ptr<T> UpdateTime(int64_t timeOld, int64_t timeNew)
       __attribute__ ((warn_unused_result)) {
     typename ListT::iterator it = stateList.find(timeOld);
     if (it == stateList.end()) {
       std::stringstream ss;
       ss << "Wanted to update a states/measurements time, but could not find "
             "the old state, for which the time was asked to be updated. time "
-          << std::fixed << std::setprecision(9) << timeOld << std::endl;
+          << timeOld << std::endl;
 
       ss << "Map: " << std::endl;
       for (typename ListT::iterator it2 = stateList.begin();
@@ -376,11 +381,21 @@ class SortedContainer {
     std::stringstream ss;
     for (typename ListT::iterator it = GetIteratorBegin();
         it != GetIteratorEnd(); ++it) {
-      ss << std::fixed << std::setprecision(9) << it->second->time << std::endl;
+      ss << it->second->time << std::endl;
     }
     return ss.str();
   }
 };
+
+/**
+ * \brief Backend storing states and measurements in a SortedContainer.
+ */
+struct SortedContainerBackend {
+  template<typename T, typename PrototypeInvalidT = T>
+  struct Container {
+    typedef SortedContainer<T, PrototypeInvalidT> type;
+  };
+};
 }
 
 #endif  // MSF_SORTEDCONTAINER_H_
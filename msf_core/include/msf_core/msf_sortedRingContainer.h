@@ -0,0 +1,537 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MSF_SORTEDRINGCONTAINER_H_
+#define MSF_SORTEDRINGCONTAINER_H_
+
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include <msf_core/msf_fwds.h>
+#include <msf_core/msf_types.h>
+#include <msf_core/msf_tools.h>
+#include <msf_core/msf_macros.h>
+
+namespace msf_core {
+/**
+ * \brief Drop-in replacement for the SortedContainer which keeps the objects
+ * in a contiguous, time ordered circular buffer instead of a std::map.
+ *
+ * Appending an object which is newer than all others and evicting the oldest
+ * objects are O(1) and do not touch the allocator. Lookups are binary
+ * searches on the contiguous buffer. Inserting out of order is supported, but
+ * shifts all newer objects by one slot.
+ *
+ * Iterators address objects by their absolute position in the stream of
+ * inserted objects. They stay valid when objects are appended or evicted at
+ * the front, but inserting or erasing in the middle of the buffer invalidates
+ * iterators to all newer objects. Dereferencing an iterator which is out of
+ * range (e.g. end or before begin) yields the invalid object.
+ */
+template<typename T, typename PrototypeInvalidT = T>
+class SortedRingContainer {
+ public:
+  typedef shared_ptr<T> Ptr_T;
+  typedef std::pair<int64_t, Ptr_T> Entry_T;
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+ private:
+  typedef std::vector<Entry_T> ListT;  ///< The ring storage.
+  ListT ring_;  ///< The container in which all the data is stored.
+  size_t mask_;  ///< Capacity - 1, the capacity is a power of two.
+  int64_t begin_pos_;  ///< Absolute position of the oldest object.
+  int64_t end_pos_;  ///< Absolute position one past the newest object.
+  Ptr_T invalid;  ///< A object to signal requests which cannot be satisfied.
+  Entry_T invalid_entry_;  ///< Returned when dereferencing out of range.
+
+ public:
+  /**
+   * \brief Bidirectional iterator mimicking the std::map iterator used by the
+   * SortedContainer, so that it->first and it->second can be used as before.
+   */
+  class iterator_T {
+    friend class SortedRingContainer;
+    SortedRingContainer* container_;
+    int64_t pos_;
+    iterator_T(SortedRingContainer* container, int64_t pos)
+        : container_(container),
+          pos_(pos) {
+    }
+   public:
+    iterator_T()
+        : container_(nullptr),
+          pos_(0) {
+    }
+    inline Entry_T& operator*() const {
+      return container_->EntryAt(pos_);
+    }
+    inline Entry_T* operator->() const {
+      return &container_->EntryAt(pos_);
+    }
+    inline iterator_T& operator++() {
+      ++pos_;
+      return *this;
+    }
+    inline iterator_T& operator--() {
+      --pos_;
+      return *this;
+    }
+    inline iterator_T operator++(int) {
+      iterator_T tmp = *this;
+      ++pos_;
+      return tmp;
+    }
+    inline iterator_T operator--(int) {
+      iterator_T tmp = *this;
+      --pos_;
+      return tmp;
+    }
+    inline bool operator==(const iterator_T& other) const {
+      return pos_ == other.pos_ && container_ == other.container_;
+    }
+    inline bool operator!=(const iterator_T& other) const {
+      return !(*this == other);
+    }
+  };
+
+  /**
+   * \brief Creates the container with a preallocated capacity which is
+   * rounded up to the next power of two. The buffer grows by doubling if the
+   * capacity is exceeded.
+   */
+  SortedRingContainer(size_t initialCapacity = 1024)
+      : begin_pos_(0),
+        end_pos_(0) {
+    size_t capacity = 1;
+    while (capacity < initialCapacity) {
+      capacity <<= 1;
+    }
+    ring_.resize(capacity);
+    mask_ = capacity - 1;
+    invalid.reset(new PrototypeInvalidT());
+    invalid->time = -1;
+    invalid_entry_ = Entry_T(-1, invalid);
+  }
+
+  /**
+   * \brief To be called to signal that a request could not be satisfied
+   * \returns an object of the "invalid" type
+   */
+  inline shared_ptr<T>& GetInvalid() {
+    return invalid;
+  }
+
+  /**
+   * \brief Clears the internal container, dropping all the contents.
+   */
+  inline void Clear() {
+    for (int64_t pos = begin_pos_; pos < end_pos_; ++pos) {
+      Slot(pos).second.reset();
+    }
+    begin_pos_ = end_pos_ = 0;
+  }
+
+  /**
+   * \brief Returns the size of the internal container.
+   * \returns Size of the container.
+   */
+  inline size_t Size() {
+    return static_cast<size_t>(end_pos_ - begin_pos_);
+  }
+
+  /**
+   * \brief Returns the number of objects the container can hold before it
+   * has to grow.
+   */
+  inline size_t Capacity() {
+    return ring_.size();
+  }
+
+  /**
+   * \brief Insert an object to the internal container to the position not
+   * violating the internal strict less than ordering by time.
+   */
+  inline iterator_T Insert(const shared_ptr<T>& value) {
+    // Fast path: in order append at the head.
+    if (end_pos_ == begin_pos_ || Slot(end_pos_ - 1).first < value->time) {
+      ReserveOne();
+      Slot(end_pos_) = Entry_T(value->time, value);
+      ++end_pos_;
+      return iterator_T(this, end_pos_ - 1);
+    }
+    int64_t pos = LowerBound(value->time);
+    if (pos != end_pos_ && Slot(pos).first == value->time) {
+      MSF_WARN_STREAM(
+          "Wanted to insert a value to the sorted container at time " <<
+          value->time <<
+          " but the map already contained a value at this time. discarding.");
+      return iterator_T(this, pos);
+    }
+    // Out of order insert: shift the newer objects by one slot.
+    ReserveOne();
+    for (int64_t i = end_pos_; i > pos; --i) {
+      Slot(i).first = Slot(i - 1).first;
+      Slot(i).second.swap(Slot(i - 1).second);
+    }
+    Slot(pos) = Entry_T(value->time, value);
+    ++end_pos_;
+    return iterator_T(this, pos);
+  }
+
+  /**
+   * \brief Returns the iterator at the beginning of the internal container.
+   */
+  inline iterator_T GetIteratorBegin() {
+    return iterator_T(this, begin_pos_);
+  }
+
+  /**
+   * \brief Returns the iterator before the beginning of the internal container.
+   */
+  inline iterator_T GetIteratorBeforeBegin() {
+    return iterator_T(this, begin_pos_ - 1);
+  }
+
+  /**
+   * \brief Returns the iterator at the end of the internal container.
+   */
+  inline iterator_T GetIteratorEnd() {
+    return iterator_T(this, end_pos_);
+  }
+
+  /**
+   * \brief Returns the iterator at the specific time instant of the supplied
+   * object or an invalid object if the request cannot be satisfied.
+   * \param value The value to get the iterator for.
+   * \returns iterator.
+   */
+  inline iterator_T GetIteratorAtValue(const shared_ptr<T>& value,
+                                       bool warnIfNotExistant = true) {
+    return GetIteratorAtValue(value->time, warnIfNotExistant);
+  }
+
+  /**
+   * \brief Returns the iterator at a specific time instant
+   * or an invalid object if the request cannot be satisfied.
+   * \param time The time where we want to get an iterator at.
+   * \returns iterator.
+   */
+  inline iterator_T GetIteratorAtValue(const int64_t& time,
+                                       bool warnIfNotExistant = true) {
+    int64_t pos = LowerBound(time);
+    if (pos == end_pos_ || Slot(pos).first != time) {
+      if (warnIfNotExistant)
+        MSF_WARN_STREAM(
+            "getIteratorAtValue(int64_t): Could not find value for time " <<
+            time);
+    }
+    return iterator_T(this, pos);
+  }
+
+  /**
+   * \brief Returns the iterator closest before a specific time instant
+   * \param time The time where we want to get an iterator at.
+   * \returns iterator.
+   */
+  inline iterator_T GetIteratorClosestBefore(const int64_t& statetime) {
+    return iterator_T(this, LowerBound(statetime) - 1);
+  }
+
+  /**
+   * \brief Returns the iterator closest after a specific time instant.
+   * \param time The time where we want to get an iterator at.
+   * \returns iterator.
+   */
+  inline iterator_T GetIteratorClosestAfter(const int64_t& statetime) {
+    return iterator_T(this, UpperBound(statetime));
+  }
+
+  /**
+   * \brief Returns the iterator closest to a specific time instant.
+   * \param time The time where we want to get an iterator at.
+   * \returns iterator.
+   */
+  inline iterator_T GetIteratorClosest(const int64_t& statetime) {
+    return iterator_T(this, ClosestPos(statetime));
+  }
+
+  /**
+   * \brief Returns a pointer to the closest object before a specific time instant.
+   * \param Time the time where we want to get the value at.
+   * \returns shared pointer of the object.
+   */
+  inline shared_ptr<T>& GetClosestBefore(const int64_t& statetime) {
+    if (end_pos_ == begin_pos_) {
+      MSF_WARN_STREAM("Requested the first object before time " << statetime <<
+        "but the container is empty");
+      return GetInvalid();
+    }
+    int64_t pos = LowerBound(statetime);
+    if (pos == begin_pos_) {
+      return Slot(pos).second;
+    }
+    return Slot(pos - 1).second;
+  }
+
+  /**
+   * \brief Returns a pointer to the closest after a specific time instant
+   * or an invalid object if the request cannot be satisfied.
+   * \param time The time where we want to get the value at
+   * \returns shared pointer of the object.
+   */
+  inline shared_ptr<T>& GetClosestAfter(const int64_t& statetime) {
+    int64_t pos = UpperBound(statetime);
+    if (pos == end_pos_) {
+      return GetInvalid();
+    }
+    return Slot(pos).second;
+  }
+
+  /**
+   * \brief Returns a pointer to the object at a specific time instant
+   * or an invalid object if the request cannot be satisfied.
+   * \param time The time where we want to get the value at.
+   * \returns shared pointer of the object.
+   */
+  inline shared_ptr<T>& GetValueAt(const int64_t& statetime) {
+    int64_t pos = LowerBound(statetime);
+    if (pos == end_pos_ || Slot(pos).first != statetime) {
+      return GetInvalid();
+    }
+    return Slot(pos).second;
+  }
+
+  /**
+   * \brief Returns a pointer to the closest to a specific time instant.
+   * \param time The time where we want to get the value at.
+   * \returns shared pointer of the object.
+   */
+  inline shared_ptr<T>& GetClosest(const int64_t& statetime) {
+    int64_t pos = ClosestPos(statetime);
+    if (pos == end_pos_) {
+      return GetInvalid();
+    }
+    return Slot(pos).second;
+  }
+
+  /**
+   * \brief Clears all objects having a time stamp older than the supplied time
+   * in nanoseconds.
+   * \param time The maximum age of states in the container.
+   */
+  inline void ClearOlderThan(int64_t age) {
+    if (end_pos_ == begin_pos_) {
+      return;
+    }
+    int64_t newest = Slot(end_pos_ - 1).first;
+    int64_t pos = ClosestPos(newest - age);
+    if (newest - Slot(pos).first < age)
+      return;  // There is no state older than time.
+    // Evict from the front, the slots are reused by later inserts.
+    for (; begin_pos_ < pos; ++begin_pos_) {
+      Slot(begin_pos_).second.reset();
+    }
+  }
+
+  /**
+   * \brief Returns a pointer to the last object in the container
+   * or an invalid object if the container is empty.
+   * \returns shared pointer of the object.
+   */
+  inline shared_ptr<T>& GetLast() {
+    if (end_pos_ == begin_pos_) {
+      MSF_WARN_STREAM("Requested the last object in the sorted container, but "
+      "the container is empty");
+      return GetInvalid();
+    }
+    return Slot(end_pos_ - 1).second;
+  }
+
+  /**
+   * \brief Returns a pointer to the first object in the container
+   * or an invalid object if the container is empty.
+   * \returns shared pointer of the object.
+   */
+  inline shared_ptr<T>& GetFirst() {
+    if (end_pos_ == begin_pos_) {
+      MSF_WARN_STREAM("Requested the first object in the sorted container, "
+      "but the container is empty");
+      return GetInvalid();
+    }
+    return Slot(begin_pos_).second;
+  }
+
+  /**
+   * \brief This function updates the time of an object in the container.
+   * If the new time keeps the ordering, the object is updated in place and
+   * iterators stay valid. Otherwise the object is moved, which invalidates
+   * iterators to newer objects.
+   * \param timeOld The time of the value to update.
+   * \param timeNew The time to update to.
+   * \returns shared pointer of the object.
+   */
+  inline shared_ptr<T> UpdateTime(int64_t timeOld, int64_t timeNew)
+      __attribute__ ((warn_unused_result)) {
+    int64_t pos = LowerBound(timeOld);
+    if (pos == end_pos_ || Slot(pos).first != timeOld) {
+      std::stringstream ss;
+      ss << "Wanted to update a states/measurements time, but could not find "
+            "the old state, for which the time was asked to be updated. time "
+          << timeOld << std::endl;
+
+      ss << "Map: " << std::endl;
+      ss << EchoBufferContentTimes();
+      MSF_WARN_STREAM(ss.str());
+      return GetClosest(timeOld);
+    }
+    shared_ptr<T> copy = Slot(pos).second;
+    bool afterPrevious = pos == begin_pos_ || Slot(pos - 1).first < timeNew;
+    bool beforeNext = pos + 1 == end_pos_ || timeNew < Slot(pos + 1).first;
+    if (afterPrevious && beforeNext) {
+      Slot(pos).first = timeNew;
+      copy->time = timeNew;
+      return copy;
+    }
+    // Get the data from the buffer, we need to update, then reinsert.
+    for (int64_t i = pos; i + 1 < end_pos_; ++i) {
+      Slot(i).first = Slot(i + 1).first;
+      Slot(i).second.swap(Slot(i + 1).second);
+    }
+    --end_pos_;
+    Slot(end_pos_).second.reset();
+    copy->time = timeNew;
+    iterator_T inserted = Insert(copy);
+    return inserted->second;
+  }
+
+  /**
+   * \brief Debug output the contents of the container in a human readable time
+   * format.
+   * \returns String of the buffer contents with line breaks after every entry.
+   */
+  std::string EchoBufferContentTimes() {
+    std::stringstream ss;
+    for (int64_t pos = begin_pos_; pos < end_pos_; ++pos) {
+      ss << Slot(pos).first << std::endl;
+    }
+    return ss.str();
+  }
+
+ private:
+  inline Entry_T& Slot(int64_t pos) {
+    return ring_[static_cast<size_t>(pos) & mask_];
+  }
+
+  inline Entry_T& EntryAt(int64_t pos) {
+    if (MSF_UNLIKELY(pos < begin_pos_ || pos >= end_pos_)) {
+      invalid_entry_.first = -1;
+      invalid_entry_.second = invalid;
+      return invalid_entry_;
+    }
+    return Slot(pos);
+  }
+
+  /// Makes sure there is space for one more object, doubles the capacity.
+  inline void ReserveOne() {
+    if (MSF_LIKELY(Size() < ring_.size())) {
+      return;
+    }
+    ListT grown(ring_.size() * 2);
+    size_t newmask = grown.size() - 1;
+    for (int64_t pos = begin_pos_; pos < end_pos_; ++pos) {
+      Entry_T& entry = grown[static_cast<size_t>(pos) & newmask];
+      entry.first = Slot(pos).first;
+      entry.second.swap(Slot(pos).second);
+    }
+    ring_.swap(grown);
+    mask_ = newmask;
+  }
+
+  /// Position of the first object not older than time.
+  inline int64_t LowerBound(int64_t time) {
+    int64_t lo = begin_pos_;
+    int64_t hi = end_pos_;
+    // Queries for the newest object are by far the most frequent.
+    if (lo == hi || Slot(hi - 1).first < time) {
+      return hi;
+    }
+    while (lo < hi) {
+      int64_t mid = lo + (hi - lo) / 2;
+      if (Slot(mid).first < time) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+
+  /// Position of the first object newer than time.
+  inline int64_t UpperBound(int64_t time) {
+    int64_t lo = begin_pos_;
+    int64_t hi = end_pos_;
+    if (lo == hi || Slot(hi - 1).first <= time) {
+      return hi;
+    }
+    while (lo < hi) {
+      int64_t mid = lo + (hi - lo) / 2;
+      if (Slot(mid).first <= time) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+
+  /// Position of the object closest to time, end if empty.
+  inline int64_t ClosestPos(int64_t time) {
+    int64_t after = LowerBound(time);
+    if (after != end_pos_ && Slot(after).first == time) {
+      return after;
+    }
+    int64_t before = after - 1;
+    if (before < begin_pos_) {
+      return after;
+    }
+    if (after == end_pos_) {
+      return before;
+    }
+    if (std::abs(Slot(after).first - time)
+        < std::abs(Slot(before).first - time)) {
+      return after;
+    } else {
+      return before;
+    }
+  }
+};
+
+/**
+ * \brief Backend storing states and measurements in a SortedRingContainer.
+ */
+struct SortedRingContainerBackend {
+  template<typename T, typename PrototypeInvalidT = T>
+  struct Container {
+    typedef SortedRingContainer<T, PrototypeInvalidT> type;
+  };
+};
+}
+
+#endif  // MSF_SORTEDRINGCONTAINER_H_
@@ -20,6 +20,9 @@
 #include <msf_core/msf_types.h>
 #include <msf_core/msf_tmp.h>
 #include <msf_core/msf_statevisitor.h>
+#include <msf_core/msf_blockTransition.h>
+#include <msf_core/msf_covarianceForm.h>
+#include <msf_core/msf_imuPreintegration.h>
 #include <Eigen/Dense>
 #include <Eigen/Geometry>
 #include <vector>
@@ -56,7 +59,8 @@ struct StateVar_T {
     sizeInState_ = msf_tmp::StateLengthForType<const StateVar_T<type_T,
         name_T>&>::value
   };
-  typedef Eigen::Matrix<double, sizeInCorrection_, sizeInCorrection_> Q_T;
+  typedef Eigen::Matrix<typename value_t::Scalar, sizeInCorrection_,
+      sizeInCorrection_> Q_T;
 
   Q_T Q;  ///< The noise covariance matrix block of this state.
   value_t state_;  ///< The state variable of this state.
@@ -80,6 +84,9 @@ struct GenericState_T {
   typedef StateSeq_T StateSequence_T;
   ///<The enums of the state variables.
   typedef StateDef_T StateDefinition_T;
+  /// The scalar of the state variables, e.g. double or float, as given by the
+  /// types of the state variables. Covariance and system inputs use it too.
+  typedef typename msf_tmp::ScalarOfSequence<StateSequence_T>::type Scalar_T;
 
   friend class msf_core::MSF_Core<
       GenericState_T<StateSequence_T, StateDefinition_T> >;
@@ -130,36 +137,210 @@ struct GenericState_T {
   Get();
 
  public:
-  typedef Eigen::Matrix<double, nErrorStatesAtCompileTime,
+  typedef Eigen::Matrix<Scalar_T, nErrorStatesAtCompileTime,
       nErrorStatesAtCompileTime> P_type;  ///< Type of the error state
                                           // covariance matrix.
-  typedef P_type F_type;
+  /// Type of the discrete state propagation matrix, only stores the blocks of
+  /// the core states which differ from identity.
+  typedef BlockSparseTransition<StateSequence_T, StateDefinition_T> F_type;
   typedef P_type Q_type;
+  /// The representation of the error state covariance.
+  typedef typename CovarianceFormForState<
+      GenericState_T<StateSequence_T, StateDefinition_T> >::type
+      CovarianceForm_T;
+  /// The IMU readings preintegrated between two states.
+  typedef ImuPreintegration<Scalar_T> Preintegration_T;
+
+  /**
+   * \brief The covariance related matrices of a state. These are kept apart
+   * from the nominal state and are only allocated for states which need them.
+   * The covariance form may store more next to P.
+   */
+  struct Covariance_T : public CovarianceForm_T::template Storage<P_type> {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    P_type P;  ///< Error state covariance.
+    F_type Fd;   ///< Discrete state propagation matrix.
+    Q_type Qd;   ///< Discrete propagation noise matrix.
+
+    Covariance_T() {
+      P.setZero();
+      Qd.setZero();
+    }
+  };
 
   StateSequence_T statevars;  ///< The actual state variables.
 
   // system inputs
-  Eigen::Matrix<double, 3, 1> w_m;         ///< Angular velocity from IMU.
-  Eigen::Matrix<double, 3, 1> a_m;         ///< Linear acceleration from IMU.
+  Eigen::Matrix<Scalar_T, 3, 1> w_m;         ///< Angular velocity from IMU.
+  Eigen::Matrix<Scalar_T, 3, 1> a_m;         ///< Linear acceleration from IMU.
+
+  int64_t time;  ///< Time of this state estimate [ns].
+
+ private:
+  shared_ptr<Covariance_T> covariance_;  ///< Side store for P, Fd and Qd.
+  /// Side store for the IMU readings since the previous state, only allocated
+  /// if the core preintegrates them.
+  shared_ptr<Preintegration_T> preintegration_;
+  /// Whether the core keeps P of this state when propagating past it.
+  bool covarianceKeyframe_;
+
+  /**
+   * \brief Returns the covariance related matrices of this state for writing.
+   * The state must have them, see HasCovariance.
+   */
+  inline Covariance_T& MutableCovariance();
 
-  double time; 	///< Time of this state estimate.
-  P_type P;  ///< Error state covariance.
-  F_type Fd;   ///< Discrete state propagation matrix.
-  Q_type Qd;   ///< Discrete propagation noise matrix.
+  /**
+   * \brief The values reported for states without covariance: P zero, Fd
+   * identity and Qd zero.
+   */
+  static const Covariance_T& DefaultCovariance();
 
-  GenericState_T() {
+  /// The empty preintegration reported for states without one.
+  static const Preintegration_T& DefaultPreintegration();
+
+ public:
+  GenericState_T()
+      : covarianceKeyframe_(false) {
     time = -1;
-    P.setZero();
-    Qd.setZero();
-    Fd.setIdentity();
     Reset();
   }
 
+  /**
+   * \brief Copies the state including its covariance related matrices. The
+   * copy is not owned by a core, so these are allocated on the heap.
+   */
+  GenericState_T(const GenericState_T& other);
+  GenericState_T& operator=(const GenericState_T& other);
+
+  /**
+   * \brief Copies the state variables, system inputs and time of another
+   * state, but not its covariance related matrices and preintegrated IMU
+   * readings. Cheap enough to keep the values before a correction, e.g. to
+   * roll back the correction.
+   */
+  void CopyStateVariables(const GenericState_T& other);
+
+  /**
+   * \brief Returns whether the covariance related matrices of this state are
+   * allocated. If not, the const accessors below return P zero, Fd identity
+   * and Qd zero, and the others must not be called.
+   */
+  inline bool HasCovariance() const {
+    return static_cast<bool>(covariance_);
+  }
+
+  /**
+   * \brief Returns whether the covariance of this state is kept, when the core
+   * only keeps the covariance at keyframes.
+   */
+  inline bool IsCovarianceKeyframe() const {
+    return covarianceKeyframe_;
+  }
+
+  /**
+   * \brief Makes the state use the given storage for its covariance related
+   * matrices, e.g. storage from a pool. Values already set are kept.
+   */
+  void SetCovarianceStorage(const shared_ptr<Covariance_T>& covariance);
+
+  /**
+   * \brief Allocates the covariance related matrices on the heap, for states
+   * which are not owned by a core, e.g. the values of an init measurement. The
+   * core allocates them from its pool by MSF_Core::AttachCovariance.
+   */
+  void AllocateCovariance();
+
+  /**
+   * \brief Frees the covariance related matrices of this state.
+   */
+  inline void ReleaseCovariance() {
+    covariance_.reset();
+  }
+
+  /**
+   * \brief Returns whether the storage for preintegrated IMU readings of this
+   * state is allocated.
+   */
+  inline bool HasPreintegration() const {
+    return static_cast<bool>(preintegration_);
+  }
+
+  /**
+   * \brief Makes the state use the given storage for its preintegrated IMU
+   * readings, e.g. storage from a pool. Readings already integrated are kept.
+   */
+  void SetPreintegrationStorage(
+      const shared_ptr<Preintegration_T>& preintegration);
+
+  /**
+   * \brief Frees the preintegrated IMU readings of this state, it is
+   * propagated over a single reading afterwards.
+   */
+  inline void ReleasePreintegration() {
+    preintegration_.reset();
+  }
+
+  /**
+   * \brief The IMU readings since the previous state, if the core
+   * preintegrates them. Empty if the state was propagated over a single
+   * reading.
+   */
+  inline const Preintegration_T& GetPreintegration() const {
+    return preintegration_ ? *preintegration_ : DefaultPreintegration();
+  }
+
+  /**
+   * \brief The preintegrated IMU readings for writing. The state must have
+   * the storage, see HasPreintegration.
+   */
+  inline Preintegration_T& MutablePreintegration();
+
+  /// \brief Error state covariance, writable only if the state has it.
+  inline P_type& GetP() {
+    return MutableCovariance().P;
+  }
+  inline const P_type& GetP() const {
+    return covariance_ ? covariance_->P : DefaultCovariance().P;
+  }
+
+  /**
+   * \brief Discrete state propagation matrix. The non-const overload needs the
+   * covariance storage, which the core attaches from its covariancePool_ by
+   * MSF_Core::AttachCovariance before writing. Without it MutableCovariance
+   * asserts, or logs an error and allocates it in release builds.
+   */
+  inline F_type& GetFd() {
+    return MutableCovariance().Fd;
+  }
+  inline const F_type& GetFd() const {
+    return covariance_ ? covariance_->Fd : DefaultCovariance().Fd;
+  }
+
+  /**
+   * \brief Discrete propagation noise matrix. Writing needs the covariance
+   * storage attached first, as for GetFd.
+   */
+  inline Q_type& GetQd() {
+    return MutableCovariance().Qd;
+  }
+  inline const Q_type& GetQd() const {
+    return covariance_ ? covariance_->Qd : DefaultCovariance().Qd;
+  }
+
+  /// \brief Square root of P, only kept with the SquareRootCovarianceForm.
+  inline P_type& GetSqrtP() {
+    return MutableCovariance().S;
+  }
+  inline const P_type& GetSqrtP() const {
+    return covariance_ ? covariance_->S : DefaultCovariance().S;
+  }
+
   /**
    * \brief Apply the correction vector to all state vars.
    */
   inline void Correct(
-      const Eigen::Matrix<double, nErrorStatesAtCompileTime, 1>& correction);
+      const Eigen::Matrix<Scalar_T, nErrorStatesAtCompileTime, 1>& correction);
 
   /**
    * \brief Returns the Q-block of the state at position INDEX in the state list,
@@ -250,7 +431,7 @@ struct GenericState_T {
   /**
    * \brief Returns all values as an eigen vector.
    */
-  Eigen::Matrix<double, nCoreStatesAtCompileTime, 1> ToEigenVector();
+  Eigen::Matrix<Scalar_T, nCoreStatesAtCompileTime, 1> ToEigenVector();
 
   /**
    * Returns a vector of int pairs with enum index in errorstate and numblocks.
@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MSF_STATEPOOL_H_
+#define MSF_STATEPOOL_H_
+
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include <boost/make_shared.hpp>
+#include <Eigen/Core>
+
+#include <msf_core/msf_types.h>
+#include <msf_core/msf_macros.h>
+
+namespace msf_core {
+/**
+ * \brief A recycling pool of preallocated, aligned slots for EKF states.
+ *
+ * Objects handed out by Acquire() are created by boost::allocate_shared, so
+ * each slot holds the object together with the reference count of its
+ * shared_ptr and handing out an object does not touch the heap. The slot is
+ * returned to the pool as soon as the last shared_ptr referencing the object
+ * goes away, e.g. when the buffers are cleaned up. The storage of the pool
+ * stays alive as long as a single object of the pool is alive, so states may
+ * outlive the pool object itself.
+ *
+ * The capacity is a hard bound: if all slots are in use, Acquire() reports an
+ * error and returns an empty pointer. A capacity of zero disables the pool and
+ * allocates every object on the heap. The number of objects in use and the
+ * high water mark are tracked in both cases.
+ */
+template<typename T>
+class StatePool {
+ public:
+  typedef shared_ptr<T> Ptr_T;
+
+ private:
+  /**
+   * \brief The shared storage of the pool: chunks of raw aligned memory and the
+   * list of currently unused slots.
+   *
+   * The size of a slot is the size of the block boost::allocate_shared
+   * requests for an object and its reference count. It is only known once the
+   * first object is allocated, so the slots are carved from the chunks then.
+   */
+  struct Arena {
+    std::vector<std::pair<char*, char*> > chunks;  ///< Allocated memory, range of the slots.
+    std::vector<void*> freeslots;  ///< Slots which can be handed out.
+    size_t slotsize;  ///< Bytes per slot, zero until the first allocation.
+    size_t slotalignment;  ///< Alignment of the slots.
+    size_t capacity;  ///< Number of slots requested.
+    size_t allocated;  ///< Number of slots allocated.
+    size_t inuse;  ///< Number of objects alive.
+    size_t highwatermark;  ///< Maximum number of objects alive at once.
+    size_t refused;  ///< Requests refused because the pool was full.
+    std::mutex mutex;
+
+    Arena()
+        : slotsize(0),
+          slotalignment(0),
+          capacity(0),
+          allocated(0),
+          inuse(0),
+          highwatermark(0),
+          refused(0) {
+    }
+
+    ~Arena() {
+      for (size_t i = 0; i < chunks.size(); ++i) {
+        std::free(chunks[i].first);
+      }
+    }
+
+    /// \brief Allocates the slots up to the capacity. Requires the lock.
+    void AllocateSlots() {
+      if (slotsize == 0 || allocated >= capacity) {
+        return;
+      }
+      size_t nslots = capacity - allocated;
+      char* memory = static_cast<char*>(
+          std::malloc(nslots * slotsize + slotalignment));
+      if (memory == nullptr) {
+        throw std::bad_alloc();
+      }
+      char* begin = memory + slotalignment
+          - reinterpret_cast<size_t>(memory) % slotalignment;
+      chunks.push_back(std::make_pair(memory, begin + nslots * slotsize));
+      freeslots.reserve(capacity);
+      // Hand out the slots in address order.
+      for (size_t i = nslots; i > 0; --i) {
+        freeslots.push_back(begin + (i - 1) * slotsize);
+      }
+      allocated = capacity;
+    }
+
+    /// \brief Returns whether the memory belongs to one of the chunks.
+    bool Owns(void* memory) const {
+      char* address = static_cast<char*>(memory);
+      for (size_t i = 0; i < chunks.size(); ++i) {
+        if (address >= chunks[i].first && address < chunks[i].second) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    void* Allocate(size_t size, size_t alignment) {
+      std::lock_guard<std::mutex> lock(mutex);
+      void* memory = nullptr;
+      if (capacity == 0) {
+        memory = Eigen::internal::aligned_malloc(size);
+      } else {
+        if (slotsize == 0) {
+          slotalignment = alignment;
+          slotsize = (size + slotalignment - 1) / slotalignment * slotalignment;
+          AllocateSlots();
+        }
+        if (freeslots.empty() || size > slotsize) {
+          ++refused;
+          throw std::bad_alloc();
+        }
+        memory = freeslots.back();
+        freeslots.pop_back();
+      }
+      ++inuse;
+      highwatermark = std::max(highwatermark, inuse);
+      return memory;
+    }
+
+    void Deallocate(void* memory) {
+      std::lock_guard<std::mutex> lock(mutex);
+      --inuse;
+      if (Owns(memory)) {
+        freeslots.push_back(memory);
+      } else {
+        Eigen::internal::aligned_free(memory);
+      }
+    }
+  };
+
+  /**
+   * \brief The allocator boost::allocate_shared places the objects and their
+   * reference counts with. Copies share the arena, so the control block of each
+   * object keeps the storage of the pool alive.
+   */
+  template<typename U>
+  struct Allocator {
+    typedef U value_type;
+    typedef U* pointer;
+    typedef const U* const_pointer;
+    typedef U& reference;
+    typedef const U& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template<typename Other>
+    struct rebind {
+      typedef Allocator<Other> other;
+    };
+
+    shared_ptr<Arena> arena;
+
+    explicit Allocator(const shared_ptr<Arena>& _arena)
+        : arena(_arena) {
+    }
+
+    template<typename Other>
+    Allocator(const Allocator<Other>& other)
+        : arena(other.arena) {
+    }
+
+    U* allocate(size_t n) {
+      return static_cast<U*>(arena->Allocate(n * sizeof(U), alignof(U)));
+    }
+
+    void deallocate(U* memory, size_t) {
+      arena->Deallocate(memory);
+    }
+
+    template<typename Other>
+    bool operator==(const Allocator<Other>& other) const {
+      return arena == other.arena;
+    }
+
+    template<typename Other>
+    bool operator!=(const Allocator<Other>& other) const {
+      return arena != other.arena;
+    }
+  };
+
+  shared_ptr<Arena> arena_;
+
+ public:
+  /**
+   * \brief Creates a pool with the given number of preallocated slots.
+   */
+  explicit StatePool(size_t capacity = 0)
+      : arena_(new Arena) {
+    SetCapacity(capacity);
+  }
+
+  /**
+   * \brief Grows the pool to the given number of slots. The memory for the new
+   * slots is allocated immediately. The capacity can only be increased, smaller
+   * values are ignored.
+   */
+  void SetCapacity(size_t capacity) {
+    bool slotsizeknown;
+    {
+      std::lock_guard<std::mutex> lock(arena_->mutex);
+      if (capacity <= arena_->capacity) {
+        return;
+      }
+      arena_->capacity = capacity;
+      arena_->AllocateSlots();
+      slotsizeknown = arena_->slotsize != 0;
+    }
+    if (!slotsizeknown) {
+      // The first allocation determines the slot size and allocates the slots.
+      Acquire();
+    }
+  }
+
+  /**
+   * \brief Returns a default constructed object placed in a free slot of the
+   * pool, or an empty pointer if the pool is exhausted.
+   */
+  Ptr_T Acquire() {
+    try {
+      return boost::allocate_shared<T>(Allocator<T>(arena_));
+    } catch (const std::bad_alloc&) {
+      MSF_ERROR_STREAM_THROTTLE(
+          1, "State pool exhausted (capacity " << Capacity()
+          << "), refusing to allocate. Increase the capacity of the pool.");
+      return Ptr_T();
+    }
+  }
+
+  /// \brief Number of preallocated slots.
+  size_t Capacity() const {
+    std::lock_guard<std::mutex> lock(arena_->mutex);
+    return arena_->capacity;
+  }
+
+  /// \brief Number of objects from this pool which are currently alive.
+  size_t InUse() const {
+    std::lock_guard<std::mutex> lock(arena_->mutex);
+    return arena_->inuse;
+  }
+
+  /// \brief The maximum number of objects that were alive at the same time.
+  size_t HighWaterMark() const {
+    std::lock_guard<std::mutex> lock(arena_->mutex);
+    return arena_->highwatermark;
+  }
+
+  /// \brief Number of objects that were refused, because the pool was full.
+  size_t Refused() const {
+    std::lock_guard<std::mutex> lock(arena_->mutex);
+    return arena_->refused;
+  }
+};
+}  // namespace msf_core
+
+#endif  // MSF_STATEPOOL_H_
@@ -86,9 +86,9 @@ template<typename T> struct EchoStateVarType;
 /**
  * \brief Runtime output of stateVariable types for const ref eigen matrices.
  */
-template<int NAME, int N, int STATE_T, int OPTIONS>
+template<typename Scalar_T, int NAME, int N, int STATE_T, int OPTIONS>
 struct EchoStateVarType<
-    const msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME, STATE_T,
+    const msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME, STATE_T,
         OPTIONS>&> {
   static std::string Value() {
     return "const ref Eigen::Matrix<double, " + boost::lexical_cast
@@ -98,9 +98,9 @@ struct EchoStateVarType<
 /**
  * \brief Runtime output of stateVariable types for const ref eigen quaternions.
  */
-template<int NAME, int STATE_T, int OPTIONS>
+template<typename Scalar_T, int NAME, int STATE_T, int OPTIONS>
 struct EchoStateVarType<
-    const msf_core::StateVar_T<Eigen::Quaterniond, NAME, STATE_T, OPTIONS>&> {
+    const msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME, STATE_T, OPTIONS>&> {
   static std::string Value() {
     return "const ref Eigen::Quaterniond";
   }
@@ -108,9 +108,9 @@ struct EchoStateVarType<
 /**
  * \brief Runtime output of stateVariable types for eigen matrices.
  */
-template<int NAME, int N, int STATE_T, int OPTIONS>
+template<typename Scalar_T, int NAME, int N, int STATE_T, int OPTIONS>
 struct EchoStateVarType<
-    msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME, STATE_T, OPTIONS> > {
+    msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME, STATE_T, OPTIONS> > {
   static std::string Value() {
     return "Eigen::Matrix<double, " + boost::lexical_cast < std::string
         > (N) + ", 1>";
@@ -119,9 +119,9 @@ struct EchoStateVarType<
 /**
  * \brief Runtime output of stateVariable types for eigen matrices.
  */
-template<int NAME, int STATE_T, int OPTIONS>
+template<typename Scalar_T, int NAME, int STATE_T, int OPTIONS>
 struct EchoStateVarType<
-    msf_core::StateVar_T<Eigen::Quaterniond, NAME, STATE_T, OPTIONS> > {
+    msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME, STATE_T, OPTIONS> > {
   static std::string Value() {
     return "Eigen::Quaterniond";
   }
@@ -131,17 +131,17 @@ namespace {  // For internal use only:
 // The number of entries in the correction vector for a given state var.
 template<typename T>
 struct CorrectionStateLengthForType;
-template<int NAME, int N, int STATE_T, int OPTIONS>
+template<typename Scalar_T, int NAME, int N, int STATE_T, int OPTIONS>
 struct CorrectionStateLengthForType<
-    const msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME, STATE_T,
+    const msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME, STATE_T,
         OPTIONS>&> {
   enum {
     value = N
   };
 };
-template<int NAME, int STATE_T, int OPTIONS>
+template<typename Scalar_T, int NAME, int STATE_T, int OPTIONS>
 struct CorrectionStateLengthForType<
-    const msf_core::StateVar_T<Eigen::Quaterniond, NAME, STATE_T, OPTIONS>&> {
+    const msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME, STATE_T, OPTIONS>&> {
   enum {
     value = 3
   };
@@ -156,17 +156,17 @@ struct CorrectionStateLengthForType<const mpl_::void_&> {
 // The number of entries in the state for a given state var.
 template<typename T>
 struct StateLengthForType;
-template<int NAME, int N, int STATE_T, int OPTIONS>
+template<typename Scalar_T, int NAME, int N, int STATE_T, int OPTIONS>
 struct StateLengthForType<
-    const msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME, STATE_T,
+    const msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME, STATE_T,
         OPTIONS>&> {
   enum {
     value = N
   };
 };
-template<int NAME, int STATE_T, int OPTIONS>
+template<typename Scalar_T, int NAME, int STATE_T, int OPTIONS>
 struct StateLengthForType<
-    const msf_core::StateVar_T<Eigen::Quaterniond, NAME, STATE_T, OPTIONS>&> {
+    const msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME, STATE_T, OPTIONS>&> {
   enum {
     value = 4
   };
@@ -181,50 +181,50 @@ struct StateLengthForType<const mpl_::void_&> {
 // The number of entries in the state for a given state var if it is core state.
 template<typename T>
 struct CoreStateLengthForType;
-template<int NAME, int N, int STATE_T, int OPTIONS>
+template<typename Scalar_T, int NAME, int N, int STATE_T, int OPTIONS>
 struct CoreStateLengthForType<
-    const msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME, STATE_T,
+    const msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME, STATE_T,
         OPTIONS>&> {
   enum {
     value = 0
   };
   // Not a core state, so length is zero.
 };
-template<int NAME, int STATE_T, int OPTIONS>
+template<typename Scalar_T, int NAME, int STATE_T, int OPTIONS>
 struct CoreStateLengthForType<
-    const msf_core::StateVar_T<Eigen::Quaterniond, NAME, STATE_T, OPTIONS>&> {
+    const msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME, STATE_T, OPTIONS>&> {
   enum {
     value = 0
   };
   // Not a core state, so length is zero.
 };
-template<int NAME, int OPTIONS, int N>
+template<typename Scalar_T, int NAME, int OPTIONS, int N>
 struct CoreStateLengthForType<
-    const msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME,
+    const msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME,
         msf_core::CoreStateWithoutPropagation, OPTIONS>&> {
   enum {
     value = N
   };
 };
-template<int NAME, int OPTIONS>
+template<typename Scalar_T, int NAME, int OPTIONS>
 struct CoreStateLengthForType<
-    const msf_core::StateVar_T<Eigen::Quaterniond, NAME,
+    const msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME,
         msf_core::CoreStateWithoutPropagation, OPTIONS>&> {
   enum {
     value = 4
   };
 };
-template<int NAME, int OPTIONS, int N>
+template<typename Scalar_T, int NAME, int OPTIONS, int N>
 struct CoreStateLengthForType<
-    const msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME,
+    const msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME,
         msf_core::CoreStateWithPropagation, OPTIONS>&> {
   enum {
     value = N
   };
 };
-template<int NAME, int OPTIONS>
+template<typename Scalar_T, int NAME, int OPTIONS>
 struct CoreStateLengthForType<
-    const msf_core::StateVar_T<Eigen::Quaterniond, NAME,
+    const msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME,
         msf_core::CoreStateWithPropagation, OPTIONS>&> {
   enum {
     value = 4
@@ -240,50 +240,50 @@ struct CoreStateLengthForType<const mpl_::void_&> {
 // The number of entries in the error state for a given state var if it is core state.
 template<typename T>
 struct CoreErrorStateLengthForType;
-template<int NAME, int N, int STATE_T, int OPTIONS>
+template<typename Scalar_T, int NAME, int N, int STATE_T, int OPTIONS>
 struct CoreErrorStateLengthForType<
-    const msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME, STATE_T,
+    const msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME, STATE_T,
         OPTIONS>&> {
   enum {
     value = 0
   };
   // Not a core state, so length is zero.
 };
-template<int NAME, int STATE_T, int OPTIONS>
+template<typename Scalar_T, int NAME, int STATE_T, int OPTIONS>
 struct CoreErrorStateLengthForType<
-    const msf_core::StateVar_T<Eigen::Quaterniond, NAME, STATE_T, OPTIONS>&> {
+    const msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME, STATE_T, OPTIONS>&> {
   enum {
     value = 0
   };
   // Not a core state, so length is zero.
 };
-template<int NAME, int OPTIONS, int N>
+template<typename Scalar_T, int NAME, int OPTIONS, int N>
 struct CoreErrorStateLengthForType<
-    const msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME,
+    const msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME,
         msf_core::CoreStateWithoutPropagation, OPTIONS>&> {
   enum {
     value = N
   };
 };
-template<int NAME, int OPTIONS>
+template<typename Scalar_T, int NAME, int OPTIONS>
 struct CoreErrorStateLengthForType<
-    const msf_core::StateVar_T<Eigen::Quaterniond, NAME,
+    const msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME,
         msf_core::CoreStateWithoutPropagation, OPTIONS>&> {
   enum {
     value = 3
   };
 };
-template<int NAME, int OPTIONS, int N>
+template<typename Scalar_T, int NAME, int OPTIONS, int N>
 struct CoreErrorStateLengthForType<
-    const msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME,
+    const msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME,
         msf_core::CoreStateWithPropagation, OPTIONS>&> {
   enum {
     value = N
   };
 };
-template<int NAME, int OPTIONS>
+template<typename Scalar_T, int NAME, int OPTIONS>
 struct CoreErrorStateLengthForType<
-    const msf_core::StateVar_T<Eigen::Quaterniond, NAME,
+    const msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME,
         msf_core::CoreStateWithPropagation, OPTIONS>&> {
   enum {
     value = 3
@@ -300,34 +300,34 @@ struct CoreErrorStateLengthForType<const mpl_::void_&> {
 // with propagation.
 template<typename T>
 struct PropagatedCoreStateLengthForType;
-template<int NAME, int N, int STATE_T, int OPTIONS>
+template<typename Scalar_T, int NAME, int N, int STATE_T, int OPTIONS>
 struct PropagatedCoreStateLengthForType<
-    const msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME, STATE_T,
+    const msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME, STATE_T,
         OPTIONS>&> {
   enum {
     value = 0
   };
   // Not a core state, so length is zero.
 };
-template<int NAME, int STATE_T, int OPTIONS>
+template<typename Scalar_T, int NAME, int STATE_T, int OPTIONS>
 struct PropagatedCoreStateLengthForType<
-    const msf_core::StateVar_T<Eigen::Quaterniond, NAME, STATE_T, OPTIONS>&> {
+    const msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME, STATE_T, OPTIONS>&> {
   enum {
     value = 0
   };
   // Not a core state, so length is zero.
 };
-template<int NAME, int OPTIONS, int N>
+template<typename Scalar_T, int NAME, int OPTIONS, int N>
 struct PropagatedCoreStateLengthForType<
-    const msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME,
+    const msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME,
         msf_core::CoreStateWithPropagation, OPTIONS>&> {
   enum {
     value = N
   };
 };
-template<int NAME, int OPTIONS>
+template<typename Scalar_T, int NAME, int OPTIONS>
 struct PropagatedCoreStateLengthForType<
-    const msf_core::StateVar_T<Eigen::Quaterniond, NAME,
+    const msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME,
         msf_core::CoreStateWithPropagation, OPTIONS>&> {
   enum {
     value = 4
@@ -344,34 +344,34 @@ struct PropagatedCoreStateLengthForType<const mpl_::void_&> {
 // state with propagation.
 template<typename T>
 struct PropagatedCoreErrorStateLengthForType;
-template<int NAME, int N, int STATE_T, int OPTIONS>
+template<typename Scalar_T, int NAME, int N, int STATE_T, int OPTIONS>
 struct PropagatedCoreErrorStateLengthForType<
-    const msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME, STATE_T,
+    const msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME, STATE_T,
         OPTIONS>&> {
   enum {
     value = 0
   };
   // Not a core state, so length is zero.
 };
-template<int NAME, int STATE_T, int OPTIONS>
+template<typename Scalar_T, int NAME, int STATE_T, int OPTIONS>
 struct PropagatedCoreErrorStateLengthForType<
-    const msf_core::StateVar_T<Eigen::Quaterniond, NAME, STATE_T, OPTIONS>&> {
+    const msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME, STATE_T, OPTIONS>&> {
   enum {
     value = 0
   };
   // Not a core state, so length is zero.
 };
-template<int NAME, int OPTIONS, int N>
+template<typename Scalar_T, int NAME, int OPTIONS, int N>
 struct PropagatedCoreErrorStateLengthForType<
-    const msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME,
+    const msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME,
         msf_core::CoreStateWithPropagation, OPTIONS>&> {
   enum {
     value = N
   };
 };
-template<int NAME, int OPTIONS>
+template<typename Scalar_T, int NAME, int OPTIONS>
 struct PropagatedCoreErrorStateLengthForType<
-    const msf_core::StateVar_T<Eigen::Quaterniond, NAME,
+    const msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME,
         msf_core::CoreStateWithPropagation, OPTIONS>&> {
   enum {
     value = 3
@@ -414,31 +414,31 @@ template<> struct GetEnumStateName<mpl_::void_> {
 
 template<typename T>
 struct IsQuaternionType;
-template<int NAME, int STATE_T, int OPTIONS, int M, int N>
+template<typename Scalar_T, int NAME, int STATE_T, int OPTIONS, int M, int N>
 struct IsQuaternionType<
-    const msf_core::StateVar_T<Eigen::Matrix<double, M, N>, NAME, STATE_T,
+    const msf_core::StateVar_T<Eigen::Matrix<Scalar_T, M, N>, NAME, STATE_T,
         OPTIONS>&> {
   enum {
     value = false
   };
 };
-template<int NAME, int STATE_T, int OPTIONS, int M, int N>
+template<typename Scalar_T, int NAME, int STATE_T, int OPTIONS, int M, int N>
 struct IsQuaternionType<
-    msf_core::StateVar_T<Eigen::Matrix<double, M, N>, NAME, STATE_T, OPTIONS> > {
+    msf_core::StateVar_T<Eigen::Matrix<Scalar_T, M, N>, NAME, STATE_T, OPTIONS> > {
   enum {
     value = false
   };
 };
-template<int NAME, int STATE_T, int OPTIONS>
+template<typename Scalar_T, int NAME, int STATE_T, int OPTIONS>
 struct IsQuaternionType<
-    const msf_core::StateVar_T<Eigen::Quaterniond, NAME, STATE_T, OPTIONS>&> {
+    const msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME, STATE_T, OPTIONS>&> {
   enum {
     value = true
   };
 };
-template<int NAME, int STATE_T, int OPTIONS>
+template<typename Scalar_T, int NAME, int STATE_T, int OPTIONS>
 struct IsQuaternionType<
-    msf_core::StateVar_T<Eigen::Quaterniond, NAME, STATE_T, OPTIONS> > {
+    msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME, STATE_T, OPTIONS> > {
   enum {
     value = true
   };
@@ -742,6 +742,17 @@ struct CountStates {
   };
 };
 
+/**
+ * \brief Returns the scalar type of the state vector, the scalar of its first
+ * state variable. All state variables have to use the same scalar.
+ */
+template<typename Sequence>
+struct ScalarOfSequence {
+  typedef typename msf_tmp::StripConstReference<
+      typename boost::fusion::result_of::at_c<Sequence, 0>::type>::result_t::
+      value_t::Scalar type;
+};
+
 /**
  * \brief Compute start indices in the correction/state vector of a given type.
  */
@@ -780,14 +791,14 @@ struct GetStartIndexInCorrection {
  * \brief Reset the EKF state in a boost fusion unrolled call.
  */
 struct ResetState {
-  template<int NAME, int N, int STATE_T, int OPTIONS>
+  template<typename Scalar_T, int NAME, int N, int STATE_T, int OPTIONS>
   void operator()(
-      msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME, STATE_T, OPTIONS>& t) const {
+      msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME, STATE_T, OPTIONS>& t) const {
     t.state_.setZero();
   }
-  template<int NAME, int STATE_T, int OPTIONS>
+  template<typename Scalar_T, int NAME, int STATE_T, int OPTIONS>
   void operator()(
-      msf_core::StateVar_T<Eigen::Quaterniond, NAME, STATE_T, OPTIONS>& t) const {
+      msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME, STATE_T, OPTIONS>& t) const {
     t.state_.setIdentity();
   }
 };
@@ -856,8 +867,8 @@ struct CopyQBlocksFromAuxiliaryStatesToQ {
     nErrorStatesAtCompileTime = msf_tmp::CountStates<stateList_T,
         msf_tmp::CorrectionStateLengthForType>::value  // N correction states.
   };
-  typedef Eigen::Matrix<double, nErrorStatesAtCompileTime,
-      nErrorStatesAtCompileTime> Q_T;
+  typedef Eigen::Matrix<typename ScalarOfSequence<stateList_T>::type,
+      nErrorStatesAtCompileTime, nErrorStatesAtCompileTime> Q_T;
   CopyQBlocksFromAuxiliaryStatesToQ(Q_T& Q)
       : Q_(Q) { }
   template<typename T, int NAME, int STATE_T, int OPTIONS>
@@ -914,10 +925,10 @@ struct CorrectState {
   CorrectState(T& correction)
       : data_(correction) {
   }
-  template<int NAME, int N, int STATE_T, int OPTIONS>
+  template<typename Scalar_T, int NAME, int N, int STATE_T, int OPTIONS>
   void operator()(
-      msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME, STATE_T, OPTIONS>& t) const {
-    typedef msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME, STATE_T,
+      msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME, STATE_T, OPTIONS>& t) const {
+    typedef msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME, STATE_T,
         OPTIONS> var_T;
     enum {
       startIdxInCorrection = msf_tmp::GetStartIndex<stateList_T, var_T,
@@ -933,10 +944,10 @@ struct CorrectState {
               startIdxInCorrection, 0);
     }
   }
-  template<int NAME, int STATE_T, int OPTIONS>
+  template<typename Scalar_T, int NAME, int STATE_T, int OPTIONS>
   void operator()(
-      msf_core::StateVar_T<Eigen::Quaterniond, NAME, STATE_T, OPTIONS>& t) const {
-    typedef msf_core::StateVar_T<Eigen::Quaterniond, NAME, STATE_T> var_T;
+      msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME, STATE_T, OPTIONS>& t) const {
+    typedef msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME, STATE_T> var_T;
     enum {
       startIdxInCorrection = msf_tmp::GetStartIndex<stateList_T, var_T,
           msf_tmp::CorrectionStateLengthForType>::value
@@ -947,7 +958,7 @@ struct CorrectState {
         "You defined the Quaternion correction to be multiplicative, but this "
         "is anyway done and not an option");
 
-    Eigen::Quaternion<double> qbuff_q = QuaternionFromSmallAngle(
+    Eigen::Quaternion<Scalar_T> qbuff_q = QuaternionFromSmallAngle(
         data_.template block<var_T::sizeInCorrection_, 1>(startIdxInCorrection,
                                                           0));
     t.state_ = t.state_ * qbuff_q;
@@ -965,10 +976,10 @@ struct CoreStatetoDoubleArray {
   CoreStatetoDoubleArray(T& statearray)
       : data_(statearray) {
   }
-  template<int NAME, int N, int STATE_T, int OPTIONS>
+  template<typename Scalar_T, int NAME, int N, int STATE_T, int OPTIONS>
   void operator()(
-      msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME, STATE_T, OPTIONS>& t) const {
-    typedef msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME, STATE_T,
+      msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME, STATE_T, OPTIONS>& t) const {
+    typedef msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME, STATE_T,
         OPTIONS> var_T;
     enum {
       startIdxInState = msf_tmp::GetStartIndex<stateList_T, var_T,
@@ -986,10 +997,10 @@ struct CoreStatetoDoubleArray {
       data_[startIdxInState + i] = t.state_[i];
     }
   }
-  template<int NAME, int STATE_T, int OPTIONS>
+  template<typename Scalar_T, int NAME, int STATE_T, int OPTIONS>
   void operator()(
-      msf_core::StateVar_T<Eigen::Quaterniond, NAME, STATE_T, OPTIONS>& t) const {
-    typedef msf_core::StateVar_T<Eigen::Quaterniond, NAME, STATE_T, OPTIONS> var_T;
+      msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME, STATE_T, OPTIONS>& t) const {
+    typedef msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME, STATE_T, OPTIONS> var_T;
     enum {
       startIdxInState = msf_tmp::GetStartIndex<stateList_T, var_T,
       // Index of the data in the state vector.
@@ -1008,28 +1019,28 @@ struct CoreStatetoDoubleArray {
     data_[startIdxInState + 2] = t.state_.y();
     data_[startIdxInState + 3] = t.state_.z();
   }
-  template<int NAME, int OPTIONS, int N>
+  template<typename Scalar_T, int NAME, int OPTIONS, int N>
   void operator()(
-      msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME,
+      msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME,
           msf_core::Auxiliary, OPTIONS>& UNUSEDPARAM(t)) const {
     // Don't copy aux states.
   }
-  template<int NAME, int OPTIONS>
+  template<typename Scalar_T, int NAME, int OPTIONS>
   void operator()(
-      msf_core::StateVar_T<Eigen::Quaterniond, NAME, msf_core::Auxiliary,
+      msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME, msf_core::Auxiliary,
           OPTIONS>& UNUSEDPARAM(t)) const {
     // Don't copy aux states.
   }
 
-  template<int NAME, int OPTIONS, int N>
+  template<typename Scalar_T, int NAME, int OPTIONS, int N>
   void operator()(
-      msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME,
+      msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME,
           msf_core::AuxiliaryNonTemporalDrifting, OPTIONS>& UNUSEDPARAM(t)) const {
     // Don't copy aux states.
   }
-  template<int NAME, int OPTIONS>
+  template<typename Scalar_T, int NAME, int OPTIONS>
   void operator()(
-      msf_core::StateVar_T<Eigen::Quaterniond, NAME,
+      msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME,
           msf_core::AuxiliaryNonTemporalDrifting, OPTIONS>& UNUSEDPARAM(t)) const {
     // Don't copy aux states.
   }
@@ -1097,10 +1108,10 @@ struct FullStatetoString {
   FullStatetoString(STREAM& data)
       : data_(data) {
   }
-  template<int NAME, int N, int STATE_T, int OPTIONS>
+  template<typename Scalar_T, int NAME, int N, int STATE_T, int OPTIONS>
   void operator()(
-      msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME, STATE_T, OPTIONS>& t) const {
-    typedef msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME, STATE_T,
+      msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME, STATE_T, OPTIONS>& t) const {
+    typedef msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME, STATE_T,
         OPTIONS> var_T;
     enum {
       startIdxInState = msf_tmp::GetStartIndex<stateList_T, var_T,
@@ -1111,10 +1122,10 @@ struct FullStatetoString {
         << "]\t : Matrix<" << N << ", 1>         : [" << t.state_.transpose()
         << "]" << std::endl;
   }
-  template<int NAME, int STATE_T, int OPTIONS>
+  template<typename Scalar_T, int NAME, int STATE_T, int OPTIONS>
   void operator()(
-      msf_core::StateVar_T<Eigen::Quaterniond, NAME, STATE_T, OPTIONS>& t) const {
-    typedef msf_core::StateVar_T<Eigen::Quaterniond, NAME, STATE_T, OPTIONS> var_T;
+      msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME, STATE_T, OPTIONS>& t) const {
+    typedef msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME, STATE_T, OPTIONS> var_T;
     enum {
       startIdxInState = msf_tmp::GetStartIndex<stateList_T, var_T,
       // Index of the data in the state vector.
@@ -1136,10 +1147,10 @@ struct FullStatetoDoubleArray {
   FullStatetoDoubleArray(T& statearray)
       : data_(statearray) {
   }
-  template<int NAME, int N, int STATE_T, int OPTIONS>
+  template<typename Scalar_T, int NAME, int N, int STATE_T, int OPTIONS>
   void operator()(
-      msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME, STATE_T, OPTIONS>& t) const {
-    typedef msf_core::StateVar_T<Eigen::Matrix<double, N, 1>, NAME, STATE_T,
+      msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME, STATE_T, OPTIONS>& t) const {
+    typedef msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME, STATE_T,
         OPTIONS> var_T;
     enum {
       startIdxInState = msf_tmp::GetStartIndex<stateList_T, var_T,
@@ -1150,10 +1161,10 @@ struct FullStatetoDoubleArray {
       data_[startIdxInState + i] = t.state_[i];
     }
   }
-  template<int NAME, int STATE_T, int OPTIONS>
+  template<typename Scalar_T, int NAME, int STATE_T, int OPTIONS>
   void operator()(
-      msf_core::StateVar_T<Eigen::Quaterniond, NAME, STATE_T, OPTIONS>& t) const {
-    typedef msf_core::StateVar_T<Eigen::Quaterniond, NAME, STATE_T, OPTIONS> var_T;
+      msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME, STATE_T, OPTIONS>& t) const {
+    typedef msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME, STATE_T, OPTIONS> var_T;
     enum {
       startIdxInState = msf_tmp::GetStartIndex<stateList_T, var_T,
       // Index of the data in the state vector.
@@ -1168,6 +1179,48 @@ struct FullStatetoDoubleArray {
  private:
   T& data_;
 };
+
+/**
+ * \brief Sets the values of the single state vars from the double array
+ * provided, the inverse of FullStatetoDoubleArray.
+ */
+template<typename T, typename stateList_T>
+struct FullStateFromDoubleArray {
+  FullStateFromDoubleArray(const T& statearray)
+      : data_(statearray) {
+  }
+  template<typename Scalar_T, int NAME, int N, int STATE_T, int OPTIONS>
+  void operator()(
+      msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME, STATE_T, OPTIONS>& t) const {
+    typedef msf_core::StateVar_T<Eigen::Matrix<Scalar_T, N, 1>, NAME, STATE_T,
+        OPTIONS> var_T;
+    enum {
+      startIdxInState = msf_tmp::GetStartIndex<stateList_T, var_T,
+      // Index of the data in the state vector.
+          msf_tmp::StateLengthForType>::value
+    };
+    for (int i = 0; i < var_T::sizeInState_; ++i) {
+      t.state_[i] = data_[startIdxInState + i];
+    }
+  }
+  template<typename Scalar_T, int NAME, int STATE_T, int OPTIONS>
+  void operator()(
+      msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME, STATE_T, OPTIONS>& t) const {
+    typedef msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, NAME, STATE_T, OPTIONS> var_T;
+    enum {
+      startIdxInState = msf_tmp::GetStartIndex<stateList_T, var_T,
+      // Index of the data in the state vector.
+          msf_tmp::StateLengthForType>::value
+    };
+    // Copy quaternion values.
+    t.state_.w() = data_[startIdxInState + 0];
+    t.state_.x() = data_[startIdxInState + 1];
+    t.state_.y() = data_[startIdxInState + 2];
+    t.state_.z() = data_[startIdxInState + 3];
+  }
+ private:
+  const T& data_;
+};
 }
 
 #endif  // MSF_TMP_H_
@@ -19,6 +19,8 @@
 
 #include <Eigen/Dense>
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
 
 namespace msf_core {
 /***
@@ -36,9 +38,10 @@ typename Eigen::MatrixBase<D>::Scalar GetMedian(
       Eigen::MatrixBase<D>::ColsAtCompileTime> m = data;
 
   if (Eigen::MatrixBase<D>::SizeAtCompileTime) {
-    double * begin = m.data();
-    double * end = m.data() + m.SizeAtCompileTime;
-    double * middle = begin + static_cast<int>(std::floor((end - begin) / 2));
+    typedef typename Eigen::MatrixBase<D>::Scalar Scalar;
+    Scalar * begin = m.data();
+    Scalar * end = m.data() + m.SizeAtCompileTime;
+    Scalar * middle = begin + static_cast<int>(std::floor((end - begin) / 2));
     std::nth_element(begin, middle, end);
     return *middle;
   } else
@@ -50,6 +53,26 @@ typename Eigen::MatrixBase<D>::Scalar GetMedian(
  */
 double timehuman(double val);
 
+/***
+ * Outputs a time stamp in nanoseconds in seconds in a human readable format
+ * for debugging.
+ */
+double timehuman(int64_t val);
+
+/***
+ * Converts a time stamp or duration in nanoseconds to seconds.
+ */
+inline double NanosecondsToSeconds(int64_t val) {
+  return static_cast<double>(val) * 1e-9;
+}
+
+/***
+ * Converts a time stamp or duration in seconds to nanoseconds.
+ */
+inline int64_t SecondsToNanoseconds(double val) {
+  return static_cast<int64_t>(std::llround(val * 1e9));
+}
+
 }
 
 #endif  // MSF_TOOLS_H_
@@ -17,6 +17,7 @@
 #ifndef MSF_TYPES_HPP_
 #define MSF_TYPES_HPP_
 
+#include <cstdint>
 #include <Eigen/Dense>
 #include <type_traits>
 
@@ -44,5 +45,14 @@ MSF_MAKE_EIGEN_TYPES(7)
 MSF_MAKE_EIGEN_TYPES(8)
 MSF_MAKE_EIGEN_TYPES(9)
 
+/**
+ * \brief An IMU reading, e.g. one of the batch an IMU delivers from its FIFO.
+ */
+struct ImuReading {
+  int64_t time;  ///< Time stamp [ns].
+  Vector3 linear_acceleration;
+  Vector3 angular_velocity;
+};
+
 }
 #endif  // MSF_TYPES_HPP_
@@ -0,0 +1,435 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef TESTING_CORE_H_
+#define TESTING_CORE_H_
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <msf_core/msf_core.h>
+#include <msf_core/msf_IMUHandler.h>
+#include <msf_core/msf_sensormanager.h>
+#include <msf_core/testing_predicates.h>
+
+namespace msf_core {
+namespace test {
+
+enum TestStateDefinition {
+  p,
+  v,
+  q,
+  b_w,
+  b_a,
+  L,
+  q_wv
+};
+
+/**
+ * \brief The state the core tests run the filter with. Another enum with the
+ * same enumerators as StateDefinition_T gives another state type, e.g. to
+ * specialize the traits of the core for it.
+ */
+template<typename Scalar_T, typename StateDefinition_T = TestStateDefinition>
+struct TestState {
+  typedef boost::fusion::vector<
+      StateVar_T<Eigen::Matrix<Scalar_T, 3, 1>, p, CoreStateWithPropagation>,
+      StateVar_T<Eigen::Matrix<Scalar_T, 3, 1>, v, CoreStateWithPropagation>,
+      StateVar_T<Eigen::Quaternion<Scalar_T>, q, CoreStateWithPropagation>,
+      StateVar_T<Eigen::Matrix<Scalar_T, 3, 1>, b_w,
+          CoreStateWithoutPropagation>,
+      StateVar_T<Eigen::Matrix<Scalar_T, 3, 1>, b_a,
+          CoreStateWithoutPropagation>,
+      StateVar_T<Eigen::Matrix<Scalar_T, 1, 1>, L, Auxiliary>,
+      StateVar_T<Eigen::Quaternion<Scalar_T>, q_wv,
+          AuxiliaryNonTemporalDrifting>
+  > StateSequence_T;
+  typedef GenericState_T<StateSequence_T, StateDefinition_T> type;
+};
+
+/// A state published by the core.
+struct TestPublication {
+  int64_t time;
+  Eigen::Vector3d p;
+  bool afterupdate;
+  /// The covariance of the states published after an update, empty for the
+  /// others, whose covariance may still be propagated in the background.
+  Eigen::MatrixXd P;
+};
+
+/**
+ * \brief Expects two filters to have published the same states, the position
+ * within tol and the covariance after the updates within covariance_tol,
+ * which defaults to tol.
+ */
+inline void ExpectSamePublications(
+    const std::vector<TestPublication>& expected,
+    const std::vector<TestPublication>& published, double tol,
+    double covariance_tol = -1) {
+  if (covariance_tol < 0) {
+    covariance_tol = tol;
+  }
+  ASSERT_EQ(published.size(), expected.size());
+  size_t updates = 0;
+  for (size_t i = 0; i < published.size(); ++i) {
+    ASSERT_EQ(published[i].time, expected[i].time);
+    ASSERT_EQ(published[i].afterupdate, expected[i].afterupdate);
+    EXPECT_NEAR_EIGEN(published[i].p, expected[i].p, tol);
+    if (published[i].afterupdate) {
+      EXPECT_NEAR_EIGEN(published[i].P, expected[i].P, covariance_tol);
+      ++updates;
+    }
+  }
+  EXPECT_GT(updates, 0u);
+}
+
+/**
+ * \brief Sets the process noise of the auxiliary states over dt seconds,
+ * 1e-6 per second for scalar states and 1e-8 per second for the others.
+ */
+class TestAuxiliaryNoise {
+  double dt_;
+ public:
+  explicit TestAuxiliaryNoise(double dt)
+      : dt_(dt) {
+  }
+  template<typename Var_T>
+  void operator()(Var_T& var) const {
+    if (static_cast<int>(Var_T::statetype_) ==
+        static_cast<int>(CoreStateWithPropagation) ||
+        static_cast<int>(Var_T::statetype_) ==
+        static_cast<int>(CoreStateWithoutPropagation))
+      return;
+    typedef typename Var_T::Q_T Q_T;
+    const double density = Var_T::sizeInCorrection_ == 1 ? 1e-6 : 1e-8;
+    var.Q = Q_T::Identity() * typename Q_T::Scalar(density * dt_);
+  }
+};
+
+/**
+ * \brief A sensor manager with fixed noise parameters, which exposes the
+ * parameters of the core and records the published states.
+ */
+template<typename EKFState_T>
+class TestSensorManager : public MSF_SensorManager<EKFState_T> {
+  typedef MSF_SensorManager<EKFState_T> Base_T;
+  typedef typename EKFState_T::Scalar_T Scalar_T;
+  enum {
+    nErrorStatesAtCompileTime = EKFState_T::nErrorStatesAtCompileTime
+  };
+  mutable std::vector<TestPublication> publications_;
+
+  void Record(const shared_ptr<EKFState_T>& state, bool afterupdate) const {
+    TestPublication publication;
+    publication.time = state->time;
+    const EKFState_T& const_state = *state;
+    publication.p = const_state.template Get<p>().template cast<double>();
+    publication.afterupdate = afterupdate;
+    if (afterupdate) {
+      publication.P = const_state.GetP().template cast<double>();
+    }
+    publications_.push_back(publication);
+  }
+ public:
+  using Base_T::state_pool_capacity_;
+  using Base_T::covariance_keyframe_stride_;
+  using Base_T::covariance_propagation_decimation_;
+  using Base_T::imu_preintegration_stride_;
+  using Base_T::covariance_propagation_thread_;
+  using Base_T::lazy_repropagation_;
+  using Base_T::coalesce_measurements_;
+  using Base_T::max_replay_measurements_;
+  using Base_T::max_replay_states_;
+  using Base_T::late_measurement_strategy_;
+  using Base_T::imu_batch_publish_decimation_;
+  using Base_T::snapshot_file_;
+  using Base_T::snapshot_period_;
+
+  const std::vector<TestPublication>& GetPublications() const {
+    return publications_;
+  }
+
+  void Init(double) const {
+  }
+  void ResetState(EKFState_T&) const {
+  }
+  void InitState(EKFState_T&) const {
+  }
+  void CalculateQAuxiliaryStates(EKFState_T& state, double dt) const {
+    boost::fusion::for_each(state.statevars, TestAuxiliaryNoise(dt));
+  }
+  void SetStateCovariance(
+      Eigen::Matrix<Scalar_T, nErrorStatesAtCompileTime,
+          nErrorStatesAtCompileTime>&) const {
+  }
+  void AugmentCorrectionVector(
+      Eigen::Matrix<Scalar_T, nErrorStatesAtCompileTime, 1>&) const {
+  }
+  void SanityCheckCorrection(
+      EKFState_T&, const EKFState_T&,
+      Eigen::Matrix<Scalar_T, nErrorStatesAtCompileTime, 1>&) const {
+  }
+  bool GetParamFixedBias() const {
+    return false;
+  }
+  double GetParamNoiseAcc() const {
+    return 0.002;
+  }
+  double GetParamNoiseAccbias() const {
+    return 5e-8;
+  }
+  double GetParamNoiseGyr() const {
+    return 0.0004;
+  }
+  double GetParamNoiseGyrbias() const {
+    return 3e-6;
+  }
+  double GetParamFuzzyTrackingThreshold() const {
+    return 0.1;
+  }
+  void PublishStateInitial(const shared_ptr<EKFState_T>&) const {
+  }
+  void PublishStateAfterPropagation(
+      const shared_ptr<EKFState_T>& state) const {
+    Record(state, false);
+  }
+  void PublishStateAfterUpdate(const shared_ptr<EKFState_T>& state) const {
+    Record(state, true);
+  }
+};
+
+template<typename EKFState_T>
+class TestIMUHandler : public IMUHandler<EKFState_T> {
+ public:
+  TestIMUHandler(MSF_SensorManager<EKFState_T>& manager)
+      : IMUHandler<EKFState_T>(manager, "", "") {
+  }
+  bool Initialize() {
+    return true;
+  }
+};
+
+/// A position measurement.
+template<typename EKFState_T>
+class TestPositionMeasurement : public MSF_MeasurementBase<EKFState_T> {
+  enum {
+    nErrorStatesAtCompileTime = EKFState_T::nErrorStatesAtCompileTime
+  };
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  Eigen::Vector3d z;
+
+  TestPositionMeasurement(int64_t time, const Eigen::Vector3d& position,
+                          int sensorID)
+      : MSF_MeasurementBase<EKFState_T>(true, sensorID),
+        z(position) {
+    this->time = time;
+  }
+  std::string Type() {
+    return "test position";
+  }
+  void Apply(shared_ptr<EKFState_T> state, MSF_Core<EKFState_T>& core) {
+    Eigen::Matrix<double, 3, nErrorStatesAtCompileTime> H;
+    H.setZero();
+    H.template block<3, 3>(0, 0).setIdentity();
+    const EKFState_T& const_state = *state;
+    const Eigen::Vector3d r = z
+        - const_state.template Get<p>().template cast<double>();
+    const Eigen::Matrix3d R = Eigen::Matrix3d::Identity() * 1e-4;
+    this->CalculateAndApplyCorrection(state, core, H, r, R);
+  }
+};
+
+/// A position measurement relative to the previous one of the sensor.
+template<typename EKFState_T>
+class TestRelativePositionMeasurement :
+    public MSF_MeasurementBase<EKFState_T> {
+  enum {
+    nErrorStatesAtCompileTime = EKFState_T::nErrorStatesAtCompileTime
+  };
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  Eigen::Vector3d z;
+
+  TestRelativePositionMeasurement(int64_t time, const Eigen::Vector3d& position,
+                                  int sensorID)
+      : MSF_MeasurementBase<EKFState_T>(false, sensorID),
+        z(position) {
+    this->time = time;
+  }
+  std::string Type() {
+    return "test relative position";
+  }
+  void Apply(shared_ptr<EKFState_T> state, MSF_Core<EKFState_T>& core) {
+    shared_ptr<MSF_MeasurementBase<EKFState_T> > previous = core
+        .GetPreviousMeasurement(this->time, this->sensorID_);
+    if (previous->time == -1)
+      return;
+    shared_ptr<EKFState_T> state_old = core.GetClosestState(previous->time);
+    if (state_old->time == -1)
+      return;
+    const TestRelativePositionMeasurement& previous_relative =
+        dynamic_cast<const TestRelativePositionMeasurement&>(*previous);
+    Eigen::Matrix<double, 3, nErrorStatesAtCompileTime> H_old, H_new;
+    H_old.setZero();
+    H_new.setZero();
+    H_old.template block<3, 3>(0, 0) = -Eigen::Matrix3d::Identity();
+    H_new.template block<3, 3>(0, 0).setIdentity();
+    const EKFState_T& const_state = *state;
+    const EKFState_T& const_state_old = *state_old;
+    const Eigen::Vector3d r = (z - previous_relative.z)
+        - (const_state.template Get<p>()
+            - const_state_old.template Get<p>()).template cast<double>();
+    const Eigen::Matrix3d R = Eigen::Matrix3d::Identity() * 1e-4;
+    this->CalculateAndApplyCorrectionRelative(state_old, state, core, H_old,
+                                              H_new, r, R);
+  }
+};
+
+/// Start time of the test scenario [s] and period of its IMU readings [s].
+const double kTestStartTime = 1000;
+const double kTestImuPeriod = 0.005;
+
+/// Position, specific force and rate of the test scenario after t seconds.
+inline void TestMotion(double t, Eigen::Vector3d* position,
+                       Eigen::Vector3d* acceleration,
+                       Eigen::Vector3d* angular_velocity) {
+  *position << sin(t), cos(0.5 * t), 0.1 * t;
+  *acceleration << -sin(t), -0.25 * cos(0.5 * t), 9.80834;
+  *angular_velocity << 0.01 * sin(t), 0.02, -0.01;
+}
+
+/// The i-th IMU reading of the test scenario.
+inline ImuReading TestImuReading(int i) {
+  const double t = i * kTestImuPeriod;
+  Eigen::Vector3d position;
+  ImuReading reading;
+  TestMotion(t, &position, &reading.linear_acceleration,
+             &reading.angular_velocity);
+  reading.time = SecondsToNanoseconds(kTestStartTime + t);
+  return reading;
+}
+
+/**
+ * \brief The filter of the test scenario: IMU readings every kTestImuPeriod
+ * seconds, delayed absolute positions of sensor 0 every 20 readings and
+ * delayed relative positions of sensor 1 every 30 readings. If burstsize is
+ * set, that many delayed positions of sensor 2 arrive at once every 40
+ * readings, out of order.
+ */
+template<typename EKFState_T>
+class TestFilter {
+ public:
+  typedef TestPositionMeasurement<EKFState_T> Position_T;
+  typedef TestRelativePositionMeasurement<EKFState_T> RelativePosition_T;
+
+  TestSensorManager<EKFState_T> manager;
+  TestIMUHandler<EKFState_T> imu;
+  int burstsize;
+  /// Times of the measurements added so far.
+  std::vector<int64_t> measurementtimes;
+
+  TestFilter()
+      : imu(manager),
+        burstsize(0) {
+  }
+
+  MSF_Core<EKFState_T>& Core() {
+    return *manager.msf_core_;
+  }
+
+  /// Initializes the core with the parameters set on the manager.
+  void Init() {
+    shared_ptr<MSF_InitMeasurement<EKFState_T> > init(
+        new MSF_InitMeasurement<EKFState_T>(true));
+    init->time = SecondsToNanoseconds(kTestStartTime);
+    Eigen::Vector3d position, acceleration, angular_velocity;
+    TestMotion(0, &position, &acceleration, &angular_velocity);
+    typedef typename EKFState_T::Scalar_T Scalar_T;
+    init->template SetStateInitValue<p>(position.cast<Scalar_T>());
+    init->template SetStateInitValue<v>(
+        Eigen::Matrix<Scalar_T, 3, 1>(1, 0, 0.1));
+    init->template SetStateInitValue<L>(
+        Eigen::Matrix<Scalar_T, 1, 1>::Constant(1));
+    init->Geta_m() = acceleration.cast<Scalar_T>();
+    init->Getw_m() = angular_velocity.cast<Scalar_T>();
+    Core().Init(init);
+  }
+
+  /// Adds the measurements arriving right after the i-th IMU reading.
+  void AddMeasurements(int i) {
+    if (i <= 40)
+      return;
+    const double t = i * kTestImuPeriod;
+    if (i % 20 == 0) {
+      AddMeasurement(new Position_T(0, Eigen::Vector3d::Zero(), 0),
+                     t - 0.0523);
+    }
+    if (burstsize > 0 && i % 40 == 10) {
+      for (int k = 0; k < burstsize; ++k) {
+        AddMeasurement(new Position_T(0, Eigen::Vector3d::Zero(), 2),
+                       t - 0.0117 - 0.0071 * k);
+      }
+    }
+    if (i % 30 == 0) {
+      AddMeasurement(new RelativePosition_T(0, Eigen::Vector3d::Zero(), 1),
+                     t - 0.031);
+    }
+  }
+
+  /**
+   * \brief Runs the scenario from the first to the last IMU reading, giving
+   * the readings in batches of batchsize to the core if set. The measurements
+   * arriving during a batch are added after it.
+   */
+  void Run(int first, int last, int batchsize = 0) {
+    std::vector<ImuReading> batch;
+    for (int i = first; i <= last; ++i) {
+      const ImuReading reading = TestImuReading(i);
+      if (batchsize <= 0) {
+        imu.ProcessIMU(reading.linear_acceleration, reading.angular_velocity,
+                       reading.time, i);
+        AddMeasurements(i);
+        continue;
+      }
+      batch.push_back(reading);
+      if (static_cast<int>(batch.size()) < batchsize && i < last)
+        continue;
+      imu.ProcessIMUBatch(&batch[0], batch.size());
+      for (int k = i + 1 - static_cast<int>(batch.size()); k <= i; ++k) {
+        AddMeasurements(k);
+      }
+      batch.clear();
+    }
+  }
+
+ private:
+  /// Takes the measurement at t seconds into the scenario.
+  template<typename Measurement_T>
+  void AddMeasurement(Measurement_T* measurement, double t) {
+    Eigen::Vector3d acceleration, angular_velocity;
+    TestMotion(t, &measurement->z, &acceleration, &angular_velocity);
+    measurement->time = SecondsToNanoseconds(kTestStartTime + t);
+    measurementtimes.push_back(measurement->time);
+    Core().AddMeasurement(
+        shared_ptr<MSF_MeasurementBase<EKFState_T> >(measurement));
+  }
+};
+
+}  // namespace test
+}  // namespace msf_core
+#endif  // TESTING_CORE_H_
@@ -19,4 +19,13 @@ namespace msf_core {
 double timehuman(double val) {
   return val - floor(val / 10000.) * 10000.;
 }
+
+double timehuman(int64_t val) {
+  // Wrap before converting, the full stamp does not fit into a double.
+  const int64_t wrap = 10000000000000LL;  // 10000 s.
+  int64_t wrapped = val % wrap;
+  if (wrapped < 0)
+    wrapped += wrap;
+  return NanosecondsToSeconds(wrapped);
+}
 }
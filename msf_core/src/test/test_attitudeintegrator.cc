@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include <msf_core/msf_attitudeIntegrator.h>
+#include <msf_core/testing_entrypoint.h>
+#include <msf_core/testing_predicates.h>
+
+namespace {
+const Eigen::Vector3d kGravity(0, 0, 9.81);
+
+/// Fast coning motion with varying specific force.
+void Motion(double t, Eigen::Vector3d* w, Eigen::Vector3d* a) {
+  *w << 6 * sin(12 * t), 6 * cos(12 * t), 1.5 + 0.5 * sin(2 * t);
+  *a << 2 * sin(3 * t), cos(5 * t), 9.81 + 0.5 * sin(7 * t);
+}
+
+/**
+ * \brief The motion sampled at rate Hz and linear in between, as the
+ * integrators assume. Zero rate returns the motion itself.
+ */
+void SampledMotion(double t, double rate, Eigen::Vector3d* w,
+                   Eigen::Vector3d* a) {
+  if (rate == 0) {
+    Motion(t, w, a);
+    return;
+  }
+  const double k = std::floor(t * rate);
+  const double s = t * rate - k;
+  Eigen::Vector3d w1, a1;
+  Motion(k / rate, w, a);
+  Motion((k + 1) / rate, &w1, &a1);
+  *w += s * (w1 - *w);
+  *a += s * (a1 - *a);
+}
+
+struct Trajectory {
+  Eigen::Quaterniond q;
+  Eigen::Vector3d v;
+  Eigen::Vector3d p;
+};
+
+/**
+ * \brief Integrates the motion sampled at samplerate Hz over duration seconds
+ * in steps of 1 / rate seconds.
+ */
+template<typename Integrator_T>
+Trajectory Integrate(double duration, double rate, double samplerate) {
+  Trajectory x;
+  x.q.setIdentity();
+  x.v.setZero();
+  x.p.setZero();
+  const int steps = static_cast<int>(duration * rate + 0.5);
+  const double dt = 1 / rate;
+  Eigen::Vector3d wold, aold, w, a;
+  SampledMotion(0, samplerate, &wold, &aold);
+  for (int i = 1; i <= steps; ++i) {
+    SampledMotion(i * dt, samplerate, &w, &a);
+    Trajectory next;
+    Integrator_T::Integrate(wold, w, aold, a, kGravity, dt, x.q, x.v, x.p,
+                            &next.q, &next.v, &next.p);
+    x = next;
+    wold = w;
+    aold = a;
+  }
+  return x;
+}
+
+double AttitudeError(const Trajectory& x, const Trajectory& reference) {
+  return x.q.angularDistance(reference.q);
+}
+
+double PositionError(const Trajectory& x, const Trajectory& reference) {
+  return (x.p - reference.p).norm();
+}
+
+/**
+ * \brief The attitude and position drift from the true motion after duration
+ * seconds of integrating its samples at rate Hz.
+ */
+template<typename Integrator_T>
+void ExpectDrift(double rate, double duration, double attitude,
+                 double position) {
+  const Trajectory truth = Integrate<msf_core::RungeKuttaAttitudeIntegrator>(
+      duration, 32 * rate, 0);
+  const Trajectory x = Integrate<Integrator_T>(duration, rate, rate);
+  EXPECT_LT(AttitudeError(x, truth), attitude);
+  EXPECT_LT(PositionError(x, truth), position);
+}
+
+/**
+ * \brief Prints the time per call of the integrator on duration seconds of
+ * the motion sampled at rate Hz, and its drift from the true motion.
+ */
+template<typename Integrator_T>
+void Benchmark(const char* name, double rate, double duration) {
+  const int steps = static_cast<int>(duration * rate + 0.5);
+  const double dt = 1 / rate;
+  std::vector<Eigen::Vector3d> w(steps + 1), a(steps + 1);
+  for (int i = 0; i <= steps; ++i) {
+    Motion(i * dt, &w[i], &a[i]);
+  }
+  Trajectory x;
+  x.q.setIdentity();
+  x.v.setZero();
+  x.p.setZero();
+
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock
+      ::now();
+  for (int i = 1; i <= steps; ++i) {
+    Trajectory next;
+    Integrator_T::Integrate(w[i - 1], w[i], a[i - 1], a[i], kGravity, dt, x.q,
+                            x.v, x.p, &next.q, &next.v, &next.p);
+    x = next;
+  }
+  const double ns = std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count();
+
+  const Trajectory truth = Integrate<msf_core::RungeKuttaAttitudeIntegrator>(
+      duration, 32 * rate, 0);
+  printf("%-12s %5.0f Hz: %6.1f ns per call, drift after %.0f s %.1e rad "
+         "%.1e m\n", name, rate, ns / steps, duration, AttitudeError(x, truth),
+         PositionError(x, truth));
+}
+}  // namespace
+
+TEST(MSF_Core, ClosedFormAttitudeExactForConstantRate) {
+  const Eigen::Vector3d w(1.5, -2, 3);
+  const Eigen::Vector3d a(0.1, 0.2, 9.8);
+  const double dt = 0.01;
+  const Eigen::Quaterniond qold =
+      Eigen::Quaterniond(Eigen::Vector4d(0.1, 0.2, 0.3, 0.9)).normalized();
+  const Eigen::Quaterniond q_expected = qold
+      * Eigen::Quaterniond(Eigen::AngleAxisd(w.norm() * dt, w.normalized()));
+  const Eigen::Vector3d vold(1, 2, 3);
+  const Eigen::Vector3d pold(4, 5, 6);
+
+  Eigen::Quaterniond q;
+  Eigen::Vector3d v, p;
+  msf_core::ClosedFormAttitudeIntegrator::Integrate(w, w, a, a, kGravity, dt,
+                                                    qold, vold, pold, &q, &v,
+                                                    &p);
+  EXPECT_NEAR(q.angularDistance(q_expected), 0, 1e-14);
+
+  // The others agree to their order, the power series is of second order.
+  msf_core::PowerSeriesAttitudeIntegrator::Integrate(w, w, a, a, kGravity, dt,
+                                                     qold, vold, pold, &q, &v,
+                                                     &p);
+  EXPECT_NEAR(q.angularDistance(q_expected), 0, 1e-5);
+  msf_core::RungeKuttaAttitudeIntegrator::Integrate(w, w, a, a, kGravity, dt,
+                                                    qold, vold, pold, &q, &v,
+                                                    &p);
+  EXPECT_NEAR(q.angularDistance(q_expected), 0, 1e-10);
+
+  // Without rotation all integrate a constant acceleration exactly.
+  const Eigen::Vector3d zero = Eigen::Vector3d::Zero();
+  msf_core::RungeKuttaAttitudeIntegrator::Integrate(zero, zero, a, a, kGravity,
+                                                    dt, qold, vold, pold, &q,
+                                                    &v, &p);
+  const Eigen::Vector3d acc = qold * a - kGravity;
+  EXPECT_NEAR((v - vold - acc * dt).norm(), 0, 1e-14);
+  EXPECT_NEAR((p - pold - vold * dt - acc * dt * dt / 2).norm(), 0, 1e-14);
+}
+
+TEST(MSF_Core, AttitudeIntegratorsConverge) {
+  // The sampled motion integrated in small steps.
+  const Trajectory reference = Integrate<
+      msf_core::RungeKuttaAttitudeIntegrator>(2, 6400, 200);
+  const Trajectory series = Integrate<
+      msf_core::PowerSeriesAttitudeIntegrator>(2, 200, 200);
+  const Trajectory closed = Integrate<
+      msf_core::ClosedFormAttitudeIntegrator>(2, 200, 200);
+  const Trajectory rk4 = Integrate<msf_core::RungeKuttaAttitudeIntegrator>(
+      2, 200, 200);
+  EXPECT_LT(AttitudeError(series, reference), 1e-2);
+  EXPECT_LT(AttitudeError(closed, reference), 1e-2);
+  EXPECT_LT(AttitudeError(rk4, reference),
+            0.1 * AttitudeError(series, reference));
+  EXPECT_LT(AttitudeError(rk4, reference),
+            0.1 * AttitudeError(closed, reference));
+  EXPECT_LT(PositionError(rk4, reference),
+            0.1 * PositionError(series, reference));
+}
+
+// The drift from sampling the motion is of second order in the IMU period.
+TEST(MSF_Core, AttitudeIntegratorsDriftWithRate) {
+  ExpectDrift<msf_core::PowerSeriesAttitudeIntegrator>(200, 2, 5e-3, 5e-3);
+  ExpectDrift<msf_core::ClosedFormAttitudeIntegrator>(200, 2, 5e-3, 5e-3);
+  ExpectDrift<msf_core::RungeKuttaAttitudeIntegrator>(200, 2, 5e-3, 5e-3);
+  ExpectDrift<msf_core::PowerSeriesAttitudeIntegrator>(1000, 2, 2e-4, 2e-4);
+  ExpectDrift<msf_core::ClosedFormAttitudeIntegrator>(1000, 2, 2e-4, 2e-4);
+  ExpectDrift<msf_core::RungeKuttaAttitudeIntegrator>(1000, 2, 2e-4, 2e-4);
+}
+
+// Run with --gtest_also_run_disabled_tests to compare the integrators.
+TEST(MSF_Core, DISABLED_AttitudeIntegratorBenchmark) {
+  const double rates[] = { 200, 1000 };
+  for (int i = 0; i < 2; ++i) {
+    Benchmark<msf_core::PowerSeriesAttitudeIntegrator>("power series",
+                                                       rates[i], 10);
+    Benchmark<msf_core::ClosedFormAttitudeIntegrator>("closed form", rates[i],
+                                                      10);
+    Benchmark<msf_core::RungeKuttaAttitudeIntegrator>("runge kutta", rates[i],
+                                                      10);
+  }
+}
+
+MSF_UNITTEST_ENTRYPOINT
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <msf_core/msf_core.h>
+#include <msf_core/testing_core.h>
+#include <msf_core/testing_entrypoint.h>
+#include <msf_core/testing_predicates.h>
+
+namespace {
+typedef msf_core::test::TestState<double> TestState_T;
+typedef msf_core::test::TestState<float> TestStateFloat_T;
+
+typedef msf_core::BlockSparseTransition<TestState_T::StateSequence_T,
+    msf_core::test::TestStateDefinition> Transition_T;
+typedef Transition_T::Dense_T Dense_T;
+
+Transition_T RandomTransition() {
+  Transition_T Fd;
+  Fd.p_v.setRandom();
+  Fd.p_q.setRandom();
+  Fd.p_b_w.setRandom();
+  Fd.p_b_a.setRandom();
+  Fd.v_q.setRandom();
+  Fd.v_b_w.setRandom();
+  Fd.v_b_a.setRandom();
+  Fd.q_q.setRandom();
+  Fd.q_b_w.setRandom();
+  return Fd;
+}
+}  // namespace
+
+// The products with the block structured Fd have to match the dense products.
+TEST(MSF_Core, BlockSparseTransitionMatchesDense) {
+  const double tol = 1e-12;
+  const Transition_T Fd = RandomTransition();
+  const Dense_T Fd_dense = Fd.ToDense();
+
+  Dense_T P = Dense_T::Random();
+  P = P * P.transpose();
+  // The process noise of the core and the auxiliary states is uncorrelated.
+  enum {
+    nCore = Transition_T::nCoreErrorStatesAtCompileTime,
+    nAux = Transition_T::nAuxErrorStatesAtCompileTime
+  };
+  Dense_T Qd = Dense_T::Zero();
+  Qd.block<nCore, nCore>(0, 0).setRandom();
+  Qd.block<nAux, nAux>(nCore, nCore).setRandom();
+
+  Dense_T P_new;
+  Fd.PropagateCovariance(P, Qd, P_new);
+  EXPECT_NEAR_EIGEN(P_new, Fd_dense * P * Fd_dense.transpose() + Qd, tol);
+
+  Dense_T F = Dense_T::Random();
+  const Dense_T F_dense = F * Fd_dense;
+  Fd.MultiplyFromRight(F);
+  EXPECT_NEAR_EIGEN(F, F_dense, tol);
+
+  // Chaining transitions as for stochastic cloning.
+  const Transition_T Fd2 = RandomTransition();
+  F.setIdentity();
+  Fd.MultiplyFromRight(F);
+  Fd2.MultiplyFromRight(F);
+  EXPECT_NEAR_EIGEN(F, Fd_dense * Fd2.ToDense(), tol);
+}
+
+// Propagating over the composed transition has to match propagating step by
+// step.
+TEST(MSF_Core, ComposedTransitionMatchesSteps) {
+  const double tol = 1e-9;
+  enum {
+    nCore = Transition_T::nCoreErrorStatesAtCompileTime,
+    nAux = Transition_T::nAuxErrorStatesAtCompileTime
+  };
+  Dense_T P = Dense_T::Random();
+  P = P * P.transpose();
+
+  msf_core::ComposedTransition<TestState_T::StateSequence_T,
+      msf_core::test::TestStateDefinition> composed;
+  Dense_T P_steps = P;
+  for (int i = 0; i < 5; ++i) {
+    const Transition_T Fd = RandomTransition();
+    Dense_T Qd = Dense_T::Zero();
+    Qd.block<nCore, nCore>(0, 0).setRandom();
+    Qd.block<nAux, nAux>(nCore, nCore).setRandom();
+    Dense_T P_next;
+    Fd.PropagateCovariance(P_steps, Qd, P_next);
+    P_steps = P_next;
+    composed.Append(Fd, Qd);
+  }
+  EXPECT_EQ(composed.Steps(), 5u);
+
+  Dense_T P_composed;
+  composed.PropagateCovariance(P, P_composed);
+  EXPECT_NEAR_EIGEN(P_composed, P_steps, tol * P_steps.norm());
+
+  composed.Reset();
+  composed.PropagateCovariance(P, P_composed);
+  EXPECT_NEAR_EIGEN(P_composed, P, tol);
+}
+
+TEST(MSF_Core, BlockSparseTransitionDefaultIsIdentity) {
+  const Transition_T Fd;
+  EXPECT_TRUE(Fd.ToDense().isIdentity());
+}
+
+// A state definition in float gives float states and transitions, which have
+// to propagate like the double ones up to float precision.
+TEST(MSF_Core, BlockSparseTransitionFloat) {
+  typedef TestStateFloat_T::type StateFloat_T;
+  typedef StateFloat_T::F_type TransitionFloat_T;
+  static_assert(std::is_same<StateFloat_T::Scalar_T, float>::value &&
+                std::is_same<TransitionFloat_T::Scalar_T, float>::value,
+                "The scalar has to follow the state definition");
+  static_assert(sizeof(StateFloat_T::P_type) * 2 == sizeof(Dense_T),
+                "The covariance has to be stored in float");
+
+  const Transition_T Fd = RandomTransition();
+  TransitionFloat_T Fd_float;
+  Fd_float.p_v = Fd.p_v.cast<float>();
+  Fd_float.p_q = Fd.p_q.cast<float>();
+  Fd_float.p_b_w = Fd.p_b_w.cast<float>();
+  Fd_float.p_b_a = Fd.p_b_a.cast<float>();
+  Fd_float.v_q = Fd.v_q.cast<float>();
+  Fd_float.v_b_w = Fd.v_b_w.cast<float>();
+  Fd_float.v_b_a = Fd.v_b_a.cast<float>();
+  Fd_float.q_q = Fd.q_q.cast<float>();
+  Fd_float.q_b_w = Fd.q_b_w.cast<float>();
+
+  Dense_T P = Dense_T::Random();
+  P = P * P.transpose();
+  const Dense_T Qd = Dense_T::Identity();
+  Dense_T P_new;
+  Fd.PropagateCovariance(P, Qd, P_new);
+
+  StateFloat_T::P_type P_new_float;
+  Fd_float.PropagateCovariance(P.cast<float>(), Qd.cast<float>(),
+                               P_new_float);
+  EXPECT_NEAR_EIGEN(P_new_float.cast<double>(), P_new, 1e-5 * P_new.norm());
+
+  StateFloat_T state;
+  Eigen::Matrix<float, StateFloat_T::nErrorStatesAtCompileTime, 1> correction;
+  correction.setZero();
+  correction.segment<3>(0).setConstant(1);
+  state.Correct(correction);
+  EXPECT_NEAR_EIGEN(
+      const_cast<const StateFloat_T&>(state).Get<msf_core::test::p>(),
+                    Eigen::Vector3f::Ones(), 0);
+}
+
+MSF_UNITTEST_ENTRYPOINT
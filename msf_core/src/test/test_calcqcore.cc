@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <msf_core/msf_core.h>
+#include <msf_core/testing_entrypoint.h>
+#include <msf_core/testing_predicates.h>
+
+namespace {
+// Only the core states. CalcQCore fills the 15 x 15 core block of Qd, so the
+// test state with its auxiliary states would only pad the matrices.
+enum StateDefinition {
+  p,
+  v,
+  q,
+  b_w,
+  b_a
+};
+
+typedef boost::fusion::vector<
+    msf_core::StateVar_T<Eigen::Matrix<double, 3, 1>, p,
+        msf_core::CoreStateWithPropagation>,
+    msf_core::StateVar_T<Eigen::Matrix<double, 3, 1>, v,
+        msf_core::CoreStateWithPropagation>,
+    msf_core::StateVar_T<Eigen::Quaterniond, q,
+        msf_core::CoreStateWithPropagation>,
+    msf_core::StateVar_T<Eigen::Matrix<double, 3, 1>, b_w,
+        msf_core::CoreStateWithoutPropagation>,
+    msf_core::StateVar_T<Eigen::Matrix<double, 3, 1>, b_a,
+        msf_core::CoreStateWithoutPropagation>
+> fullState_T;
+
+typedef Eigen::Matrix<double, 15, 15> Q_T;
+typedef Eigen::Matrix<double, 3, 1> Vector3;
+}  // namespace
+
+// The noise terms cached over several calls have to give the same Qd as the
+// noise densities passed on every call.
+TEST(MSF_Core, CalcQCoreCachedNoiseMatches) {
+  const Vector3 n_a(0.08, 0.09, 0.1);
+  const Vector3 n_ba(0.001, 0.002, 0.003);
+  const Vector3 n_w(0.01, 0.02, 0.03);
+  const Vector3 n_bw(0.0001, 0.0002, 0.0003);
+
+  CoreProcessNoise noise;
+  EXPECT_TRUE(noise.Set(n_a, n_ba, n_w, n_bw));
+  EXPECT_FALSE(noise.Set(n_a, n_ba, n_w, n_bw));
+
+  for (int i = 0; i < 10; ++i) {
+    const double dt = 0.005 * (i + 1);
+    const Eigen::Quaterniond q_s = Eigen::Quaterniond(
+        Eigen::Vector4d::Random()).normalized();
+    const Vector3 ew = Vector3::Random();
+    const Vector3 ea = Vector3::Random() * 10;
+    Q_T Qd = Q_T::Zero();
+    CalcQCore<fullState_T, StateDefinition>(dt, q_s, ew, ea, n_a, n_ba, n_w,
+                                            n_bw, Qd);
+    Q_T Qd_cached = Q_T::Zero();
+    CalcQCore<fullState_T, StateDefinition>(dt, q_s, ew, ea, noise, Qd_cached);
+    EXPECT_TRUE(Qd == Qd_cached);
+    EXPECT_NEAR(Qd(14, 14), dt * n_ba(2) * n_ba(2), 1e-15);
+  }
+}
+
+// Leaving out the O(dt^3) terms changes Qd only within tolerance for the dt
+// the fast path is taken for.
+TEST(MSF_Core, CalcQCoreSecondOrderMatchesThirdOrder) {
+  CoreProcessNoise noise;
+  noise.Set(Vector3(0.08, 0.09, 0.1), Vector3(0.001, 0.002, 0.003),
+            Vector3(0.01, 0.02, 0.03), Vector3(0.0001, 0.0002, 0.0003));
+
+  const double dts[] = { 0.0005, 0.001, kCalcQCoreSecondOrderMaxDt };
+  for (int i = 0; i < 30; ++i) {
+    const double dt = dts[i % 3];
+    const Eigen::Quaterniond q_s = Eigen::Quaterniond(
+        Eigen::Vector4d::Random()).normalized();
+    const Vector3 ew = Vector3::Random();
+    const Vector3 ea = Vector3::Random() * 10;
+    // Storage taken from the pool holds the Qd of an earlier step.
+    const Q_T Qd_previous = Q_T::Random();
+    Q_T Qd_third = Qd_previous;
+    CalcQCoreThirdOrder<fullState_T, StateDefinition>(dt, q_s, ew, ea, noise,
+                                                      Qd_third);
+    Q_T Qd_second = Qd_previous;
+    CalcQCoreSecondOrder<fullState_T, StateDefinition>(dt, q_s, ew, ea, noise,
+                                                       Qd_second);
+    EXPECT_LT((Qd_second - Qd_third).norm(), 2e-5 * Qd_third.norm());
+
+    Q_T Qd = Qd_previous;
+    CalcQCore<fullState_T, StateDefinition>(dt, q_s, ew, ea, noise, Qd);
+    EXPECT_TRUE(Qd == Qd_second);
+    // Above the threshold the full expression is taken.
+    const double dt_large = dt + kCalcQCoreSecondOrderMaxDt;
+    Qd = Qd_previous;
+    CalcQCore<fullState_T, StateDefinition>(dt_large, q_s, ew, ea, noise, Qd);
+    Qd_third = Qd_previous;
+    CalcQCoreThirdOrder<fullState_T, StateDefinition>(dt_large, q_s, ew, ea,
+                                                      noise, Qd_third);
+    EXPECT_TRUE(Qd == Qd_third);
+  }
+}
+
+// A batch gives the same Qd as its steps one by one.
+TEST(MSF_Core, CalcQCoreBatchMatchesSingleSteps) {
+  CoreProcessNoise noise;
+  noise.Set(Vector3(0.08, 0.09, 0.1), Vector3(0.001, 0.002, 0.003),
+            Vector3(0.01, 0.02, 0.03), Vector3(0.0001, 0.0002, 0.0003));
+
+  enum {
+    kSteps = 8
+  };
+  CoreProcessInterval intervals[kSteps];
+  std::vector<Q_T, Eigen::aligned_allocator<Q_T> > Qd(kSteps, Q_T::Zero());
+  Q_T* Qd_batch[kSteps];
+  for (int i = 0; i < kSteps; ++i) {
+    intervals[i].dt = 0.001 * (i + 1);
+    intervals[i].q = Eigen::Quaterniond(Eigen::Vector4d::Random())
+        .normalized();
+    intervals[i].ew = Vector3::Random();
+    intervals[i].ea = Vector3::Random() * 10;
+    Qd_batch[i] = &Qd[i];
+  }
+  CalcQCoreBatch<fullState_T, StateDefinition>(intervals, kSteps, noise,
+                                               Qd_batch);
+
+  for (int i = 0; i < kSteps; ++i) {
+    Q_T Qd_single = Q_T::Zero();
+    CalcQCore<fullState_T, StateDefinition>(intervals[i].dt, intervals[i].q,
+                                            intervals[i].ew, intervals[i].ea,
+                                            noise, Qd_single);
+    EXPECT_TRUE(Qd[i] == Qd_single);
+  }
+}
+
+TEST(MSF_Core, CoreParameterBuffer) {
+  msf_core::CoreParameterBuffer buffer;
+  msf_core::CoreParameters read;
+  uint64_t version = 0;
+  EXPECT_FALSE(buffer.ReadIfNewer(&version, &read));
+
+  for (int i = 1; i <= 3; ++i) {
+    msf_core::CoreParameters published;
+    published.fixed_bias = i % 2;
+    published.SetNoise(0.1 * i, 0.2 * i, 0.3 * i, 0.4 * i);
+    buffer.Publish(published);
+
+    EXPECT_TRUE(buffer.ReadIfNewer(&version, &read));
+    EXPECT_EQ(version, static_cast<uint64_t>(i));
+    EXPECT_FALSE(buffer.ReadIfNewer(&version, &read));
+    EXPECT_EQ(read.fixed_bias, published.fixed_bias);
+    EXPECT_TRUE(read.noise.n_a == published.noise.n_a);
+    EXPECT_TRUE(read.noise.n_bw == published.noise.n_bw);
+    EXPECT_NEAR(read.noise.n_w2(1), 0.09 * i * i, 1e-15);
+  }
+}
+
+MSF_UNITTEST_ENTRYPOINT
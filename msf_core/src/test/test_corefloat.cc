@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <msf_core/msf_core.h>
+#include <msf_core/testing_core.h>
+#include <msf_core/testing_entrypoint.h>
+#include <msf_core/testing_predicates.h>
+
+namespace {
+typedef msf_core::test::TestState<double>::type DoubleState_T;
+typedef msf_core::test::TestState<float>::type FloatState_T;
+
+enum {
+  kReadings = 600
+};
+}  // namespace
+
+// The core and the measurement updates compile and run in float, and stay
+// close to the filter in double.
+TEST(MSF_Core, FloatStateMatchesDouble) {
+  msf_core::test::TestFilter<DoubleState_T> reference;
+  msf_core::test::TestFilter<FloatState_T> filter;
+  reference.Init();
+  reference.Run(1, kReadings);
+  filter.Init();
+  filter.Run(1, kReadings);
+
+  const std::vector<msf_core::test::TestPublication>& expected = reference
+      .manager.GetPublications();
+  const std::vector<msf_core::test::TestPublication>& published = filter
+      .manager.GetPublications();
+  msf_core::test::ExpectSamePublications(expected, published, 1e-4, 1e-3);
+
+  const int64_t last = msf_core::test::TestImuReading(kReadings).time;
+  shared_ptr<DoubleState_T> reference_state = reference.Core().GetClosestState(
+      last);
+  shared_ptr<FloatState_T> state = filter.Core().GetClosestState(last);
+  ASSERT_EQ(state->time, last);
+  const DoubleState_T& const_reference_state = *reference_state;
+  const FloatState_T& const_state = *state;
+  const Eigen::MatrixXd P = const_state.GetP().cast<double>();
+  EXPECT_TRUE(P.allFinite());
+  EXPECT_NEAR_EIGEN(P, const_reference_state.GetP(), 1e-3);
+}
+
+MSF_UNITTEST_ENTRYPOINT
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <msf_core/msf_core.h>
+#include <msf_core/testing_core.h>
+#include <msf_core/testing_entrypoint.h>
+#include <msf_core/testing_predicates.h>
+
+namespace ring {
+// The test state definition again, to give a state type of its own.
+enum StateDefinition {
+  p,
+  v,
+  q,
+  b_w,
+  b_a,
+  L,
+  q_wv
+};
+}  // namespace ring
+
+namespace {
+typedef msf_core::test::TestState<double>::type MapState_T;
+typedef msf_core::test::TestState<double, ring::StateDefinition>::type
+    RingState_T;
+}  // namespace
+
+namespace msf_core {
+template<>
+struct ContainerBackendForState<RingState_T> {
+  typedef SortedRingContainerBackend type;
+};
+}  // namespace msf_core
+
+namespace {
+enum {
+  kReadings = 600
+};
+
+/**
+ * \brief Runs the scenario, whose delayed measurements insert states out of
+ * order, with the given IMU preintegration stride and covariance keyframe
+ * stride.
+ */
+template<typename EKFState_T>
+void RunScenario(msf_core::test::TestFilter<EKFState_T>& filter,
+                 int preintegrationstride, int keyframestride) {
+  filter.manager.imu_preintegration_stride_ = preintegrationstride;
+  filter.manager.covariance_keyframe_stride_ = keyframestride;
+  filter.burstsize = 3;
+  filter.Init();
+  filter.Run(1, kReadings);
+}
+
+/// The ring backend has to give the same filter as the map backend.
+void ExpectSameFilter(int preintegrationstride, int keyframestride) {
+  msf_core::test::TestFilter<MapState_T> map;
+  msf_core::test::TestFilter<RingState_T> ring;
+  RunScenario(map, preintegrationstride, keyframestride);
+  RunScenario(ring, preintegrationstride, keyframestride);
+
+  const std::vector<msf_core::test::TestPublication>& map_published = map
+      .manager.GetPublications();
+  const std::vector<msf_core::test::TestPublication>& ring_published = ring
+      .manager.GetPublications();
+  ASSERT_EQ(map_published.size(), ring_published.size());
+  size_t updates = 0;
+  for (size_t i = 0; i < map_published.size(); ++i) {
+    ASSERT_EQ(map_published[i].time, ring_published[i].time);
+    ASSERT_EQ(map_published[i].afterupdate, ring_published[i].afterupdate);
+    EXPECT_NEAR_EIGEN(map_published[i].p, ring_published[i].p, 1e-12);
+    updates += map_published[i].afterupdate;
+  }
+  EXPECT_GT(updates, 0u);
+
+  // The states at the IMU readings, also those between covariance keyframes.
+  for (int i = kReadings - 100; i <= kReadings; ++i) {
+    const int64_t time = msf_core::test::TestImuReading(i).time;
+    shared_ptr<MapState_T> map_state = map.Core().GetStateAtTime(time);
+    shared_ptr<RingState_T> ring_state = ring.Core().GetStateAtTime(time);
+    ASSERT_EQ(map_state->time, ring_state->time);
+    if (map_state->time == -1)
+      continue;
+    const MapState_T& const_map_state = *map_state;
+    const RingState_T& const_ring_state = *ring_state;
+    EXPECT_NEAR_EIGEN(map_state->ToEigenVector(), ring_state->ToEigenVector(),
+                      1e-12);
+    ASSERT_EQ(const_map_state.HasCovariance(),
+              const_ring_state.HasCovariance());
+    if (const_map_state.HasCovariance()) {
+      EXPECT_NEAR_EIGEN(const_map_state.GetP(), const_ring_state.GetP(),
+                        1e-12);
+    }
+  }
+}
+}  // namespace
+
+TEST(MSF_Core, RingBackendMatchesMapBackend) {
+  ExpectSameFilter(1, 0);
+}
+
+// Preintegration moves the latest state in time while the core iterates over
+// the buffer.
+TEST(MSF_Core, RingBackendMatchesMapBackendPreintegrated) {
+  ExpectSameFilter(4, 0);
+}
+
+// Covariance keyframes make the core search back for the last keyframe.
+TEST(MSF_Core, RingBackendMatchesMapBackendWithKeyframes) {
+  ExpectSameFilter(1, 4);
+}
+
+MSF_UNITTEST_ENTRYPOINT
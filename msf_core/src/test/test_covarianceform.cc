@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <msf_core/msf_core.h>
+#include <msf_core/testing_core.h>
+#include <msf_core/testing_entrypoint.h>
+#include <msf_core/testing_predicates.h>
+
+namespace {
+enum StateDefinition {
+  p,
+  v,
+  q,
+  b_w,
+  b_a,
+  L,
+  q_wv
+};
+
+// The test state under an enum of its own, so that the core keeps the
+// covariance of this state type, and only of it, in square root form.
+typedef msf_core::test::TestState<double, StateDefinition>::type EKFState_T;
+}  // namespace
+
+// Has to be specialized before the state type is instantiated.
+namespace msf_core {
+template<>
+struct CovarianceFormForState<EKFState_T> {
+  typedef SquareRootCovarianceForm type;
+};
+}  // namespace msf_core
+
+namespace {
+typedef EKFState_T::P_type P_type;
+enum {
+  N = EKFState_T::nErrorStatesAtCompileTime
+};
+
+P_type RandomCovariance() {
+  P_type A = P_type::Random();
+  return A * A.transpose() + P_type::Identity();
+}
+
+EKFState_T::F_type RandomTransition() {
+  EKFState_T::F_type Fd;
+  Fd.p_v.setRandom();
+  Fd.p_q.setRandom();
+  Fd.p_b_w.setRandom();
+  Fd.p_b_a.setRandom();
+  Fd.v_q.setRandom();
+  Fd.v_b_w.setRandom();
+  Fd.v_b_a.setRandom();
+  Fd.q_q.setRandom();
+  Fd.q_b_w.setRandom();
+  return Fd;
+}
+}  // namespace
+
+// Propagating the square root of P has to give the same P as propagating P.
+TEST(MSF_Core, SquareRootPropagationMatchesFull) {
+  const double tol = 1e-9;
+  EKFState_T state_old, state_full, state_sqrt;
+  state_old.AllocateCovariance();
+  state_full.AllocateCovariance();
+  state_sqrt.AllocateCovariance();
+  state_old.GetP() = RandomCovariance();
+  msf_core::SquareRootCovarianceForm::FromP(state_old);
+  const P_type& S = const_cast<const EKFState_T&>(state_old).GetSqrtP();
+  EXPECT_NEAR_EIGEN(S * S.transpose(), state_old.GetP(), tol);
+  EXPECT_TRUE(S.isLowerTriangular());
+
+  const EKFState_T::F_type Fd = RandomTransition();
+  P_type Qd = P_type::Zero();
+  Qd.block<15, 15>(0, 0) = RandomCovariance().block<15, 15>(0, 0);
+  Qd.block<N - 15, N - 15>(15, 15).diagonal().setConstant(0.1);
+
+  msf_core::FullCovarianceForm::Propagate(state_old, Fd, Qd, state_full);
+  msf_core::SquareRootCovarianceForm::Propagate(state_old, Fd, Qd,
+                                                state_sqrt);
+  const P_type& P_sqrt = state_sqrt.GetP();
+  EXPECT_NEAR_EIGEN(P_sqrt, state_full.GetP(), tol * P_sqrt.norm());
+  EXPECT_TRUE(P_sqrt == P_sqrt.transpose());
+}
+
+// The update of the square root has to give the same gain and P as the Joseph
+// form update, for fixed and dynamic size measurements.
+TEST(MSF_Core, SquareRootUpdateMatchesFull) {
+  const double tol = 1e-9;
+  EKFState_T state_full, state_sqrt;
+  state_full.AllocateCovariance();
+  state_sqrt.AllocateCovariance();
+  state_full.GetP() = RandomCovariance();
+  state_sqrt.GetP() = state_full.GetP();
+  msf_core::SquareRootCovarianceForm::FromP(state_sqrt);
+
+  const Eigen::Matrix<double, 3, N> H = Eigen::Matrix<double, 3, N>::Random();
+  Eigen::Matrix<double, 3, 3> R = Eigen::Matrix<double, 3, 3>::Random();
+  R = R * R.transpose() + Eigen::Matrix<double, 3, 3>::Identity();
+
+  Eigen::Matrix<double, N, 3> K_full, K_sqrt;
+  msf_core::FullCovarianceForm::Update(state_full, H, R, K_full);
+  msf_core::SquareRootCovarianceForm::Update(state_sqrt, H, R, K_sqrt);
+  EXPECT_NEAR_EIGEN(K_sqrt, K_full, tol);
+  EXPECT_NEAR_EIGEN(state_sqrt.GetP(), state_full.GetP(), tol);
+
+  const Eigen::MatrixXd H_dyn = H;
+  const Eigen::MatrixXd R_dyn = R;
+  Eigen::MatrixXd K_full_dyn(static_cast<int>(N), 3);
+  Eigen::MatrixXd K_sqrt_dyn(static_cast<int>(N), 3);
+  msf_core::FullCovarianceForm::Update(state_full, H_dyn, R_dyn, K_full_dyn);
+  msf_core::SquareRootCovarianceForm::Update(state_sqrt, H_dyn, R_dyn,
+                                             K_sqrt_dyn);
+  EXPECT_NEAR_EIGEN(K_sqrt_dyn, K_full_dyn, tol);
+  EXPECT_NEAR_EIGEN(state_sqrt.GetP(), state_full.GetP(), tol);
+}
+
+// The sparse update over the declared column blocks of H has to give the same
+// gain and P as the dense update, in both covariance forms.
+TEST(MSF_Core, SparseUpdateMatchesDense) {
+  const double tol = 1e-9;
+  typedef msf_core::BlockSparseJacobian<EKFState_T::StateSequence_T, q_wv, p, L> HBlocks_T;
+  EXPECT_EQ(HBlocks_T::nColumns, 7);
+
+  Eigen::Matrix<double, 3, N> H = Eigen::Matrix<double, 3, N>::Zero();
+  H.block<3, 3>(0, 0).setRandom();  // p
+  H.block<3, 1>(0, 15).setRandom();  // L
+  H.block<3, 3>(0, 16).setRandom();  // q_wv
+  Eigen::Matrix<double, 3, 3> R = Eigen::Matrix<double, 3, 3>::Random();
+  R = R * R.transpose() + Eigen::Matrix<double, 3, 3>::Identity();
+
+  EKFState_T state_dense, state_sparse, state_joseph;
+  state_dense.AllocateCovariance();
+  state_sparse.AllocateCovariance();
+  state_joseph.AllocateCovariance();
+  state_dense.GetP() = RandomCovariance();
+  state_sparse.GetP() = state_dense.GetP();
+  state_joseph.GetP() = state_dense.GetP();
+  Eigen::Matrix<double, N, 3> K_dense, K_sparse, K_joseph;
+  msf_core::FullCovarianceForm::Update(state_dense, H, R, K_dense);
+  msf_core::FullCovarianceForm::UpdateSparse<HBlocks_T>(
+      state_sparse, H, R, K_sparse, msf_core::kStandardUpdate);
+  msf_core::FullCovarianceForm::UpdateSparse<HBlocks_T>(
+      state_joseph, H, R, K_joseph, msf_core::kJosephUpdate);
+  EXPECT_NEAR_EIGEN(K_sparse, K_dense, tol);
+  EXPECT_NEAR_EIGEN(K_joseph, K_dense, tol);
+  EXPECT_NEAR_EIGEN(state_sparse.GetP(), state_dense.GetP(), tol);
+  EXPECT_NEAR_EIGEN(state_joseph.GetP(), state_dense.GetP(), tol);
+
+  EKFState_T state_sqrt;
+  state_sqrt.AllocateCovariance();
+  state_sqrt.GetP() = state_sparse.GetP();
+  msf_core::SquareRootCovarianceForm::FromP(state_sqrt);
+  msf_core::FullCovarianceForm::Update(state_sparse, H, R, K_dense);
+  msf_core::SquareRootCovarianceForm::UpdateSparse<HBlocks_T>(
+      state_sqrt, H, R, K_sparse, msf_core::kStandardUpdate);
+  EXPECT_NEAR_EIGEN(K_sparse, K_dense, tol);
+  EXPECT_NEAR_EIGEN(state_sqrt.GetP(), state_sparse.GetP(), tol);
+}
+
+// Applying the rows of a measurement with diagonal R one by one has to give the
+// same correction and P as the batch update, dense and over column blocks.
+TEST(MSF_Core, SequentialUpdateMatchesBatch) {
+  const double tol = 1e-9;
+  typedef msf_core::BlockSparseJacobian<EKFState_T::StateSequence_T, q_wv, p, L> HBlocks_T;
+
+  Eigen::Matrix<double, 7, N> H = Eigen::Matrix<double, 7, N>::Zero();
+  H.block<7, 3>(0, 0).setRandom();  // p
+  H.block<7, 1>(0, 15).setRandom();  // L
+  H.block<7, 3>(0, 16).setRandom();  // q_wv
+  Eigen::Matrix<double, 7, 7> R = Eigen::Matrix<double, 7, 7>::Zero();
+  R.diagonal() << 0.1, 0.1, 0.1, 0.01, 0.01, 0.01, 1e-6;
+  EXPECT_TRUE(msf_core::IsDiagonalCovariance(R));
+  const Eigen::Matrix<double, 7, 1> r = Eigen::Matrix<double, 7, 1>::Random();
+
+  EKFState_T state_batch, state_dense, state_sparse;
+  state_batch.AllocateCovariance();
+  state_dense.AllocateCovariance();
+  state_sparse.AllocateCovariance();
+  state_batch.GetP() = RandomCovariance();
+  state_dense.GetP() = state_batch.GetP();
+  state_sparse.GetP() = state_batch.GetP();
+  Eigen::Matrix<double, N, 7> K;
+  msf_core::FullCovarianceForm::Update(state_batch, H, R, K);
+  const Eigen::Matrix<double, N, 1> correction_batch = K * r;
+
+  Eigen::Matrix<double, N, 1> correction_dense, correction_sparse;
+  msf_core::FullCovarianceForm::UpdateSequential<msf_core::DenseJacobian<N> >(
+      state_dense, H, R, r, correction_dense);
+  msf_core::FullCovarianceForm::UpdateSequential<HBlocks_T>(
+      state_sparse, H, R, r, correction_sparse);
+  EXPECT_NEAR_EIGEN(correction_dense, correction_batch, tol);
+  EXPECT_NEAR_EIGEN(correction_sparse, correction_batch, tol);
+  EXPECT_NEAR_EIGEN(state_dense.GetP(), state_batch.GetP(), tol);
+  EXPECT_NEAR_EIGEN(state_sparse.GetP(), state_batch.GetP(), tol);
+
+  // The scalar updates in Joseph form give the same covariance.
+  state_dense.GetP() = state_batch.GetP() = RandomCovariance();
+  state_sparse.GetP() = state_batch.GetP();
+  msf_core::FullCovarianceForm::Update(state_batch, H, R, K);
+  msf_core::FullCovarianceForm::UpdateSequential<msf_core::DenseJacobian<N> >(
+      state_dense, H, R, r, correction_dense, msf_core::kJosephUpdate);
+  msf_core::FullCovarianceForm::UpdateSequential<HBlocks_T>(
+      state_sparse, H, R, r, correction_sparse, msf_core::kJosephUpdate);
+  EXPECT_NEAR_EIGEN(correction_dense, K * r, tol);
+  EXPECT_NEAR_EIGEN(correction_sparse, K * r, tol);
+  EXPECT_NEAR_EIGEN(state_dense.GetP(), state_batch.GetP(), tol);
+  EXPECT_NEAR_EIGEN(state_sparse.GetP(), state_batch.GetP(), tol);
+
+  R(0, 1) = R(1, 0) = 0.01;
+  EXPECT_FALSE(msf_core::IsDiagonalCovariance(R));
+}
+
+MSF_UNITTEST_ENTRYPOINT
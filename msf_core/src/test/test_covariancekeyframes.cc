@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <msf_core/msf_core.h>
+#include <msf_core/testing_core.h>
+#include <msf_core/testing_entrypoint.h>
+#include <msf_core/testing_predicates.h>
+
+namespace {
+typedef msf_core::test::TestState<double>::type EKFState_T;
+typedef msf_core::test::TestFilter<EKFState_T> TestFilter_T;
+
+enum {
+  kReadings = 600
+};
+
+void RunScenario(TestFilter_T& filter, int keyframestride, int decimation) {
+  filter.manager.covariance_keyframe_stride_ = keyframestride;
+  filter.manager.covariance_propagation_decimation_ = decimation;
+  filter.Init();
+  filter.Run(1, kReadings);
+}
+
+/**
+ * \brief The covariance at the measurement states still in the buffer has to
+ * be the same as with the covariance of every state kept, whether it is kept
+ * there or reconstructed from a keyframe.
+ */
+void ExpectSameCovariance(int keyframestride, int decimation,
+                          double precision) {
+  TestFilter_T reference;
+  TestFilter_T filter;
+  RunScenario(reference, 0, 1);
+  RunScenario(filter, keyframestride, decimation);
+  ASSERT_EQ(reference.measurementtimes, filter.measurementtimes);
+
+  size_t compared = 0;
+  for (size_t i = 0; i < filter.measurementtimes.size(); ++i) {
+    const int64_t time = filter.measurementtimes[i];
+    shared_ptr<EKFState_T> reference_state = reference.Core().GetStateAtTime(
+        time);
+    shared_ptr<EKFState_T> state = filter.Core().GetStateAtTime(time);
+    // The buffers are cleaned up from the keyframes, so the oldest states
+    // may differ.
+    if (state->time == -1 || reference_state->time == -1)
+      continue;
+    // Reconstructs the covariance if it is not kept.
+    state = filter.Core().GetClosestState(time);
+    ASSERT_EQ(state->time, time);
+    EXPECT_NEAR_EIGEN(state->ToEigenVector(), reference_state->ToEigenVector(),
+                      1e-12);
+    const EKFState_T& const_reference_state = *reference_state;
+    const EKFState_T& const_state = *state;
+    EXPECT_NEAR_EIGEN(const_state.GetP(), const_reference_state.GetP(),
+                      precision);
+    ++compared;
+  }
+  EXPECT_GT(compared, 2u);
+
+  const int64_t last = msf_core::test::TestImuReading(kReadings).time;
+  shared_ptr<EKFState_T> reference_state = reference.Core().GetClosestState(
+      last);
+  shared_ptr<EKFState_T> state = filter.Core().GetClosestState(last);
+  const EKFState_T& const_reference_state = *reference_state;
+  const EKFState_T& const_state = *state;
+  EXPECT_NEAR_EIGEN(const_state.GetP(), const_reference_state.GetP(),
+                    precision);
+}
+}  // namespace
+
+// ReconstructCovariance replays the propagation from the keyframe.
+TEST(MSF_Core, KeyframeCovarianceMatchesFull) {
+  ExpectSameCovariance(4, 1, 1e-9);
+}
+
+// ComposeCovariancePropagation propagates over several states at once.
+TEST(MSF_Core, ComposedCovarianceMatchesFull) {
+  ExpectSameCovariance(0, 3, 1e-6);
+  ExpectSameCovariance(4, 3, 1e-6);
+}
+
+MSF_UNITTEST_ENTRYPOINT
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <msf_core/msf_core.h>
+#include <msf_core/testing_core.h>
+#include <msf_core/testing_entrypoint.h>
+
+namespace {
+typedef msf_core::test::TestState<double>::type EKFState_T;
+typedef msf_core::test::TestFilter<EKFState_T> TestFilter_T;
+
+enum {
+  kReadings = 600
+};
+
+void RunScenario(TestFilter_T& filter, bool thread) {
+  filter.manager.covariance_propagation_thread_ = thread;
+  filter.burstsize = 3;
+  filter.Init();
+  filter.Run(1, kReadings);
+}
+}  // namespace
+
+// The covariance thread does the same steps as the IMU callback, just later,
+// so the filter has to be the same.
+TEST(MSF_Core, CovarianceThreadMatchesSynchronous) {
+  TestFilter_T reference;
+  TestFilter_T filter;
+  RunScenario(reference, false);
+  RunScenario(filter, true);
+
+  const std::vector<msf_core::test::TestPublication>& expected = reference
+      .manager.GetPublications();
+  const std::vector<msf_core::test::TestPublication>& published = filter
+      .manager.GetPublications();
+  msf_core::test::ExpectSamePublications(expected, published, 1e-12);
+}
+
+MSF_UNITTEST_ENTRYPOINT
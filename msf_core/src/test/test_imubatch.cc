@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <msf_core/msf_core.h>
+#include <msf_core/testing_core.h>
+#include <msf_core/testing_entrypoint.h>
+#include <msf_core/testing_predicates.h>
+
+namespace {
+typedef msf_core::test::TestState<double>::type EKFState_T;
+typedef msf_core::test::TestFilter<EKFState_T> TestFilter_T;
+
+enum {
+  kReadings = 600,
+  kBatchSize = 8
+};
+
+/**
+ * \brief Gives the readings one by one to the core, but adds the measurements
+ * arriving during a batch after it, like TestFilter::Run does for batches.
+ */
+void RunSingleReadings(TestFilter_T& filter) {
+  filter.burstsize = 3;
+  filter.Init();
+  for (int i = 1; i <= kReadings; ++i) {
+    const msf_core::ImuReading reading = msf_core::test::TestImuReading(i);
+    filter.imu.ProcessIMU(reading.linear_acceleration,
+                          reading.angular_velocity, reading.time, i);
+    if (i % kBatchSize != 0 && i < kReadings)
+      continue;
+    for (int k = i - (i - 1) % kBatchSize; k <= i; ++k) {
+      filter.AddMeasurements(k);
+    }
+  }
+}
+
+void RunBatches(TestFilter_T& filter, int decimation) {
+  filter.manager.imu_batch_publish_decimation_ = decimation;
+  filter.burstsize = 3;
+  filter.Init();
+  filter.Run(1, kReadings, kBatchSize);
+}
+}  // namespace
+
+// A batch does the same steps as its readings given one by one.
+TEST(MSF_Core, ImuBatchMatchesSingleReadings) {
+  TestFilter_T reference;
+  TestFilter_T filter;
+  RunSingleReadings(reference);
+  RunBatches(filter, 1);
+  ASSERT_EQ(reference.measurementtimes, filter.measurementtimes);
+
+  const std::vector<msf_core::test::TestPublication>& expected = reference
+      .manager.GetPublications();
+  const std::vector<msf_core::test::TestPublication>& published = filter
+      .manager.GetPublications();
+  msf_core::test::ExpectSamePublications(expected, published, 1e-12);
+
+  // The same states are buffered. The buffers are only cleaned up after a
+  // batch, so the oldest states may differ.
+  size_t compared = 0;
+  for (int i = 1; i <= kReadings; ++i) {
+    const int64_t time = msf_core::test::TestImuReading(i).time;
+    shared_ptr<EKFState_T> reference_state = reference.Core().GetStateAtTime(
+        time);
+    shared_ptr<EKFState_T> state = filter.Core().GetStateAtTime(time);
+    if (state->time == -1 || reference_state->time == -1)
+      continue;
+    ++compared;
+    EXPECT_NEAR_EIGEN(state->ToEigenVector(), reference_state->ToEigenVector(),
+                      1e-12);
+    const EKFState_T& const_reference_state = *reference_state;
+    const EKFState_T& const_state = *state;
+    EXPECT_NEAR_EIGEN(const_state.GetP(), const_reference_state.GetP(), 1e-12);
+  }
+  EXPECT_GT(compared, static_cast<size_t>(kBatchSize));
+}
+
+// Only every decimation-th reading of a batch and its last one are published.
+TEST(MSF_Core, ImuBatchPublishesDecimated) {
+  TestFilter_T filter;
+  RunBatches(filter, 3);
+
+  std::vector<int64_t> expected;
+  for (int i = 1; i <= kReadings; ++i) {
+    const int inbatch = (i - 1) % kBatchSize + 1;
+    if (inbatch % 3 == 0 || inbatch == kBatchSize || i == kReadings) {
+      expected.push_back(msf_core::test::TestImuReading(i).time);
+    }
+  }
+  std::vector<int64_t> published;
+  for (size_t i = 0; i < filter.manager.GetPublications().size(); ++i) {
+    const msf_core::test::TestPublication& publication = filter.manager
+        .GetPublications()[i];
+    if (!publication.afterupdate) {
+      published.push_back(publication.time);
+    }
+  }
+  EXPECT_EQ(published, expected);
+}
+
+MSF_UNITTEST_ENTRYPOINT
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <vector>
+
+#include <msf_core/msf_imuPreintegration.h>
+#include <msf_core/testing_entrypoint.h>
+#include <msf_core/testing_predicates.h>
+
+namespace {
+typedef msf_core::ImuPreintegration<double> Preintegration_T;
+typedef Preintegration_T::Reading Reading_T;
+
+const int64_t kImuPeriod = 5000000;  // 200 Hz.
+
+std::vector<Reading_T> MakeReadings(int n) {
+  std::vector<Reading_T> readings;
+  for (int i = 0; i <= n; ++i) {
+    const double t = i * 0.005;
+    Reading_T reading;
+    reading.time = i * kImuPeriod;
+    reading.a_m << sin(t) + 0.3, cos(2 * t), 9.81 + 0.2 * t;
+    reading.w_m << 0.5 * sin(3 * t), 0.2, -0.4 * cos(t);
+    readings.push_back(reading);
+  }
+  return readings;
+}
+
+void Preintegrate(const std::vector<Reading_T>& readings,
+                  const Eigen::Vector3d& b_a, const Eigen::Vector3d& b_w,
+                  Preintegration_T* preintegration) {
+  CoreProcessNoise noise;
+  noise.Set(Eigen::Vector3d::Constant(0.002), Eigen::Vector3d::Constant(5e-8),
+            Eigen::Vector3d::Constant(0.0004), Eigen::Vector3d::Constant(3e-6));
+  preintegration->Start(readings[0].time, readings[0].a_m, readings[0].w_m,
+                        b_a, b_w);
+  for (size_t i = 1; i < readings.size(); ++i) {
+    preintegration->Integrate(readings[i].time, readings[i].a_m,
+                              readings[i].w_m, noise);
+  }
+}
+}  // namespace
+
+TEST(MSF_Core, ImuPreintegrationMatchesDirectIntegration) {
+  const std::vector<Reading_T> readings = MakeReadings(20);
+  const Eigen::Vector3d b_a(0.01, -0.02, 0.03);
+  const Eigen::Vector3d b_w(0.001, 0.002, -0.001);
+  const Eigen::Vector3d g(0, 0, 9.80834);
+
+  Preintegration_T preintegration;
+  Preintegrate(readings, b_a, b_w, &preintegration);
+  EXPECT_EQ(preintegration.Size(), readings.size() - 1);
+
+  // Integrate in the world frame the way the core propagates the state.
+  const Eigen::Quaterniond q0 =
+      Eigen::Quaterniond(Eigen::Vector4d(0.1, 0.2, 0.3, 0.9)).normalized();
+  const Eigen::Vector3d v0(1, 0.5, -0.2);
+  const Eigen::Vector3d p0(3, 2, 1);
+  Eigen::Quaterniond q = q0;
+  Eigen::Vector3d v = v0;
+  Eigen::Vector3d p = p0;
+  for (size_t i = 1; i < readings.size(); ++i) {
+    const double dt = msf_core::NanosecondsToSeconds(
+        readings[i].time - readings[i - 1].time);
+    const Eigen::Vector3d ew = (readings[i].w_m + readings[i - 1].w_m) / 2
+        - b_w;
+    const Eigen::Quaterniond q_new = (q * Eigen::Quaterniond(
+        Eigen::AngleAxisd(ew.norm() * dt, ew.normalized()))).normalized();
+    const Eigen::Vector3d v_new = v + ((q_new * (readings[i].a_m - b_a)
+        + q * (readings[i - 1].a_m - b_a)) / 2 - g) * dt;
+    p += (v + v_new) / 2 * dt;
+    v = v_new;
+    q = q_new;
+  }
+
+  Eigen::Quaterniond dq;
+  Eigen::Vector3d dv;
+  Eigen::Vector3d dp;
+  preintegration.Predict(b_a, b_w, &dq, &dv, &dp);
+  const double T = preintegration.Dt();
+  EXPECT_NEAR(T, 0.1, 1e-12);
+  EXPECT_NEAR(((q0 * dq).coeffs() - q.coeffs()).norm(), 0, 1e-12);
+  EXPECT_NEAR((v0 + q0 * dv - g * T - v).norm(), 0, 1e-12);
+  EXPECT_NEAR((p0 + v0 * T + q0 * dp - g * T * T / 2 - p).norm(), 0, 1e-12);
+}
+
+TEST(MSF_Core, ImuPreintegrationBiasJacobians) {
+  const std::vector<Reading_T> readings = MakeReadings(40);
+  const Eigen::Vector3d b_a(0.01, -0.02, 0.03);
+  const Eigen::Vector3d b_w(0.001, 0.002, -0.001);
+  Preintegration_T preintegration;
+  Preintegrate(readings, b_a, b_w, &preintegration);
+
+  const Eigen::Vector3d db_a(0.02, 0.01, -0.03);
+  const Eigen::Vector3d db_w(-0.005, 0.01, 0.008);
+  Preintegration_T reintegrated;
+  Preintegrate(readings, b_a + db_a, b_w + db_w, &reintegrated);
+
+  Eigen::Quaterniond dq;
+  Eigen::Vector3d dv;
+  Eigen::Vector3d dp;
+  preintegration.Predict(b_a + db_a, b_w + db_w, &dq, &dv, &dp);
+
+  // The first order correction removes most of the change.
+  const double change_v = (reintegrated.DeltaV()
+      - preintegration.DeltaV()).norm();
+  const double change_p = (reintegrated.DeltaP()
+      - preintegration.DeltaP()).norm();
+  const double change_q = reintegrated.DeltaQ().angularDistance(
+      preintegration.DeltaQ());
+  EXPECT_LT((dv - reintegrated.DeltaV()).norm(), 0.05 * change_v);
+  EXPECT_LT((dp - reintegrated.DeltaP()).norm(), 0.05 * change_p);
+  EXPECT_LT(dq.angularDistance(reintegrated.DeltaQ()), 0.05 * change_q);
+}
+
+TEST(MSF_Core, ImuPreintegrationSplit) {
+  const std::vector<Reading_T> readings = MakeReadings(20);
+  const Eigen::Vector3d b_a(0.01, -0.02, 0.03);
+  const Eigen::Vector3d b_w(0.001, 0.002, -0.001);
+  Preintegration_T whole;
+  Preintegrate(readings, b_a, b_w, &whole);
+
+  Preintegration_T tail = whole;
+  Preintegration_T head;
+  const int64_t tsplit = 7 * kImuPeriod + kImuPeriod / 3;
+  CoreProcessNoise noise;
+  // Times outside of the readings are rejected.
+  EXPECT_FALSE(tail.Split(readings.back().time + kImuPeriod, noise, &head));
+  EXPECT_TRUE(head.Empty());
+  EXPECT_EQ(tail.Size(), whole.Size());
+  ASSERT_TRUE(tail.Split(tsplit, noise, &head));
+  EXPECT_EQ(head.Front().time, readings.front().time);
+  EXPECT_EQ(head.Back().time, tsplit);
+  EXPECT_EQ(tail.Front().time, tsplit);
+  EXPECT_EQ(tail.Back().time, readings.back().time);
+  EXPECT_EQ(head.Size(), 8u);
+  EXPECT_EQ(tail.Size(), 13u);
+  EXPECT_NEAR(head.Dt() + tail.Dt(), whole.Dt(), 1e-12);
+
+  // Chaining the two intervals gives the increments over the whole one.
+  const Eigen::Quaterniond dq = head.DeltaQ() * tail.DeltaQ();
+  const Eigen::Vector3d dv = head.DeltaV() + head.DeltaQ() * tail.DeltaV();
+  const Eigen::Vector3d dp = head.DeltaP() + head.DeltaV() * tail.Dt()
+      + head.DeltaQ() * tail.DeltaP();
+  EXPECT_LT(dq.angularDistance(whole.DeltaQ()), 1e-6);
+  EXPECT_LT((dv - whole.DeltaV()).norm(), 1e-5);
+  EXPECT_LT((dp - whole.DeltaP()).norm(), 1e-6);
+}
+
+MSF_UNITTEST_ENTRYPOINT
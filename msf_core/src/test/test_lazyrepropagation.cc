@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <msf_core/msf_core.h>
+#include <msf_core/testing_core.h>
+#include <msf_core/testing_entrypoint.h>
+#include <msf_core/testing_predicates.h>
+
+namespace {
+typedef msf_core::test::TestState<double>::type EKFState_T;
+typedef msf_core::test::TestFilter<EKFState_T> TestFilter_T;
+
+enum {
+  kReadings = 600
+};
+
+void RunScenario(TestFilter_T& filter, bool lazy) {
+  filter.manager.lazy_repropagation_ = lazy;
+  filter.burstsize = 3;
+  filter.Init();
+  filter.Run(1, kReadings);
+}
+}  // namespace
+
+// The composed transition to the latest state and the covariance reconstructed
+// for the states in between have to give the filter propagating every state.
+TEST(MSF_Core, LazyRepropagationMatchesFull) {
+  TestFilter_T reference;
+  TestFilter_T filter;
+  RunScenario(reference, false);
+  RunScenario(filter, true);
+
+  const std::vector<msf_core::test::TestPublication>& expected = reference
+      .manager.GetPublications();
+  const std::vector<msf_core::test::TestPublication>& published = filter
+      .manager.GetPublications();
+  // The states published after the updates have the updated covariance.
+  msf_core::test::ExpectSamePublications(expected, published, 1e-9);
+
+  // The states before the latest one get their covariance when read.
+  for (size_t i = 0; i < filter.measurementtimes.size(); ++i) {
+    const int64_t time = filter.measurementtimes[i];
+    shared_ptr<EKFState_T> reference_state = reference.Core().GetStateAtTime(
+        time);
+    shared_ptr<EKFState_T> state = filter.Core().GetStateAtTime(time);
+    if (state->time == -1 || reference_state->time == -1)
+      continue;
+    const EKFState_T& const_reference_state = *reference_state;
+    const EKFState_T& const_state = *state;
+    EXPECT_NEAR_EIGEN(const_state.GetP(), const_reference_state.GetP(), 1e-9);
+  }
+}
+
+MSF_UNITTEST_ENTRYPOINT
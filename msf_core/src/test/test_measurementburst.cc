@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <msf_core/msf_core.h>
+#include <msf_core/testing_core.h>
+#include <msf_core/testing_entrypoint.h>
+#include <msf_core/testing_predicates.h>
+
+namespace {
+typedef msf_core::test::TestState<double>::type EKFState_T;
+typedef msf_core::test::TestFilter<EKFState_T> TestFilter_T;
+typedef msf_core::MSF_Core<EKFState_T>::MeasurementBurstStatistics
+    MeasurementBurstStatistics_T;
+
+// No measurements arrive after the last reading, so all of them are applied.
+enum {
+  kReadings = 599,
+  kBurstSize = 3
+};
+
+void RunScenario(TestFilter_T& filter, bool coalesce) {
+  filter.manager.coalesce_measurements_ = coalesce;
+  filter.burstsize = kBurstSize;
+  filter.Init();
+  filter.Run(1, kReadings);
+}
+
+/**
+ * \brief The statistics of the test scenario. Its measurements arriving
+ * after the same IMU reading are the newest so far and arrive from the newest
+ * to the oldest, except for the relative position arriving last.
+ */
+MeasurementBurstStatistics_T ExpectedStatistics() {
+  MeasurementBurstStatistics_T statistics;
+  for (int i = 41; i <= kReadings; ++i) {
+    size_t burst = 0;
+    size_t newestfirst = 0;
+    if (i % 20 == 0)
+      ++burst;
+    if (i % 40 == 10) {
+      burst += kBurstSize;
+      newestfirst += kBurstSize;
+    }
+    if (i % 30 == 0) {
+      ++burst;
+      // The relative position is older than the burst of sensor 2.
+      if (newestfirst > 0)
+        ++newestfirst;
+    }
+    if (burst <= 1)
+      continue;
+    ++statistics.bursts;
+    statistics.measurements += burst;
+    // Each of these would have replayed the ones that arrived before it.
+    statistics.savedreplays += newestfirst * (newestfirst - 1) / 2;
+    statistics.coalescedmeasurements += burst - 1;
+  }
+  return statistics;
+}
+}  // namespace
+
+// A burst is replayed once from its oldest measurement, which has to give the
+// same states as replaying for each measurement.
+TEST(MSF_Core, CoalescedMeasurementsMatchSeparate) {
+  TestFilter_T reference;
+  TestFilter_T filter;
+  RunScenario(reference, false);
+  RunScenario(filter, true);
+  ASSERT_EQ(reference.measurementtimes, filter.measurementtimes);
+
+  size_t compared = 0;
+  for (size_t i = 0; i < filter.measurementtimes.size(); ++i) {
+    const int64_t time = filter.measurementtimes[i];
+    shared_ptr<EKFState_T> reference_state = reference.Core().GetStateAtTime(
+        time);
+    shared_ptr<EKFState_T> state = filter.Core().GetStateAtTime(time);
+    if (state->time == -1 || reference_state->time == -1)
+      continue;
+    EXPECT_NEAR_EIGEN(state->ToEigenVector(), reference_state->ToEigenVector(),
+                      1e-9);
+    const EKFState_T& const_reference_state = *reference_state;
+    const EKFState_T& const_state = *state;
+    EXPECT_NEAR_EIGEN(const_state.GetP(), const_reference_state.GetP(), 1e-9);
+    ++compared;
+  }
+  EXPECT_GT(compared, 2u);
+
+  const msf_core::test::TestPublication& expected = reference.manager
+      .GetPublications().back();
+  const msf_core::test::TestPublication& published = filter.manager
+      .GetPublications().back();
+  EXPECT_EQ(published.time, expected.time);
+  EXPECT_NEAR_EIGEN(published.p, expected.p, 1e-9);
+}
+
+TEST(MSF_Core, CoalescedMeasurementsSaveReplays) {
+  TestFilter_T reference;
+  TestFilter_T filter;
+  RunScenario(reference, false);
+  RunScenario(filter, true);
+
+  const MeasurementBurstStatistics_T expected = ExpectedStatistics();
+  const MeasurementBurstStatistics_T& statistics = filter.Core()
+      .GetMeasurementBurstStatistics();
+  EXPECT_GT(expected.bursts, 0u);
+  EXPECT_EQ(statistics.bursts, expected.bursts);
+  EXPECT_EQ(statistics.measurements, expected.measurements);
+  EXPECT_EQ(statistics.savedreplays, expected.savedreplays);
+  EXPECT_EQ(statistics.coalescedmeasurements, expected.coalescedmeasurements);
+  EXPECT_EQ(reference.Core().GetMeasurementBurstStatistics().bursts, 0u);
+
+  // Only one update is published for every burst.
+  size_t updates = 0;
+  size_t coalescedupdates = 0;
+  for (size_t i = 0; i < reference.manager.GetPublications().size(); ++i) {
+    updates += reference.manager.GetPublications()[i].afterupdate;
+  }
+  for (size_t i = 0; i < filter.manager.GetPublications().size(); ++i) {
+    coalescedupdates += filter.manager.GetPublications()[i].afterupdate;
+  }
+  EXPECT_EQ(coalescedupdates + expected.coalescedmeasurements, updates);
+}
+
+MSF_UNITTEST_ENTRYPOINT
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <msf_core/msf_measurementIndex.h>
+#include <msf_core/testing_entrypoint.h>
+
+namespace {
+struct SensorReading {
+  int64_t time;
+  int sensorID_;
+  SensorReading(int64_t _time, int _sensorID)
+      : time(_time),
+        sensorID_(_sensorID) {
+  }
+};
+typedef msf_core::MeasurementIndex<SensorReading> Index_T;
+}  // namespace
+
+// Queries have to skip the measurements of other sensors.
+TEST(MSF_Core, MeasurementIndexPerSensorQueries) {
+  Index_T index;
+  // Sensor 0 every 10 ns, sensor 1 every 30 ns.
+  for (int64_t t = 10; t <= 300; t += 10) {
+    index.Insert(Index_T::Ptr_T(new SensorReading(t, 0)));
+    if (t % 30 == 0) {
+      index.Insert(Index_T::Ptr_T(new SensorReading(t + 1, 1)));
+    }
+  }
+  EXPECT_EQ(index.Size(0), 30u);
+  EXPECT_EQ(index.Size(1), 10u);
+  EXPECT_EQ(index.Size(2), 0u);
+
+  EXPECT_EQ(index.GetPrevious(1, 91)->time, 61);
+  EXPECT_EQ(index.GetPrevious(1, 95)->time, 91);
+  EXPECT_FALSE(index.GetPrevious(1, 31));
+  EXPECT_EQ(index.GetNext(1, 91)->time, 121);
+  EXPECT_FALSE(index.GetNext(1, 301));
+  EXPECT_EQ(index.GetPrevious(0, 91)->time, 90);
+  EXPECT_FALSE(index.GetPrevious(2, 100));
+
+  std::vector<Index_T::Ptr_T> range;
+  EXPECT_EQ(index.GetRange(1, 61, 150, range), 3u);
+  ASSERT_EQ(range.size(), 3u);
+  EXPECT_EQ(range.front()->time, 61);
+  EXPECT_EQ(range.back()->time, 121);
+
+  index.ClearOlderThan(100);
+  EXPECT_EQ(index.Size(0), 21u);
+  EXPECT_EQ(index.Size(1), 7u);
+  EXPECT_FALSE(index.GetPrevious(1, 121));
+  index.ClearOlderThan(1000);
+  EXPECT_EQ(index.Size(0), 0u);
+}
+
+MSF_UNITTEST_ENTRYPOINT
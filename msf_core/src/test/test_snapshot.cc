@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cstdio>
+
+#include <msf_core/msf_core.h>
+#include <msf_core/testing_core.h>
+#include <msf_core/testing_entrypoint.h>
+#include <msf_core/testing_predicates.h>
+
+namespace {
+typedef msf_core::test::TestState<double>::type EKFState_T;
+
+// The test state with L and q_wv swapped. It has the same length, so it is
+// declared here to check that the snapshots of one are not read as the other.
+typedef boost::fusion::vector<
+    msf_core::StateVar_T<Eigen::Matrix<double, 3, 1>, msf_core::test::p,
+        msf_core::CoreStateWithPropagation>,
+    msf_core::StateVar_T<Eigen::Matrix<double, 3, 1>, msf_core::test::v,
+        msf_core::CoreStateWithPropagation>,
+    msf_core::StateVar_T<Eigen::Quaterniond, msf_core::test::q,
+        msf_core::CoreStateWithPropagation>,
+    msf_core::StateVar_T<Eigen::Matrix<double, 3, 1>, msf_core::test::b_w,
+        msf_core::CoreStateWithoutPropagation>,
+    msf_core::StateVar_T<Eigen::Matrix<double, 3, 1>, msf_core::test::b_a,
+        msf_core::CoreStateWithoutPropagation>,
+    msf_core::StateVar_T<Eigen::Quaterniond, msf_core::test::L,
+        msf_core::Auxiliary>,
+    msf_core::StateVar_T<Eigen::Matrix<double, 1, 1>, msf_core::test::q_wv,
+        msf_core::AuxiliaryNonTemporalDrifting>
+> otherState_T;
+
+typedef msf_core::GenericState_T<otherState_T,
+    msf_core::test::TestStateDefinition> OtherState_T;
+typedef msf_core::FilterSnapshot<EKFState_T> Snapshot_T;
+}  // namespace
+
+TEST(MSF_Core, SnapshotRoundTrip) {
+  const std::string filename = "/tmp/msf_test_snapshot.bin";
+  EKFState_T state;
+  state.AllocateCovariance();
+  state.time = 1234567890123LL;
+  state.Set<msf_core::test::L>(Eigen::Matrix<double, 1, 1>::Constant(0.7));
+  state.Set<msf_core::test::q_wv>(Eigen::Quaterniond(0.5, 0.5, -0.5, 0.5));
+  state.w_m << 0.1, 0.2, 0.3;
+  state.a_m << 0.0, 0.0, 9.81;
+  state.GetP().setRandom();
+  EKFState_T stateWithoutP;
+  stateWithoutP.time = state.time + 5000000;
+
+  std::vector<Snapshot_T::Record> records(2);
+  Snapshot_T::ToRecord(state, records[0]);
+  Snapshot_T::ToRecord(stateWithoutP, records[1]);
+  ASSERT_TRUE(Snapshot_T::Write(filename, records));
+
+  std::vector<Snapshot_T::Record> read;
+  ASSERT_TRUE(Snapshot_T::Read(filename, read));
+  ASSERT_EQ(read.size(), 2u);
+  EXPECT_TRUE(read[0].flags & Snapshot_T::kHasCovariance);
+  EXPECT_FALSE(read[1].flags & Snapshot_T::kHasCovariance);
+
+  EKFState_T restored;
+  restored.AllocateCovariance();
+  Snapshot_T::FromRecord(read[0], restored);
+  const EKFState_T& crestored = restored;
+  EXPECT_EQ(crestored.time, state.time);
+  EXPECT_EQ(crestored.Get<msf_core::test::L>()(0), 0.7);
+  EXPECT_NEAR_EIGEN(crestored.Get<msf_core::test::q_wv>().coeffs(),
+                    Eigen::Quaterniond(0.5, 0.5, -0.5, 0.5).coeffs(), 0);
+  EXPECT_NEAR_EIGEN(crestored.w_m, state.w_m, 0);
+  EXPECT_NEAR_EIGEN(crestored.a_m, state.a_m, 0);
+  EXPECT_NEAR_EIGEN(crestored.GetP(),
+                    const_cast<const EKFState_T&>(state).GetP(), 0);
+
+  // Snapshots of other state definitions are rejected.
+  std::vector<msf_core::FilterSnapshot<OtherState_T>::Record> other;
+  EXPECT_FALSE(msf_core::FilterSnapshot<OtherState_T>::Read(filename, other));
+  std::remove(filename.c_str());
+}
+
+TEST(MSF_Core, SnapshotRestoresAllStates) {
+  typedef msf_core::test::TestFilter<EKFState_T> TestFilter_T;
+  const std::string filename = "/tmp/msf_test_core_snapshot.bin";
+
+  // The covariance lags behind by the decimation, so the snapshot holds the
+  // states after the one it was propagated to as well.
+  TestFilter_T filter;
+  filter.manager.covariance_propagation_decimation_ = 3;
+  filter.Init();
+  filter.Run(1, 401);
+  ASSERT_TRUE(filter.Core().WriteSnapshot(filename));
+  std::vector<Snapshot_T::Record> records;
+  ASSERT_TRUE(Snapshot_T::Read(filename, records));
+  ASSERT_GT(records.size(), 1u);
+
+  TestFilter_T restored;
+  restored.manager.covariance_propagation_decimation_ = 3;
+  ASSERT_TRUE(restored.Core().RestoreFromSnapshot(filename));
+  for (size_t i = 0; i < records.size(); ++i) {
+    shared_ptr<EKFState_T> expected = filter.Core().GetClosestState(
+        records[i].time);
+    shared_ptr<EKFState_T> state = restored.Core().GetClosestState(
+        records[i].time);
+    ASSERT_EQ(state->time, records[i].time);
+    EXPECT_NEAR_EIGEN(state->ToEigenVector(), expected->ToEigenVector(), 0);
+    const EKFState_T& const_expected = *expected;
+    const EKFState_T& const_state = *state;
+    EXPECT_NEAR_EIGEN(const_state.GetP(), const_expected.GetP(), 1e-12);
+  }
+  std::remove(filename.c_str());
+}
+
+MSF_UNITTEST_ENTRYPOINT
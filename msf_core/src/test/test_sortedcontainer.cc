@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cstdlib>
+#include <msf_core/msf_sortedContainer.h>
+#include <msf_core/msf_sortedRingContainer.h>
+#include <msf_core/testing_entrypoint.h>
+
+namespace {
+struct TimedValue {
+  int64_t time;
+  int value;
+  TimedValue()
+      : time(0),
+        value(0) {
+  }
+};
+
+template<typename Container_T>
+void InsertValue(Container_T& container, int64_t time, int value) {
+  typename Container_T::Ptr_T val(new TimedValue);
+  val->time = time;
+  val->value = value;
+  container.Insert(val);
+}
+}  // namespace
+
+// The ring buffer backend has to answer all queries exactly like the map.
+TEST(MSF_Core, SortedRingContainerMatchesSortedContainer) {
+  using namespace msf_core;
+  SortedContainer<TimedValue> map_buffer;
+  SortedRingContainer<TimedValue> ring_buffer(4);  // Force regrowth.
+
+  srand(42);
+  int64_t time = 100000000000;  // 100 s.
+  for (int i = 0; i < 500; ++i) {
+    time += 5000000;
+    // Mostly in order, sometimes an older value as for delayed states.
+    int64_t t = (i % 7 == 0) ? time - 12300000 : time;
+    InsertValue(map_buffer, t, i);
+    InsertValue(ring_buffer, t, i);
+  }
+  ASSERT_EQ(map_buffer.Size(), ring_buffer.Size());
+
+  for (int i = 0; i < 200; ++i) {
+    int64_t query = 99900000000
+        + static_cast<int64_t>(2.8e9 * static_cast<double>(rand()) / RAND_MAX);
+    EXPECT_EQ(map_buffer.GetClosestBefore(query)->time,
+              ring_buffer.GetClosestBefore(query)->time);
+    EXPECT_EQ(map_buffer.GetClosestAfter(query)->time,
+              ring_buffer.GetClosestAfter(query)->time);
+    EXPECT_EQ(map_buffer.GetClosest(query)->time,
+              ring_buffer.GetClosest(query)->time);
+  }
+
+  int64_t last = map_buffer.GetLast()->time;
+  EXPECT_EQ(map_buffer.UpdateTime(last, last + 1000000000)->value,
+            ring_buffer.UpdateTime(last, last + 1000000000)->value);
+  EXPECT_EQ(map_buffer.GetLast()->time, ring_buffer.GetLast()->time);
+
+  map_buffer.ClearOlderThan(1500000000);
+  ring_buffer.ClearOlderThan(1500000000);
+  ASSERT_EQ(map_buffer.Size(), ring_buffer.Size());
+  EXPECT_EQ(map_buffer.GetFirst()->time, ring_buffer.GetFirst()->time);
+
+  SortedContainer<TimedValue>::iterator_T it_map =
+      map_buffer.GetIteratorBegin();
+  SortedRingContainer<TimedValue>::iterator_T it_ring =
+      ring_buffer.GetIteratorBegin();
+  for (; it_map != map_buffer.GetIteratorEnd(); ++it_map, ++it_ring) {
+    ASSERT_TRUE(it_ring != ring_buffer.GetIteratorEnd());
+    EXPECT_EQ(it_map->first, it_ring->first);
+    EXPECT_EQ(it_map->second->value, it_ring->second->value);
+  }
+  EXPECT_TRUE(it_ring == ring_buffer.GetIteratorEnd());
+}
+
+MSF_UNITTEST_ENTRYPOINT
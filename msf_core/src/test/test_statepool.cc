@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cstdlib>
+#include <new>
+
+#include <msf_core/msf_statePool.h>
+#include <msf_core/testing_core.h>
+#include <msf_core/testing_entrypoint.h>
+
+namespace {
+// Counts the calls to the global operator new while enabled.
+bool countallocations = false;
+size_t allocations = 0;
+
+struct PooledState {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  Eigen::Matrix<double, 15, 15> P;
+  Eigen::Quaterniond q;
+  int64_t time;
+};
+typedef msf_core::StatePool<PooledState> Pool_T;
+typedef msf_core::test::TestState<double>::type EKFState_T;
+}  // namespace
+
+// Not inlined, so the compiler does not match the free below against new.
+__attribute__((noinline)) void* operator new(size_t size) {
+  if (countallocations) {
+    ++allocations;
+  }
+  void* memory = std::malloc(size > 0 ? size : 1);
+  if (memory == nullptr) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+__attribute__((noinline)) void operator delete(void* memory) noexcept {
+  std::free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void* memory,
+                                               size_t) noexcept {
+  std::free(memory);
+}
+
+// Once the pool is set up, handing out and releasing states must not touch the
+// heap, neither for the states nor for their reference counts.
+TEST(MSF_Core, StatePoolSteadyStateDoesNotAllocate) {
+  Pool_T pool(8);
+  std::vector<Pool_T::Ptr_T> states;
+  states.reserve(8);
+
+  allocations = 0;
+  countallocations = true;
+  for (int cycle = 0; cycle < 100; ++cycle) {
+    for (int i = 0; i < 8; ++i) {
+      states.push_back(pool.Acquire());
+      states.back()->time = cycle;
+    }
+    states.clear();
+  }
+  countallocations = false;
+
+  EXPECT_EQ(allocations, 0u);
+  EXPECT_EQ(pool.InUse(), 0u);
+  EXPECT_EQ(pool.HighWaterMark(), 8u);
+  EXPECT_EQ(pool.Refused(), 0u);
+}
+
+// The capacity is a hard bound, exhausting the pool refuses further states.
+TEST(MSF_Core, StatePoolRefusesWhenExhausted) {
+  Pool_T pool(4);
+  std::vector<Pool_T::Ptr_T> states;
+  for (int i = 0; i < 4; ++i) {
+    states.push_back(pool.Acquire());
+    ASSERT_TRUE(states.back());
+    EXPECT_EQ(reinterpret_cast<size_t>(states.back().get()) % 16, 0u);
+  }
+  EXPECT_FALSE(pool.Acquire());
+  EXPECT_EQ(pool.Refused(), 1u);
+  EXPECT_EQ(pool.InUse(), 4u);
+
+  // A released slot is handed out again.
+  PooledState* released = states.back().get();
+  states.pop_back();
+  Pool_T::Ptr_T state = pool.Acquire();
+  EXPECT_EQ(state.get(), released);
+}
+
+// States keep the storage of the pool alive.
+TEST(MSF_Core, StatePoolStatesOutliveThePool) {
+  Pool_T::Ptr_T state;
+  {
+    Pool_T pool(2);
+    state = pool.Acquire();
+  }
+  state->P.setIdentity();
+  EXPECT_EQ(state->P.trace(), 15);
+}
+
+// A capacity of zero allocates every state on the heap.
+TEST(MSF_Core, StatePoolDisabled) {
+  Pool_T pool;
+  std::vector<Pool_T::Ptr_T> states;
+  for (int i = 0; i < 10; ++i) {
+    states.push_back(pool.Acquire());
+    ASSERT_TRUE(states.back());
+  }
+  EXPECT_EQ(pool.Capacity(), 0u);
+  EXPECT_EQ(pool.HighWaterMark(), 10u);
+  EXPECT_EQ(pool.Refused(), 0u);
+}
+
+// The core gives the same filter with its states taken from the pool.
+TEST(MSF_Core, StatePoolCoreMatchesHeap) {
+  msf_core::test::TestFilter<EKFState_T> heap;
+  msf_core::test::TestFilter<EKFState_T> pooled;
+  pooled.manager.state_pool_capacity_ = 400;
+  heap.Init();
+  pooled.Init();
+  heap.Run(1, 600);
+  pooled.Run(1, 600);
+
+  const msf_core::StatePool<EKFState_T>& pool = pooled.Core().GetStatePool();
+  EXPECT_EQ(pool.Refused(), 0u);
+  EXPECT_LE(pool.HighWaterMark(), pool.Capacity());
+
+  const std::vector<msf_core::test::TestPublication>& expected = heap.manager
+      .GetPublications();
+  const std::vector<msf_core::test::TestPublication>& published = pooled
+      .manager.GetPublications();
+  msf_core::test::ExpectSamePublications(expected, published, 1e-12);
+}
+
+MSF_UNITTEST_ENTRYPOINT
@@ -27,8 +27,8 @@ template<typename MEASUREMENT_TYPE, typename MANAGER_TYPE>
 PoseSensorHandler<MEASUREMENT_TYPE, MANAGER_TYPE>::PoseSensorHandler(
     MANAGER_TYPE& meas, std::string topic_namespace,
     std::string parameternamespace, bool distortmeas)
-    : SensorHandler<msf_updates::EKFState>(meas, topic_namespace,
-                                           parameternamespace),
+    : msf_core::SensorHandler<typename MEASUREMENT_TYPE::EKFState_T>(
+          meas, topic_namespace, parameternamespace),
       n_zp_(1e-6),
       n_zq_(1e-6),
       delay_(0) {
@@ -124,13 +124,13 @@ void PoseSensorHandler<MEASUREMENT_TYPE, MANAGER_TYPE>::ProcessPoseMeasurement(
 
   // Get the fixed states.
   int fixedstates = 0;
-  static_assert(msf_updates::EKFState::nStateVarsAtCompileTime < 32, "Your state "
+  static_assert(MEASUREMENT_TYPE::EKFState_T::nStateVarsAtCompileTime < 32, "Your state "
       "has more than 32 variables. The code needs to be changed here to have a "
       "larger variable to mark the fixed_states");
   // Do not exceed the 32 bits of int.
 
   // Get all the fixed states and set flag bits.
-  MANAGER_TYPE* mngr = dynamic_cast<MANAGER_TYPE*>(&manager_);
+  MANAGER_TYPE* mngr = dynamic_cast<MANAGER_TYPE*>(&this->manager_);
 
   // TODO(acmarkus): if we have multiple sensor handlers, they all share the same dynparams,
   // which me maybe don't want. E.g. if we have this for multiple AR Markers, we
@@ -161,7 +161,8 @@ void PoseSensorHandler<MEASUREMENT_TYPE, MANAGER_TYPE>::ProcessPoseMeasurement(
                                provides_absolute_measurements_, this->sensorID,
                                fixedstates, distorter_));
 
-  meas->MakeFromSensorReading(msg, msg->header.stamp.toSec() - delay_);
+  meas->MakeFromSensorReading(
+      msg, msg->header.stamp.toNSec() - msf_core::SecondsToNanoseconds(delay_));
 
   z_p_ = meas->z_p_;  //store this for the init procedure
   z_q_ = meas->z_q_;
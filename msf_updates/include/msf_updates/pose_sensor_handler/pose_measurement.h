@@ -32,24 +32,32 @@ enum {
 /**
  * \brief A measurement as provided by a pose tracking algorithm.
  */
-typedef msf_core::MSF_Measurement<geometry_msgs::PoseWithCovarianceStamped,
-    Eigen::Matrix<double, nMeasurements, nMeasurements>, msf_updates::EKFState> PoseMeasurementBase;
+template<typename STATE_TYPE>
+struct PoseMeasurementBase {
+  typedef msf_core::MSF_Measurement<geometry_msgs::PoseWithCovarianceStamped,
+      Eigen::Matrix<double, nMeasurements, nMeasurements>, STATE_TYPE> type;
+};
 
+/**
+ * \brief The pose measurement for a state of the filter, H and the residuals
+ * are computed in the scalar of the state.
+ */
 template<
     int StateLIdx = EKFState::StateDefinition_T::L,
     int StateQicIdx = EKFState::StateDefinition_T::q_ic,
     int StatePicIdx = EKFState::StateDefinition_T::p_ic,
     int StateQwvIdx = EKFState::StateDefinition_T::q_wv,
-    int StatePwvIdx = EKFState::StateDefinition_T::p_wv
+    int StatePwvIdx = EKFState::StateDefinition_T::p_wv,
+    typename STATE_TYPE = msf_updates::EKFState
     >
-struct PoseMeasurement : public PoseMeasurementBase {
+struct PoseMeasurement : public PoseMeasurementBase<STATE_TYPE>::type {
  private:
-  typedef PoseMeasurementBase Measurement_t;
-  typedef Measurement_t::Measurement_ptr measptr_t;
+  typedef typename PoseMeasurementBase<STATE_TYPE>::type Measurement_t;
+  typedef typename Measurement_t::Measurement_ptr measptr_t;
 
   virtual void MakeFromSensorReadingImpl(measptr_t msg) {
     Eigen::Matrix<double, nMeasurements,
-        msf_core::MSF_Core<msf_updates::EKFState>::nErrorStatesAtCompileTime> H_old;
+        msf_core::MSF_Core<EKFState_T>::nErrorStatesAtCompileTime> H_old;
     Eigen::Matrix<double, nMeasurements, 1> r_old;
 
     H_old.setZero();
@@ -64,35 +72,35 @@ struct PoseMeasurement : public PoseMeasurementBase {
                                      msg->pose.pose.orientation.z);
 
     if (distorter_) {
-      static double tlast = 0;
+      static int64_t tlast = 0;
       if (tlast != 0) {
-        double dt = time - tlast;
+        double dt = msf_core::NanosecondsToSeconds(this->time - tlast);
         distorter_->Distort(z_p_, z_q_, dt);
       }
-      tlast = time;
+      tlast = this->time;
     }
 
     if (fixed_covariance_) {  // Take fix covariance from reconfigure GUI.
       const double s_zp = n_zp_ * n_zp_;
       const double s_zq = n_zq_ * n_zq_;
-      R_ =
+      this->R_ =
           (Eigen::Matrix<double, nMeasurements, 1>() << s_zp, s_zp, s_zp, s_zq, s_zq, s_zq, 1e-6)
               .finished().asDiagonal();
     } else {  // Take covariance from sensor.
-      R_.block<6, 6>(0, 0) = Eigen::Matrix<double, 6, 6>(
+      this->R_.template block<6, 6>(0, 0) = Eigen::Matrix<double, 6, 6>(
           &msg->pose.covariance[0]);
 
       if (msg->header.seq % 100 == 0) {  // Only do this check from time to time.
-        if (R_.block<6, 6>(0, 0).determinant() < -0.001)
+        if (this->R_.template block<6, 6>(0, 0).determinant() < -0.001)
           MSF_WARN_STREAM_THROTTLE(
               60,
-              "The covariance matrix you provided for " "the pose sensor is not positive definite: "<<(R_.block<6, 6>(0, 0)));
+              "The covariance matrix you provided for " "the pose sensor is not positive definite: "<<(this->R_.template block<6, 6>(0, 0)));
       }
 
       // Clear cross-correlations between q and p.
-      R_.block<3, 3>(0, 3) = Eigen::Matrix<double, 3, 3>::Zero();
-      R_.block<3, 3>(3, 0) = Eigen::Matrix<double, 3, 3>::Zero();
-      R_(6, 6) = 1e-6;  // q_wv yaw-measurement noise
+      this->R_.template block<3, 3>(0, 3) = Eigen::Matrix<double, 3, 3>::Zero();
+      this->R_.template block<3, 3>(3, 0) = Eigen::Matrix<double, 3, 3>::Zero();
+      this->R_(6, 6) = 1e-6;  // q_wv yaw-measurement noise
 
       /*************************************************************************************/
       // Use this if your pose sensor is ethzasl_ptam (www.ros.org/wiki/ethzasl_ptam)
@@ -106,7 +114,8 @@ struct PoseMeasurement : public PoseMeasurementBase {
         C_cov.block<3, 3>(0, 0) = C_zq;
         C_cov.block<3, 3>(3, 3) = C_zq;
 
-        R_.block<6, 6>(0, 0) = C_cov.transpose() * R_.block<6, 6>(0, 0) * C_cov;
+        this->R_.template block<6, 6>(0, 0) = C_cov.transpose()
+            * this->R_.template block<6, 6>(0, 0) * C_cov;
       }
       /*************************************************************************************/
     }
@@ -123,9 +132,10 @@ struct PoseMeasurement : public PoseMeasurementBase {
   msf_updates::PoseDistorter::Ptr distorter_;
   int fixedstates_;
 
-  typedef msf_updates::EKFState EKFState_T;
-  typedef EKFState_T::StateSequence_T StateSequence_T;
-  typedef EKFState_T::StateDefinition_T StateDefinition_T;
+  typedef STATE_TYPE EKFState_T;
+  typedef typename EKFState_T::StateSequence_T StateSequence_T;
+  typedef typename EKFState_T::StateDefinition_T StateDefinition_T;
+  typedef typename EKFState_T::Scalar_T Scalar_T;
 
   enum AuxState {
     L = StateLIdx,
@@ -135,6 +145,11 @@ struct PoseMeasurement : public PoseMeasurementBase {
     p_wv = StatePwvIdx
   };
 
+  /// The states H of the absolute measurement is nonzero for.
+  typedef msf_core::BlockSparseJacobian<StateSequence_T, StateDefinition_T::p,
+      StateDefinition_T::q, StateLIdx, StateQwvIdx, StatePwvIdx, StateQicIdx,
+      StatePicIdx> HBlocks_T;
+
   virtual ~PoseMeasurement() {
   }
   PoseMeasurement(double n_zp, double n_zq, bool measurement_world_sensor,
@@ -142,7 +157,7 @@ struct PoseMeasurement : public PoseMeasurementBase {
                   int sensorID, int fixedstates,
                   msf_updates::PoseDistorter::Ptr distorter =
                       msf_updates::PoseDistorter::Ptr())
-      : PoseMeasurementBase(isabsoluteMeasurement, sensorID),
+      : Measurement_t(isabsoluteMeasurement, sensorID),
         n_zp_(n_zp),
         n_zq_(n_zq),
         measurement_world_sensor_(measurement_world_sensor),
@@ -156,29 +171,29 @@ struct PoseMeasurement : public PoseMeasurementBase {
 
   virtual void CalculateH(
       shared_ptr<EKFState_T> state_in,
-      Eigen::Matrix<double, nMeasurements,
+      Eigen::Matrix<Scalar_T, nMeasurements,
           msf_core::MSF_Core<EKFState_T>::nErrorStatesAtCompileTime>& H) {
     const EKFState_T& state = *state_in;  // Get a const ref, so we can read core states.
 
     H.setZero();
 
     // Get rotation matrices.
-    Eigen::Matrix<double, 3, 3> C_wv = state.Get<StateQwvIdx>()
+    Eigen::Matrix<Scalar_T, 3, 3> C_wv = state.template Get<StateQwvIdx>()
         .toRotationMatrix();
-    Eigen::Matrix<double, 3, 3> C_q = state.Get<StateDefinition_T::q>()
+    Eigen::Matrix<Scalar_T, 3, 3> C_q = state.template Get<StateDefinition_T::q>()
         .toRotationMatrix();
 
-    Eigen::Matrix<double, 3, 3> C_ci = state.Get<StateQicIdx>()
+    Eigen::Matrix<Scalar_T, 3, 3> C_ci = state.template Get<StateQicIdx>()
         .conjugate().toRotationMatrix();
 
     // Preprocess for elements in H matrix.
-    Eigen::Matrix<double, 3, 1> vecold;
+    Eigen::Matrix<Scalar_T, 3, 1> vecold;
 
-    vecold = (state.Get<StateDefinition_T::p>()
-        + C_q * state.Get<StatePicIdx>()) * state.Get<StateLIdx>();
-    Eigen::Matrix<double, 3, 3> skewold = Skew(vecold);
+    vecold = (state.template Get<StateDefinition_T::p>()
+        + C_q * state.template Get<StatePicIdx>()) * state.template Get<StateLIdx>();
+    Eigen::Matrix<Scalar_T, 3, 3> skewold = Skew(vecold);
 
-    Eigen::Matrix<double, 3, 3> pci_sk = Skew(state.Get<StatePicIdx>());
+    Eigen::Matrix<Scalar_T, 3, 3> pci_sk = Skew(state.template Get<StatePicIdx>());
 
 
     // Get indices of states in error vector.
@@ -211,61 +226,61 @@ struct PoseMeasurement : public PoseMeasurementBase {
 
     // Set crosscov to zero for fixed states.
     if (scalefix)
-      state_in->ClearCrossCov<StateLIdx>();
+      state_in->template ClearCrossCov<StateLIdx>();
     if (calibposfix)
-      state_in->ClearCrossCov<StatePicIdx>();
+      state_in->template ClearCrossCov<StatePicIdx>();
     if (calibattfix)
-      state_in->ClearCrossCov<StateQicIdx>();
+      state_in->template ClearCrossCov<StateQicIdx>();
     if (driftwvattfix)
-      state_in->ClearCrossCov<StateQwvIdx>();
+      state_in->template ClearCrossCov<StateQwvIdx>();
     if (driftwvposfix)
-      state_in->ClearCrossCov<StatePwvIdx>();
+      state_in->template ClearCrossCov<StatePwvIdx>();
 
 
     // Construct H matrix.
     // Position:
-    H.block<3, 3>(0, kIdxstartcorr_p) = C_wv
-        * state.Get<StateLIdx>()(0);  // p
+    H.template block<3, 3>(0, kIdxstartcorr_p) = C_wv
+        * state.template Get<StateLIdx>()(0);  // p
 
-    H.block<3, 3>(0, kIdxstartcorr_q) = -C_wv * C_q * pci_sk
-        * state.Get<StateLIdx>()(0);  // q
+    H.template block<3, 3>(0, kIdxstartcorr_q) = -C_wv * C_q * pci_sk
+        * state.template Get<StateLIdx>()(0);  // q
 
-    H.block<3, 1>(0, kIdxstartcorr_L) =
+    H.template block<3, 1>(0, kIdxstartcorr_L) =
         scalefix ?
-            Eigen::Matrix<double, 3, 1>::Zero() :
-            (C_wv * C_q * state.Get<StatePicIdx>() + C_wv
-                    * (-state.Get<StatePwvIdx>()
-                        + state.Get<StateDefinition_T::p>())).eval();  // L
+            Eigen::Matrix<Scalar_T, 3, 1>::Zero() :
+            (C_wv * C_q * state.template Get<StatePicIdx>() + C_wv
+                    * (-state.template Get<StatePwvIdx>()
+                        + state.template Get<StateDefinition_T::p>())).eval();  // L
 
-    H.block<3, 3>(0, kIdxstartcorr_qwv) =
+    H.template block<3, 3>(0, kIdxstartcorr_qwv) =
         driftwvattfix ?
-            Eigen::Matrix<double, 3, 3>::Zero() : (-C_wv * skewold).eval();  // q_wv
+            Eigen::Matrix<Scalar_T, 3, 3>::Zero() : (-C_wv * skewold).eval();  // q_wv
 
-    H.block<3, 3>(0, kIdxstartcorr_pic) =
+    H.template block<3, 3>(0, kIdxstartcorr_pic) =
         calibposfix ?
-            Eigen::Matrix<double, 3, 3>::Zero() :
-            (C_wv * C_q * state.Get<StateLIdx>()(0)).eval();  //p_ic
+            Eigen::Matrix<Scalar_T, 3, 3>::Zero() :
+            (C_wv * C_q * state.template Get<StateLIdx>()(0)).eval();  //p_ic
 
 
     // TODO (slynen): Check scale commenting
-    H.block<3, 3>(0, kIdxstartcorr_pwv) =
+    H.template block<3, 3>(0, kIdxstartcorr_pwv) =
         driftwvposfix ?
-            Eigen::Matrix<double, 3, 3>::Zero() :
-            (-Eigen::Matrix<double, 3, 3>::Identity()
+            Eigen::Matrix<Scalar_T, 3, 3>::Zero() :
+            (-Eigen::Matrix<Scalar_T, 3, 3>::Identity()
             /* * state.Get<StateLIdx>()(0)*/).eval();  //p_wv
 
     // Attitude.
-    H.block<3, 3>(3, kIdxstartcorr_q) = C_ci;  // q
+    H.template block<3, 3>(3, kIdxstartcorr_q) = C_ci;  // q
 
-    H.block<3, 3>(3, kIdxstartcorr_qwv) =
+    H.template block<3, 3>(3, kIdxstartcorr_qwv) =
         driftwvattfix ?
-            Eigen::Matrix<double, 3, 3>::Zero() :
+            Eigen::Matrix<Scalar_T, 3, 3>::Zero() :
             (C_ci * C_q.transpose()).eval();  // q_wv
 
-    H.block<3, 3>(3, kIdxstartcorr_qic) =
+    H.template block<3, 3>(3, kIdxstartcorr_qic) =
         calibattfix ?
-            Eigen::Matrix<double, 3, 3>::Zero() :
-            Eigen::Matrix<double, 3, 3>::Identity().eval();  //q_ic
+            Eigen::Matrix<Scalar_T, 3, 3>::Zero() :
+            Eigen::Matrix<Scalar_T, 3, 3>::Identity().eval();  //q_ic
 
     // This line breaks the filter if a position sensor in the global frame is
     // available or if we want to set a global yaw rotation.
@@ -281,41 +296,42 @@ struct PoseMeasurement : public PoseMeasurementBase {
   virtual void Apply(shared_ptr<EKFState_T> state_nonconst_new,
                      msf_core::MSF_Core<EKFState_T>& core) {
 
-    if (isabsolute_) {  // Does this measurement refer to an absolute measurement,
+    if (this->isabsolute_) {  // Does this measurement refer to an absolute measurement,
       // or is is just relative to the last measurement.
       // Get a const ref, so we can read core states
       const EKFState_T& state = *state_nonconst_new;
       // init variables
-      Eigen::Matrix<double, nMeasurements,
+      Eigen::Matrix<Scalar_T, nMeasurements,
           msf_core::MSF_Core<EKFState_T>::nErrorStatesAtCompileTime> H_new;
-      Eigen::Matrix<double, nMeasurements, 1> r_old;
+      Eigen::Matrix<Scalar_T, nMeasurements, 1> r_old;
 
       CalculateH(state_nonconst_new, H_new);
 
       // Get rotation matrices.
-      Eigen::Matrix<double, 3, 3> C_wv = state.Get<StateQwvIdx>()
+      Eigen::Matrix<Scalar_T, 3, 3> C_wv = state.template Get<StateQwvIdx>()
 
           .conjugate().toRotationMatrix();
-      Eigen::Matrix<double, 3, 3> C_q = state.Get<StateDefinition_T::q>()
+      Eigen::Matrix<Scalar_T, 3, 3> C_q = state.template Get<StateDefinition_T::q>()
           .conjugate().toRotationMatrix();
 
       // Construct residuals.
       // Position.
-      r_old.block<3, 1>(0, 0) = z_p_
+      r_old.template block<3, 1>(0, 0) = z_p_.template cast<Scalar_T>()
           - (C_wv.transpose()
-              * (-state.Get<StatePwvIdx>()
-                  + state.Get<StateDefinition_T::p>()
-                  + C_q.transpose() * state.Get<StatePicIdx>()))
-              * state.Get<StateLIdx>();
+              * (-state.template Get<StatePwvIdx>()
+                  + state.template Get<StateDefinition_T::p>()
+                  + C_q.transpose() * state.template Get<StatePicIdx>()))
+              * state.template Get<StateLIdx>();
 
       // Attitude.
-      Eigen::Quaternion<double> q_err;
-      q_err = (state.Get<StateQwvIdx>()
-          * state.Get<StateDefinition_T::q>()
-          * state.Get<StateQicIdx>()).conjugate() * z_q_;
-      r_old.block<3, 1>(3, 0) = q_err.vec() / q_err.w() * 2;
+      Eigen::Quaternion<Scalar_T> q_err;
+      q_err = (state.template Get<StateQwvIdx>()
+          * state.template Get<StateDefinition_T::q>()
+          * state.template Get<StateQicIdx>()).conjugate()
+          * z_q_.template cast<Scalar_T>();
+      r_old.template block<3, 1>(3, 0) = q_err.vec() / q_err.w() * 2;
       // Vision world yaw drift.
-      q_err = state.Get<StateQwvIdx>();
+      q_err = state.template Get<StateQwvIdx>();
 
       r_old(6, 0) = -2 * (q_err.w() * q_err.z() + q_err.x() * q_err.y())
           / (1 - 2 * (q_err.y() * q_err.y() + q_err.z() * q_err.z()));
@@ -330,15 +346,15 @@ struct PoseMeasurement : public PoseMeasurementBase {
         MSF_WARN_STREAM(
             "state: "<<const_cast<EKFState_T&>(state). ToEigenVector().transpose());
       }
-      if (!CheckForNumeric(R_, "R_")) {
-        MSF_ERROR_STREAM("R_: "<<R_);
+      if (!CheckForNumeric(this->R_, "R_")) {
+        MSF_ERROR_STREAM("R_: "<<this->R_);
         MSF_WARN_STREAM(
             "state: "<<const_cast<EKFState_T&>(state). ToEigenVector().transpose());
       }
 
       // Call update step in base class.
       this->CalculateAndApplyCorrection(state_nonconst_new, core, H_new, r_old,
-                                        R_);
+                                        this->R_, HBlocks_T());
     } else {
       // Init variables: Get previous measurement.
       shared_ptr < msf_core::MSF_MeasurementBase<EKFState_T> > prevmeas_base =
@@ -375,10 +391,10 @@ struct PoseMeasurement : public PoseMeasurementBase {
       const EKFState_T& state_new = *state_nonconst_new;
       const EKFState_T& state_old = *state_nonconst_old;
 
-      Eigen::Matrix<double, nMeasurements,
+      Eigen::Matrix<Scalar_T, nMeasurements,
           msf_core::MSF_Core<EKFState_T>::nErrorStatesAtCompileTime> H_new,
           H_old;
-      Eigen::Matrix<double, nMeasurements, 1> r_new, r_old;
+      Eigen::Matrix<Scalar_T, nMeasurements, 1> r_new, r_old;
 
       CalculateH(state_nonconst_old, H_old);
 
@@ -387,48 +403,52 @@ struct PoseMeasurement : public PoseMeasurementBase {
       CalculateH(state_nonconst_new, H_new);
 
       //TODO (slynen): check that both measurements have the same states fixed!
-      Eigen::Matrix<double, 3, 3> C_wv_old, C_wv_new;
-      Eigen::Matrix<double, 3, 3> C_q_old, C_q_new;
+      Eigen::Matrix<Scalar_T, 3, 3> C_wv_old, C_wv_new;
+      Eigen::Matrix<Scalar_T, 3, 3> C_q_old, C_q_new;
 
-      C_wv_new = state_new.Get<StateQwvIdx>().conjugate().toRotationMatrix();
-      C_q_new = state_new.Get<StateDefinition_T::q>().conjugate()
+      C_wv_new = state_new.template Get<StateQwvIdx>().conjugate()
+          .toRotationMatrix();
+      C_q_new = state_new.template Get<StateDefinition_T::q>().conjugate()
           .toRotationMatrix();
 
-      C_wv_old = state_old.Get<StateQwvIdx>().conjugate().toRotationMatrix();
-      C_q_old = state_old.Get<StateDefinition_T::q>().conjugate()
+      C_wv_old = state_old.template Get<StateQwvIdx>().conjugate()
+          .toRotationMatrix();
+      C_q_old = state_old.template Get<StateDefinition_T::q>().conjugate()
           .toRotationMatrix();
 
       // Construct residuals.
       // Position:
-      Eigen::Matrix<double, 3, 1> diffprobpos = (C_wv_new.transpose()
-          * (-state_new.Get<StatePwvIdx>() + state_new.Get<StateDefinition_T::p>()
-              + C_q_new.transpose() * state_new.Get<StatePicIdx>()))
-          * state_new.Get<StateLIdx>() - (C_wv_old.transpose()
-          * (-state_old.Get<StatePwvIdx>() + state_old.Get<StateDefinition_T::p>()
-              + C_q_old.transpose() * state_old.Get<StatePicIdx>()))
-              * state_old.Get<StateLIdx>();
+      Eigen::Matrix<Scalar_T, 3, 1> diffprobpos = (C_wv_new.transpose()
+          * (-state_new.template Get<StatePwvIdx>() + state_new.template Get<StateDefinition_T::p>()
+              + C_q_new.transpose() * state_new.template Get<StatePicIdx>()))
+          * state_new.template Get<StateLIdx>() - (C_wv_old.transpose()
+          * (-state_old.template Get<StatePwvIdx>() + state_old.template Get<StateDefinition_T::p>()
+              + C_q_old.transpose() * state_old.template Get<StatePicIdx>()))
+              * state_old.template Get<StateLIdx>();
 
 
-      Eigen::Matrix<double, 3, 1> diffmeaspos = z_p_ - prevmeas->z_p_;
+      Eigen::Matrix<Scalar_T, 3, 1> diffmeaspos = (z_p_ - prevmeas->z_p_)
+          .template cast<Scalar_T>();
 
-      r_new.block<3, 1>(0, 0) = diffmeaspos - diffprobpos;
+      r_new.template block<3, 1>(0, 0) = diffmeaspos - diffprobpos;
 
       // Attitude:
-      Eigen::Quaternion<double> diffprobatt = (state_new.Get<StateQwvIdx>()
-          * state_new.Get<StateDefinition_T::q>()
-          * state_new.Get<StateQicIdx>()).conjugate()
-          * (state_old.Get<StateQwvIdx>()
-              * state_old.Get<StateDefinition_T::q>()
-              * state_old.Get<StateQicIdx>());
+      Eigen::Quaternion<Scalar_T> diffprobatt = (state_new.template Get<StateQwvIdx>()
+          * state_new.template Get<StateDefinition_T::q>()
+          * state_new.template Get<StateQicIdx>()).conjugate()
+          * (state_old.template Get<StateQwvIdx>()
+              * state_old.template Get<StateDefinition_T::q>()
+              * state_old.template Get<StateQicIdx>());
 
-      Eigen::Quaternion<double> diffmeasatt = z_q_.conjugate() * prevmeas->z_q_;
+      Eigen::Quaternion<Scalar_T> diffmeasatt = (z_q_.conjugate()
+          * prevmeas->z_q_).template cast<Scalar_T>();
 
-      Eigen::Quaternion<double> q_err;
+      Eigen::Quaternion<Scalar_T> q_err;
       q_err = diffprobatt.conjugate() * diffmeasatt;
 
-      r_new.block<3, 1>(3, 0) = q_err.vec() / q_err.w() * 2;
+      r_new.template block<3, 1>(3, 0) = q_err.vec() / q_err.w() * 2;
       // Vision world yaw drift.
-      q_err = state_new.Get<StateQwvIdx>();
+      q_err = state_new.template Get<StateQwvIdx>();
 
       r_new(6, 0) = -2 * (q_err.w() * q_err.z() + q_err.x() * q_err.y())
           / (1 - 2 * (q_err.y() * q_err.y() + q_err.z() * q_err.z()));
@@ -443,8 +463,8 @@ struct PoseMeasurement : public PoseMeasurementBase {
         MSF_WARN_STREAM(
             "state: "<<const_cast<EKFState_T&>(state_new). ToEigenVector().transpose());
       }
-      if (!CheckForNumeric(R_, "R_")) {
-        MSF_ERROR_STREAM("R_: "<<R_);
+      if (!CheckForNumeric(this->R_, "R_")) {
+        MSF_ERROR_STREAM("R_: "<<this->R_);
         MSF_WARN_STREAM(
             "state: "<<const_cast<EKFState_T&>(state_new). ToEigenVector().transpose());
       }
@@ -452,7 +472,7 @@ struct PoseMeasurement : public PoseMeasurementBase {
       // Call update step in base class.
       this->CalculateAndApplyCorrectionRelative(state_nonconst_old,
                                                 state_nonconst_new, core, H_old,
-                                                H_new, r_new, R_);
+                                                H_new, r_new, this->R_);
 
     }
   }
@@ -29,7 +29,7 @@ namespace msf_pose_sensor {
 
 template<typename MEASUREMENT_TYPE, typename MANAGER_TYPE>
 class PoseSensorHandler : public msf_core::SensorHandler<
-    typename msf_updates::EKFState> {
+    typename MEASUREMENT_TYPE::EKFState_T> {
  private:
 
   Eigen::Quaternion<double> z_q_;  ///< Attitude measurement camera seen from world.
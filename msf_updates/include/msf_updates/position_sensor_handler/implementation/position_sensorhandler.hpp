@@ -27,8 +27,8 @@ template<typename MEASUREMENT_TYPE, typename MANAGER_TYPE>
 PositionSensorHandler<MEASUREMENT_TYPE, MANAGER_TYPE>::PositionSensorHandler(
     MANAGER_TYPE& meas, std::string topic_namespace,
     std::string parameternamespace)
-    : SensorHandler<msf_updates::EKFState>(meas, topic_namespace,
-                                           parameternamespace),
+    : msf_core::SensorHandler<typename MEASUREMENT_TYPE::EKFState_T>(
+          meas, topic_namespace, parameternamespace),
       n_zp_(1e-6),
       delay_(0) {
   ros::NodeHandle pnh("~/position_sensor");
@@ -85,7 +85,7 @@ void PositionSensorHandler<MEASUREMENT_TYPE, MANAGER_TYPE>::ProcessPositionMeasu
     const sensor_fusion_comm::PointWithCovarianceStampedConstPtr& msg) {
   // Get the fixed states.
   int fixedstates = 0;
-  static_assert(msf_updates::EKFState::nStateVarsAtCompileTime < 32, "Your state "
+  static_assert(MEASUREMENT_TYPE::EKFState_T::nStateVarsAtCompileTime < 32, "Your state "
       "has more than 32 variables. The code needs to be changed here to have a "
       "larger variable to mark the fixed_states");
   // Do not exceed the 32 bits of int.
@@ -99,11 +99,11 @@ void PositionSensorHandler<MEASUREMENT_TYPE, MANAGER_TYPE>::ProcessPositionMeasu
   }
 
   // Get all the fixed states and set flag bits.
-  MANAGER_TYPE* mngr = dynamic_cast<MANAGER_TYPE*>(&manager_);
+  MANAGER_TYPE* mngr = dynamic_cast<MANAGER_TYPE*>(&this->manager_);
 
   if (mngr) {
     if (mngr->Getcfg().position_fixed_p_ip) {
-      fixedstates |= 1 << msf_updates::EKFState::StateDefinition_T::p_ip;
+      fixedstates |= 1 << MEASUREMENT_TYPE::StateDefinition_T::p_ip;
     }
   }
 
@@ -113,7 +113,8 @@ void PositionSensorHandler<MEASUREMENT_TYPE, MANAGER_TYPE>::ProcessPositionMeasu
                                provides_absolute_measurements_, this->sensorID,
                                fixedstates));
 
-  meas->MakeFromSensorReading(msg, msg->header.stamp.toSec() - delay_);
+  meas->MakeFromSensorReading(
+      msg, msg->header.stamp.toNSec() - msf_core::SecondsToNanoseconds(delay_));
 
   z_p_ = meas->z_p_;  // Store this for the init procedure.
 
@@ -33,18 +33,27 @@ enum {
 /**
  * \brief A measurement as provided by a position sensor, e.g. Total Station, GPS.
  */
-typedef msf_core::MSF_Measurement<
-    sensor_fusion_comm::PointWithCovarianceStamped,
-    Eigen::Matrix<double, nMeasurements, nMeasurements>, msf_updates::EKFState> PositionMeasurementBase;
-struct PositionMeasurement : public PositionMeasurementBase {
+template<typename STATE_TYPE>
+struct PositionMeasurementBase {
+  typedef msf_core::MSF_Measurement<
+      sensor_fusion_comm::PointWithCovarianceStamped,
+      Eigen::Matrix<double, nMeasurements, nMeasurements>, STATE_TYPE> type;
+};
+
+/**
+ * \brief The position measurement for a state of the filter, H and the
+ * residuals are computed in the scalar of the state.
+ */
+template<typename STATE_TYPE = msf_updates::EKFState>
+struct PositionMeasurement : public PositionMeasurementBase<STATE_TYPE>::type {
  private:
-  typedef PositionMeasurementBase Measurement_t;
-  typedef Measurement_t::Measurement_ptr measptr_t;
+  typedef typename PositionMeasurementBase<STATE_TYPE>::type Measurement_t;
+  typedef typename Measurement_t::Measurement_ptr measptr_t;
 
   virtual void MakeFromSensorReadingImpl(measptr_t msg) {
 
     Eigen::Matrix<double, nMeasurements,
-        msf_core::MSF_Core<msf_updates::EKFState>::nErrorStatesAtCompileTime> H_old;
+        msf_core::MSF_Core<EKFState_T>::nErrorStatesAtCompileTime> H_old;
     Eigen::Matrix<double, nMeasurements, 1> r_old;
 
     H_old.setZero();
@@ -57,15 +66,15 @@ struct PositionMeasurement : public PositionMeasurementBase {
     {
 
       const double s_zp = n_zp_ * n_zp_;
-      R_ = (Eigen::Matrix<double, nMeasurements, 1>() << s_zp, s_zp, s_zp)
+      this->R_ = (Eigen::Matrix<double, nMeasurements, 1>() << s_zp, s_zp, s_zp)
           .finished().asDiagonal();
 
     } else {  // Tke covariance from sensor.
 
-      R_.block<3, 3>(0, 0) = msf_core::Matrix3(&msg->covariance[0]);
+      this->R_.template block<3, 3>(0, 0) = msf_core::Matrix3(&msg->covariance[0]);
 
       if (msg->header.seq % 100 == 0) {  // Only do this check from time to time.
-        if (R_.block<3, 3>(0, 0).determinant() < -0.01)
+        if (this->R_.template block<3, 3>(0, 0).determinant() < -0.01)
           MSF_WARN_STREAM_THROTTLE(
               60, "The covariance matrix you provided for "
               "the position sensor is not positive definite");
@@ -80,14 +89,19 @@ struct PositionMeasurement : public PositionMeasurementBase {
   bool fixed_covariance_;
   int fixedstates_;
 
-  typedef msf_updates::EKFState EKFState_T;
-  typedef EKFState_T::StateSequence_T StateSequence_T;
-  typedef EKFState_T::StateDefinition_T StateDefinition_T;
+  typedef STATE_TYPE EKFState_T;
+  typedef typename EKFState_T::StateSequence_T StateSequence_T;
+  typedef typename EKFState_T::StateDefinition_T StateDefinition_T;
+  typedef typename EKFState_T::Scalar_T Scalar_T;
+
+  /// The states H is nonzero for.
+  typedef msf_core::BlockSparseJacobian<StateSequence_T, StateDefinition_T::p,
+      StateDefinition_T::q, StateDefinition_T::p_ip> HBlocks_T;
   virtual ~PositionMeasurement() {
   }
   PositionMeasurement(double n_zp, bool fixed_covariance,
                       bool isabsoluteMeasurement, int sensorID, int fixedstates)
-      : PositionMeasurementBase(isabsoluteMeasurement, sensorID),
+      : Measurement_t(isabsoluteMeasurement, sensorID),
         n_zp_(n_zp),
         fixed_covariance_(fixed_covariance),
         fixedstates_(fixedstates) {
@@ -98,19 +112,19 @@ struct PositionMeasurement : public PositionMeasurementBase {
 
   virtual void CalculateH(
       shared_ptr<EKFState_T> state_in,
-      Eigen::Matrix<double, nMeasurements,
+      Eigen::Matrix<Scalar_T, nMeasurements,
           msf_core::MSF_Core<EKFState_T>::nErrorStatesAtCompileTime>& H) {
     const EKFState_T& state = *state_in;  // Get a const ref, so we can read core states.
 
     H.setZero();
 
     // Get rotation matrices.
-    Eigen::Matrix<double, 3, 3> C_q = state.Get<StateDefinition_T::q>()
+    Eigen::Matrix<Scalar_T, 3, 3> C_q = state.template Get<StateDefinition_T::q>()
         .conjugate().toRotationMatrix();
 
     // Preprocess for elements in H matrix.
-    Eigen::Matrix<double, 3, 3> p_prism_imu_sk = Skew(
-        state.Get<StateDefinition_T::p_ip>());
+    Eigen::Matrix<Scalar_T, 3, 3> p_prism_imu_sk = Skew(
+        state.template Get<StateDefinition_T::p_ip>());
 
     // Get indices of states in error vector.
     enum {
@@ -128,17 +142,17 @@ struct PositionMeasurement : public PositionMeasurementBase {
 
     // Clear crosscorrelations.
     if (fixed_p_pos_imu)
-      state_in->ClearCrossCov<StateDefinition_T::p_ip>();
+      state_in->template ClearCrossCov<StateDefinition_T::p_ip>();
 
     // Construct H matrix:
     // Position:
-    H.block<3, 3>(0, idxstartcorr_p_) = Eigen::Matrix<double, 3, 3>::Identity();  // p
+    H.template block<3, 3>(0, idxstartcorr_p_) = Eigen::Matrix<Scalar_T, 3, 3>::Identity();  // p
 
-    H.block<3, 3>(0, idxstartcorr_q_) = -C_q.transpose() * p_prism_imu_sk;  // q
+    H.template block<3, 3>(0, idxstartcorr_q_) = -C_q.transpose() * p_prism_imu_sk;  // q
 
-    H.block<3, 3>(0, idxstartcorr_p_pi_) =
+    H.template block<3, 3>(0, idxstartcorr_p_pi_) =
         fixed_p_pos_imu ?
-            Eigen::Matrix<double, 3, 3>::Zero() : (C_q.transpose()).eval();  //p_pos_imu_
+            Eigen::Matrix<Scalar_T, 3, 3>::Zero() : (C_q.transpose()).eval();  //p_pos_imu_
 
   }
 
@@ -148,26 +162,26 @@ struct PositionMeasurement : public PositionMeasurementBase {
   virtual void Apply(shared_ptr<EKFState_T> state_nonconst_new,
                      msf_core::MSF_Core<EKFState_T>& core) {
 
-    if (isabsolute_) {  // Does this measurement refer to an absolute measurement,
+    if (this->isabsolute_) {  // Does this measurement refer to an absolute measurement,
       // or is it relative to the last measurement.
       // Get a const ref, so we can read core states.
       const EKFState_T& state = *state_nonconst_new;
       // init variables
-      Eigen::Matrix<double, nMeasurements,
+      Eigen::Matrix<Scalar_T, nMeasurements,
           msf_core::MSF_Core<EKFState_T>::nErrorStatesAtCompileTime> H_new;
-      Eigen::Matrix<double, nMeasurements, 1> r_old;
+      Eigen::Matrix<Scalar_T, nMeasurements, 1> r_old;
 
       CalculateH(state_nonconst_new, H_new);
 
       // Get rotation matrices.
-      Eigen::Matrix<double, 3, 3> C_q = state.Get<StateDefinition_T::q>()
+      Eigen::Matrix<Scalar_T, 3, 3> C_q = state.template Get<StateDefinition_T::q>()
           .conjugate().toRotationMatrix();
 
       // Construct residuals:
       // Position
-      r_old.block<3, 1>(0, 0) = z_p_
-          - (state.Get<StateDefinition_T::p>()
-              + C_q.transpose() * state.Get<StateDefinition_T::p_ip>());
+      r_old.template block<3, 1>(0, 0) = z_p_.template cast<Scalar_T>()
+          - (state.template Get<StateDefinition_T::p>()
+              + C_q.transpose() * state.template Get<StateDefinition_T::p_ip>());
 
       if (!CheckForNumeric(r_old, "r_old")) {
         MSF_ERROR_STREAM("r_old: "<<r_old);
@@ -179,15 +193,15 @@ struct PositionMeasurement : public PositionMeasurementBase {
         MSF_WARN_STREAM(
             "state: "<<const_cast<EKFState_T&>(state). ToEigenVector().transpose());
       }
-      if (!CheckForNumeric(R_, "R_")) {
-        MSF_ERROR_STREAM("R_: "<<R_);
+      if (!CheckForNumeric(this->R_, "R_")) {
+        MSF_ERROR_STREAM("R_: "<<this->R_);
         MSF_WARN_STREAM(
             "state: "<<const_cast<EKFState_T&>(state). ToEigenVector().transpose());
       }
 
       // Call update step in base class.
       this->CalculateAndApplyCorrection(state_nonconst_new, core, H_new, r_old,
-                                        R_);
+                                        this->R_, HBlocks_T());
     } else {
       MSF_ERROR_STREAM_THROTTLE(
           1, "You chose to apply the position measurement "
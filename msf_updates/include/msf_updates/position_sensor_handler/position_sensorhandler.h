@@ -30,7 +30,7 @@ namespace msf_position_sensor {
 
 template<typename MEASUREMENT_TYPE, typename MANAGER_TYPE>
 class PositionSensorHandler : public msf_core::SensorHandler<
-    typename msf_updates::EKFState> {
+    typename MEASUREMENT_TYPE::EKFState_T> {
  private:
 
   Eigen::Matrix<double, 3, 1> z_p_;  ///< Position measurement.
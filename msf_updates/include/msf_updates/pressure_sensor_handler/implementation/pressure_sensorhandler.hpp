@@ -57,7 +57,7 @@ void PressureSensorHandler::MeasurementCallback(
   shared_ptr<pressure_measurement::PressureMeasurement> meas(
       new pressure_measurement::PressureMeasurement(n_zp_, true,
                                                     this->sensorID));
-  meas->MakeFromSensorReading(msg, msg->header.stamp.toSec());
+  meas->MakeFromSensorReading(msg, msg->header.stamp.toNSec());
 
   z_p_ = meas->z_p_;  // Store this for the init procedure.
 
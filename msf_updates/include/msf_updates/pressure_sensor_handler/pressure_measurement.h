@@ -58,6 +58,10 @@ struct PressureMeasurement : public PressureMeasurementBase {
 
   typedef msf_updates::EKFState EKFState_T;
   typedef EKFState_T::StateDefinition_T StateDefinition_T;
+
+  /// The states H is nonzero for.
+  typedef msf_core::BlockSparseJacobian<EKFState_T::StateSequence_T,
+      StateDefinition_T::p, StateDefinition_T::b_p> HBlocks_T;
   virtual ~PressureMeasurement() { }
   PressureMeasurement(double n_zp, bool isabsoluteMeasurement, int sensorID)
       : PressureMeasurementBase(isabsoluteMeasurement, sensorID),
@@ -110,7 +114,8 @@ struct PressureMeasurement : public PressureMeasurementBase {
         - state.Get<StateDefinition_T::p>().block<1, 1>(2, 0);
 
     // Call update step in base class.
-    this->CalculateAndApplyCorrection(non_const_state, core, H_old, r_old, R_);
+    this->CalculateAndApplyCorrection(non_const_state, core, H_old, r_old, R_,
+                                      HBlocks_T());
   }
 };
 }  // namespace pressure_measurement
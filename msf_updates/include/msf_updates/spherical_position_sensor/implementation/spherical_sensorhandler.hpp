@@ -108,7 +108,8 @@ void AngleSensorHandler<MEASUREMENT_TYPE, MANAGER_TYPE>::MeasurementCallback(
                            provides_absolute_measurements_, this->sensorID,
                            fixedstates));
 
-  meas->MakeFromSensorReading(msg, msg->header.stamp.toSec() - delay_);
+  meas->MakeFromSensorReading(
+      msg, msg->header.stamp.toNSec() - msf_core::SecondsToNanoseconds(delay_));
 
   z_a_ = meas->z_a_;  //store this for the init procedure
 
@@ -198,7 +199,8 @@ void DistanceSensorHandler<MEASUREMENT_TYPE, MANAGER_TYPE>::MeasurementCallback(
                            provides_absolute_measurements_, this->sensorID,
                            fixedstates));
 
-  meas->MakeFromSensorReading(msg, msg->header.stamp.toSec() - delay_);
+  meas->MakeFromSensorReading(
+      msg, msg->header.stamp.toNSec() - msf_core::SecondsToNanoseconds(delay_));
 
   z_d_ = meas->z_d_;  //store this for the init procedure
 
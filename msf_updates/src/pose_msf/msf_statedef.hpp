@@ -44,34 +44,40 @@ enum StateDefinition {  // Must not manually set the enum values!
 namespace {
 
 /***
- * Setup core state, then auxiliary state.
+ * Setup core state, then auxiliary state, in the scalar of the filter.
  */
-typedef boost::fusion::vector<
-    // States varying during propagation - must not change the ordering here for
-    // now, CalcQ has the ordering hardcoded
-    msf_core::StateVar_T<Eigen::Matrix<double, 3, 1>, p,
-        msf_core::CoreStateWithPropagation>,  ///< Translation from the world frame to the IMU frame expressed in the world frame.
-    msf_core::StateVar_T<Eigen::Matrix<double, 3, 1>, v,
-        msf_core::CoreStateWithPropagation>,  ///< Velocity of the IMU frame expressed in the world frame.
-    msf_core::StateVar_T<Eigen::Quaternion<double>, q,
-        msf_core::CoreStateWithPropagation>,  ///< Rotation from the world frame to the IMU frame expressed in the world frame.
-    msf_core::StateVar_T<Eigen::Matrix<double, 3, 1>, b_w,
-        msf_core::CoreStateWithoutPropagation>,  ///< Gyro biases.
-    msf_core::StateVar_T<Eigen::Matrix<double, 3, 1>, b_a,
-        msf_core::CoreStateWithoutPropagation>,  ///< Acceleration biases.
+template<typename Scalar_T>
+struct FullState {
+  typedef boost::fusion::vector<
+      // States varying during propagation - must not change the ordering here for
+      // now, CalcQ has the ordering hardcoded
+      msf_core::StateVar_T<Eigen::Matrix<Scalar_T, 3, 1>, p,
+          msf_core::CoreStateWithPropagation>,  ///< Translation from the world frame to the IMU frame expressed in the world frame.
+      msf_core::StateVar_T<Eigen::Matrix<Scalar_T, 3, 1>, v,
+          msf_core::CoreStateWithPropagation>,  ///< Velocity of the IMU frame expressed in the world frame.
+      msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, q,
+          msf_core::CoreStateWithPropagation>,  ///< Rotation from the world frame to the IMU frame expressed in the world frame.
+      msf_core::StateVar_T<Eigen::Matrix<Scalar_T, 3, 1>, b_w,
+          msf_core::CoreStateWithoutPropagation>,  ///< Gyro biases.
+      msf_core::StateVar_T<Eigen::Matrix<Scalar_T, 3, 1>, b_a,
+          msf_core::CoreStateWithoutPropagation>,  ///< Acceleration biases.
 
-    // States not varying during propagation.
-    msf_core::StateVar_T<Eigen::Matrix<double, 1, 1>, L, msf_core::Auxiliary>,  ///< Visual scale.
-    msf_core::StateVar_T<Eigen::Quaternion<double>, q_wv,
-        msf_core::AuxiliaryNonTemporalDrifting>,  ///< Rotation from the world frame to the frame in which the pose is measured expressed in the world frame.
-    msf_core::StateVar_T<Eigen::Matrix<double, 3, 1>, p_wv>,  ///< Translation from the world frame to the frame in which the pose is measured expressed in the world frame.
-    msf_core::StateVar_T<Eigen::Quaternion<double>, q_ic>,  ///< Rotation from the IMU frame to the camera frame expressed in the IMU frame.
-    msf_core::StateVar_T<Eigen::Matrix<double, 3, 1>, p_ic>  ///< Translation from the IMU frame to the camera frame expressed in the IMU frame.
+      // States not varying during propagation.
+      msf_core::StateVar_T<Eigen::Matrix<Scalar_T, 1, 1>, L, msf_core::Auxiliary>,  ///< Visual scale.
+      msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, q_wv,
+          msf_core::AuxiliaryNonTemporalDrifting>,  ///< Rotation from the world frame to the frame in which the pose is measured expressed in the world frame.
+      msf_core::StateVar_T<Eigen::Matrix<Scalar_T, 3, 1>, p_wv>,  ///< Translation from the world frame to the frame in which the pose is measured expressed in the world frame.
+      msf_core::StateVar_T<Eigen::Quaternion<Scalar_T>, q_ic>,  ///< Rotation from the IMU frame to the camera frame expressed in the IMU frame.
+      msf_core::StateVar_T<Eigen::Matrix<Scalar_T, 3, 1>, p_ic>  ///< Translation from the IMU frame to the camera frame expressed in the IMU frame.
 
-> fullState_T;
+  > type;
+};
+typedef FullState<double>::type fullState_T;
 }
 
 typedef msf_core::GenericState_T<fullState_T, StateDefinition> EKFState;  ///< The state we want to use in this EKF.
+/// The same state in single precision.
+typedef msf_core::GenericState_T<FullState<float>::type, StateDefinition> EKFStateFloat;
 typedef shared_ptr<EKFState> EKFStatePtr;
 typedef shared_ptr<const EKFState> EKFStateConstPtr;
 
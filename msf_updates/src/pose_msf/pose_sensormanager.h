@@ -36,27 +36,38 @@ typedef msf_updates::SinglePoseSensorConfig Config_T;
 typedef dynamic_reconfigure::Server<Config_T> ReconfigureServer;
 typedef shared_ptr<ReconfigureServer> ReconfigureServerPtr;
 
-class PoseSensorManager : public msf_core::MSF_SensorManagerROS<
-    msf_updates::EKFState> {
-  typedef PoseSensorHandler<msf_updates::pose_measurement::PoseMeasurement<>,
-      PoseSensorManager> PoseSensorHandler_T;
-  friend class PoseSensorHandler<msf_updates::pose_measurement::PoseMeasurement<>,
-      PoseSensorManager> ;
+/**
+ * \brief The pose filter, STATE_TYPE selects the scalar the filter runs in:
+ * msf_updates::EKFState or msf_updates::EKFStateFloat.
+ */
+template<typename STATE_TYPE = msf_updates::EKFState>
+class PoseSensorManager : public msf_core::MSF_SensorManagerROS<STATE_TYPE> {
+ public:
+  typedef STATE_TYPE EKFState_T;
+  typedef typename EKFState_T::StateSequence_T StateSequence_T;
+  typedef typename EKFState_T::StateDefinition_T StateDefinition_T;
+  typedef typename EKFState_T::Scalar_T Scalar_T;
+
+ private:
+  typedef msf_updates::pose_measurement::PoseMeasurement<StateDefinition_T::L,
+      StateDefinition_T::q_ic, StateDefinition_T::p_ic,
+      StateDefinition_T::q_wv, StateDefinition_T::p_wv, EKFState_T>
+      PoseMeasurement_T;
+  typedef PoseSensorHandler<PoseMeasurement_T, PoseSensorManager>
+      PoseSensorHandler_T;
+  friend class PoseSensorHandler<PoseMeasurement_T, PoseSensorManager> ;
  public:
-  typedef msf_updates::EKFState EKFState_T;
-  typedef EKFState_T::StateSequence_T StateSequence_T;
-  typedef EKFState_T::StateDefinition_T StateDefinition_T;
 
   PoseSensorManager(ros::NodeHandle pnh = ros::NodeHandle("~/pose_sensor")) {
     bool distortmeas = false;  ///< Distort the pose measurements.
 
     imu_handler_.reset(
-        new msf_core::IMUHandler_ROS<msf_updates::EKFState>(*this, "msf_core",
-                                                            "imu_handler"));
+        new msf_core::IMUHandler_ROS<EKFState_T>(*this, "msf_core",
+                                                 "imu_handler"));
     pose_handler_.reset(
         new PoseSensorHandler_T(*this, "", "pose_sensor", distortmeas));
 
-    AddHandler(pose_handler_);
+    this->AddHandler(pose_handler_);
 
     reconf_server_.reset(new ReconfigureServer(pnh));
     ReconfigureServer::CallbackType f = boost::bind(&PoseSensorManager::Config,
@@ -76,7 +87,7 @@ class PoseSensorManager : public msf_core::MSF_SensorManagerROS<
   }
 
  private:
-  shared_ptr<msf_core::IMUHandler_ROS<msf_updates::EKFState> > imu_handler_;
+  shared_ptr<msf_core::IMUHandler_ROS<EKFState_T> > imu_handler_;
   shared_ptr<PoseSensorHandler_T> pose_handler_;
 
   Config_T config_;
@@ -154,7 +165,7 @@ class PoseSensorManager : public msf_core::MSF_SensorManagerROS<
   void Init(double scale) const {
     Eigen::Matrix<double, 3, 1> p, v, b_w, b_a, g, w_m, a_m, p_ic, p_vc, p_wv;
     Eigen::Quaternion<double> q, q_wv, q_ic, q_cv;
-    msf_core::MSF_Core<EKFState_T>::ErrorStateCov P;
+    typename msf_core::MSF_Core<EKFState_T>::ErrorStateCov P;
 
     // init values
     g << 0, 0, 9.81;	        /// Gravity.
@@ -211,34 +222,43 @@ class PoseSensorManager : public msf_core::MSF_SensorManagerROS<
     shared_ptr < msf_core::MSF_InitMeasurement<EKFState_T>
         > meas(new msf_core::MSF_InitMeasurement<EKFState_T>(true));
 
-    meas->SetStateInitValue < StateDefinition_T::p > (p);
-    meas->SetStateInitValue < StateDefinition_T::v > (v);
-    meas->SetStateInitValue < StateDefinition_T::q > (q);
-    meas->SetStateInitValue < StateDefinition_T::b_w > (b_w);
-    meas->SetStateInitValue < StateDefinition_T::b_a > (b_a);
-    meas->SetStateInitValue < StateDefinition_T::L
-        > (Eigen::Matrix<double, 1, 1>::Constant(scale));
-    meas->SetStateInitValue < StateDefinition_T::q_wv > (q_wv);
-    meas->SetStateInitValue < StateDefinition_T::p_wv > (p_wv);
-    meas->SetStateInitValue < StateDefinition_T::q_ic > (q_ic);
-    meas->SetStateInitValue < StateDefinition_T::p_ic > (p_ic);
+    meas->template SetStateInitValue<StateDefinition_T::p>(
+        p.cast<Scalar_T>());
+    meas->template SetStateInitValue<StateDefinition_T::v>(
+        v.cast<Scalar_T>());
+    meas->template SetStateInitValue<StateDefinition_T::q>(
+        q.cast<Scalar_T>());
+    meas->template SetStateInitValue<StateDefinition_T::b_w>(
+        b_w.cast<Scalar_T>());
+    meas->template SetStateInitValue<StateDefinition_T::b_a>(
+        b_a.cast<Scalar_T>());
+    meas->template SetStateInitValue<StateDefinition_T::L>(
+        Eigen::Matrix<Scalar_T, 1, 1>::Constant(scale));
+    meas->template SetStateInitValue<StateDefinition_T::q_wv>(
+        q_wv.cast<Scalar_T>());
+    meas->template SetStateInitValue<StateDefinition_T::p_wv>(
+        p_wv.cast<Scalar_T>());
+    meas->template SetStateInitValue<StateDefinition_T::q_ic>(
+        q_ic.cast<Scalar_T>());
+    meas->template SetStateInitValue<StateDefinition_T::p_ic>(
+        p_ic.cast<Scalar_T>());
 
     SetStateCovariance(meas->GetStateCovariance());  // Call my set P function.
-    meas->Getw_m() = w_m;
-    meas->Geta_m() = a_m;
-    meas->time = ros::Time::now().toSec();
+    meas->Getw_m() = w_m.cast<Scalar_T>();
+    meas->Geta_m() = a_m.cast<Scalar_T>();
+    meas->time = ros::Time::now().toNSec();
 
     // Call initialization in core.
-    msf_core_->Init(meas);
+    this->msf_core_->Init(meas);
 
   }
 
   // Prior to this call, all states are initialized to zero/identity.
   virtual void ResetState(EKFState_T& state) const {
     //set scale to 1
-    Eigen::Matrix<double, 1, 1> scale;
+    Eigen::Matrix<Scalar_T, 1, 1> scale;
     scale << 1.0;
-    state.Set < StateDefinition_T::L > (scale);
+    state.template Set<StateDefinition_T::L>(scale);
   }
   virtual void InitState(EKFState_T& state) const {
     UNUSED(state);
@@ -258,20 +278,24 @@ class PoseSensorManager : public msf_core::MSF_SensorManagerROS<
 
     // Compute the blockwise Q values and store them with the states,
     // these then get copied by the core to the correct places in Qd.
-    state.GetQBlock<StateDefinition_T::L>() = (dt * n_L.cwiseProduct(n_L))
-        .asDiagonal();
-    state.GetQBlock<StateDefinition_T::q_wv>() =
-        (dt * nqwvv.cwiseProduct(nqwvv)).asDiagonal();
-    state.GetQBlock<StateDefinition_T::p_wv>() =
-        (dt * npwvv.cwiseProduct(npwvv)).asDiagonal();
-    state.GetQBlock<StateDefinition_T::q_ic>() =
-        (dt * nqicv.cwiseProduct(nqicv)).asDiagonal();
-    state.GetQBlock<StateDefinition_T::p_ic>() =
-        (dt * npicv.cwiseProduct(npicv)).asDiagonal();
+    state.template GetQBlock<StateDefinition_T::L>() =
+        (dt * n_L.cwiseProduct(n_L)).template cast<Scalar_T>().asDiagonal();
+    state.template GetQBlock<StateDefinition_T::q_wv>() =
+        (dt * nqwvv.cwiseProduct(nqwvv)).template cast<Scalar_T>()
+            .asDiagonal();
+    state.template GetQBlock<StateDefinition_T::p_wv>() =
+        (dt * npwvv.cwiseProduct(npwvv)).template cast<Scalar_T>()
+            .asDiagonal();
+    state.template GetQBlock<StateDefinition_T::q_ic>() =
+        (dt * nqicv.cwiseProduct(nqicv)).template cast<Scalar_T>()
+            .asDiagonal();
+    state.template GetQBlock<StateDefinition_T::p_ic>() =
+        (dt * npicv.cwiseProduct(npicv)).template cast<Scalar_T>()
+            .asDiagonal();
   }
 
   virtual void SetStateCovariance(
-      Eigen::Matrix<double, EKFState_T::nErrorStatesAtCompileTime,
+      Eigen::Matrix<Scalar_T, EKFState_T::nErrorStatesAtCompileTime,
           EKFState_T::nErrorStatesAtCompileTime>& P) const {
     UNUSED(P);
     // Nothing, we only use the simulated cov for the core plus diagonal for the
@@ -279,25 +303,25 @@ class PoseSensorManager : public msf_core::MSF_SensorManagerROS<
   }
 
   virtual void AugmentCorrectionVector(
-      Eigen::Matrix<double, EKFState_T::nErrorStatesAtCompileTime, 1>& correction) const {
+      Eigen::Matrix<Scalar_T, EKFState_T::nErrorStatesAtCompileTime, 1>& correction) const {
     UNUSED(correction);
   }
 
   virtual void SanityCheckCorrection(
       EKFState_T& delaystate,
       const EKFState_T& buffstate,
-      Eigen::Matrix<double, EKFState_T::nErrorStatesAtCompileTime, 1>& correction) const {
+      Eigen::Matrix<Scalar_T, EKFState_T::nErrorStatesAtCompileTime, 1>& correction) const {
     UNUSED(buffstate);
     UNUSED(correction);
 
     const EKFState_T& state = delaystate;
-    if (state.Get<StateDefinition_T::L>()(0) < 0) {
+    if (state.template Get<StateDefinition_T::L>()(0) < 0) {
       MSF_WARN_STREAM_THROTTLE(
           1,
-          "Negative scale detected: " << state.Get<StateDefinition_T::L>()(0) << ". Correcting to 0.1");
-      Eigen::Matrix<double, 1, 1> L_;
+          "Negative scale detected: " << state.template Get<StateDefinition_T::L>()(0) << ". Correcting to 0.1");
+      Eigen::Matrix<Scalar_T, 1, 1> L_;
       L_ << 0.1;
-      delaystate.Set < StateDefinition_T::L > (L_);
+      delaystate.template Set<StateDefinition_T::L>(L_);
     }
   }
 };
@@ -20,6 +20,8 @@ int main(int argc, char** argv) {
   ros::init(argc, argv, "msf_pose_pressure_sensor");
 
   msf_pose_pressure_sensor::PosePressureSensorManager manager;
+  // Warm restart from the last snapshot, if the core has a snapshot file.
+  manager.RestoreFromSnapshot();
 
   ros::spin();
 
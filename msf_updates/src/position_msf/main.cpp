@@ -18,12 +18,28 @@
  */
 #include "position_sensormanager.h"
 
+namespace {
+template<typename EKFState_T>
+void Spin() {
+  msf_position_sensor::PositionSensorManager<EKFState_T> manager;
+  // Warm restart from the last snapshot, if the core has a snapshot file.
+  manager.RestoreFromSnapshot();
+
+  ros::spin();
+}
+}  // namespace
+
 int main(int argc, char** argv) {
   ros::init(argc, argv, "msf_position_sensor");
 
-  msf_position_sensor::PositionSensorManager manager;
-
-  ros::spin();
+  // Run the filter in float instead of double if requested.
+  bool single_precision = false;
+  ros::NodeHandle("~core").param("single_precision", single_precision, false);
+  if (single_precision) {
+    Spin<msf_updates::EKFStateFloat>();
+  } else {
+    Spin<msf_updates::EKFState>();
+  }
 
   return 0;
 }
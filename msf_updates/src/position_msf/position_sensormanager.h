@@ -35,28 +35,37 @@ typedef msf_updates::SinglePositionSensorConfig Config_T;
 typedef dynamic_reconfigure::Server<Config_T> ReconfigureServer;
 typedef shared_ptr<ReconfigureServer> ReconfigureServerPtr;
 
+/**
+ * \brief The position filter, STATE_TYPE selects the scalar the filter runs
+ * in: msf_updates::EKFState or msf_updates::EKFStateFloat.
+ */
+template<typename STATE_TYPE = msf_updates::EKFState>
 class PositionSensorManager : public msf_core::MSF_SensorManagerROS<
-    msf_updates::EKFState> {
-  typedef PositionSensorHandler<
-      msf_updates::position_measurement::PositionMeasurement,
-      PositionSensorManager> PositionSensorHandler_T;
-  friend class PositionSensorHandler<
-      msf_updates::position_measurement::PositionMeasurement,
+    STATE_TYPE> {
+ public:
+  typedef STATE_TYPE EKFState_T;
+  typedef typename EKFState_T::StateSequence_T StateSequence_T;
+  typedef typename EKFState_T::StateDefinition_T StateDefinition_T;
+  typedef typename EKFState_T::Scalar_T Scalar_T;
+
+ private:
+  typedef msf_updates::position_measurement::PositionMeasurement<EKFState_T>
+      PositionMeasurement_T;
+  typedef PositionSensorHandler<PositionMeasurement_T, PositionSensorManager>
+      PositionSensorHandler_T;
+  friend class PositionSensorHandler<PositionMeasurement_T,
       PositionSensorManager> ;
  public:
-  typedef msf_updates::EKFState EKFState_T;
-  typedef EKFState_T::StateSequence_T StateSequence_T;
-  typedef EKFState_T::StateDefinition_T StateDefinition_T;
 
   PositionSensorManager(
       ros::NodeHandle pnh = ros::NodeHandle("~/position_sensor")) {
     imu_handler_.reset(
-        new msf_core::IMUHandler_ROS<msf_updates::EKFState>(*this, "msf_core",
-                                                            "imu_handler"));
+        new msf_core::IMUHandler_ROS<EKFState_T>(*this, "msf_core",
+                                                 "imu_handler"));
 
     position_handler_.reset(
         new PositionSensorHandler_T(*this, "", "position_sensor"));
-    AddHandler(position_handler_);
+    this->AddHandler(position_handler_);
 
     reconf_server_.reset(new ReconfigureServer(pnh));
     ReconfigureServer::CallbackType f = boost::bind(
@@ -71,7 +80,7 @@ class PositionSensorManager : public msf_core::MSF_SensorManagerROS<
   }
 
  private:
-  shared_ptr<msf_core::IMUHandler_ROS<msf_updates::EKFState> > imu_handler_;
+  shared_ptr<msf_core::IMUHandler_ROS<EKFState_T> > imu_handler_;
   shared_ptr<PositionSensorHandler_T> position_handler_;
 
   Config_T config_;
@@ -99,7 +108,7 @@ class PositionSensorManager : public msf_core::MSF_SensorManagerROS<
 
     Eigen::Matrix<double, 3, 1> p, v, b_w, b_a, g, w_m, a_m, p_ip, p_vc;
     Eigen::Quaternion<double> q;
-    msf_core::MSF_Core<EKFState_T>::ErrorStateCov P;
+    typename msf_core::MSF_Core<EKFState_T>::ErrorStateCov P;
 
     // Init values.
     g << 0, 0, 9.81;  /// Gravity.
@@ -144,20 +153,26 @@ class PositionSensorManager : public msf_core::MSF_SensorManagerROS<
     shared_ptr < msf_core::MSF_InitMeasurement<EKFState_T>
         > meas(new msf_core::MSF_InitMeasurement<EKFState_T>(true));
 
-    meas->SetStateInitValue < StateDefinition_T::p > (p);
-    meas->SetStateInitValue < StateDefinition_T::v > (v);
-    meas->SetStateInitValue < StateDefinition_T::q > (q);
-    meas->SetStateInitValue < StateDefinition_T::b_w > (b_w);
-    meas->SetStateInitValue < StateDefinition_T::b_a > (b_a);
-    meas->SetStateInitValue < StateDefinition_T::p_ip > (p_ip);
+    meas->template SetStateInitValue<StateDefinition_T::p>(
+        p.cast<Scalar_T>());
+    meas->template SetStateInitValue<StateDefinition_T::v>(
+        v.cast<Scalar_T>());
+    meas->template SetStateInitValue<StateDefinition_T::q>(
+        q.cast<Scalar_T>());
+    meas->template SetStateInitValue<StateDefinition_T::b_w>(
+        b_w.cast<Scalar_T>());
+    meas->template SetStateInitValue<StateDefinition_T::b_a>(
+        b_a.cast<Scalar_T>());
+    meas->template SetStateInitValue<StateDefinition_T::p_ip>(
+        p_ip.cast<Scalar_T>());
 
     SetStateCovariance(meas->GetStateCovariance());  // Call my set P function.
-    meas->Getw_m() = w_m;
-    meas->Geta_m() = a_m;
-    meas->time = ros::Time::now().toSec();
+    meas->Getw_m() = w_m.cast<Scalar_T>();
+    meas->Geta_m() = a_m.cast<Scalar_T>();
+    meas->time = ros::Time::now().toNSec();
 
     // Call initialization in core.
-    msf_core_->Init(meas);
+    this->msf_core_->Init(meas);
   }
 
   // Prior to this call, all states are initialized to zero/identity.
@@ -174,12 +189,13 @@ class PositionSensorManager : public msf_core::MSF_SensorManagerROS<
 
     // Compute the blockwise Q values and store them with the states,
     //these then get copied by the core to the correct places in Qd.
-    state.GetQBlock<StateDefinition_T::p_ip>() =
-        (dt * npipv.cwiseProduct(npipv)).asDiagonal();
+    state.template GetQBlock<StateDefinition_T::p_ip>() =
+        (dt * npipv.cwiseProduct(npipv)).template cast<Scalar_T>()
+            .asDiagonal();
   }
 
   virtual void SetStateCovariance(
-      Eigen::Matrix<double, EKFState_T::nErrorStatesAtCompileTime,
+      Eigen::Matrix<Scalar_T, EKFState_T::nErrorStatesAtCompileTime,
           EKFState_T::nErrorStatesAtCompileTime>& P) const {
     UNUSED(P);
     // Nothing, we only use the simulated cov for the core plus diagonal for the
@@ -187,14 +203,14 @@ class PositionSensorManager : public msf_core::MSF_SensorManagerROS<
   }
 
   virtual void AugmentCorrectionVector(
-      Eigen::Matrix<double, EKFState_T::nErrorStatesAtCompileTime, 1>& correction) const {
+      Eigen::Matrix<Scalar_T, EKFState_T::nErrorStatesAtCompileTime, 1>& correction) const {
     UNUSED(correction);
   }
 
   virtual void SanityCheckCorrection(
       EKFState_T& delaystate,
       const EKFState_T& buffstate,
-      Eigen::Matrix<double, EKFState_T::nErrorStatesAtCompileTime, 1>& correction) const {
+      Eigen::Matrix<Scalar_T, EKFState_T::nErrorStatesAtCompileTime, 1>& correction) const {
     UNUSED(delaystate);
     UNUSED(buffstate);
     UNUSED(correction);
@@ -43,9 +43,9 @@ class PositionPoseSensorManager : public msf_core::MSF_SensorManagerROS<
   friend class msf_pose_sensor::PoseSensorHandler<
       msf_updates::pose_measurement::PoseMeasurement<>, this_T>;
   typedef msf_position_sensor::PositionSensorHandler<
-      msf_updates::position_measurement::PositionMeasurement, this_T> PositionSensorHandler_T;
+      msf_updates::position_measurement::PositionMeasurement<>, this_T> PositionSensorHandler_T;
   friend class msf_position_sensor::PositionSensorHandler<
-      msf_updates::position_measurement::PositionMeasurement, this_T>;
+      msf_updates::position_measurement::PositionMeasurement<>, this_T>;
  public:
   typedef msf_updates::EKFState EKFState_T;
   typedef EKFState_T::StateSequence_T StateSequence_T;
@@ -230,7 +230,7 @@ class PositionPoseSensorManager : public msf_core::MSF_SensorManagerROS<
     SetStateCovariance(meas->GetStateCovariance());  // Call my set P function.
     meas->Getw_m() = w_m;
     meas->Geta_m() = a_m;
-    meas->time = ros::Time::now().toSec();
+    meas->time = ros::Time::now().toNSec();
 
     // Call initialization in core.
     msf_core_->Init(meas);
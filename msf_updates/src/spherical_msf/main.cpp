@@ -19,6 +19,8 @@ int main(int argc, char** argv) {
   ros::init(argc, argv, "msf_spherical_position_sensor");
 
   msf_spherical_position::SensorManager manager;
+  // Warm restart from the last snapshot, if the core has a snapshot file.
+  manager.RestoreFromSnapshot();
 
   ros::spin();
 
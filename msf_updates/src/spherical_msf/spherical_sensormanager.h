@@ -156,7 +156,7 @@ class SensorManager : public msf_core::MSF_SensorManagerROS<
     SetStateCovariance(meas->GetStateCovariance());  // Call my set P function.
     meas->Getw_m() = w_m;
     meas->Geta_m() = a_m;
-    meas->time = ros::Time::now().toSec();
+    meas->time = ros::Time::now().toNSec();
 
     // Call initialization in core.
     msf_core_->Init(meas);
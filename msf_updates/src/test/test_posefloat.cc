@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2012-2013 Simon Lynen, ASL, ETH Zurich, Switzerland
+ * You can contact the author at <slynen at ethz dot ch>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <msf_core/testing_core.h>
+#include <msf_core/testing_entrypoint.h>
+#include "../pose_msf/msf_statedef.hpp"
+#include <msf_updates/pose_sensor_handler/pose_measurement.h>
+
+namespace {
+enum {
+  kReadings = 600
+};
+
+/**
+ * The pose filter in the scalar of EKFState_T on the IMU readings of the core
+ * tests, with a pose measurement every 20 readings.
+ */
+template<typename EKFState_T>
+class PoseFilter {
+  typedef typename EKFState_T::Scalar_T Scalar_T;
+  typedef msf_updates::pose_measurement::PoseMeasurement<msf_updates::L,
+      msf_updates::q_ic, msf_updates::p_ic, msf_updates::q_wv,
+      msf_updates::p_wv, EKFState_T> PoseMeasurement_T;
+ public:
+  msf_core::test::TestSensorManager<EKFState_T> manager;
+  msf_core::test::TestIMUHandler<EKFState_T> imu;
+
+  PoseFilter()
+      : imu(manager) {
+  }
+
+  void Run() {
+    shared_ptr<msf_core::MSF_InitMeasurement<EKFState_T> > init(
+        new msf_core::MSF_InitMeasurement<EKFState_T>(true));
+    Eigen::Vector3d position, acceleration, angular_velocity;
+    msf_core::test::TestMotion(0, &position, &acceleration, &angular_velocity);
+    init->time = msf_core::SecondsToNanoseconds(
+        msf_core::test::kTestStartTime);
+    init->template SetStateInitValue<msf_updates::p>(
+        position.cast<Scalar_T>());
+    init->template SetStateInitValue<msf_updates::v>(
+        Eigen::Matrix<Scalar_T, 3, 1>(1, 0, 0.1));
+    init->template SetStateInitValue<msf_updates::L>(
+        Eigen::Matrix<Scalar_T, 1, 1>::Constant(1));
+    init->Geta_m() = acceleration.cast<Scalar_T>();
+    init->Getw_m() = angular_velocity.cast<Scalar_T>();
+    manager.msf_core_->Init(init);
+
+    for (int i = 1; i <= kReadings; ++i) {
+      const msf_core::ImuReading reading = msf_core::test::TestImuReading(i);
+      imu.ProcessIMU(reading.linear_acceleration, reading.angular_velocity,
+                     reading.time, i);
+      if (i > 40 && i % 20 == 0) {
+        AddPose(i * msf_core::test::kTestImuPeriod - 0.0523);
+      }
+    }
+  }
+
+ private:
+  /// Adds the pose of the scenario at t seconds, seen from the world frame.
+  void AddPose(double t) {
+    Eigen::Vector3d position, acceleration, angular_velocity;
+    msf_core::test::TestMotion(t, &position, &acceleration, &angular_velocity);
+    shared_ptr<geometry_msgs::PoseWithCovarianceStamped> msg(
+        new geometry_msgs::PoseWithCovarianceStamped);
+    msg->pose.pose.position.x = position.x();
+    msg->pose.pose.position.y = position.y();
+    msg->pose.pose.position.z = position.z();
+    msg->pose.pose.orientation.w = 1;
+    msg->pose.pose.orientation.x = 0;
+    msg->pose.pose.orientation.y = 0;
+    msg->pose.pose.orientation.z = 0;
+
+    PoseMeasurement_T* measurement = new PoseMeasurement_T(0.01, 0.05, true,
+                                                           true, true, 0, 0);
+    measurement->MakeFromSensorReading(
+        msg, msf_core::SecondsToNanoseconds(
+            msf_core::test::kTestStartTime + t));
+    manager.msf_core_->AddMeasurement(
+        shared_ptr<msf_core::MSF_MeasurementBase<EKFState_T> >(measurement));
+  }
+};
+}  // namespace
+
+// The pose measurement computes its update in the scalar of the state, the
+// filter in float stays close to the one in double.
+TEST(MSF_Updates, PoseFloatStateMatchesDouble) {
+  PoseFilter<msf_updates::EKFState> reference;
+  PoseFilter<msf_updates::EKFStateFloat> filter;
+  reference.Run();
+  filter.Run();
+
+  const std::vector<msf_core::test::TestPublication>& expected = reference
+      .manager.GetPublications();
+  const std::vector<msf_core::test::TestPublication>& published = filter
+      .manager.GetPublications();
+  msf_core::test::ExpectSamePublications(expected, published, 1e-5, 1e-3);
+}
+
+MSF_UNITTEST_ENTRYPOINT